@@ -46,14 +46,18 @@ fn buildFoundation(
     lib.setBuildMode(mode);
     lib.install();
     lib.linkLibC();
+    // NOTE (Matteo): Required by the Linux specific APIs (futex, pthread extensions, mmap flags)
+    lib.defineCMacro("_GNU_SOURCE", null);
     lib.addCSourceFiles(&[_][]const u8{
         dir ++ "colors.c",
         dir ++ "error.c",
+        dir ++ "hash_map.c",
         dir ++ "io.c",
         dir ++ "list.c",
         dir ++ "log.c",
         dir ++ "memory.c",
         dir ++ "paths.c",
+        dir ++ "slot_map.c",
         dir ++ "strings.c",
         dir ++ "task.c",
         dir ++ "threading.c",
@@ -37,6 +37,7 @@
 #include "foundation/strings.h"
 #include "foundation/task.h"
 
+#include "foundation/atom.inl"
 #include "foundation/math.inl"
 #include "foundation/mem_buffer.inl"
 
@@ -47,6 +48,15 @@
 static Cstr g_supported_ext[] = {".jpg", ".jpeg", ".bmp", ".png", ".gif"};
 static IoFileApi *g_file = NULL;
 
+// NOTE (Matteo): The scratch arena is reset every frame, so its pages are retained across frames
+// and returned to the OS only after a few seconds of lower usage
+static MemArenaCommitPolicy const g_scratch_policy = {
+    .min_commit = CF_KB(256),
+    .max_commit = CF_MB(16),
+    .idle_resets = 300,
+    .retain_threshold = CF_MB(64),
+};
+
 #define MAIN_WINDOW "Main"
 #define STYLE_WINDOW "Style Editor"
 #define FONTS_WINDOW "Font Options"
@@ -63,8 +73,13 @@ enum Constants
     /// Number of buffered textures to use for image display
     /// 1 texture = no buffering, 2 textures seems reasonable
     NumTextures = 2,
+    /// Version of the directory cache content (must be bumped on any change to DirCache)
+    DirCacheVersion = 1,
 };
 
+/// Size of the directory cache file (sparse where supported, so the actual disk usage is lower)
+#define DIR_CACHE_SIZE CF_MB(64)
+
 CF_STATIC_ASSERT(BrowseWidth & 1, "Browse width must be odd");
 CF_STATIC_ASSERT(BrowseWidth > 1, "Browse width must be > 1");
 
@@ -82,6 +97,7 @@ typedef struct ImageTex
 typedef struct ImageView
 {
     ImageTex tex[NumTextures];
+    U32 staging; /// Pixel buffer used to stage texture uploads
 
     Vec2f drag;
     float zoom;
@@ -107,8 +123,18 @@ typedef struct ImageFile
     Char8 filename[FILENAME_SIZE];
     Image image;
     I32 state;
+    TaskId task; /// Loading task, valid while queued
 } ImageFile;
 
+/// Image files of the last browsed folder, stored in the persistent directory cache
+typedef struct DirCache
+{
+    Char8 root_name[FILENAME_SIZE];
+    SystemTime last_write; /// Last write time of the folder when scanned
+    Size count;
+    MemRelPtr names; /// File names, packed and null terminated
+} DirCache;
+
 struct AppState
 {
     //=== Application memory storage ===//
@@ -118,6 +144,9 @@ struct AppState
     MemArena *main;     /// Arena for persistent storage (main data structures)
     MemArena *scratch;  /// Arena for temporary storage (one-off allocations)
 
+    /// Profiler of the heap allocations performed by image loading
+    MemProfiler *profiler;
+
     //=== Platform services ===//
 
     Platform *plat;
@@ -128,9 +157,14 @@ struct AppState
     /// Array of image file info backed by a large VM allocation (no waste since
     /// memory is committed only when required)
     MemBuffer(ImageFile) files;
+    MemVmBlock files_block;
     Size curr_file;
     Size browse_width;
 
+    /// Persistent cache of the last browsed folder, which avoids a rescan on the next launch
+    MemPersist dir_cache;
+    bool dir_cache_open;
+
     //=== Async file loading ===//
 
     TaskQueue *queue;
@@ -172,16 +206,57 @@ TASK_QUEUE_FN(loadFileTask)
 }
 
 static void
-loadFileEnqueue(TaskQueue *queue, ImageFile *file)
+loadFileEnqueue(TaskQueue *queue, ImageFile *file, TaskPriority priority)
 {
     if (file->state == ImageFileState_Idle)
     {
         file->state = ImageFileState_Queued;
-        if (!taskEnqueue(queue, loadFileTask, file))
+        file->task = taskEnqueuePriority(queue, loadFileTask, file, priority);
+
+        // NOTE (Matteo): Overflowing tasks are spilled, so this fails only if out of memory; the
+        // file is queued again on the next browsing step
+        if (!file->task) file->state = ImageFileState_Idle;
+    }
+    else if (file->state == ImageFileState_Queued)
+    {
+        // NOTE (Matteo): The file could have been queued for prefetching, so reschedule it
+        // (this fails harmlessly if loading has started in the meantime)
+        TaskId task = taskSetPriority(queue, file->task, priority);
+        if (task) file->task = task;
+    }
+}
+
+static void
+loadFilesPrefetch(TaskQueue *queue, ImageFile **files, Size count)
+{
+    TaskFn fns[BrowseWidth];
+    void *datas[BrowseWidth];
+    ImageFile *queued[BrowseWidth];
+    Size num_queued = 0;
+
+    CF_ASSERT(count <= BrowseWidth, "Too many files to prefetch");
+
+    for (Size i = 0; i < count; ++i)
+    {
+        if (files[i]->state == ImageFileState_Idle)
+        {
+            files[i]->state = ImageFileState_Queued;
+            fns[num_queued] = loadFileTask;
+            datas[num_queued] = files[i];
+            queued[num_queued++] = files[i];
+        }
+        else
         {
-            CF_INVALID_CODE_PATH();
+            loadFileEnqueue(queue, files[i], TaskPriority_Low);
         }
     }
+
+    // NOTE (Matteo): Idle files are queued in a single batch, preserving the prefetch order
+    TaskId ids[BrowseWidth];
+    Size enqueued = taskEnqueueBatchPriority(queue, fns, datas, num_queued, TaskPriority_Low, ids);
+
+    for (Size i = 0; i < enqueued; ++i) queued[i]->task = ids[i];
+    for (Size i = enqueued; i < num_queued; ++i) queued[i]->state = ImageFileState_Idle;
 }
 
 //-----------------------//
@@ -248,6 +323,8 @@ imageViewInit(ImageView *iv)
     {
         iv->tex[i] = imageTexCreate(4920, 3264);
     }
+
+    glGenBuffers(1, &iv->staging);
 }
 
 static void
@@ -258,6 +335,9 @@ imageViewShutdown(ImageView *iv)
         glDeleteTextures(1, &iv->tex[i].id);
         iv->tex[i].id = 0;
     }
+
+    glDeleteBuffers(1, &iv->staging);
+    iv->staging = 0;
 }
 
 static inline ImageTex *
@@ -290,8 +370,35 @@ imageViewUpdate(ImageView *iv, Image const *image)
         }
 
         glBindTexture(GL_TEXTURE_2D, tex->id);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->width, image->height, GL_RGBA,
-                        GL_UNSIGNED_BYTE, image->bytes);
+
+        // NOTE (Matteo): The pixels are staged in a pixel buffer using a streaming copy, so that
+        // uploading tens of megabytes does not evict the working set of the application from the
+        // cache (the driver copy from client memory would). Re-specifying the buffer storage
+        // orphans the previous one, which may still be in use by a pending upload.
+        Size size = (Size)image->width * (Size)image->height * sizeof(*image->pixels);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, iv->staging);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_DRAW);
+
+        void *staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+        if (staging)
+        {
+            memStreamCopy(image->bytes, staging, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            // NOTE (Matteo): With a bound unpack buffer, the pointer is an offset into the buffer
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->width, image->height, GL_RGBA,
+                            GL_UNSIGNED_BYTE, NULL);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (!staging)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->width, image->height, GL_RGBA,
+                            GL_UNSIGNED_BYTE, image->bytes);
+        }
     }
 }
 
@@ -319,7 +426,9 @@ appClearImages(AppState *app)
         }
     }
 
+    // NOTE (Matteo): Release the pages committed for a previous, larger folder
     memBufferClear(&app->files);
+    memBufferTrim(&app->files, memVmBlockAllocator(&app->files_block));
     app->curr_file = SIZE_MAX;
 }
 
@@ -340,23 +449,27 @@ appIsFileSupported(Str path)
 static void
 appQueueLoadFiles(AppState *app)
 {
-    // NOTE (Matteo): improve browsing performance by pre-loading previous and next files
+    // NOTE (Matteo): improve browsing performance by pre-loading previous and next files; the
+    // current file has higher priority, so that it is not delayed by stale prefetches
 
     Size curr = app->curr_file;
     TaskQueue *queue = app->queue;
 
-    loadFileEnqueue(queue, app->files.ptr + curr);
+    loadFileEnqueue(queue, app->files.ptr + curr, TaskPriority_High);
+
+    ImageFile *prefetch[BrowseWidth];
+    Size num_prefetch = 0;
 
     if (app->browse_width == app->files.len)
     {
         for (Size i = curr + 1; i < app->files.len; ++i)
         {
-            loadFileEnqueue(queue, app->files.ptr + i);
+            prefetch[num_prefetch++] = app->files.ptr + i;
         }
 
         for (Size i = 0; i < curr; ++i)
         {
-            loadFileEnqueue(queue, app->files.ptr + curr - i - 1);
+            prefetch[num_prefetch++] = app->files.ptr + curr - i - 1;
         }
     }
     else
@@ -372,11 +485,13 @@ appQueueLoadFiles(AppState *app)
             CF_ASSERT(next != curr, "");
             CF_ASSERT(next != prev, "");
             CF_ASSERT(prev != curr, "");
-            loadFileEnqueue(queue, app->files.ptr + next);
-            loadFileEnqueue(queue, app->files.ptr + prev);
+            prefetch[num_prefetch++] = app->files.ptr + next;
+            prefetch[num_prefetch++] = app->files.ptr + prev;
         }
     }
 
+    loadFilesPrefetch(queue, prefetch, num_prefetch);
+
     // NOTE (Matteo): Set view as dirty
     app->iv.dirty = true;
     app->iv.zoom = 1.0f;
@@ -387,7 +502,8 @@ static void
 appPushFile(AppState *app, Cstr root_name, Str filename)
 {
     ImageFile *file = NULL;
-    ErrorCode32 err = memBufferExtendAlloc(&app->files, 1, memArenaAllocator(app->main), &file);
+    ErrorCode32 err =
+        memBufferExtendAlloc(&app->files, 1, memVmBlockAllocator(&app->files_block), &file);
     CF_ASSERT(!err, "Push file should not fail");
 
     file->state = ImageFileState_Idle;
@@ -397,6 +513,100 @@ appPushFile(AppState *app, Cstr root_name, Str filename)
     CF_ASSERT(len > 0, "Path is too long!");
 }
 
+static bool
+appDirCacheLoad(AppState *app, Cstr root_name, SystemTime last_write)
+{
+    if (!app->dir_cache_open) return false;
+
+    MemPersist *persist = &app->dir_cache;
+    DirCache *cache = memPersistRoot(persist);
+
+    // NOTE (Matteo): The file content is not trusted, so the cache is discarded unless all of it
+    // lies within the allocated part of the arena
+    U8 const *begin = persist->arena.memory;
+    U8 const *end = begin + persist->arena.allocated;
+
+    if (!cache || (U8 const *)cache < begin || (Size)(end - (U8 const *)cache) < sizeof(*cache))
+    {
+        return false;
+    }
+
+    if (cache->last_write != last_write || !memMatch(cache->root_name, root_name, FILENAME_SIZE))
+    {
+        return false;
+    }
+
+    Char8 const *name = memRelPtrGet(&cache->names, Char8);
+
+    if (cache->count && (!name || (U8 const *)name < begin || (U8 const *)name >= end))
+    {
+        return false;
+    }
+
+    // NOTE (Matteo): All the names are validated before pushing any of them, so that a rejected
+    // cache leaves the file list untouched for the folder scan
+    Char8 const *cursor = name;
+
+    for (Size i = 0; i < cache->count; ++i)
+    {
+        while ((U8 const *)cursor < end && *cursor) ++cursor;
+        if ((U8 const *)cursor == end) return false;
+        ++cursor;
+    }
+
+    for (Size i = 0; i < cache->count; ++i)
+    {
+        Str filename = strFromCstr(name);
+        appPushFile(app, root_name, filename);
+        name += filename.len + 1;
+    }
+
+    return true;
+}
+
+static void
+appDirCacheStore(AppState *app, Cstr root_name, SystemTime last_write)
+{
+    if (!app->dir_cache_open) return;
+
+    MemPersist *persist = &app->dir_cache;
+    memPersistReset(persist);
+
+    Size root_len = strLength(root_name);
+    Size names_size = 0;
+
+    for (Size i = 0; i < app->files.len; ++i)
+    {
+        names_size += strLength(app->files.ptr[i].filename) - root_len + 1;
+    }
+
+    DirCache *cache = memArenaAllocStruct(&persist->arena, DirCache);
+    Char8 *names = memArenaAllocArray(&persist->arena, Char8, names_size);
+
+    // NOTE (Matteo): Folders too large for the cache are simply scanned every time
+    if (!cache || !names)
+    {
+        memPersistReset(persist);
+        return;
+    }
+
+    memCopy(root_name, cache->root_name, root_len);
+    cache->last_write = last_write;
+    cache->count = app->files.len;
+    memRelPtrSet(&cache->names, names);
+
+    for (Size i = 0; i < app->files.len; ++i)
+    {
+        Cstr filename = app->files.ptr[i].filename + root_len;
+        Size len = strLength(filename);
+        memCopy(filename, names, len + 1);
+        names += len + 1;
+    }
+
+    memPersistSetRoot(persist, cache);
+    memPersistSync(persist);
+}
+
 static void
 appLoadFromFile(AppState *state, Str full_name)
 {
@@ -417,7 +627,13 @@ appLoadFromFile(AppState *state, Str full_name)
 
         IoFileApi *io = state->plat->file;
         IoDirectory it = {0};
-        if (io->dirOpen(&it, strFromCstr(root_name)))
+
+        // NOTE (Matteo): The last write time of a folder changes when files are added, removed or
+        // renamed, so the cached list is valid as long as it matches
+        SystemTime last_write = io->propertiesP(strFromCstr(root_name)).last_write;
+
+        if (!appDirCacheLoad(state, root_name, last_write) &&
+            io->dirOpen(&it, strFromCstr(root_name)))
         {
             Str filename = {0};
             while (it.next(&it, &filename, NULL))
@@ -429,6 +645,8 @@ appLoadFromFile(AppState *state, Str full_name)
             }
 
             it.close(&it);
+
+            if (last_write) appDirCacheStore(state, root_name, last_write);
         }
 
         CF_DIAGNOSTIC_POP()
@@ -738,6 +956,25 @@ appMainWindow(AppState *state)
     guiEnd();
 }
 
+static void
+appProfilerStats(MemProfiler *profiler)
+{
+    MemProfilerEntry entries[8];
+    Size count = memProfilerSnapshot(profiler, MemProfilerSort_Live, entries,
+                                     CF_ARRAY_SIZE(entries));
+
+    guiText("Image heap: live %.3fkb - peak %.3fkb", (double)atomRead(&profiler->live) / 1024,
+            (double)atomRead(&profiler->peak) / 1024);
+
+    for (Size index = 0; index < count; ++index)
+    {
+        MemProfilerEntry const *entry = entries + index;
+        guiText("%p: %zu allocs, %zu reallocs, %zu frees - live %.3fkb, peak %.3fkb",
+                entry->callsite, entry->allocs, entry->reallocs, entry->frees,
+                (double)entry->live / 1024, (double)entry->peak / 1024);
+    }
+}
+
 //---------------------------------------//
 //     Application API implementation    //
 //---------------------------------------//
@@ -762,16 +999,43 @@ APP_CREATE_FN(appCreate)
     app->scratch = memArenaAllocStruct(main, MemArena);
     memArenaSplit(main, app->scratch, memArenaAvailable(main) / 2);
 
+    app->profiler = memArenaAllocStruct(main, MemProfiler);
+    memProfilerInit(app->profiler, plat->heap);
+
     // Init file list management
     app->filter.name = "Image files";
     app->filter.extensions = g_supported_ext;
     app->filter.num_extensions = CF_ARRAY_SIZE(g_supported_ext);
     app->curr_file = SIZE_MAX;
 
-    TaskQueueConfig cfg = {.buffer_size = 128, .num_workers = 1};
+    // NOTE (Matteo): Enough room for folders with millions of files; the file list grows in place
+    // so its items are never copied (nor moved under the loading tasks)
+    if (memBufferInitVm(&app->files, &app->files_block, plat->vmem, 1 << 20))
+    {
+        CF_INVALID_CODE_PATH();
+    }
+
+    // NOTE (Matteo): The directory cache is optional, so failures are ignored
+    Char8 cache_name[FILENAME_SIZE] = {0};
+    if (strPrint(cache_name, FILENAME_SIZE, "%.*sdir_cache.bin", (I32)plat->paths->data.len,
+                 plat->paths->data.ptr) > 0)
+    {
+        app->dir_cache_open = memPersistOpen(&app->dir_cache, plat->vmem, strFromCstr(cache_name),
+                                             DIR_CACHE_SIZE, DirCacheVersion,
+                                             MemPersistFlags_Verify) != MemPersistResult_Error;
+    }
+
+    // NOTE (Matteo): A small buffer covers the browsing window, larger bursts are spilled
+    TaskQueueConfig cfg = {
+        .buffer_size = 16,
+        .num_workers = 1,
+        .overflow = TaskOverflow_Spill,
+        .spill_alloc = plat->heap,
+    };
     if (taskConfig(&cfg))
     {
-        app->queue = taskInit(&cfg, memArenaAlloc(main, cfg.footprint));
+        void *queue_memory = memArenaAllocAlign(main, cfg.footprint, CF_CACHELINE_SIZE);
+        app->queue = taskInit(&cfg, queue_memory);
     }
     else
     {
@@ -798,7 +1062,8 @@ APP_FN(appDestroy)
     taskShutdown(app->queue);
     appClearImages(app);
     imageViewShutdown(&app->iv);
-    memBufferFree(&app->files, memArenaAllocator(app->main));
+    memBufferShutdownVm(&app->files, &app->files_block);
+    if (app->dir_cache_open) memPersistClose(&app->dir_cache);
     memArenaClear(app->scratch);
     memArenaClear(app->main);
 
@@ -814,10 +1079,13 @@ APP_FN(appLoad)
     guiSetContext(app->plat->gui);
     // Init image loading
     glApiSet(app->plat->gl);
-    imageInit(app->plat->heap);
+    imageInit(memProfilerAllocator(app->profiler));
 
     g_file = app->plat->file;
 
+    // NOTE (Matteo): The policy lives in the library, so it must be set again after a reload
+    memArenaSetCommitPolicy(app->scratch, &g_scratch_policy);
+
     taskStartProcessing(app->queue);
 }
 
@@ -825,6 +1093,7 @@ APP_API
 APP_FN(appUnload)
 {
     taskStopProcessing(app->queue, true);
+    memArenaSetCommitPolicy(app->scratch, NULL);
 }
 
 APP_API
@@ -880,6 +1149,12 @@ APP_UPDATE_FN(appUpdate)
                 plat->heap_blocks);
         guiText("Virtual memory reserved %.3fkb - committed %.3fkb",
                 (double)plat->reserved_size / 1024, (double)plat->committed_size / 1024);
+        MemArenaCommitStats const *scratch = &state->scratch->commit_stats;
+        guiText("Scratch commits %zu (%zu avoided) - decommits %zu (%zu avoided)",
+                scratch->commits, scratch->commits_avoided, scratch->decommits,
+                scratch->decommits_avoided);
+        guiSeparator();
+        appProfilerStats(state->profiler);
         guiSeparator();
         guiText("App base path:%.*s", (I32)state->plat->paths->base.len,
                 state->plat->paths->base.ptr);
@@ -106,6 +106,21 @@ ATOM__COMPARE_EXCHANGE(U16)
 ATOM__COMPARE_EXCHANGE(U32)
 ATOM__COMPARE_EXCHANGE(U64)
 
+static inline void *
+atomCompareExchangePtr(AtomPtr *object, void *expected, void *desired)
+{
+    void *got = expected;
+    __c11_atomic_compare_exchange_strong(object, &got, desired, __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED);
+    return got;
+}
+
+static inline void *
+atomExchangePtr(AtomPtr *object, void *desired)
+{
+    return __c11_atomic_exchange(object, desired, __ATOMIC_RELAXED);
+}
+
 // ATOM__CLANG_BUILTINS
 //----------------------------------------------------------------------------//
 #elif CF_OS_WIN32
@@ -595,3 +610,15 @@ atom__Write64(U64 volatile *object, U64 value)
 #else
 #    error "Atomics not yet supported on this platform"
 #endif
+
+//----------------------------------------------------------------------------//
+// Spin-wait hint
+
+#if CF_COMPILER_CLANG
+#    define atomSpinPause() __builtin_ia32_pause()
+#elif CF_COMPILER_MSVC
+#    include <intrin.h>
+#    define atomSpinPause() _mm_pause()
+#else
+#    error "Spin-wait hint not supported on this compiler"
+#endif
@@ -130,6 +130,14 @@
 #    define CF_MAX_ALIGN (alignof(max_align_t))
 #endif
 
+#if CF_COMPILER_MSVC
+#    define CF_THREAD_LOCAL __declspec(thread)
+#elif defined(__cplusplus)
+#    define CF_THREAD_LOCAL thread_local
+#else
+#    define CF_THREAD_LOCAL _Thread_local
+#endif
+
 //-------------------------//
 // Configuration defines   //
 //-------------------------//
@@ -449,7 +457,8 @@ typedef U64 SystemTime;
 typedef MEM_ALLOCATOR_FN((*MemAllocatorFn));
 
 /// Generic allocator interface
-/// The memory provided by this interface should already be cleared to 0
+/// The memory provided by this interface should already be cleared to 0.
+/// Blocks must be reallocated and freed with the same alignment used to allocate them.
 typedef struct MemAllocator
 {
     void *state;
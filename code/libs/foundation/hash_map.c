@@ -0,0 +1,554 @@
+#include "hash_map.h"
+#include "error.h"
+#include "memory.h"
+#include "strings.h"
+
+#include <string.h>
+
+#if CF_COMPILER_MSVC
+#    include <intrin.h>
+#endif
+
+#if CF_ARCH_X64 || CF_ARCH_X86
+#    include <emmintrin.h>
+#    define HASH_MAP_SSE2 1
+#else
+#    define HASH_MAP_SSE2 0
+#endif
+
+//--------------------//
+//   Hash functions   //
+//--------------------//
+
+#define HASH_K0 0x9E3779B97F4A7C15ull
+#define HASH_K1 0xBF58476D1CE4E5B9ull
+#define HASH_K2 0x94D049BB133111EBull
+
+static inline U64
+hash_Rotate(U64 value, U32 bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/// Final avalanche (splitmix64)
+static inline U64
+hash_Finalize(U64 h)
+{
+    h ^= h >> 30;
+    h *= HASH_K1;
+    h ^= h >> 27;
+    h *= HASH_K2;
+    h ^= h >> 31;
+    return h;
+}
+
+static inline U64
+hash_Step(U64 h, U64 word)
+{
+    word *= HASH_K1;
+    word ^= word >> 29;
+    return hash_Rotate(h ^ word, 23) * HASH_K0;
+}
+
+/// Convert the ASCII uppercase letters of the given word to lowercase
+static inline U64
+hash_FoldCase(U64 word)
+{
+    U64 const ones = 0x0101010101010101ull;
+    U64 const high = 0x8080808080808080ull;
+
+    // NOTE (Matteo): The high bit of each byte is cleared so that the additions do not carry
+    // across bytes; non-ASCII bytes are then excluded explicitly.
+    U64 low = word & ~high;
+    U64 ge_a = low + (0x80 - 'A') * ones;
+    U64 gt_z = low + (0x80 - 'Z' - 1) * ones;
+    U64 upper = ge_a & ~gt_z & ~word & high;
+
+    return word | (upper >> 2);
+}
+
+static inline U64
+hash_Bytes(U8 const *data, Size size, U64 seed, bool fold_case)
+{
+    U64 h = seed ^ (size * HASH_K0);
+    U64 word;
+
+    // NOTE (Matteo): memcpy with a constant or small size compiles to a single unaligned load,
+    // while memCopy is an out-of-line call
+    while (size >= 8)
+    {
+        memcpy(&word, data, 8); // NOLINT
+        if (fold_case) word = hash_FoldCase(word);
+        h = hash_Step(h, word);
+        data += 8;
+        size -= 8;
+    }
+
+    if (size)
+    {
+        word = 0;
+        memcpy(&word, data, size); // NOLINT
+        if (fold_case) word = hash_FoldCase(word);
+        h = hash_Step(h, word);
+    }
+
+    return hash_Finalize(h);
+}
+
+U64
+cfHashBytes(void const *data, Size size, U64 seed)
+{
+    return hash_Bytes(data, size, seed, false);
+}
+
+CF_HASH_FN(cfHashKeyBytes)
+{
+    return hash_Bytes(key, key_size, 0, false);
+}
+
+CF_HASH_EQUAL_FN(cfHashKeyBytesEqual)
+{
+    return memMatch(left, right, key_size);
+}
+
+CF_HASH_FN(cfHashKeyStr)
+{
+    CF_ASSERT(key_size == sizeof(Str), "Key is not a string");
+    Str const *str = key;
+    return hash_Bytes((U8 const *)str->ptr, str->len, 0, false);
+}
+
+CF_HASH_EQUAL_FN(cfHashKeyStrEqual)
+{
+    CF_ASSERT(key_size == sizeof(Str), "Key is not a string");
+    Str const *l = left;
+    Str const *r = right;
+    return l->len == r->len && memMatch(l->ptr, r->ptr, l->len);
+}
+
+CF_HASH_FN(cfHashKeyStrInsensitive)
+{
+    CF_ASSERT(key_size == sizeof(Str), "Key is not a string");
+    Str const *str = key;
+    return hash_Bytes((U8 const *)str->ptr, str->len, 0, true);
+}
+
+CF_HASH_EQUAL_FN(cfHashKeyStrEqualInsensitive)
+{
+    CF_ASSERT(key_size == sizeof(Str), "Key is not a string");
+    return strEqualInsensitive(*(Str const *)left, *(Str const *)right);
+}
+
+//-------------------------//
+//   Control byte groups   //
+//-------------------------//
+
+enum
+{
+    HashCtrl_Empty = 0x80,
+};
+
+/// Bit masks of the group bytes matching the given hash tag, and of the empty bytes
+typedef struct HashGroup
+{
+    U32 match;
+    U32 empty;
+} HashGroup;
+
+static inline HashGroup
+hash_GroupLoad(U8 const *ctrl, U8 tag)
+{
+    HashGroup group;
+#if HASH_MAP_SSE2
+    __m128i bytes = _mm_loadu_si128((__m128i const *)ctrl);
+    group.match = (U32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)tag)));
+    // NOTE (Matteo): Only empty bytes have the high bit set
+    group.empty = (U32)_mm_movemask_epi8(bytes);
+#else
+    group.match = group.empty = 0;
+    for (U32 i = 0; i < CfHashMap_GroupSize; ++i)
+    {
+        group.match |= (U32)(ctrl[i] == tag) << i;
+        group.empty |= (U32)(ctrl[i] == HashCtrl_Empty) << i;
+    }
+#endif
+    return group;
+}
+
+static inline U32
+hash_BitLsb(U32 mask)
+{
+    CF_ASSERT(mask, "Bit scan of 0 is undefined");
+#if CF_COMPILER_MSVC
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (U32)index;
+#else
+    return (U32)__builtin_ctz(mask);
+#endif
+}
+
+//--------------//
+//   Hash map   //
+//--------------//
+
+// NOTE (Matteo): The maximum load factor is 7/8; this would be too much for plain linear probing,
+// but since the probe sequence is scanned a group at a time, and keys are compared only on a tag
+// match (1/128 chance for a false positive), the expected number of group loads stays low.
+
+static inline Size
+hashMap_MaxLoad(Size capacity)
+{
+    return capacity - capacity / 8;
+}
+
+// NOTE (Matteo): The default bitwise callbacks are special-cased, so that the common integer and
+// pointer keys do not pay for indirect calls.
+
+static inline U64
+hashMap_Hash(CfHashMap const *map, void const *key)
+{
+    if (map->hash == cfHashKeyBytes)
+    {
+        switch (map->key_size)
+        {
+            case 4: return hash_Bytes(key, 4, 0, false);
+            case 8: return hash_Bytes(key, 8, 0, false);
+            default: return hash_Bytes(key, map->key_size, 0, false);
+        }
+    }
+
+    // NOTE (Matteo): Mix the user hash, so that weak functions (e.g. identity on integers) still
+    // spread over both the probe index (low bits) and the tag (high bits)
+    U64 h = map->hash(key, map->key_size) * HASH_K0;
+    return h ^ (h >> 32);
+}
+
+static inline bool
+hashMap_Equal(CfHashMap const *map, void const *key, void const *slot)
+{
+    if (map->equal == cfHashKeyBytesEqual)
+    {
+        // NOTE (Matteo): Keys have no alignment requirement, so small ones are loaded with a
+        // constant size memcpy, which compiles to a single unaligned load
+        switch (map->key_size)
+        {
+            case 4:
+            {
+                U32 l, r;
+                memcpy(&l, key, sizeof(l));  // NOLINT
+                memcpy(&r, slot, sizeof(r)); // NOLINT
+                return l == r;
+            }
+
+            case 8:
+            {
+                U64 l, r;
+                memcpy(&l, key, sizeof(l));  // NOLINT
+                memcpy(&r, slot, sizeof(r)); // NOLINT
+                return l == r;
+            }
+
+            default: return memMatch(key, slot, map->key_size);
+        }
+    }
+
+    return map->equal(key, slot, map->key_size);
+}
+
+static inline U8
+hashMap_Tag(U64 hash)
+{
+    return (U8)(hash >> 57);
+}
+
+static inline U8 *
+hashMap_Slot(CfHashMap const *map, Size index)
+{
+    return map->slots + index * map->slot_size;
+}
+
+static inline void
+hashMap_SetCtrl(CfHashMap *map, Size index, U8 value)
+{
+    map->ctrl[index] = value;
+    // Keep the copy of the first group in sync
+    if (index < CfHashMap_GroupSize) map->ctrl[map->capacity + index] = value;
+}
+
+static inline Size
+hashMap_StorageSize(CfHashMap const *map, Size capacity)
+{
+    return capacity * map->slot_size + capacity + CfHashMap_GroupSize;
+}
+
+static inline Size
+hashMap_StorageAlign(CfHashMap const *map)
+{
+    return cfMax(map->slot_align, (Size)CfHashMap_GroupSize);
+}
+
+/// Find the slot containing the key; if not present, return false and the first empty slot
+/// of the probe sequence as the insertion point
+static bool
+hashMap_Locate(CfHashMap const *map, void const *key, U64 hash, Size *out_index)
+{
+    Size const mask = map->capacity - 1;
+    U8 const tag = hashMap_Tag(hash);
+    Size pos = (Size)hash & mask;
+
+    for (;;)
+    {
+        HashGroup group = hash_GroupLoad(map->ctrl + pos, tag);
+
+        // NOTE (Matteo): Entries are never placed past an empty slot of their probe sequence,
+        // so matches after the first empty byte can be ignored
+        U32 match = group.match;
+        if (group.empty) match &= (group.empty & (0u - group.empty)) - 1;
+
+        while (match)
+        {
+            Size index = (pos + hash_BitLsb(match)) & mask;
+            if (hashMap_Equal(map, key, hashMap_Slot(map, index)))
+            {
+                *out_index = index;
+                return true;
+            }
+            match &= match - 1;
+        }
+
+        if (group.empty)
+        {
+            *out_index = (pos + hash_BitLsb(group.empty)) & mask;
+            return false;
+        }
+
+        pos = (pos + CfHashMap_GroupSize) & mask;
+    }
+}
+
+/// Find the first empty slot of the probe sequence (the key is known not to be present)
+static Size
+hashMap_FindEmpty(CfHashMap const *map, U64 hash)
+{
+    Size const mask = map->capacity - 1;
+    Size pos = (Size)hash & mask;
+
+    for (;;)
+    {
+        HashGroup group = hash_GroupLoad(map->ctrl + pos, HashCtrl_Empty);
+        if (group.empty) return (pos + hash_BitLsb(group.empty)) & mask;
+        pos = (pos + CfHashMap_GroupSize) & mask;
+    }
+}
+
+static ErrorCode32
+hashMap_Rehash(CfHashMap *map, Size capacity)
+{
+    CF_ASSERT(cfIsPowerOf2(capacity) && capacity >= CfHashMap_MinCapacity,
+              "Invalid hash map capacity");
+    CF_ASSERT(hashMap_MaxLoad(capacity) >= map->count, "Hash map capacity too small");
+
+    Size const align = hashMap_StorageAlign(map);
+    U8 *storage = memAllocAlign(map->alloc, hashMap_StorageSize(map, capacity), align);
+    if (!storage) return Error_OutOfMemory;
+
+    CfHashMap old = *map;
+
+    map->slots = storage;
+    map->ctrl = storage + capacity * map->slot_size;
+    map->capacity = capacity;
+    memWrite(map->ctrl, HashCtrl_Empty, capacity + CfHashMap_GroupSize);
+
+    if (old.slots)
+    {
+        for (Size index = 0; index < old.capacity; ++index)
+        {
+            if (old.ctrl[index] == HashCtrl_Empty) continue;
+
+            U8 const *slot = hashMap_Slot(&old, index);
+            U64 hash = hashMap_Hash(map, slot);
+            Size target = hashMap_FindEmpty(map, hash);
+
+            hashMap_SetCtrl(map, target, old.ctrl[index]);
+            memCopy(slot, hashMap_Slot(map, target), map->slot_size);
+        }
+
+        memFreeAlign(map->alloc, old.slots, hashMap_StorageSize(&old, old.capacity), align);
+    }
+
+    return Error_None;
+}
+
+/// Smallest valid capacity able to store the given number of entries
+static Size
+hashMap_CapacityFor(Size count)
+{
+    Size capacity = CfHashMap_MinCapacity;
+    while (hashMap_MaxLoad(capacity) < count) capacity <<= 1;
+    return capacity;
+}
+
+void
+cfHashMapInitEx(CfHashMap *map, MemAllocator alloc, Size key_size, Size key_align,
+                Size value_size, Size value_align, CfHashFn hash, CfHashEqualFn equal)
+{
+    CF_ASSERT(key_size, "Invalid key size");
+    CF_ASSERT(cfIsPowerOf2(key_align) && cfIsPowerOf2(value_align), "Invalid alignment");
+
+    Size slot_align = cfMax(key_align, value_align);
+    Size value_offset = (key_size + value_align - 1) & ~(value_align - 1);
+    Size slot_size = (value_offset + value_size + slot_align - 1) & ~(slot_align - 1);
+
+    CF_ASSERT(slot_size <= U32_MAX, "Hash map entry too large");
+
+    memClearStruct(map);
+    map->alloc = alloc;
+    map->hash = hash ? hash : cfHashKeyBytes;
+    map->equal = equal ? equal : cfHashKeyBytesEqual;
+    map->key_size = (U32)key_size;
+    map->value_offset = (U32)value_offset;
+    map->value_size = (U32)value_size;
+    map->slot_size = (U32)slot_size;
+    map->slot_align = (U32)slot_align;
+}
+
+void
+cfHashMapShutdown(CfHashMap *map)
+{
+    if (map->slots)
+    {
+        memFreeAlign(map->alloc, map->slots, hashMap_StorageSize(map, map->capacity),
+                     hashMap_StorageAlign(map));
+    }
+
+    map->slots = map->ctrl = NULL;
+    map->capacity = map->count = 0;
+}
+
+void
+cfHashMapClear(CfHashMap *map)
+{
+    if (map->ctrl) memWrite(map->ctrl, HashCtrl_Empty, map->capacity + CfHashMap_GroupSize);
+    map->count = 0;
+}
+
+ErrorCode32
+cfHashMapReserve(CfHashMap *map, Size count)
+{
+    Size capacity = hashMap_CapacityFor(count);
+    if (capacity <= map->capacity) return Error_None;
+    return hashMap_Rehash(map, capacity);
+}
+
+void *
+cfHashMapFind(CfHashMap *map, void const *key)
+{
+    Size index;
+
+    if (!map->count || !hashMap_Locate(map, key, hashMap_Hash(map, key), &index)) return NULL;
+
+    return hashMap_Slot(map, index) + map->value_offset;
+}
+
+void *
+cfHashMapInsert(CfHashMap *map, void const *key, bool *out_inserted)
+{
+    U64 hash = hashMap_Hash(map, key);
+    Size index;
+    bool inserted = false;
+
+    if (!map->slots)
+    {
+        if (hashMap_Rehash(map, CfHashMap_MinCapacity)) return NULL;
+        index = hashMap_FindEmpty(map, hash);
+        inserted = true;
+    }
+    else if (!hashMap_Locate(map, key, hash, &index))
+    {
+        if (map->count == hashMap_MaxLoad(map->capacity))
+        {
+            if (hashMap_Rehash(map, map->capacity * 2)) return NULL;
+            index = hashMap_FindEmpty(map, hash);
+        }
+        inserted = true;
+    }
+
+    U8 *slot = hashMap_Slot(map, index);
+
+    if (inserted)
+    {
+        hashMap_SetCtrl(map, index, hashMap_Tag(hash));
+        memCopy(key, slot, map->key_size);
+        map->count++;
+    }
+
+    if (out_inserted) *out_inserted = inserted;
+
+    return slot + map->value_offset;
+}
+
+ErrorCode32
+cfHashMapPut(CfHashMap *map, void const *key, void const *value)
+{
+    U8 *dest = cfHashMapInsert(map, key, NULL);
+    if (!dest) return Error_OutOfMemory;
+    memCopy(value, dest, map->value_size);
+    return Error_None;
+}
+
+bool
+cfHashMapRemove(CfHashMap *map, void const *key, void *out_value)
+{
+    Size hole;
+
+    if (!map->count || !hashMap_Locate(map, key, hashMap_Hash(map, key), &hole)) return false;
+
+    if (out_value)
+    {
+        memCopy(hashMap_Slot(map, hole) + map->value_offset, out_value, map->value_size);
+    }
+
+    // NOTE (Matteo): Backward shift deletion: the following entries of the run are moved back
+    // into the hole, unless this would place them before their home slot (the start of their
+    // probe sequence). The run ends at the first empty slot, which becomes the new hole.
+    Size const mask = map->capacity - 1;
+
+    for (Size index = (hole + 1) & mask; map->ctrl[index] != HashCtrl_Empty;
+         index = (index + 1) & mask)
+    {
+        U8 *slot = hashMap_Slot(map, index);
+        Size home = (Size)hashMap_Hash(map, slot) & mask;
+
+        if (((index - home) & mask) >= ((index - hole) & mask))
+        {
+            hashMap_SetCtrl(map, hole, map->ctrl[index]);
+            memCopy(slot, hashMap_Slot(map, hole), map->slot_size);
+            hole = index;
+        }
+    }
+
+    hashMap_SetCtrl(map, hole, HashCtrl_Empty);
+    map->count--;
+
+    return true;
+}
+
+bool
+cfHashMapNext(CfHashMap const *map, Size *cursor, void **out_key, void **out_value)
+{
+    for (Size index = *cursor; index < map->capacity; ++index)
+    {
+        if (map->ctrl[index] != HashCtrl_Empty)
+        {
+            U8 *slot = hashMap_Slot(map, index);
+            if (out_key) *out_key = slot;
+            if (out_value) *out_value = slot + map->value_offset;
+            *cursor = index + 1;
+            return true;
+        }
+    }
+
+    *cursor = map->capacity;
+    return false;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+/// Foundation hash map
+/// This is an API header and as such the only included header must be "core.h"
+
+#include "core.h"
+
+//--------------------//
+//   Hash functions   //
+//--------------------//
+
+#define CF_HASH_FN(name) U64 name(void const *key, Size key_size)
+#define CF_HASH_EQUAL_FN(name) bool name(void const *left, void const *right, Size key_size)
+
+typedef CF_HASH_FN((*CfHashFn));
+typedef CF_HASH_EQUAL_FN((*CfHashEqualFn));
+
+/// Hash the given bytes (fast, non-cryptographic)
+CF_API U64 cfHashBytes(void const *data, Size size, U64 seed);
+
+/// Bitwise hash and comparison of the whole key (default for maps without custom callbacks)
+CF_API CF_HASH_FN(cfHashKeyBytes);
+CF_API CF_HASH_EQUAL_FN(cfHashKeyBytesEqual);
+
+/// Hash and comparison of the content of Str keys
+CF_API CF_HASH_FN(cfHashKeyStr);
+CF_API CF_HASH_EQUAL_FN(cfHashKeyStrEqual);
+
+/// Hash and comparison of the content of Str keys, ignoring ASCII case
+CF_API CF_HASH_FN(cfHashKeyStrInsensitive);
+CF_API CF_HASH_EQUAL_FN(cfHashKeyStrEqualInsensitive);
+
+//--------------//
+//   Hash map   //
+//--------------//
+
+// NOTE (Matteo): Open addressing, Swiss table style: each slot has a control byte which is either
+// empty or stores 7 bits of the key hash, and lookups compare a group of 16 control bytes at once
+// (SSE2 on x86) before touching the keys.
+// Collisions are resolved by linear probing, so that removal can shift the following entries
+// back instead of leaving tombstones: lookups never have to skip deleted slots, and the table
+// does not degrade under insert/remove churn.
+// Keys and values are stored inline and copied bitwise; pointers returned by the API are
+// invalidated by any insertion or removal.
+
+enum
+{
+    CfHashMap_GroupSize = 16,
+    CfHashMap_MinCapacity = CfHashMap_GroupSize,
+};
+
+typedef struct CfHashMap
+{
+    MemAllocator alloc;
+    CfHashFn hash;
+    CfHashEqualFn equal;
+
+    /// Control bytes, followed by a copy of the first group to allow unaligned group loads at the
+    /// end of the table
+    U8 *ctrl;
+    /// Slot storage (key followed by value)
+    U8 *slots;
+
+    Size capacity;
+    Size count;
+
+    U32 key_size;
+    U32 value_offset;
+    U32 value_size;
+    U32 slot_size;
+    U32 slot_align;
+} CfHashMap;
+
+/// Initialize an empty map; no memory is allocated until the first insertion (or reservation).
+/// Storage is obtained from the given allocator; an arena can be used as backing (through
+/// memArenaAllocator) for maps with a bounded lifetime, better if capacity is reserved upfront.
+/// If NULL, the hash and equality functions default to the bitwise ones.
+CF_API void cfHashMapInitEx(CfHashMap *map, MemAllocator alloc, Size key_size, Size key_align,
+                            Size value_size, Size value_align, CfHashFn hash, CfHashEqualFn equal);
+
+#define cfHashMapInit(map, alloc, KeyType, ValueType, hash, equal)                      \
+    cfHashMapInitEx(map, alloc, sizeof(KeyType), alignof(KeyType), sizeof(ValueType), \
+                    alignof(ValueType), hash, equal)
+
+/// Release the map storage
+CF_API void cfHashMapShutdown(CfHashMap *map);
+
+/// Remove all the entries, retaining the storage
+CF_API void cfHashMapClear(CfHashMap *map);
+
+/// Ensure the map can hold the given number of entries without reallocating
+CF_API ErrorCode32 cfHashMapReserve(CfHashMap *map, Size count);
+
+/// Retrieve the value associated with the given key, or NULL if not present
+CF_API void *cfHashMapFind(CfHashMap *map, void const *key);
+
+/// Retrieve the value associated with the given key, inserting a new entry if not present; the
+/// value of a new entry is left uninitialized.
+/// Returns NULL if the map storage cannot be grown.
+CF_API void *cfHashMapInsert(CfHashMap *map, void const *key, bool *out_inserted);
+
+/// Associate the given value to the given key, replacing the existing one if any
+CF_API ErrorCode32 cfHashMapPut(CfHashMap *map, void const *key, void const *value);
+
+/// Remove the entry with the given key, optionally copying out its value.
+/// Returns false if the key is not present.
+CF_API bool cfHashMapRemove(CfHashMap *map, void const *key, void *out_value);
+
+/// Iterate over the map entries, in unspecified order.
+/// The cursor must be initialized to 0; the map must not be modified during the iteration.
+CF_API bool cfHashMapNext(CfHashMap const *map, Size *cursor, void **out_key, void **out_value);
+
+#define cfHashMapFindT(map, key, ValueType) ((ValueType *)cfHashMapFind(map, key))
@@ -1,10 +1,6 @@
 /// Foundation dynamic buffer implementation
 /// This is not an API header, include it in implementation files only
 
-// TODO (Matteo):
-// * Range insertion/removal
-// * Trim unused memory
-
 #include "core.h"
 #include "error.h"
 #include "memory.h"
@@ -68,12 +64,34 @@
                                            --(buffer)->len - (Size)(at)),                        \
                               Error_None))
 
+/// Replace the given range of the buffer with the given items (which must not alias the buffer),
+/// shifting the following buffer elements as needed with a single move.
+/// Fails if the range is out of bounds or the resulting size exceeds capacity.
+#define memBufferReplaceRange(buffer, at, remove_count, items, count)                          \
+    (CF_SAME_TYPE(*(buffer)->ptr, *(items)),                                                   \
+     mem_BufferReplace((buffer)->ptr, &(buffer)->len, (buffer)->cap, memBufferItemSize(buffer), \
+                       (Size)(at), (Size)(remove_count), (items), (Size)(count)))
+
+/// Insert the given items at the given position in the buffer (which may be the end of the buffer),
+/// if the capacity allows for it
+#define memBufferInsertRange(buffer, at, items, count) \
+    memBufferReplaceRange(buffer, at, 0, items, count)
+
+/// Remove the given range from the buffer, preserving the order of the following elements
+#define memBufferRemoveRange(buffer, at, count)                                                 \
+    mem_BufferReplace((buffer)->ptr, &(buffer)->len, (buffer)->cap, memBufferItemSize(buffer), \
+                      (Size)(at), (Size)(count), NULL, 0)
+
+/// Append the items of the given slice at the end of the buffer, if the capacity allows for it
+#define memBufferAppend(buffer, slice) \
+    memBufferInsertRange(buffer, (buffer)->len, (slice).ptr, (slice).len)
+
 //=== Allocating API ===//
 
 /// Free the allocated buffer memory
-#define memBufferFree(buffer, allocator)                                                  \
-    ((void)memFreeArray(allocator, (buffer)->ptr, (buffer)->cap), /**/ (buffer)->cap = 0, \
-     (buffer)->len = 0)
+#define memBufferFree(buffer, allocator)                                                     \
+    ((void)memFreeArray(allocator, (buffer)->ptr, (buffer)->cap), /**/ (buffer)->ptr = NULL, \
+     (buffer)->cap = 0, (buffer)->len = 0)
 
 /// Ensure the buffer has the required capacity, allocating memory if needed
 #define memBufferEnsure(buffer, required_capacity, allocator)                            \
@@ -103,6 +121,45 @@
     (memBufferEnsure(buffer, (buffer)->len + 1, allocator) ? Error_OutOfMemory \
                                                            : memBufferInsert(buffer, at, item))
 
+#define memBufferReplaceRangeAlloc(buffer, at, remove_count, items, count, allocator)             \
+    (memBufferEnsure(buffer, mem_BufferReplaceLen((buffer)->len, remove_count, count), allocator) \
+         ? Error_OutOfMemory                                                                      \
+         : memBufferReplaceRange(buffer, at, remove_count, items, count))
+
+#define memBufferInsertRangeAlloc(buffer, at, items, count, allocator) \
+    (memBufferEnsure(buffer, (buffer)->len + (Size)(count), allocator) \
+         ? Error_OutOfMemory                                           \
+         : memBufferInsertRange(buffer, at, items, count))
+
+#define memBufferAppendAlloc(buffer, slice, allocator)               \
+    (memBufferEnsure(buffer, (buffer)->len + (slice).len, allocator) \
+         ? Error_OutOfMemory                                         \
+         : memBufferAppend(buffer, slice))
+
+/// Shrink the capacity of the buffer to its current size, releasing the unused memory
+#define memBufferTrim(buffer, allocator)                                                 \
+    mem_BufferTrim((void **)(&(buffer)->ptr), &(buffer)->cap, memBufferItemSize(buffer), \
+                   mem_BufferItemAlign(buffer), (buffer)->len, allocator)
+
+//=== Virtual memory backed API ===//
+
+// NOTE (Matteo): A buffer can be backed by a MemVmBlock, passing its allocator to the allocating
+// API: the storage is reserved once up front and committed as the buffer grows, so the items never
+// move (pointers to them stay valid) and growth never copies. Trimming the buffer decommits the
+// pages beyond its size.
+
+/// Reserve a virtual memory block able to store up to the given number of items and reset the
+/// buffer; the block allocator must then be used for all the allocating operations
+#define memBufferInitVm(buffer, block, vmem, max_items)                         \
+    ((buffer)->ptr = NULL, (buffer)->len = (buffer)->cap = 0,                   \
+     memVmBlockInit(block, vmem, (Size)(max_items) * memBufferItemSize(buffer)) \
+         ? Error_None                                                           \
+         : Error_OutOfMemory)
+
+/// Free the buffer memory and release the virtual memory block backing it
+#define memBufferShutdownVm(buffer, block) \
+    ((buffer)->ptr = NULL, (buffer)->len = (buffer)->cap = 0, memVmBlockShutdown(block))
+
 #if CF_COMPILER_CLANG
 #    define mem_BufferItemAlign(buffer) alignof(*(buffer)->ptr)
 #else
@@ -119,11 +176,20 @@ mem_BufferGrow(void **data, Size *cap, Size item_size, Size item_align, Size req
     if (required > *cap)
     {
         Size new_cap = (*cap) ? (*cap << 1) : 1;
-        CF_ASSERT(cfIsPowerOf2(new_cap), "Capacity not a power of 2");
         while (new_cap < required) new_cap <<= 1;
 
         void *new_data =
             memReallocAlign(allocator, *data, *cap * item_size, new_cap * item_size, item_align);
+
+        if (!new_data && new_cap > required)
+        {
+            // NOTE (Matteo): The geometric growth may exceed a bounded storage (e.g. a virtual
+            // memory block) which can still fit the required capacity
+            new_cap = required;
+            new_data = memReallocAlign(allocator, *data, *cap * item_size, new_cap * item_size,
+                                       item_align);
+        }
+
         if (!new_data) return Error_OutOfMemory;
 
         *data = new_data;
@@ -132,3 +198,59 @@ mem_BufferGrow(void **data, Size *cap, Size item_size, Size item_align, Size req
 
     return Error_None;
 }
+
+static inline ErrorCode32
+mem_BufferTrim(void **data, Size *cap, Size item_size, Size item_align, Size len,
+               MemAllocator allocator)
+{
+    CF_ASSERT_NOT_NULL(data);
+    CF_ASSERT_NOT_NULL(cap);
+    CF_ASSERT(len <= *cap, "Buffer size exceeds capacity");
+
+    if (len < *cap)
+    {
+        void *new_data =
+            memReallocAlign(allocator, *data, *cap * item_size, len * item_size, item_align);
+        if (len && !new_data) return Error_OutOfMemory;
+
+        *data = new_data;
+        *cap = len;
+    }
+
+    return Error_None;
+}
+
+static inline Size
+mem_BufferReplaceLen(Size len, Size remove_count, Size count)
+{
+    // NOTE (Matteo): Out of range removals are reported by the replacement itself
+    return len - cfMin(len, (Size)remove_count) + (Size)count;
+}
+
+static inline ErrorCode32
+mem_BufferReplace(void *data, Size *len, Size cap, Size item_size, Size at, Size remove_count,
+                  void const *items, Size count)
+{
+    CF_ASSERT_NOT_NULL(len);
+    CF_ASSERT(items || !count, "Inserting NULL items");
+
+    if (at > *len || remove_count > *len - at) return Error_OutOfRange;
+
+    Size new_len = *len - remove_count + count;
+    if (new_len > cap) return Error_BufferFull;
+
+    U8 *bytes = data;
+    Size tail = *len - at - remove_count;
+
+    if (tail && count != remove_count)
+    {
+        memCopy(bytes + (at + remove_count) * item_size, bytes + (at + count) * item_size,
+                tail * item_size);
+    }
+
+    if (count) memCopy(items, bytes + at * item_size, count * item_size);
+
+    *len = new_len;
+
+    return Error_None;
+}
@@ -1,523 +1,3798 @@
 #include "memory.h"
+#include "atom.inl"
 #include "core.h"
 #include "error.h"
+#include "log.h"
 #include "util.h"
 
+#include <immintrin.h>
 #include <string.h>
 
-//----------------------------//
-//   Basic memory utilities   //
-//----------------------------//
+#if CF_COMPILER_MSVC
+#    include <intrin.h>
+#else
+#    include <cpuid.h>
+#endif
 
-void
-memClear(void *mem, Size count)
-{
-    memset(mem, 0, count); // NOLINT
-}
+//------------------------//
+//   Bit manipulation     //
+//------------------------//
 
-void
-memCopy(void const *from, void *to, Size count)
+/// Index of the least significant bit set (value must be non-zero)
+static inline U32
+mem_BitLsb(Size value)
 {
-    memmove(to, from, count); // NOLINT
+    CF_ASSERT(value, "Bit scan of 0 is undefined");
+#if CF_COMPILER_MSVC
+    unsigned long index;
+#    if CF_ARCH_X64
+    _BitScanForward64(&index, value);
+#    else
+    _BitScanForward(&index, value);
+#    endif
+    return (U32)index;
+#else
+    return (U32)__builtin_ctzll(value);
+#endif
 }
 
-void
-memCopySafe(void const *from, Size from_size, void *to, Size to_size)
+/// Index of the most significant bit set (value must be non-zero)
+static inline U32
+mem_BitMsb(Size value)
 {
-    memmove_s(to, to_size, from, from_size);
+    CF_ASSERT(value, "Bit scan of 0 is undefined");
+#if CF_COMPILER_MSVC
+    unsigned long index;
+#    if CF_ARCH_X64
+    _BitScanReverse64(&index, value);
+#    else
+    _BitScanReverse(&index, value);
+#    endif
+    return (U32)index;
+#else
+    return (U32)(sizeof(unsigned long long) * 8 - 1) - (U32)__builtin_clzll(value);
+#endif
 }
 
-void
-memWrite(U8 *mem, U8 value, Size count)
-{
-    memset(mem, value, count); // NOLINT
-}
+//----------------------------//
+//   Basic memory utilities   //
+//----------------------------//
 
-I32
-memCompare(void const *left, void const *right, Size count)
-{
-    return memcmp(left, right, count);
-}
+// NOTE (Matteo): The basic utilities forward to SSE2 or AVX2 kernels, selected through cpuid on
+// first use. Sizes up to 16 bytes never reach the kernels: they are handled inline using a couple
+// of overlapping scalar loads/stores, which is cheaper than both the libc call and the setup of
+// the vector loops.
+
+#if CF_COMPILER_MSVC
+#    define MEM_TARGET_SSE2
+#    define MEM_TARGET_AVX2
+#else
+#    define MEM_TARGET_SSE2 __attribute__((target("sse2")))
+#    define MEM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
 
-bool
-memMatch(void const *left, void const *right, Size count)
+typedef struct MemKernels
 {
-    return !memcmp(left, right, count);
-}
+    void (*copy)(U8 *dst, U8 const *src, Size count);
+    void (*fill)(U8 *dst, U8 value, Size count);
+    I32 (*compare)(U8 const *left, U8 const *right, Size count);
+    bool (*match)(U8 const *left, U8 const *right, Size count);
+    void (*stream_copy)(U8 *dst, U8 const *src, Size count);
+    void (*stream_fill)(U8 *dst, U8 value, Size count);
+} MemKernels;
 
-U8 const *
-memAlignForward(U8 const *address, Size alignment)
-{
-    CF_ASSERT((alignment & (alignment - 1)) == 0, "Alignment is not a power of 2");
-    // Same as (address % alignment) but faster as alignment is a power of 2
-    Size modulo = (Size)address & (alignment - 1);
-    // Move pointer forward if needed
-    return modulo ? address + alignment - modulo : address;
-}
+static AtomPtr g_mem_kernels;
+static MemSimd g_mem_simd_detected = MemSimd_None;
 
-void *
-memAlloc(MemAllocator a, Size size)
+// NOTE (Matteo): Default streaming threshold, in the order of the L2 cache size of a core: larger
+// buffers are unlikely to be still cached by the time they are read back
+static Size g_mem_stream_threshold = CF_MB(1);
+
+//=== Scalar helpers ===//
+
+static inline U64
+mem_load64(U8 const *src)
 {
-    return memAllocAlign(a, size, CF_MAX_ALIGN);
+    U64 value;
+    memcpy(&value, src, sizeof(value)); // NOLINT
+    return value;
 }
 
-void *
-memAllocAlign(MemAllocator a, Size size, Size align)
+static inline U32
+mem_load32(U8 const *src)
 {
-    return a.func(a.state, NULL, 0, size, align);
+    U32 value;
+    memcpy(&value, src, sizeof(value)); // NOLINT
+    return value;
 }
 
-void *
-memRealloc(MemAllocator a, void *mem, Size old_size, Size new_size)
+static inline void
+mem_store64(U8 *dst, U64 value)
 {
-    return memReallocAlign(a, mem, old_size, new_size, CF_MAX_ALIGN);
+    memcpy(dst, &value, sizeof(value)); // NOLINT
 }
 
-void *
-memReallocAlign(MemAllocator a, void *mem, Size old_size, Size new_size, Size align)
+static inline void
+mem_store32(U8 *dst, U32 value)
 {
-    return a.func(a.state, mem, old_size, new_size, align);
+    memcpy(dst, &value, sizeof(value)); // NOLINT
 }
 
-void
-memFree(MemAllocator a, void *mem, Size size)
+/// Copy up to 16 bytes; all loads happen before the stores, so overlapping regions are supported
+static inline void
+mem_copySmall(U8 *dst, U8 const *src, Size count)
 {
+    CF_ASSERT(count <= 16, "Size too large");
 
-    memFreeAlign(a, mem, size, CF_MAX_ALIGN);
+    if (count >= 8)
+    {
+        U64 head = mem_load64(src);
+        U64 tail = mem_load64(src + count - 8);
+        mem_store64(dst, head);
+        mem_store64(dst + count - 8, tail);
+    }
+    else if (count >= 4)
+    {
+        U32 head = mem_load32(src);
+        U32 tail = mem_load32(src + count - 4);
+        mem_store32(dst, head);
+        mem_store32(dst + count - 4, tail);
+    }
+    else if (count)
+    {
+        U8 head = src[0];
+        U8 mid = src[count / 2];
+        U8 tail = src[count - 1];
+        dst[0] = head;
+        dst[count / 2] = mid;
+        dst[count - 1] = tail;
+    }
 }
 
-void
-memFreeAlign(MemAllocator a, void *mem, Size size, Size align)
+static inline void
+mem_fillSmall(U8 *dst, U8 value, Size count)
 {
+    CF_ASSERT(count <= 16, "Size too large");
 
-    a.func(a.state, mem, size, 0, align);
+    if (count >= 8)
+    {
+        U64 pattern = value * 0x0101010101010101ULL;
+        mem_store64(dst, pattern);
+        mem_store64(dst + count - 8, pattern);
+    }
+    else if (count >= 4)
+    {
+        U32 pattern = value * 0x01010101U;
+        mem_store32(dst, pattern);
+        mem_store32(dst + count - 4, pattern);
+    }
+    else if (count)
+    {
+        dst[0] = value;
+        dst[count / 2] = value;
+        dst[count - 1] = value;
+    }
 }
 
-//---------------------------//
-//   End-of-page allocator   //
-//---------------------------//
-
-static Size
-memRoundSize(Size req_size, Size page_size)
+/// Compare the first differing byte of two words known to be different
+static inline I32
+mem_compareWord(U64 left, U64 right)
 {
-    Size page_count = (req_size + page_size - 1) / page_size;
-    return page_count * page_size;
+    // NOTE (Matteo): On little endian machines the first byte in memory is the least significant
+    U32 shift = mem_BitLsb(left ^ right) & ~7U;
+    return (I32)((left >> shift) & 0xFF) - (I32)((right >> shift) & 0xFF);
 }
 
-static MEM_ALLOCATOR_FN(memEndOfPageAlloc)
+static inline I32
+mem_compareSmall(U8 const *left, U8 const *right, Size count)
 {
-    VMemApi *vmem = state;
+    CF_ASSERT(count <= 16, "Size too large");
 
-    // NOTE (Matteo): This function cannot guarantee the required alignment
-    // because of the stricter requirement to align the block at the end of
-    // a page; as such, UBSan can complain about misaligned accessess and
-    // SIMD data structures can pose a problem if not allocated in power-of-2 sizes.
+    if (count >= 8)
+    {
+        // NOTE (Matteo): The tail words overlap the head ones; since the head words match, the
+        // first difference found in the tail is the first difference overall
+        U64 l = mem_load64(left);
+        U64 r = mem_load64(right);
+        if (l != r) return mem_compareWord(l, r);
+
+        l = mem_load64(left + count - 8);
+        r = mem_load64(right + count - 8);
+        return l != r ? mem_compareWord(l, r) : 0;
+    }
 
-    CF_ASSERT((align & (align - 1)) == 0, "Alignment is not a power of 2");
+    if (count >= 4)
+    {
+        U32 l = mem_load32(left);
+        U32 r = mem_load32(right);
+        if (l != r) return mem_compareWord(l, r);
 
-    void *new_mem = NULL;
+        l = mem_load32(left + count - 4);
+        r = mem_load32(right + count - 4);
+        return l != r ? mem_compareWord(l, r) : 0;
+    }
 
-    if (new_size)
+    for (Size index = 0; index < count; ++index)
     {
-        Size block_size = memRoundSize(new_size, vmem->page_size);
-        U8 *base = vmemReserve(vmem, block_size);
-        if (!base) return NULL;
+        if (left[index] != right[index]) return (I32)left[index] - (I32)right[index];
+    }
 
-        vmemCommit(vmem, base, block_size);
+    return 0;
+}
+
+static inline bool
+mem_matchSmall(U8 const *left, U8 const *right, Size count)
+{
+    CF_ASSERT(count <= 16, "Size too large");
 
-        new_mem = base + block_size - new_size;
+    if (count >= 8)
+    {
+        return ((mem_load64(left) ^ mem_load64(right)) |
+                (mem_load64(left + count - 8) ^ mem_load64(right + count - 8))) == 0;
     }
 
-    if (memory)
+    if (count >= 4)
     {
-        CF_ASSERT(old_size > 0, "Freeing valid pointer but given size is 0");
+        return ((mem_load32(left) ^ mem_load32(right)) |
+                (mem_load32(left + count - 4) ^ mem_load32(right + count - 4))) == 0;
+    }
 
-        if (new_mem)
-        {
-            memCopy(memory, new_mem, cfMin(old_size, new_size));
-        }
+    return !count || (left[0] == right[0] && left[count / 2] == right[count / 2] &&
+                      left[count - 1] == right[count - 1]);
+}
 
-        Size block_size = memRoundSize(old_size, vmem->page_size);
-        U8 *base = (U8 *)memory + old_size - block_size;
+//=== Fallback kernels ===//
 
-        vmemDecommit(vmem, base, block_size);
-        vmemRelease(vmem, base, block_size);
+static void
+mem_copyLibc(U8 *dst, U8 const *src, Size count)
+{
+    memcpy(dst, src, count); // NOLINT
+}
 
-        memory = NULL;
-    }
+static void
+mem_fillLibc(U8 *dst, U8 value, Size count)
+{
+    memset(dst, value, count); // NOLINT
+}
 
-    return new_mem;
+static I32
+mem_compareLibc(U8 const *left, U8 const *right, Size count)
+{
+    return memcmp(left, right, count);
 }
 
-MemAllocator
-memEndOfPageAllocator(VMemApi *vmem)
+static bool
+mem_matchLibc(U8 const *left, U8 const *right, Size count)
 {
-    return (MemAllocator){.func = memEndOfPageAlloc, .state = vmem};
+    return !memcmp(left, right, count);
 }
 
-//------------------//
-//   Memory arena   //
-//------------------//
+static MemKernels const g_mem_kernels_libc = {
+    .copy = mem_copyLibc,
+    .fill = mem_fillLibc,
+    .compare = mem_compareLibc,
+    .match = mem_matchLibc,
+    .stream_copy = mem_copyLibc,
+    .stream_fill = mem_fillLibc,
+};
 
-static void
-mem_arenaCommitVMem(MemArena *arena)
+//=== SSE2 kernels ===//
+
+MEM_TARGET_SSE2 static void
+mem_copySse2(U8 *dst, U8 const *src, Size count)
 {
-    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT(count > 16, "Small sizes must be handled inline");
+
+    __m128i head = _mm_loadu_si128((__m128i const *)src);
+    __m128i tail = _mm_loadu_si128((__m128i const *)(src + count - 16));
 
-    if (arena->vmem && arena->allocated > arena->committed)
+    if (count <= 32)
     {
-        // NOTE (Matteo): Align memory commits to page boundaries
-        U8 const *next_pos =
-            memAlignForward(arena->memory + arena->allocated, arena->vmem->address_granularity);
-        U8 *curr_pos = arena->memory + arena->committed;
+        _mm_storeu_si128((__m128i *)dst, head);
+        _mm_storeu_si128((__m128i *)(dst + count - 16), tail);
+        return;
+    }
 
-        Size max_commit_size = arena->reserved - arena->allocated;
-        Size commit_size = cfMin((Size)(next_pos - curr_pos), max_commit_size);
+    // NOTE (Matteo): The head vector covers the bytes skipped to align the destination, the tail
+    // vector those left over by the main loop
+    Size skip = 16 - ((Size)dst & 15);
+    U8 *d = dst + skip;
+    U8 const *s = src + skip;
+    Size left = count - skip;
 
-        vmemCommit(arena->vmem, curr_pos, commit_size);
-        arena->committed += commit_size;
+    for (; left > 64; left -= 64, d += 64, s += 64)
+    {
+        __m128i v0 = _mm_loadu_si128((__m128i const *)s);
+        __m128i v1 = _mm_loadu_si128((__m128i const *)(s + 16));
+        __m128i v2 = _mm_loadu_si128((__m128i const *)(s + 32));
+        __m128i v3 = _mm_loadu_si128((__m128i const *)(s + 48));
+        _mm_store_si128((__m128i *)d, v0);
+        _mm_store_si128((__m128i *)(d + 16), v1);
+        _mm_store_si128((__m128i *)(d + 32), v2);
+        _mm_store_si128((__m128i *)(d + 48), v3);
+    }
+
+    for (; left > 16; left -= 16, d += 16, s += 16)
+    {
+        _mm_store_si128((__m128i *)d, _mm_loadu_si128((__m128i const *)s));
     }
+
+    _mm_storeu_si128((__m128i *)dst, head);
+    _mm_storeu_si128((__m128i *)(dst + count - 16), tail);
 }
 
-static void
-mem_arenaDecommitVm(MemArena *arena)
+MEM_TARGET_SSE2 static void
+mem_fillSse2(U8 *dst, U8 value, Size count)
 {
-    if (arena->vmem && arena->committed > arena->allocated)
-    {
-        // NOTE (Matteo): Since VM decommit acts on full pages, I need to align the block to be
-        // decommitted 1 page up in order to preserve the last page which is partially filled
+    CF_ASSERT(count > 16, "Small sizes must be handled inline");
 
-        // Align base pointer forward
-        U8 const *base = arena->memory + arena->allocated;
-        U8 const *next = memAlignForward(base, arena->vmem->address_granularity);
+    __m128i v = _mm_set1_epi8((char)value);
 
-        CF_ASSERT(next >= arena->memory, "Possible overflow");
+    _mm_storeu_si128((__m128i *)dst, v);
+    _mm_storeu_si128((__m128i *)(dst + count - 16), v);
 
-        Size offset = (Size)(next - arena->memory);
+    if (count <= 32) return;
 
-        if (offset < arena->committed)
-        {
-            Size decommit_size = arena->committed - offset;
-            vmemDecommit(arena->vmem, arena->memory + offset, decommit_size);
-            arena->committed -= decommit_size;
-        }
+    U8 *d = dst + 16 - ((Size)dst & 15);
+    U8 *end = dst + count - 16;
+
+    for (; d + 64 <= end; d += 64)
+    {
+        _mm_store_si128((__m128i *)d, v);
+        _mm_store_si128((__m128i *)(d + 16), v);
+        _mm_store_si128((__m128i *)(d + 32), v);
+        _mm_store_si128((__m128i *)(d + 48), v);
     }
+
+    for (; d < end; d += 16) _mm_store_si128((__m128i *)d, v);
 }
 
-static inline Size
-memRoundUp(Size block_size, Size page_size)
+static inline I32
+mem_compareMask(U8 const *left, U8 const *right, Size offset, U32 mask)
 {
-    CF_ASSERT((page_size & (page_size - 1)) == 0, "Page size is not a power of 2");
-    return page_size * ((block_size + page_size - 1) / page_size);
+    Size index = offset + mem_BitLsb(mask);
+    return (I32)left[index] - (I32)right[index];
 }
 
-void
-memArenaInitOnVmem(MemArena *arena, VMemApi *vmem, void *reserved_block, Size reserved_size)
+MEM_TARGET_SSE2 static inline U32
+mem_diffMaskSse2(U8 const *left, U8 const *right, Size offset)
 {
-    CF_ASSERT_NOT_NULL(arena);
-
-    arena->vmem = vmem;
-    arena->memory = reserved_block;
-    arena->reserved = reserved_size;
-    arena->allocated = 0;
-    arena->committed = 0;
-    arena->save_stack = 0;
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(left + offset)),
+                                _mm_loadu_si128((__m128i const *)(right + offset)));
+    return (U32)_mm_movemask_epi8(eq) ^ 0xFFFF;
 }
 
-void
-memArenaInitOnBuffer(MemArena *arena, U8 *buffer, Size buffer_size)
+MEM_TARGET_SSE2 static inline bool
+mem_matchBlockSse2(U8 const *left, U8 const *right, Size offset)
 {
-    CF_ASSERT_NOT_NULL(arena);
-
-    arena->vmem = NULL;
-    arena->memory = buffer;
-    arena->reserved = buffer_size;
-    arena->allocated = 0;
-    arena->committed = 0;
-    arena->save_stack = 0;
+    __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(left + offset)),
+                                 _mm_loadu_si128((__m128i const *)(right + offset)));
+    __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(left + offset + 16)),
+                                 _mm_loadu_si128((__m128i const *)(right + offset + 16)));
+    __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(left + offset + 32)),
+                                 _mm_loadu_si128((__m128i const *)(right + offset + 32)));
+    __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(left + offset + 48)),
+                                 _mm_loadu_si128((__m128i const *)(right + offset + 48)));
+    __m128i eq = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+    return _mm_movemask_epi8(eq) == 0xFFFF;
 }
 
-MemArena *
-memArenaBootstrapFromVmem(VMemApi *vmem, void *reserved_block, Size reserved_size)
+MEM_TARGET_SSE2 static I32
+mem_compareSse2(U8 const *left, U8 const *right, Size count)
 {
-    MemArena *arena = NULL;
+    CF_ASSERT(count > 16, "Small sizes must be handled inline");
 
-    if (reserved_block)
-    {
-        CF_ASSERT(reserved_size > sizeof(*arena), "Cannot bootstrap arena from smaller allocation");
+    Size offset = 0;
 
-        Size commit_size =
-            cfMin(reserved_size, memRoundUp(sizeof(*arena), vmem->address_granularity));
-        vmemCommit(vmem, reserved_block, commit_size);
+    // NOTE (Matteo): Scan 64 byte blocks until a difference is found, then locate it
+    while (offset + 64 <= count && mem_matchBlockSse2(left, right, offset)) offset += 64;
 
-        arena = reserved_block;
-        arena->vmem = vmem;
-        arena->memory = (U8 *)arena;
-        arena->reserved = reserved_size;
-        arena->allocated = sizeof(*arena);
-        arena->committed = commit_size;
-        arena->save_stack = 0;
+    for (; offset + 16 <= count; offset += 16)
+    {
+        U32 mask = mem_diffMaskSse2(left, right, offset);
+        if (mask) return mem_compareMask(left, right, offset, mask);
     }
 
-    return arena;
+    // NOTE (Matteo): The last vector is moved back to end at the buffer boundary; the bytes it
+    // shares with the previous one are known to match
+    if (offset < count)
+    {
+        offset = count - 16;
+        U32 mask = mem_diffMaskSse2(left, right, offset);
+        if (mask) return mem_compareMask(left, right, offset, mask);
+    }
+
+    return 0;
 }
 
-MemArena *
-memArenaBootstrapFromBuffer(U8 *buffer, Size buffer_size)
+MEM_TARGET_SSE2 static bool
+mem_matchSse2(U8 const *left, U8 const *right, Size count)
 {
-    MemArena *arena = NULL;
+    CF_ASSERT(count > 16, "Small sizes must be handled inline");
 
-    if (buffer)
+    Size offset = 0;
+
+    for (; offset + 64 <= count; offset += 64)
     {
-        CF_ASSERT(buffer_size > sizeof(*arena), "Cannot bootstrap arena from smaller allocation");
+        if (!mem_matchBlockSse2(left, right, offset)) return false;
+    }
 
-        arena = (MemArena *)buffer;
-        arena->vmem = NULL;
-        arena->memory = buffer;
-        arena->reserved = buffer_size;
-        arena->allocated = sizeof(*arena);
-        arena->committed = 0;
-        arena->save_stack = 0;
+    for (; offset + 16 <= count; offset += 16)
+    {
+        if (mem_diffMaskSse2(left, right, offset)) return false;
     }
 
-    return arena;
+    return offset == count || !mem_diffMaskSse2(left, right, count - 16);
 }
 
-void
-memArenaClear(MemArena *arena)
+MEM_TARGET_SSE2 static void
+mem_streamCopySse2(U8 *dst, U8 const *src, Size count)
 {
-    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT(count >= 64, "Small sizes must not be streamed");
 
-    if (arena->memory == (U8 *)arena)
+    __m128i head = _mm_loadu_si128((__m128i const *)src);
+    __m128i tail = _mm_loadu_si128((__m128i const *)(src + count - 16));
+
+    Size skip = 16 - ((Size)dst & 15);
+    U8 *d = dst + skip;
+    U8 const *s = src + skip;
+    Size left = count - skip;
+
+    for (; left > 64; left -= 64, d += 64, s += 64)
     {
-        // Arena is bootstrapped, so I need to preserve its allocation
-        arena->allocated = sizeof(*arena);
+        __m128i v0 = _mm_loadu_si128((__m128i const *)s);
+        __m128i v1 = _mm_loadu_si128((__m128i const *)(s + 16));
+        __m128i v2 = _mm_loadu_si128((__m128i const *)(s + 32));
+        __m128i v3 = _mm_loadu_si128((__m128i const *)(s + 48));
+        _mm_stream_si128((__m128i *)d, v0);
+        _mm_stream_si128((__m128i *)(d + 16), v1);
+        _mm_stream_si128((__m128i *)(d + 32), v2);
+        _mm_stream_si128((__m128i *)(d + 48), v3);
     }
-    else
+
+    for (; left > 16; left -= 16, d += 16, s += 16)
     {
-        arena->allocated = 0;
+        _mm_stream_si128((__m128i *)d, _mm_loadu_si128((__m128i const *)s));
     }
 
-    mem_arenaDecommitVm(arena);
-}
-
-Size
-memArenaAvailable(MemArena *arena)
-{
-    return arena->reserved - arena->allocated;
-}
+    // NOTE (Matteo): Non-temporal stores are weakly ordered, fence them so that the copy is
+    // complete for anyone synchronizing with the caller afterwards
+    _mm_sfence();
 
-void *
-memArenaAlloc(MemArena *arena, Size size)
-{
-    return memArenaAllocAlign(arena, size, CF_MAX_ALIGN);
+    _mm_storeu_si128((__m128i *)dst, head);
+    _mm_storeu_si128((__m128i *)(dst + count - 16), tail);
 }
 
-void *
-memArenaAllocAlign(MemArena *arena, Size size, Size align)
+MEM_TARGET_SSE2 static void
+mem_streamFillSse2(U8 *dst, U8 value, Size count)
 {
-    CF_ASSERT_NOT_NULL(arena);
-    CF_ASSERT((align & (align - 1)) == 0, "Alignment is not a power of 2");
-
-    U8 *result = NULL;
+    CF_ASSERT(count >= 64, "Small sizes must not be streamed");
 
-    // Align base pointer forward
-    U8 const *base = arena->memory + arena->allocated;
-    U8 const *next = memAlignForward(base, align);
+    __m128i v = _mm_set1_epi8((char)value);
 
-    CF_ASSERT(next >= arena->memory, "Possible overflow");
-    Size offset = (Size)(next - arena->memory);
+    U8 *d = dst + 16 - ((Size)dst & 15);
+    U8 *end = dst + count - 16;
 
-    if (offset + size <= arena->reserved)
+    for (; d + 64 <= end; d += 64)
     {
-        result = arena->memory + offset;
-        arena->allocated = offset + size;
+        _mm_stream_si128((__m128i *)d, v);
+        _mm_stream_si128((__m128i *)(d + 16), v);
+        _mm_stream_si128((__m128i *)(d + 32), v);
+        _mm_stream_si128((__m128i *)(d + 48), v);
+    }
 
-        mem_arenaCommitVMem(arena);
+    for (; d < end; d += 16) _mm_stream_si128((__m128i *)d, v);
 
-        // NOTE (Matteo): For simplicity every allocation is cleared, even it can be
-        // avoided for freshly committed VM pages
-        memClear(result, size);
-    }
+    _mm_sfence();
 
-    return result;
+    _mm_storeu_si128((__m128i *)dst, v);
+    _mm_storeu_si128((__m128i *)(dst + count - 16), v);
 }
 
-void *
-memArenaRealloc(MemArena *arena, void *memory, Size old_size, Size new_size)
-{
-    return memArenaReallocAlign(arena, memory, old_size, new_size, CF_MAX_ALIGN);
-}
+static MemKernels const g_mem_kernels_sse2 = {
+    .copy = mem_copySse2,
+    .fill = mem_fillSse2,
+    .compare = mem_compareSse2,
+    .match = mem_matchSse2,
+    .stream_copy = mem_streamCopySse2,
+    .stream_fill = mem_streamFillSse2,
+};
 
-void *
-memArenaReallocAlign(MemArena *arena, void *memory, Size old_size, Size new_size, Size align)
+//=== AVX2 kernels ===//
+
+MEM_TARGET_AVX2 static void
+mem_copyAvx2(U8 *dst, U8 const *src, Size count)
+{
+    CF_ASSERT(count > 16, "Small sizes must be handled inline");
+
+    if (count <= 32)
+    {
+        __m128i head = _mm_loadu_si128((__m128i const *)src);
+        __m128i tail = _mm_loadu_si128((__m128i const *)(src + count - 16));
+        _mm_storeu_si128((__m128i *)dst, head);
+        _mm_storeu_si128((__m128i *)(dst + count - 16), tail);
+        return;
+    }
+
+    __m256i head = _mm256_loadu_si256((__m256i const *)src);
+    __m256i tail = _mm256_loadu_si256((__m256i const *)(src + count - 32));
+
+    if (count <= 64)
+    {
+        _mm256_storeu_si256((__m256i *)dst, head);
+        _mm256_storeu_si256((__m256i *)(dst + count - 32), tail);
+        return;
+    }
+
+    Size skip = 32 - ((Size)dst & 31);
+    U8 *d = dst + skip;
+    U8 const *s = src + skip;
+    Size left = count - skip;
+
+    for (; left > 128; left -= 128, d += 128, s += 128)
+    {
+        __m256i v0 = _mm256_loadu_si256((__m256i const *)s);
+        __m256i v1 = _mm256_loadu_si256((__m256i const *)(s + 32));
+        __m256i v2 = _mm256_loadu_si256((__m256i const *)(s + 64));
+        __m256i v3 = _mm256_loadu_si256((__m256i const *)(s + 96));
+        _mm256_store_si256((__m256i *)d, v0);
+        _mm256_store_si256((__m256i *)(d + 32), v1);
+        _mm256_store_si256((__m256i *)(d + 64), v2);
+        _mm256_store_si256((__m256i *)(d + 96), v3);
+    }
+
+    for (; left > 32; left -= 32, d += 32, s += 32)
+    {
+        _mm256_store_si256((__m256i *)d, _mm256_loadu_si256((__m256i const *)s));
+    }
+
+    _mm256_storeu_si256((__m256i *)dst, head);
+    _mm256_storeu_si256((__m256i *)(dst + count - 32), tail);
+}
+
+MEM_TARGET_AVX2 static void
+mem_fillAvx2(U8 *dst, U8 value, Size count)
+{
+    CF_ASSERT(count > 16, "Small sizes must be handled inline");
+
+    if (count <= 32)
+    {
+        __m128i v = _mm_set1_epi8((char)value);
+        _mm_storeu_si128((__m128i *)dst, v);
+        _mm_storeu_si128((__m128i *)(dst + count - 16), v);
+        return;
+    }
+
+    __m256i v = _mm256_set1_epi8((char)value);
+
+    _mm256_storeu_si256((__m256i *)dst, v);
+    _mm256_storeu_si256((__m256i *)(dst + count - 32), v);
+
+    if (count <= 64) return;
+
+    U8 *d = dst + 32 - ((Size)dst & 31);
+    U8 *end = dst + count - 32;
+
+    for (; d + 128 <= end; d += 128)
+    {
+        _mm256_store_si256((__m256i *)d, v);
+        _mm256_store_si256((__m256i *)(d + 32), v);
+        _mm256_store_si256((__m256i *)(d + 64), v);
+        _mm256_store_si256((__m256i *)(d + 96), v);
+    }
+
+    for (; d < end; d += 32) _mm256_store_si256((__m256i *)d, v);
+}
+
+MEM_TARGET_AVX2 static inline U32
+mem_diffMaskAvx2(U8 const *left, U8 const *right, Size offset)
+{
+    __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const *)(left + offset)),
+                                   _mm256_loadu_si256((__m256i const *)(right + offset)));
+    return ~(U32)_mm256_movemask_epi8(eq);
+}
+
+MEM_TARGET_AVX2 static inline bool
+mem_matchBlockAvx2(U8 const *left, U8 const *right, Size offset)
+{
+    __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const *)(left + offset)),
+                                    _mm256_loadu_si256((__m256i const *)(right + offset)));
+    __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const *)(left + offset + 32)),
+                                    _mm256_loadu_si256((__m256i const *)(right + offset + 32)));
+    __m256i eq2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const *)(left + offset + 64)),
+                                    _mm256_loadu_si256((__m256i const *)(right + offset + 64)));
+    __m256i eq3 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const *)(left + offset + 96)),
+                                    _mm256_loadu_si256((__m256i const *)(right + offset + 96)));
+    __m256i eq = _mm256_and_si256(_mm256_and_si256(eq0, eq1), _mm256_and_si256(eq2, eq3));
+    return _mm256_movemask_epi8(eq) == -1;
+}
+
+MEM_TARGET_AVX2 static I32
+mem_compareAvx2(U8 const *left, U8 const *right, Size count)
+{
+    CF_ASSERT(count > 16, "Small sizes must be handled inline");
+
+    if (count < 32) return mem_compareSse2(left, right, count);
+
+    Size offset = 0;
+
+    while (offset + 128 <= count && mem_matchBlockAvx2(left, right, offset)) offset += 128;
+
+    for (; offset + 32 <= count; offset += 32)
+    {
+        U32 mask = mem_diffMaskAvx2(left, right, offset);
+        if (mask) return mem_compareMask(left, right, offset, mask);
+    }
+
+    if (offset < count)
+    {
+        offset = count - 32;
+        U32 mask = mem_diffMaskAvx2(left, right, offset);
+        if (mask) return mem_compareMask(left, right, offset, mask);
+    }
+
+    return 0;
+}
+
+MEM_TARGET_AVX2 static bool
+mem_matchAvx2(U8 const *left, U8 const *right, Size count)
+{
+    CF_ASSERT(count > 16, "Small sizes must be handled inline");
+
+    if (count < 32) return mem_matchSse2(left, right, count);
+
+    Size offset = 0;
+
+    for (; offset + 128 <= count; offset += 128)
+    {
+        if (!mem_matchBlockAvx2(left, right, offset)) return false;
+    }
+
+    for (; offset + 32 <= count; offset += 32)
+    {
+        if (mem_diffMaskAvx2(left, right, offset)) return false;
+    }
+
+    return offset == count || !mem_diffMaskAvx2(left, right, count - 32);
+}
+
+MEM_TARGET_AVX2 static void
+mem_streamCopyAvx2(U8 *dst, U8 const *src, Size count)
+{
+    CF_ASSERT(count >= 64, "Small sizes must not be streamed");
+
+    __m256i head = _mm256_loadu_si256((__m256i const *)src);
+    __m256i tail = _mm256_loadu_si256((__m256i const *)(src + count - 32));
+
+    Size skip = 32 - ((Size)dst & 31);
+    U8 *d = dst + skip;
+    U8 const *s = src + skip;
+    Size left = count - skip;
+
+    for (; left > 128; left -= 128, d += 128, s += 128)
+    {
+        __m256i v0 = _mm256_loadu_si256((__m256i const *)s);
+        __m256i v1 = _mm256_loadu_si256((__m256i const *)(s + 32));
+        __m256i v2 = _mm256_loadu_si256((__m256i const *)(s + 64));
+        __m256i v3 = _mm256_loadu_si256((__m256i const *)(s + 96));
+        _mm256_stream_si256((__m256i *)d, v0);
+        _mm256_stream_si256((__m256i *)(d + 32), v1);
+        _mm256_stream_si256((__m256i *)(d + 64), v2);
+        _mm256_stream_si256((__m256i *)(d + 96), v3);
+    }
+
+    for (; left > 32; left -= 32, d += 32, s += 32)
+    {
+        _mm256_stream_si256((__m256i *)d, _mm256_loadu_si256((__m256i const *)s));
+    }
+
+    _mm_sfence();
+
+    _mm256_storeu_si256((__m256i *)dst, head);
+    _mm256_storeu_si256((__m256i *)(dst + count - 32), tail);
+}
+
+MEM_TARGET_AVX2 static void
+mem_streamFillAvx2(U8 *dst, U8 value, Size count)
+{
+    CF_ASSERT(count >= 64, "Small sizes must not be streamed");
+
+    __m256i v = _mm256_set1_epi8((char)value);
+
+    U8 *d = dst + 32 - ((Size)dst & 31);
+    U8 *end = dst + count - 32;
+
+    for (; d + 128 <= end; d += 128)
+    {
+        _mm256_stream_si256((__m256i *)d, v);
+        _mm256_stream_si256((__m256i *)(d + 32), v);
+        _mm256_stream_si256((__m256i *)(d + 64), v);
+        _mm256_stream_si256((__m256i *)(d + 96), v);
+    }
+
+    for (; d < end; d += 32) _mm256_stream_si256((__m256i *)d, v);
+
+    _mm_sfence();
+
+    _mm256_storeu_si256((__m256i *)dst, v);
+    _mm256_storeu_si256((__m256i *)(dst + count - 32), v);
+}
+
+static MemKernels const g_mem_kernels_avx2 = {
+    .copy = mem_copyAvx2,
+    .fill = mem_fillAvx2,
+    .compare = mem_compareAvx2,
+    .match = mem_matchAvx2,
+    .stream_copy = mem_streamCopyAvx2,
+    .stream_fill = mem_streamFillAvx2,
+};
+
+//=== Dispatch ===//
+
+static void
+mem_cpuid(U32 leaf, U32 subleaf, U32 regs[4])
+{
+#if CF_COMPILER_MSVC
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    for (Size index = 0; index < 4; ++index) regs[index] = (U32)info[index];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static U64
+mem_xgetbv(U32 index)
+{
+#if CF_COMPILER_MSVC
+    return _xgetbv(index);
+#else
+    U32 lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+    return ((U64)hi << 32) | lo;
+#endif
+}
+
+static MemSimd
+mem_simdDetect(void)
+{
+    U32 regs[4];
+
+    mem_cpuid(0, 0, regs);
+    U32 max_leaf = regs[0];
+    if (max_leaf < 1) return MemSimd_None;
+
+    mem_cpuid(1, 0, regs);
+    if (!(regs[3] & (1U << 26))) return MemSimd_None;
+
+    // NOTE (Matteo): AVX2 requires the OS to save the YMM state (OSXSAVE + XCR0 bits 1 and 2)
+    bool os_avx = (regs[2] & (1U << 27)) && (regs[2] & (1U << 28)) &&
+                  (mem_xgetbv(0) & 0x6) == 0x6;
+    if (!os_avx || max_leaf < 7) return MemSimd_Sse2;
+
+    mem_cpuid(7, 0, regs);
+    return (regs[1] & (1U << 5)) ? MemSimd_Avx2 : MemSimd_Sse2;
+}
+
+static MemKernels const *
+mem_simdResolve(void)
+{
+    // NOTE (Matteo): Concurrent first calls may run the detection more than once, but they all
+    // store the same kernels, so no synchronization is required
+    g_mem_simd_detected = mem_simdDetect();
+    MemKernels const *kernels = (g_mem_simd_detected == MemSimd_Avx2   ? &g_mem_kernels_avx2
+                                 : g_mem_simd_detected == MemSimd_Sse2 ? &g_mem_kernels_sse2
+                                                                       : &g_mem_kernels_libc);
+    atomWrite(&g_mem_kernels, (void *)kernels);
+    return kernels;
+}
+
+static inline MemKernels const *
+mem_kernels(void)
+{
+    MemKernels const *kernels = atomRead(&g_mem_kernels);
+    return kernels ? kernels : mem_simdResolve();
+}
+
+MemSimd
+memSimdLevel(void)
+{
+    MemKernels const *kernels = mem_kernels();
+    if (kernels == &g_mem_kernels_avx2) return MemSimd_Avx2;
+    if (kernels == &g_mem_kernels_sse2) return MemSimd_Sse2;
+    return MemSimd_None;
+}
+
+MemSimd
+memSimdSelect(MemSimd level)
+{
+    mem_kernels();
+
+    if (level > g_mem_simd_detected) level = g_mem_simd_detected;
+
+    MemKernels const *kernels = (level == MemSimd_Avx2   ? &g_mem_kernels_avx2
+                                 : level == MemSimd_Sse2 ? &g_mem_kernels_sse2
+                                                         : &g_mem_kernels_libc);
+    atomWrite(&g_mem_kernels, (void *)kernels);
+
+    return level;
+}
+
+//=== Public API ===//
+
+void
+memClear(void *mem, Size count)
+{
+    memWrite(mem, 0, count);
+}
+
+void
+memCopy(void const *from, void *to, Size count)
+{
+    U8 const *src = from;
+    U8 *dst = to;
+
+    if (count <= 16)
+    {
+        mem_copySmall(dst, src, count);
+    }
+    else if ((Size)(dst - src) >= count && (Size)(src - dst) >= count)
+    {
+        // NOTE (Matteo): Fast path for disjoint regions, which is by far the most common case
+        mem_kernels()->copy(dst, src, count);
+    }
+    else
+    {
+        memmove(dst, src, count); // NOLINT
+    }
+}
+
+void
+memCopySafe(void const *from, Size from_size, void *to, Size to_size)
+{
+#if CF_OS_WIN32
+    memmove_s(to, to_size, from, from_size);
+#else
+    // NOTE (Matteo): memmove_s is not provided by glibc, mimic its checks
+    CF_ASSERT(from_size <= to_size, "Destination buffer is too small");
+    memmove(to, from, cfMin(from_size, to_size)); // NOLINT
+#endif
+}
+
+void
+memWrite(U8 *mem, U8 value, Size count)
+{
+    if (count <= 16)
+    {
+        mem_fillSmall(mem, value, count);
+    }
+    else
+    {
+        mem_kernels()->fill(mem, value, count);
+    }
+}
+
+I32
+memCompare(void const *left, void const *right, Size count)
+{
+    if (count <= 16) return mem_compareSmall(left, right, count);
+    return mem_kernels()->compare(left, right, count);
+}
+
+bool
+memMatch(void const *left, void const *right, Size count)
+{
+    if (count <= 16) return mem_matchSmall(left, right, count);
+    return mem_kernels()->match(left, right, count);
+}
+
+Size
+memStreamThreshold(void)
+{
+    return g_mem_stream_threshold;
+}
+
+void
+memStreamSetThreshold(Size threshold)
+{
+    // NOTE (Matteo): The streaming kernels require at least a few vectors to work with
+    g_mem_stream_threshold = cfMax(threshold, (Size)64);
+}
+
+void
+memStreamCopy(void const *from, void *to, Size count)
+{
+    U8 const *src = from;
+    U8 *dst = to;
+
+    CF_ASSERT((Size)(dst - src) >= count && (Size)(src - dst) >= count,
+              "Streaming copy between overlapping regions");
+
+    if (count < g_mem_stream_threshold)
+    {
+        memCopy(src, dst, count);
+    }
+    else
+    {
+        mem_kernels()->stream_copy(dst, src, count);
+    }
+}
+
+void
+memStreamWrite(U8 *mem, U8 value, Size count)
+{
+    if (count < g_mem_stream_threshold)
+    {
+        memWrite(mem, value, count);
+    }
+    else
+    {
+        mem_kernels()->stream_fill(mem, value, count);
+    }
+}
+
+void
+memStreamClear(void *mem, Size count)
+{
+    memStreamWrite(mem, 0, count);
+}
+
+U8 const *
+memAlignForward(U8 const *address, Size alignment)
+{
+    CF_ASSERT((alignment & (alignment - 1)) == 0, "Alignment is not a power of 2");
+    // Same as (address % alignment) but faster as alignment is a power of 2
+    Size modulo = (Size)address & (alignment - 1);
+    // Move pointer forward if needed
+    return modulo ? address + alignment - modulo : address;
+}
+
+void *
+memAlloc(MemAllocator a, Size size)
+{
+    return memAllocAlign(a, size, CF_MAX_ALIGN);
+}
+
+void *
+memAllocAlign(MemAllocator a, Size size, Size align)
+{
+    return a.func(a.state, NULL, 0, size, align);
+}
+
+void *
+memRealloc(MemAllocator a, void *mem, Size old_size, Size new_size)
+{
+    return memReallocAlign(a, mem, old_size, new_size, CF_MAX_ALIGN);
+}
+
+void *
+memReallocAlign(MemAllocator a, void *mem, Size old_size, Size new_size, Size align)
+{
+    return a.func(a.state, mem, old_size, new_size, align);
+}
+
+void
+memFree(MemAllocator a, void *mem, Size size)
+{
+
+    memFreeAlign(a, mem, size, CF_MAX_ALIGN);
+}
+
+void
+memFreeAlign(MemAllocator a, void *mem, Size size, Size align)
+{
+
+    a.func(a.state, mem, size, 0, align);
+}
+
+static Size
+mem_cacheLineRound(Size size)
+{
+    return (size + CF_CACHELINE_SIZE - 1) & ~(Size)(CF_CACHELINE_SIZE - 1);
+}
+
+void *
+memAllocCacheAligned(MemAllocator a, Size size)
+{
+    return memAllocAlign(a, mem_cacheLineRound(size), CF_CACHELINE_SIZE);
+}
+
+void
+memFreeCacheAligned(MemAllocator a, void *mem, Size size)
+{
+    memFreeAlign(a, mem, mem_cacheLineRound(size), CF_CACHELINE_SIZE);
+}
+
+//---------------------------//
+//   End-of-page allocator   //
+//---------------------------//
+
+static Size
+memRoundSize(Size req_size, Size page_size)
+{
+    Size page_count = (req_size + page_size - 1) / page_size;
+    return page_count * page_size;
+}
+
+// NOTE (Matteo): Explicit over-alignment requests (e.g. cache line or SIMD alignment) are honored
+// by rounding the block size up to the alignment, giving up a few bytes of overflow detection
+static Size
+memEndOfPageBlockSize(Size size, Size align)
+{
+    return align > CF_MAX_ALIGN ? (size + align - 1) & ~(align - 1) : size;
+}
+
+static MEM_ALLOCATOR_FN(memEndOfPageAlloc)
+{
+    VMemApi *vmem = state;
+
+    // NOTE (Matteo): This function cannot guarantee the default alignment
+    // because of the stricter requirement to align the block at the end of
+    // a page; as such, UBSan can complain about misaligned accessess and
+    // SIMD data structures can pose a problem if not allocated in power-of-2 sizes.
+
+    CF_ASSERT((align & (align - 1)) == 0, "Alignment is not a power of 2");
+    CF_ASSERT(align <= vmem->page_size, "Unsupported alignment");
+
+    void *new_mem = NULL;
+
+    if (new_size)
+    {
+        Size used_size = memEndOfPageBlockSize(new_size, align);
+        Size block_size = memRoundSize(used_size, vmem->page_size);
+        U8 *base = vmemReserve(vmem, block_size);
+        if (!base) return NULL;
+
+        vmemCommit(vmem, base, block_size);
+
+        new_mem = base + block_size - used_size;
+    }
+
+    if (memory)
+    {
+        CF_ASSERT(old_size > 0, "Freeing valid pointer but given size is 0");
+
+        if (new_mem)
+        {
+            memCopy(memory, new_mem, cfMin(old_size, new_size));
+        }
+
+        Size used_size = memEndOfPageBlockSize(old_size, align);
+        Size block_size = memRoundSize(used_size, vmem->page_size);
+        U8 *base = (U8 *)memory + used_size - block_size;
+
+        vmemDecommit(vmem, base, block_size);
+        vmemRelease(vmem, base, block_size);
+
+        memory = NULL;
+    }
+
+    return new_mem;
+}
+
+MemAllocator
+memEndOfPageAllocator(VMemApi *vmem)
+{
+    return (MemAllocator){.func = memEndOfPageAlloc, .state = vmem};
+}
+
+//--------------------------//
+//   Virtual memory block   //
+//--------------------------//
+
+bool
+memVmBlockInitEx(MemVmBlock *block, VMemApi *vmem, Size reserved_size, VMemFlags flags)
+{
+    CF_ASSERT_NOT_NULL(block);
+    CF_ASSERT_NOT_NULL(vmem);
+
+    memClearStruct(block);
+
+    Size granularity = vmemCommitGranularity(vmem, flags);
+    Size reserved = memRoundSize(reserved_size, granularity);
+
+    block->base = vmemReserveEx(vmem, reserved, flags);
+    if (!block->base) return false;
+
+    block->vmem = vmem;
+    block->reserved = reserved;
+    block->granularity = granularity;
+    block->flags = flags;
+
+    return true;
+}
+
+void
+memVmBlockShutdown(MemVmBlock *block)
+{
+    CF_ASSERT_NOT_NULL(block);
+
+    if (block->base)
+    {
+        if (block->committed) vmemDecommit(block->vmem, block->base, block->committed);
+        vmemRelease(block->vmem, block->base, block->reserved);
+    }
+
+    memClearStruct(block);
+}
+
+bool
+memVmBlockResize(MemVmBlock *block, Size size)
+{
+    CF_ASSERT_NOT_NULL(block);
+
+    if (size > block->reserved) return false;
+
+    Size required = memRoundSize(size, block->granularity);
+
+    if (required > block->committed)
+    {
+        if (!vmemCommitEx(block->vmem, block->base + block->committed,
+                          required - block->committed, block->flags))
+        {
+            return false;
+        }
+    }
+    else if (required < block->committed)
+    {
+        // NOTE (Matteo): Decommitted pages come back cleared when committed again
+        vmemDecommit(block->vmem, block->base + required, block->committed - required);
+    }
+
+    // NOTE (Matteo): Only the previously committed memory can hold stale data from a larger size
+    if (size > block->size)
+    {
+        Size stale_end = cfMin(size, block->committed);
+        if (stale_end > block->size) memClear(block->base + block->size, stale_end - block->size);
+    }
+
+    block->committed = required;
+    block->size = size;
+
+    return true;
+}
+
+static MEM_ALLOCATOR_FN(mem_vmBlockAllocFn)
+{
+    MemVmBlock *block = state;
+
+    CF_ASSERT(!memory || memory == block->base, "Memory does not belong to the block");
+    CF_ASSERT(old_size == (memory ? block->size : 0), "Invalid allocation request");
+    CF_ASSERT(align <= block->vmem->page_size, "Unsupported alignment request");
+    CF_UNUSED(memory);
+    CF_UNUSED(old_size);
+    CF_UNUSED(align);
+
+    if (!memVmBlockResize(block, new_size)) return NULL;
+
+    return new_size ? block->base : NULL;
+}
+
+MemAllocator
+memVmBlockAllocator(MemVmBlock *block)
+{
+    return (MemAllocator){.func = mem_vmBlockAllocFn, .state = block};
+}
+
+//------------------//
+//   Memory arena   //
+//------------------//
+
+static inline Size
+memRoundUp(Size block_size, Size page_size)
+{
+    CF_ASSERT((page_size & (page_size - 1)) == 0, "Page size is not a power of 2");
+    return page_size * ((block_size + page_size - 1) / page_size);
+}
+
+static inline Size
+mem_arenaCommitEnd(MemArena *arena, Size offset)
+{
+    // NOTE (Matteo): Align memory commits to page boundaries (or huge page boundaries, if
+    // enabled, so that the OS can actually back the range with them).
+    // The end of the block is not necessarily aligned to the commit granularity (e.g. after a
+    // split), so the commit must be clamped to it
+    U8 const *end = memAlignForward(arena->memory + offset, arena->granularity);
+    CF_ASSERT(end >= arena->memory, "Possible overflow");
+    return cfMin((Size)(end - arena->memory), arena->reserved);
+}
+
+/// Commit the pages required by the current allocation size; returns false if the OS fails to
+/// provide them, in which case the arena state is left untouched and the caller must roll back
+/// the allocation
+static bool
+mem_arenaCommitVMem(MemArena *arena)
+{
+    CF_ASSERT_NOT_NULL(arena);
+
+    if (!arena->vmem) return true;
+
+    MemArenaCommitPolicy const *policy = arena->commit_policy;
+    MemArenaCommitStats *stats = &arena->commit_stats;
+    Size required = mem_arenaCommitEnd(arena, arena->allocated);
+    bool committed = false;
+
+    if (arena->allocated > arena->committed)
+    {
+        Size commit_size = required - arena->committed;
+        Size next_commit = stats->next_commit;
+
+        if (policy)
+        {
+            // NOTE (Matteo): Commit geometrically more than required, so that a growing arena
+            // performs a logarithmic number of commits
+            Size commit_end = mem_arenaCommitEnd(
+                arena, arena->committed + cfMax(commit_size, stats->next_commit));
+            commit_size = commit_end - arena->committed;
+            next_commit = cfMin(2 * stats->next_commit, policy->max_commit);
+        }
+
+        if (!vmemCommitEx(arena->vmem, arena->memory + arena->committed, commit_size,
+                          arena->vmem_flags))
+        {
+            return false;
+        }
+
+        arena->committed += commit_size;
+        stats->next_commit = next_commit;
+        stats->commits++;
+        committed = true;
+    }
+
+    stats->high_water = cfMax(stats->high_water, arena->allocated);
+
+    if (policy && required > stats->eager_committed)
+    {
+        if (!committed) stats->commits_avoided++;
+        stats->eager_committed = required;
+    }
+
+    return true;
+}
+
+static void
+mem_arenaDecommitVm(MemArena *arena, Size offset)
+{
+    CF_ASSERT(offset <= arena->committed, "Invalid decommit offset");
+
+    if (offset < arena->committed)
+    {
+        Size decommit_size = arena->committed - offset;
+        vmemDecommit(arena->vmem, arena->memory + offset, decommit_size);
+        arena->committed -= decommit_size;
+        arena->commit_stats.decommits++;
+    }
+}
+
+/// Release the committed memory which is not in use anymore, according to the commit policy.
+/// 'reset' tells if the arena is being reset (restore or clear), while 'eager' tells if the
+/// default behavior is to decommit all the pages not in use.
+static void
+mem_arenaTrimVm(MemArena *arena, bool reset, bool eager)
+{
+    if (!arena->vmem) return;
+
+    MemArenaCommitPolicy const *policy = arena->commit_policy;
+    MemArenaCommitStats *stats = &arena->commit_stats;
+
+    // NOTE (Matteo): Since VM decommit acts on full pages, the decommitted range starts 1 page up
+    // in order to preserve the last page which is partially filled
+    Size target = mem_arenaCommitEnd(arena, arena->allocated);
+
+    if (!policy)
+    {
+        if (eager && target < arena->committed) mem_arenaDecommitVm(arena, target);
+        if (reset) stats->high_water = arena->allocated;
+        return;
+    }
+
+    bool eager_decommit = eager && stats->eager_committed > target;
+    if (eager_decommit) stats->eager_committed = target;
+
+    Size keep = arena->committed;
+
+    if (reset && policy->idle_resets && ++stats->resets >= policy->idle_resets)
+    {
+        // NOTE (Matteo): Pages above the high-water mark of the last resets were not needed in the
+        // meantime, so they are returned to the OS
+        keep = cfMax(mem_arenaCommitEnd(arena, stats->high_water), target);
+        stats->high_water = arena->allocated;
+        stats->resets = 0;
+    }
+
+    if (policy->retain_threshold && keep - target > policy->retain_threshold)
+    {
+        keep = mem_arenaCommitEnd(arena, target + policy->retain_threshold);
+    }
+
+    if (keep < arena->committed)
+    {
+        mem_arenaDecommitVm(arena, keep);
+        stats->next_commit = policy->min_commit;
+    }
+    else if (eager_decommit)
+    {
+        stats->decommits_avoided++;
+    }
+}
+
+// NOTE (Matteo): Chained blocks
+// Each linked block starts with a header that stores the state of the previous block, so that the
+// arena can be rolled back to it when the block is released; the chain is thus an intrusive stack.
+
+typedef struct MemArenaBlock
+{
+    U8 *memory;
+    Size reserved;
+    Size allocated;
+    Size committed;
+    VMemApi *vmem;
+    VMemFlags vmem_flags;
+    Size granularity;
+} MemArenaBlock;
+
+static void
+mem_arenaRestoreBlock(MemArena *arena, MemArenaBlock const *prev)
+{
+    arena->memory = prev->memory;
+    arena->reserved = prev->reserved;
+    arena->allocated = prev->allocated;
+    arena->committed = prev->committed;
+    arena->vmem = prev->vmem;
+    arena->vmem_flags = prev->vmem_flags;
+    arena->granularity = prev->granularity;
+    arena->commit_stats.eager_committed = prev->committed;
+}
+
+static bool
+mem_arenaPushBlock(MemArena *arena, Size size, Size align)
+{
+    MemArenaChain *chain = &arena->chain;
+
+    if (!chain->block_size) return false;
+
+    Size block_size = cfMax(chain->block_size, sizeof(MemArenaBlock) + size + align);
+    U8 *block = NULL;
+    VMemApi *vmem = NULL;
+
+    if (chain->alloc.func)
+    {
+        block = memAllocAlign(chain->alloc, block_size, alignof(MemArenaBlock));
+    }
+    else
+    {
+        vmem = chain->vmem;
+        block_size = memRoundUp(block_size, vmem->address_granularity);
+        block = vmemReserve(vmem, block_size);
+    }
+
+    if (!block) return false;
+
+    MemArenaBlock const prev = {
+        .memory = arena->memory,
+        .reserved = arena->reserved,
+        .allocated = arena->allocated,
+        .committed = arena->committed,
+        .vmem = arena->vmem,
+        .vmem_flags = arena->vmem_flags,
+        .granularity = arena->granularity,
+    };
+
+    arena->memory = block;
+    arena->reserved = block_size;
+    arena->allocated = sizeof(prev);
+    arena->committed = 0;
+    arena->vmem = vmem;
+    arena->vmem_flags = VMemFlags_None;
+    arena->granularity = vmem ? vmem->address_granularity : 0;
+    arena->commit_stats.eager_committed = 0;
+
+    if (!mem_arenaCommitVMem(arena))
+    {
+        // NOTE (Matteo): Not even the block header can be committed, give the block back
+        vmemRelease(vmem, block, block_size);
+        mem_arenaRestoreBlock(arena, &prev);
+        return false;
+    }
+
+    memCopy(&prev, block, sizeof(prev));
+    chain->depth++;
+
+    return true;
+}
+
+static void
+mem_arenaPopBlock(MemArena *arena)
+{
+    MemArenaChain *chain = &arena->chain;
+    CF_ASSERT(chain->depth, "No block to release");
+
+    MemArenaBlock prev;
+    memCopy(arena->memory, &prev, sizeof(prev));
+
+    if (arena->vmem)
+    {
+        vmemDecommit(arena->vmem, arena->memory, arena->committed);
+        vmemRelease(arena->vmem, arena->memory, arena->reserved);
+    }
+    else
+    {
+        memFreeAlign(chain->alloc, arena->memory, arena->reserved, alignof(MemArenaBlock));
+    }
+
+    mem_arenaRestoreBlock(arena, &prev);
+    chain->depth--;
+}
+
+void
+memArenaInitOnVmemEx(MemArena *arena, VMemApi *vmem, void *reserved_block, Size reserved_size,
+                     VMemFlags flags)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT_NOT_NULL(vmem);
+
+    arena->vmem = vmem;
+    arena->vmem_flags = flags;
+    arena->granularity = vmemCommitGranularity(vmem, flags);
+    arena->memory = reserved_block;
+    arena->reserved = reserved_size;
+    arena->allocated = 0;
+    arena->committed = 0;
+    arena->save_stack = 0;
+    arena->chain = (MemArenaChain){0};
+    arena->commit_policy = NULL;
+    arena->commit_stats = (MemArenaCommitStats){0};
+}
+
+void
+memArenaInitOnBuffer(MemArena *arena, U8 *buffer, Size buffer_size)
+{
+    CF_ASSERT_NOT_NULL(arena);
+
+    arena->vmem = NULL;
+    arena->vmem_flags = VMemFlags_None;
+    arena->granularity = 0;
+    arena->memory = buffer;
+    arena->reserved = buffer_size;
+    arena->allocated = 0;
+    arena->committed = 0;
+    arena->save_stack = 0;
+    arena->chain = (MemArenaChain){0};
+    arena->commit_policy = NULL;
+    arena->commit_stats = (MemArenaCommitStats){0};
+}
+
+void
+memArenaChainOnAllocator(MemArena *arena, MemAllocator alloc, Size block_size)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT_NOT_NULL(alloc.func);
+    CF_ASSERT(!arena->chain.depth, "Cannot change the source of linked blocks");
+
+    arena->chain.alloc = alloc;
+    arena->chain.vmem = NULL;
+    arena->chain.block_size = block_size;
+}
+
+void
+memArenaChainOnVmem(MemArena *arena, VMemApi *vmem, Size block_size)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT_NOT_NULL(vmem);
+    CF_ASSERT(!arena->chain.depth, "Cannot change the source of linked blocks");
+
+    arena->chain.alloc = (MemAllocator){0};
+    arena->chain.vmem = vmem;
+    arena->chain.block_size = block_size;
+}
+
+void
+memArenaSetCommitPolicy(MemArena *arena, MemArenaCommitPolicy const *policy)
+{
+    CF_ASSERT_NOT_NULL(arena);
+
+    arena->commit_policy = policy;
+    arena->commit_stats.next_commit = policy ? policy->min_commit : 0;
+    arena->commit_stats.eager_committed = arena->committed;
+    arena->commit_stats.high_water = arena->allocated;
+    arena->commit_stats.resets = 0;
+}
+
+MemArena *
+memArenaBootstrapFromVmem(VMemApi *vmem, void *reserved_block, Size reserved_size)
+{
+    MemArena *arena = NULL;
+
+    if (reserved_block)
+    {
+        CF_ASSERT(reserved_size > sizeof(*arena), "Cannot bootstrap arena from smaller allocation");
+
+        Size commit_size =
+            cfMin(reserved_size, memRoundUp(sizeof(*arena), vmem->address_granularity));
+        if (!vmemCommit(vmem, reserved_block, commit_size)) return NULL;
+
+        arena = reserved_block;
+        arena->vmem = vmem;
+        arena->vmem_flags = VMemFlags_None;
+        arena->granularity = vmem->address_granularity;
+        arena->memory = (U8 *)arena;
+        arena->reserved = reserved_size;
+        arena->allocated = sizeof(*arena);
+        arena->committed = commit_size;
+        arena->save_stack = 0;
+        arena->chain = (MemArenaChain){0};
+        arena->commit_policy = NULL;
+        arena->commit_stats = (MemArenaCommitStats){0};
+    }
+
+    return arena;
+}
+
+MemArena *
+memArenaBootstrapFromBuffer(U8 *buffer, Size buffer_size)
+{
+    MemArena *arena = NULL;
+
+    if (buffer)
+    {
+        CF_ASSERT(buffer_size > sizeof(*arena), "Cannot bootstrap arena from smaller allocation");
+
+        arena = (MemArena *)buffer;
+        arena->vmem = NULL;
+        arena->vmem_flags = VMemFlags_None;
+        arena->granularity = 0;
+        arena->memory = buffer;
+        arena->reserved = buffer_size;
+        arena->allocated = sizeof(*arena);
+        arena->committed = 0;
+        arena->save_stack = 0;
+        arena->chain = (MemArenaChain){0};
+        arena->commit_policy = NULL;
+        arena->commit_stats = (MemArenaCommitStats){0};
+    }
+
+    return arena;
+}
+
+void
+memArenaClear(MemArena *arena)
+{
+    CF_ASSERT_NOT_NULL(arena);
+
+    while (arena->chain.depth) mem_arenaPopBlock(arena);
+
+    if (arena->memory == (U8 *)arena)
+    {
+        // Arena is bootstrapped, so I need to preserve its allocation
+        arena->allocated = sizeof(*arena);
+    }
+    else
+    {
+        arena->allocated = 0;
+    }
+
+    mem_arenaTrimVm(arena, true, true);
+}
+
+Size
+memArenaAvailable(MemArena *arena)
+{
+    return arena->reserved - arena->allocated;
+}
+
+void *
+memArenaAlloc(MemArena *arena, Size size)
+{
+    return memArenaAllocAlign(arena, size, CF_MAX_ALIGN);
+}
+
+static inline Size
+mem_arenaAlignOffset(MemArena *arena, Size align)
+{
+    // Align base pointer forward
+    U8 const *base = arena->memory + arena->allocated;
+    U8 const *next = memAlignForward(base, align);
+
+    CF_ASSERT(next >= arena->memory, "Possible overflow");
+    return (Size)(next - arena->memory);
+}
+
+void *
+memArenaAllocAlign(MemArena *arena, Size size, Size align)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT((align & (align - 1)) == 0, "Alignment is not a power of 2");
+
+    U8 *result = NULL;
+    Size offset = mem_arenaAlignOffset(arena, align);
+
+    // NOTE (Matteo): Chained arenas link a new block if the current one is exhausted
+    if (offset + size > arena->reserved && mem_arenaPushBlock(arena, size, align))
+    {
+        offset = mem_arenaAlignOffset(arena, align);
+    }
+
+    if (offset + size <= arena->reserved)
+    {
+        Size allocated = arena->allocated;
+        arena->allocated = offset + size;
+
+        if (!mem_arenaCommitVMem(arena))
+        {
+            arena->allocated = allocated;
+            return NULL;
+        }
+
+        result = arena->memory + offset;
+
+        // NOTE (Matteo): For simplicity every allocation is cleared, even it can be
+        // avoided for freshly committed VM pages
+        memClear(result, size);
+    }
+
+    return result;
+}
+
+void *
+memArenaRealloc(MemArena *arena, void *memory, Size old_size, Size new_size)
+{
+    return memArenaReallocAlign(arena, memory, old_size, new_size, CF_MAX_ALIGN);
+}
+
+void *
+memArenaReallocAlign(MemArena *arena, void *memory, Size old_size, Size new_size, Size align)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT((align & (align - 1)) == 0, "Alignment is not a power of 2");
+
+    U8 *block = memory;
+    U8 const *block_end = block + old_size;
+    U8 const *alloc_end = arena->memory + arena->allocated;
+    U8 const *arena_end = arena->memory + arena->reserved;
+
+    U8 *result = NULL;
+
+    if (!block)
+    {
+        // New allocation
+        CF_ASSERT(old_size == 0, "Allocating new block but old size given");
+        result = memArenaAllocAlign(arena, new_size, align);
+    }
+    else if (arena->memory <= block && block <= arena_end)
+    {
+        // The given block is in bounds; if it matches the last allocation it
+        // can be expanded, otherwise a new allocation is performed
+        if (block_end == alloc_end && block_end - old_size + new_size < arena_end)
+        {
+            Size allocated = arena->allocated;
+            arena->allocated += new_size - old_size;
+
+            if (new_size > old_size)
+            {
+                if (!mem_arenaCommitVMem(arena))
+                {
+                    arena->allocated = allocated;
+                    return NULL;
+                }
+
+                memClear(block + old_size, new_size - old_size);
+            }
+
+            result = block;
+        }
+        else
+        {
+            result = memArenaAllocAlign(arena, new_size, align);
+            if (result) memCopy(memory, result, cfMin(old_size, new_size));
+        }
+    }
+    else if (arena->chain.depth)
+    {
+        // NOTE (Matteo): The block belongs to a previous block of the chain, and can only be moved
+        result = memArenaAllocAlign(arena, new_size, align);
+        if (result) memCopy(memory, result, cfMin(old_size, new_size));
+    }
+    else
+    {
+        CF_ASSERT(false, "Block is out of arena bounds");
+    }
+
+    return result;
+}
+
+void
+memArenaFree(MemArena *arena, void *memory, Size size)
+{
+    CF_ASSERT_NOT_NULL(arena);
+
+    U8 const *block = memory;
+    U8 const *block_end = block + size;
+    U8 const *alloc_end = arena->memory + arena->allocated;
+    U8 const *arena_end = arena->memory + arena->reserved;
+
+    if (!block)
+    {
+        CF_ASSERT(size == 0, "Freeing null block but size given");
+    }
+    else if (arena->memory <= block && block <= arena_end)
+    {
+        // Memory management is LIFO, so only the last allocated block can be freed
+        if (block_end == alloc_end)
+        {
+            arena->allocated -= size;
+            // NOTE (Matteo): With memory protection, unused memory is decommitted to trigger access
+            // violations
+            mem_arenaTrimVm(arena, false, CF_MEMORY_PROTECTION);
+        }
+    }
+    else
+    {
+        // NOTE (Matteo): Blocks of previous blocks of the chain are released only on restore
+        CF_ASSERT(arena->chain.depth, "Block is out of arena bounds");
+    }
+}
+
+MemArenaState
+memArenaSave(MemArena *arena)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    return (MemArenaState){
+        .arena = arena,
+        .memory = arena->memory,
+        .allocated = arena->allocated,
+        .stack_id = ++arena->save_stack,
+    };
+}
+
+void
+memArenaRestore(MemArenaState state)
+{
+    MemArena *arena = state.arena;
+
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT(arena->save_stack == state.stack_id, "Restoring invalid state");
+
+    // NOTE (Matteo): Release the blocks linked after the state was saved
+    while (arena->memory != state.memory) mem_arenaPopBlock(arena);
+
+    CF_ASSERT(arena->allocated >= state.allocated, "Restoring invalid state");
+
+    arena->allocated = state.allocated;
+    arena->save_stack--;
+
+    // NOTE (Matteo): With memory protection, unused memory is decommitted to trigger access
+    // violations
+    mem_arenaTrimVm(arena, true, CF_MEMORY_PROTECTION);
+}
+
+bool
+memArenaSplit(MemArena *arena, MemArena *split, Size size)
+{
+    CF_ASSERT(!split->memory, "split is expected to be 0-initialized");
+    CF_ASSERT(!arena->chain.depth && !arena->chain.block_size, "Cannot split a chained arena");
+
+    if (size > arena->reserved) return false;
+
+    Size new_reserved = arena->reserved - size;
+
+    if (arena->vmem)
+    {
+        // NOTE (Matteo): When VM is involved, split must occur on commit boundaries
+        Size new_end = (Size)(arena->memory + new_reserved);
+        Size modulo = new_end & (arena->granularity - 1);
+        new_reserved -= modulo;
+    }
+
+    if (new_reserved < arena->allocated) return false;
+
+    split->vmem = arena->vmem;
+    split->vmem_flags = arena->vmem_flags;
+    split->granularity = arena->granularity;
+    split->memory = arena->memory + new_reserved;
+    split->reserved = arena->reserved - new_reserved;
+    split->allocated = 0;
+    split->committed = 0;
+    split->save_stack = 0;
+    split->chain = (MemArenaChain){0};
+    split->commit_policy = NULL;
+    split->commit_stats = (MemArenaCommitStats){0};
+
+    if (arena->vmem && arena->committed > new_reserved)
+    {
+        split->committed = arena->committed - new_reserved;
+        arena->committed = new_reserved;
+    }
+
+    arena->reserved = new_reserved;
+
+    return true;
+}
+
+static MEM_ALLOCATOR_FN(mem_arenaAllocFn)
+{
+    CF_ASSERT(memory || !old_size, "Invalid allocation request");
+
+    MemArena *arena = state;
+    void *new_memory = NULL;
+
+    if (new_size)
+    {
+        new_memory = memArenaReallocAlign(arena, memory, old_size, new_size, align);
+    }
+    else
+    {
+        memArenaFree(arena, memory, old_size);
+    }
+
+    return new_memory;
+}
+
+MemAllocator
+memArenaAllocator(MemArena *arena)
+{
+    return (MemAllocator){
+        .state = arena,
+        .func = mem_arenaAllocFn,
+    };
+}
+
+//-----------------------//
+//   Persistent arena    //
+//-----------------------//
+
+#define MEM_PERSIST_MAGIC 0x41504643 // "CFPA"
+#define MEM_PERSIST_SEED 0x9E3779B97F4A7C15ull
+
+// NOTE (Matteo): The arena content starts at a fixed offset, so that the header occupies its own
+// page(s) and can be flushed independently
+#define MEM_PERSIST_HEADER_SIZE 4096
+
+CF_STATIC_ASSERT(sizeof(MemPersistHeader) <= MEM_PERSIST_HEADER_SIZE, "Header is too large");
+
+// NOTE (Matteo): The format depends on the header layout and on the pointer size, since the size of
+// the data structures stored in the arena depends on it
+enum
+{
+    MemPersist_FormatVersion = 1,
+    MemPersist_Format = (MemPersist_FormatVersion << 8) | CF_PTR_SIZE,
+};
+
+// NOTE (Matteo): Same word-at-a-time mixing as cfHashBytes, kept local so that the allocators do
+// not depend on the containers built on top of them; the results match, so files written before
+// are still valid
+static U64
+mem_persistChecksum(void const *data, Size size)
+{
+    U64 const k0 = 0x9E3779B97F4A7C15ull;
+    U64 const k1 = 0xBF58476D1CE4E5B9ull;
+    U64 const k2 = 0x94D049BB133111EBull;
+
+    U8 const *bytes = data;
+    U64 h = MEM_PERSIST_SEED ^ (size * k0);
+
+    while (size)
+    {
+        U64 word = 0;
+        Size chunk = cfMin(size, sizeof(word));
+        memcpy(&word, bytes, chunk); // NOLINT
+
+        word *= k1;
+        word ^= word >> 29;
+        h ^= word;
+        h = ((h << 23) | (h >> 41)) * k0;
+
+        bytes += chunk;
+        size -= chunk;
+    }
+
+    // Final avalanche (splitmix64)
+    h ^= h >> 30;
+    h *= k1;
+    h ^= h >> 27;
+    h *= k2;
+    h ^= h >> 31;
+    return h;
+}
+
+static U64
+mem_persistHeaderChecksum(MemPersistHeader const *header)
+{
+    return mem_persistChecksum(header, offsetof(MemPersistHeader, header_checksum));
+}
+
+static U64
+mem_persistContentChecksum(MemPersist const *persist, Size allocated)
+{
+    return mem_persistChecksum(persist->arena.memory, allocated);
+}
+
+static bool
+mem_persistFlushHeader(MemPersist *persist)
+{
+    MemPersistHeader *header = persist->header;
+    header->header_checksum = mem_persistHeaderChecksum(header);
+    return vmemFileFlush(persist->vmem, &persist->map, header, MEM_PERSIST_HEADER_SIZE);
+}
+
+static MemPersistResult
+mem_persistValidate(MemPersist const *persist, U32 version, MemPersistFlags flags)
+{
+    MemPersistHeader const *header = persist->header;
+
+    if (!persist->map.file_size) return MemPersistResult_Created;
+
+    // NOTE (Matteo): A file which was never synced is equivalent to a new one, except for the
+    // wasted disk space
+    if (header->magic != MEM_PERSIST_MAGIC || !header->clean ||
+        header->header_checksum != mem_persistHeaderChecksum(header))
+    {
+        return MemPersistResult_Corrupted;
+    }
+
+    if (header->format != MemPersist_Format || header->version != version)
+    {
+        return MemPersistResult_Outdated;
+    }
+
+    // NOTE (Matteo): The root must point inside the allocated content
+    I64 root_offset = header->root + (I64)offsetof(MemPersistHeader, root);
+
+    if (header->allocated > persist->arena.reserved ||
+        (header->root && (root_offset < MEM_PERSIST_HEADER_SIZE ||
+                          (U64)root_offset > MEM_PERSIST_HEADER_SIZE + header->allocated)))
+    {
+        return MemPersistResult_Corrupted;
+    }
+
+    if ((flags & MemPersistFlags_Verify) &&
+        header->checksum != mem_persistContentChecksum(persist, (Size)header->allocated))
+    {
+        return MemPersistResult_Corrupted;
+    }
+
+    return MemPersistResult_Restored;
+}
+
+MemPersistResult
+memPersistOpen(MemPersist *persist, VMemApi *vmem, Str path, Size size, U32 version,
+               MemPersistFlags flags)
+{
+    CF_ASSERT_NOT_NULL(persist);
+    CF_ASSERT_NOT_NULL(vmem);
+
+    *persist = (MemPersist){.vmem = vmem};
+    persist->map = vmemFileMap(vmem, path, size);
+
+    if (!persist->map.data) return MemPersistResult_Error;
+
+    if (persist->map.size <= MEM_PERSIST_HEADER_SIZE)
+    {
+        vmemFileUnmap(vmem, &persist->map);
+        return MemPersistResult_Error;
+    }
+
+    U8 *data = persist->map.data;
+    persist->header = (MemPersistHeader *)data;
+    memArenaInitOnBuffer(&persist->arena, data + MEM_PERSIST_HEADER_SIZE,
+                         persist->map.size - MEM_PERSIST_HEADER_SIZE);
+
+    MemPersistResult result = mem_persistValidate(persist, version, flags);
+    MemPersistHeader *header = persist->header;
+
+    if (result == MemPersistResult_Restored)
+    {
+        persist->arena.allocated = (Size)header->allocated;
+    }
+    else
+    {
+        memClear(header, sizeof(*header));
+        header->magic = MEM_PERSIST_MAGIC;
+        header->format = MemPersist_Format;
+        header->version = version;
+    }
+
+    // NOTE (Matteo): The file is marked as dirty (on disk) before any change to the content, so
+    // that a crash before the next sync can be detected
+    header->size = persist->map.size;
+    header->clean = false;
+
+    if (!mem_persistFlushHeader(persist))
+    {
+        vmemFileUnmap(vmem, &persist->map);
+        *persist = (MemPersist){0};
+        return MemPersistResult_Error;
+    }
+
+    return result;
+}
+
+static bool
+mem_persistCommit(MemPersist *persist)
+{
+    CF_ASSERT_NOT_NULL(persist);
+    CF_ASSERT_NOT_NULL(persist->header);
+
+    MemPersistHeader *header = persist->header;
+    MemArena *arena = &persist->arena;
+
+    // NOTE (Matteo): The content must hit the disk before the header is marked as clean
+    if (arena->allocated && !vmemFileFlush(persist->vmem, &persist->map, arena->memory,
+                                           arena->allocated))
+    {
+        return false;
+    }
+
+    header->allocated = arena->allocated;
+    header->checksum = mem_persistContentChecksum(persist, arena->allocated);
+    header->clean = true;
+
+    return mem_persistFlushHeader(persist);
+}
+
+bool
+memPersistSync(MemPersist *persist)
+{
+    if (!mem_persistCommit(persist)) return false;
+
+    // NOTE (Matteo): The OS can write back the pages modified after the sync at any time, so the
+    // file must be marked as dirty again
+    persist->header->clean = false;
+    return mem_persistFlushHeader(persist);
+}
+
+bool
+memPersistClose(MemPersist *persist)
+{
+    bool result = mem_persistCommit(persist);
+    vmemFileUnmap(persist->vmem, &persist->map);
+    *persist = (MemPersist){0};
+    return result;
+}
+
+void
+memPersistReset(MemPersist *persist)
+{
+    CF_ASSERT_NOT_NULL(persist);
+    CF_ASSERT_NOT_NULL(persist->header);
+
+    memArenaClear(&persist->arena);
+    persist->header->root = 0;
+}
+
+void *
+memPersistRoot(MemPersist *persist)
+{
+    CF_ASSERT_NOT_NULL(persist);
+    CF_ASSERT_NOT_NULL(persist->header);
+    return memRelPtrGet(&persist->header->root, void);
+}
+
+void
+memPersistSetRoot(MemPersist *persist, void *root)
+{
+    CF_ASSERT_NOT_NULL(persist);
+    CF_ASSERT_NOT_NULL(persist->header);
+    CF_ASSERT(!root || ((U8 *)root >= persist->arena.memory &&
+                        (U8 *)root <= persist->arena.memory + persist->arena.allocated),
+              "Root must be allocated from the persistent arena");
+
+    memRelPtrSet(&persist->header->root, root);
+}
+
+//---------------------//
+//   Scratch arenas    //
+//---------------------//
+
+static CF_THREAD_LOCAL MemScratch *g_scratch = NULL;
+
+bool
+memScratchInit(MemScratch *scratch, MemArena *parent, Size arena_size)
+{
+    CF_ASSERT_NOT_NULL(scratch);
+    CF_ASSERT_NOT_NULL(parent);
+
+    memClearStruct(scratch);
+
+    // NOTE (Matteo): Splits are taken from the end of the parent, so restoring its extent gives
+    // back the memory (and committed pages) of the arenas split before a failure
+    Size reserved = parent->reserved;
+    Size committed = parent->committed;
+
+    for (Size index = 0; index < MemScratch_Count; ++index)
+    {
+        if (!memArenaSplit(parent, scratch->arenas + index, arena_size))
+        {
+            parent->reserved = reserved;
+            parent->committed = committed;
+            memClearStruct(scratch);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+MemScratch *
+memScratchBind(MemScratch *scratch)
+{
+    MemScratch *prev = g_scratch;
+    g_scratch = scratch;
+    return prev;
+}
+
+MemScratch *
+memScratchCurrent(void)
+{
+    return g_scratch;
+}
+
+MemArena *
+memScratchArena(MemArena const *conflict)
+{
+    MemScratch *scratch = g_scratch;
+
+    if (scratch)
+    {
+        for (Size index = 0; index < MemScratch_Count; ++index)
+        {
+            MemArena *arena = scratch->arenas + index;
+            if (arena != conflict) return arena;
+        }
+    }
+
+    return NULL;
+}
+
+//--------------------//
+//    Shared arena    //
+//--------------------//
+
+void
+memSharedArenaInitOnVmem(MemSharedArena *arena, VMemApi *vmem, void *reserved_block,
+                         Size reserved_size)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT_NOT_NULL(vmem);
+    CF_ASSERT_NOT_NULL(reserved_block);
+
+    memClearStruct(arena);
+    arena->vmem = vmem;
+    arena->memory = reserved_block;
+    arena->reserved = reserved_size;
+
+    atomInit(&arena->allocated, 0);
+    atomInit(&arena->committed, 0);
+    atomInit(&arena->commit_lock, false);
+}
+
+void
+memSharedArenaInitOnBuffer(MemSharedArena *arena, U8 *buffer, Size buffer_size)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT_NOT_NULL(buffer);
+    // NOTE (Matteo): Required by the padding computed by memSharedArenaAlloc
+    CF_ASSERT(((Size)buffer & (CF_MAX_ALIGN - 1)) == 0, "Buffer is not aligned to CF_MAX_ALIGN");
+
+    memClearStruct(arena);
+    arena->memory = buffer;
+    arena->reserved = buffer_size;
+
+    atomInit(&arena->allocated, 0);
+    atomInit(&arena->committed, buffer_size);
+    atomInit(&arena->commit_lock, false);
+}
+
+static bool
+mem_sharedArenaCommit(MemSharedArena *arena, Size end)
+{
+    // NOTE (Matteo): Commits are rare (at most one per commit granularity), so a simple spin lock
+    // is enough; the watermark is checked again under the lock because another thread may have
+    // already committed the required pages in the meantime
+    while (atomExchange(&arena->commit_lock, true)) atomSpinPause();
+    atomAcquireFence();
+
+    Size committed = atomRead(&arena->committed);
+    bool result = true;
+
+    if (end > committed)
+    {
+        Size granularity = vmemCommitGranularity(arena->vmem, VMemFlags_None);
+        Size commit_end = cfMin((end + granularity - 1) & ~(granularity - 1), arena->reserved);
+
+        // NOTE (Matteo): The watermark is published only if the pages are actually committed, so
+        // that the next allocation in the range tries again
+        result = vmemCommit(arena->vmem, arena->memory + committed, commit_end - committed);
+
+        if (result)
+        {
+            atomReleaseFence();
+            atomWrite(&arena->committed, commit_end);
+        }
+    }
+
+    atomReleaseFence();
+    atomWrite(&arena->commit_lock, false);
+
+    return result;
+}
+
+void *
+memSharedArenaAlloc(MemSharedArena *arena, Size size, Size align)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT(cfIsPowerOf2(align), "Alignment is not a power of 2");
+
+    // NOTE (Matteo): Every reservation is a multiple of the maximum alignment, so that the offset
+    // is always aligned for common requests; larger alignments are satisfied by over-reserving
+    Size base_align = CF_MAX_ALIGN;
+    Size padding = align > base_align ? align - base_align : 0;
+    Size reserve_size = (size + padding + base_align - 1) & ~(base_align - 1);
+
+    // NOTE (Matteo): Requests which can never fit are rejected before touching the offset, so
+    // that they do not exhaust the arena for everyone else
+    if (reserve_size > arena->reserved || reserve_size < size) return NULL;
+
+    Size offset = atomFetchAdd(&arena->allocated, reserve_size);
+
+    if (offset + reserve_size > arena->reserved || offset + reserve_size < offset) return NULL;
+
+    U8 *result = (U8 *)memAlignForward(arena->memory + offset, align);
+    Size end = (Size)(result - arena->memory) + size;
+
+    CF_ASSERT(end <= offset + reserve_size, "Aligned block overflows its reservation");
+
+    if (arena->vmem)
+    {
+        Size committed = atomRead(&arena->committed);
+        atomAcquireFence();
+
+        if (end > committed && !mem_sharedArenaCommit(arena, end)) return NULL;
+    }
+
+    // NOTE (Matteo): As for the regular arena, every allocation is cleared for simplicity
+    memClear(result, size);
+
+    return result;
+}
+
+Size
+memSharedArenaAllocated(MemSharedArena *arena)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    return cfMin(atomRead(&arena->allocated), arena->reserved);
+}
+
+void
+memSharedArenaReset(MemSharedArena *arena)
+{
+    CF_ASSERT_NOT_NULL(arena);
+    atomWrite(&arena->allocated, 0);
+    atomSequentialFence();
+}
+
+void
+memSharedArenaClear(MemSharedArena *arena)
+{
+    memSharedArenaReset(arena);
+
+    Size committed = atomRead(&arena->committed);
+
+    if (arena->vmem && committed)
+    {
+        vmemDecommit(arena->vmem, arena->memory, committed);
+        atomWrite(&arena->committed, 0);
+        atomSequentialFence();
+    }
+}
+
+static MEM_ALLOCATOR_FN(mem_sharedArenaAllocFn)
+{
+    CF_ASSERT(memory || !old_size, "Invalid allocation request");
+
+    MemSharedArena *arena = state;
+    void *new_memory = NULL;
+
+    if (new_size)
+    {
+        new_memory = memSharedArenaAlloc(arena, new_size, align);
+        if (new_memory && memory) memCopy(memory, new_memory, cfMin(old_size, new_size));
+    }
+
+    return new_memory;
+}
+
+MemAllocator
+memSharedArenaAllocator(MemSharedArena *arena)
+{
+    return (MemAllocator){
+        .state = arena,
+        .func = mem_sharedArenaAllocFn,
+    };
+}
+
+//--------------------//
+//   Slab allocator   //
+//--------------------//
+
+CF_STATIC_ASSERT(MemSlab_MinSize << (MemSlab_ClassCount - 1) == MemSlab_MaxSize,
+                 "Inconsistent slab size classes");
+CF_STATIC_ASSERT(MemSlab_MinSize >= sizeof(void *), "Slab blocks must fit a free list link");
+CF_STATIC_ASSERT(MemSlab_PageSize % MemSlab_MaxSize == 0, "Slab pages must fit whole blocks");
+
+static inline Size
+mem_slabClassIndex(Size size)
+{
+    if (size <= MemSlab_MinSize) return 0;
+    // NOTE (Matteo): ceil(log2(size)) - log2(min_size)
+    return mem_BitMsb(size - 1) + 1 - mem_BitMsb(MemSlab_MinSize);
+}
+
+void
+memSlabInit(MemSlab *slab, MemArena *arena, MemAllocator fallback)
+{
+    CF_ASSERT_NOT_NULL(slab);
+    CF_ASSERT_NOT_NULL(arena);
+
+    memClearStruct(slab);
+    slab->arena = arena;
+    slab->fallback = fallback;
+
+    for (Size index = 0; index < MemSlab_ClassCount; ++index)
+    {
+        slab->classes[index].block_size = (Size)MemSlab_MinSize << index;
+    }
+}
+
+void *
+memSlabAlloc(MemSlab *slab, Size size, Size align)
+{
+    CF_ASSERT_NOT_NULL(slab);
+    CF_ASSERT(cfIsPowerOf2(align), "Alignment is not a power of 2");
+
+    // NOTE (Matteo): Blocks are aligned to their size, so an over-aligned request just
+    // selects a larger class
+    Size class_size = cfMax(size, align);
+
+    if (class_size > MemSlab_MaxSize)
+    {
+        return memAllocAlign(slab->fallback, size, align);
+    }
+
+    MemSlabClass *class = slab->classes + mem_slabClassIndex(class_size);
+    U8 *block = class->free_list;
+
+    if (block)
+    {
+        // Pop from the free list
+        class->free_list = *(U8 **)block;
+    }
+    else
+    {
+        if (class->cursor == class->end)
+        {
+            // Carve a new page; aligning it to the largest block size keeps every block aligned to
+            // its own size
+            U8 *page = memArenaAllocAlign(slab->arena, MemSlab_PageSize, MemSlab_MaxSize);
+            if (!page) return NULL;
+
+            class->cursor = page;
+            class->end = page + MemSlab_PageSize;
+            class->capacity += MemSlab_PageSize / class->block_size;
+            class->pages++;
+        }
+
+        block = class->cursor;
+        class->cursor += class->block_size;
+    }
+
+    class->used++;
+
+    // NOTE (Matteo): Only the requested size must be cleared, since blocks grown in place clear
+    // the extra bytes
+    memClear(block, size);
+
+    return block;
+}
+
+void
+memSlabFree(MemSlab *slab, void *memory, Size size, Size align)
+{
+    CF_ASSERT_NOT_NULL(slab);
+
+    if (!memory) return;
+
+    Size class_size = cfMax(size, align);
+
+    if (class_size > MemSlab_MaxSize)
+    {
+        memFreeAlign(slab->fallback, memory, size, align);
+        return;
+    }
+
+    MemSlabClass *class = slab->classes + mem_slabClassIndex(class_size);
+
+    CF_ASSERT(class->used > 0, "Freeing block of an empty size class");
+    CF_ASSERT(((Size)memory & (class->block_size - 1)) == 0, "Block size mismatch");
+
+    // Push on the free list
+    *(U8 **)memory = class->free_list;
+    class->free_list = memory;
+    class->used--;
+}
+
+MemSlabStats
+memSlabClassStats(MemSlab *slab, Size class_index)
+{
+    CF_ASSERT_NOT_NULL(slab);
+    CF_ASSERT(class_index < MemSlab_ClassCount, "Invalid size class");
+
+    MemSlabClass *class = slab->classes + class_index;
+
+    return (MemSlabStats){
+        .block_size = class->block_size,
+        .pages = class->pages,
+        .used = class->used,
+        .capacity = class->capacity,
+        .occupancy = class->capacity ? (double)class->used / (double)class->capacity : 0.0,
+    };
+}
+
+static MEM_ALLOCATOR_FN(mem_slabAllocFn)
+{
+    CF_ASSERT(memory || !old_size, "Invalid allocation request");
+
+    MemSlab *slab = state;
+
+    if (!new_size)
+    {
+        memSlabFree(slab, memory, old_size, align);
+        return NULL;
+    }
+
+    if (memory)
+    {
+        Size old_class = cfMax(old_size, align);
+        Size new_class = cfMax(new_size, align);
+
+        // NOTE (Matteo): Blocks are resized in place if the size class does not change
+        if (old_class <= MemSlab_MaxSize && new_class <= MemSlab_MaxSize &&
+            mem_slabClassIndex(old_class) == mem_slabClassIndex(new_class))
+        {
+            if (new_size > old_size) memClear((U8 *)memory + old_size, new_size - old_size);
+            return memory;
+        }
+
+        if (old_class > MemSlab_MaxSize && new_class > MemSlab_MaxSize)
+        {
+            return memReallocAlign(slab->fallback, memory, old_size, new_size, align);
+        }
+    }
+
+    void *new_memory = memSlabAlloc(slab, new_size, align);
+
+    if (new_memory && memory)
+    {
+        memCopy(memory, new_memory, cfMin(old_size, new_size));
+        memSlabFree(slab, memory, old_size, align);
+    }
+
+    return new_memory;
+}
+
+MemAllocator
+memSlabAllocator(MemSlab *slab)
+{
+    return (MemAllocator){
+        .state = slab,
+        .func = mem_slabAllocFn,
+    };
+}
+
+//--------------------//
+//   Pool allocator   //
+//--------------------//
+
+// NOTE (Matteo): Free blocks are linked by index (+1, so that 0 terminates the list) through their
+// first 32 bit word; the second word links the batches in the depot, using the first block of each
+// batch as the node. Stack heads hold the version tag in the upper 32 bits.
+
+CF_STATIC_ASSERT(MemPool_MagazineSize % MemPool_BatchSize == 0, "Invalid pool batch size");
+
+#define MEM_POOL_NONE U32_MAX
+
+enum
+{
+    MemPoolLink_Next = 0,
+    MemPoolLink_Batch = 1,
+};
+
+static inline U32 volatile *
+mem_poolLinks(MemPool const *pool, U32 index)
+{
+    CF_ASSERT(index < pool->capacity, "Invalid pool block");
+    return (U32 volatile *)(pool->blocks + (Size)index * pool->block_size);
+}
+
+static inline U32
+mem_poolIndex(MemPool const *pool, void const *memory)
+{
+    CF_ASSERT(memPoolOwns(pool, memory), "Block not owned by the pool");
+    Size offset = (Size)((U8 const *)memory - pool->blocks);
+    CF_ASSERT(offset % pool->block_size == 0, "Invalid pool block");
+    return (U32)(offset / pool->block_size);
+}
+
+/// Push the chain of blocks from first to last (already linked through the given link) on a stack
+static void
+mem_poolPush(MemPool *pool, AtomU64 *stack, U32 link, U32 first, U32 last)
+{
+    U32 volatile *last_links = mem_poolLinks(pool, last);
+    U64 head = atomRead(stack);
+    U64 desired;
+
+    do
+    {
+        last_links[link] = (U32)head;
+        // Publish the link (and the content of the chain) before the new head
+        atomReleaseFence();
+        desired = (((head >> 32) + 1) << 32) | (U64)(first + 1);
+    } while (!atomCompareExchangeWeak(stack, &head, desired));
+}
+
+/// Pop a block from a stack, or return MEM_POOL_NONE if empty
+static U32
+mem_poolPop(MemPool *pool, AtomU64 *stack, U32 link)
+{
+    U64 head = atomRead(stack);
+
+    for (;;)
+    {
+        atomAcquireFence();
+
+        U32 top = (U32)head;
+        if (!top) return MEM_POOL_NONE;
+
+        // NOTE (Matteo): The top block could have been popped (and reused) by another thread in the
+        // meantime, so the link can be garbage; this is harmless since the region is never released
+        // while in use, and the tag makes the CAS fail in such case
+        U32 next = mem_poolLinks(pool, top - 1)[link];
+        U64 desired = (((head >> 32) + 1) << 32) | (U64)next;
+
+        if (atomCompareExchangeWeak(stack, &head, desired)) return top - 1;
+    }
+}
+
+/// Reserve up to count never used blocks; returns the number of reserved blocks
+static U32
+mem_poolCarve(MemPool *pool, U32 count, U32 *out_first)
+{
+    // NOTE (Matteo): Check before incrementing, so that the counter cannot wrap around when many
+    // threads keep hitting an exhausted pool
+    if (atomRead(&pool->carved) >= pool->capacity) return 0;
+
+    U32 first = atomFetchAdd(&pool->carved, count);
+    if (first >= pool->capacity) return 0;
+
+    *out_first = first;
+    return cfMin(count, pool->capacity - first);
+}
+
+static inline void *
+mem_poolBlock(MemPool *pool, U32 index)
+{
+    U8 *block = pool->blocks + (Size)index * pool->block_size;
+    memClear(block, pool->block_size);
+    return block;
+}
+
+bool
+memPoolInit(MemPool *pool, MemAllocator backing, Size block_size, Size block_align,
+            Size capacity, MemAllocator fallback)
+{
+    CF_ASSERT_NOT_NULL(pool);
+    CF_ASSERT(cfIsPowerOf2(block_align), "Alignment is not a power of 2");
+    CF_ASSERT(capacity && capacity < U32_MAX, "Invalid pool capacity");
+
+    memClearStruct(pool);
+
+    // NOTE (Matteo): Blocks must fit the two links
+    Size align = cfMax(block_align, alignof(U32));
+    Size region_align = cfMax(align, CF_MAX_ALIGN);
+    Size stride = (cfMax(block_size, 2 * sizeof(U32)) + align - 1) & ~(align - 1);
+
+    // NOTE (Matteo): Blocks can be more aligned than requested, depending on the stride; exploiting
+    // this allows to serve generic requests, which use the maximum alignment by default
+    pool->block_size = stride;
+    pool->block_align = cfMin(stride & (0 - stride), region_align);
+    pool->capacity = (U32)capacity;
+    pool->backing = backing;
+    pool->fallback = fallback;
+    pool->blocks = memAllocAlign(backing, stride * capacity, region_align);
+
+    return pool->blocks != NULL;
+}
+
+void
+memPoolShutdown(MemPool *pool)
+{
+    CF_ASSERT_NOT_NULL(pool);
+
+    if (pool->blocks)
+    {
+        memFreeAlign(pool->backing, pool->blocks, pool->block_size * pool->capacity,
+                     cfMax(pool->block_align, CF_MAX_ALIGN));
+    }
+
+    memClearStruct(pool);
+}
+
+bool
+memPoolOwns(MemPool const *pool, void const *memory)
+{
+    U8 const *bytes = memory;
+    return bytes >= pool->blocks && bytes < pool->blocks + pool->block_size * pool->capacity;
+}
+
+void *
+memPoolAlloc(MemPool *pool)
+{
+    CF_ASSERT_NOT_NULL(pool);
+
+    U32 index = mem_poolPop(pool, &pool->free_list, MemPoolLink_Next);
+    if (index != MEM_POOL_NONE) return mem_poolBlock(pool, index);
+
+    if (mem_poolCarve(pool, 1, &index)) return mem_poolBlock(pool, index);
+
+    // NOTE (Matteo): Take a whole batch spilled by a magazine, and move the remaining blocks
+    // to the free list
+    index = mem_poolPop(pool, &pool->depot, MemPoolLink_Batch);
+    if (index == MEM_POOL_NONE) return NULL;
+
+    U32 first = mem_poolLinks(pool, index)[MemPoolLink_Next];
+
+    if (first)
+    {
+        U32 last = first - 1;
+        for (U32 next; (next = mem_poolLinks(pool, last)[MemPoolLink_Next]) != 0;) last = next - 1;
+        mem_poolPush(pool, &pool->free_list, MemPoolLink_Next, first - 1, last);
+    }
+
+    return mem_poolBlock(pool, index);
+}
+
+void
+memPoolFree(MemPool *pool, void *memory)
+{
+    CF_ASSERT_NOT_NULL(pool);
+
+    if (!memory) return;
+
+    U32 index = mem_poolIndex(pool, memory);
+    mem_poolPush(pool, &pool->free_list, MemPoolLink_Next, index, index);
+}
+
+void
+memPoolMagazineInit(MemPoolMagazine *magazine, MemPool *pool)
+{
+    CF_ASSERT_NOT_NULL(magazine);
+    CF_ASSERT_NOT_NULL(pool);
+
+    magazine->pool = pool;
+    magazine->count = 0;
+}
+
+static void
+mem_poolMagazineRefill(MemPoolMagazine *magazine)
+{
+    CF_ASSERT(!magazine->count, "Refilling a non empty magazine");
+
+    MemPool *pool = magazine->pool;
+
+    // Take a batch from the depot...
+    U32 index = mem_poolPop(pool, &pool->depot, MemPoolLink_Batch);
+
+    if (index != MEM_POOL_NONE)
+    {
+        do
+        {
+            CF_ASSERT(magazine->count < MemPool_MagazineSize, "Pool batch too large");
+            magazine->blocks[magazine->count++] = index;
+            index = mem_poolLinks(pool, index)[MemPoolLink_Next] - 1;
+        } while (index != MEM_POOL_NONE);
+
+        return;
+    }
+
+    // ...or carve a batch from the region...
+    U32 count = mem_poolCarve(pool, MemPool_BatchSize, &index);
+
+    if (count)
+    {
+        // NOTE (Matteo): Store in reverse order, so that blocks are handed out in address order
+        for (U32 i = 0; i < count; ++i) magazine->blocks[i] = index + count - 1 - i;
+        magazine->count = count;
+        return;
+    }
+
+    // ...or collect single blocks from the free list
+    while (magazine->count < MemPool_BatchSize)
+    {
+        index = mem_poolPop(pool, &pool->free_list, MemPoolLink_Next);
+        if (index == MEM_POOL_NONE) break;
+        magazine->blocks[magazine->count++] = index;
+    }
+}
+
+/// Move up to a batch of blocks from the bottom of the magazine (the least recently freed ones) to
+/// the depot
+static void
+mem_poolMagazineSpill(MemPoolMagazine *magazine)
+{
+    CF_ASSERT(magazine->count, "Spilling an empty magazine");
+
+    MemPool *pool = magazine->pool;
+    U32 *batch = magazine->blocks;
+    U32 count = cfMin(magazine->count, (U32)MemPool_BatchSize);
+
+    for (U32 i = 0; i + 1 < count; ++i)
+    {
+        mem_poolLinks(pool, batch[i])[MemPoolLink_Next] = batch[i + 1] + 1;
+    }
+    mem_poolLinks(pool, batch[count - 1])[MemPoolLink_Next] = 0;
+
+    mem_poolPush(pool, &pool->depot, MemPoolLink_Batch, batch[0], batch[0]);
+
+    magazine->count -= count;
+    memCopyArray(batch + count, batch, magazine->count);
+}
+
+void *
+memPoolMagazineAlloc(MemPoolMagazine *magazine)
+{
+    CF_ASSERT_NOT_NULL(magazine);
+
+    if (!magazine->count) mem_poolMagazineRefill(magazine);
+    if (!magazine->count) return NULL;
+
+    return mem_poolBlock(magazine->pool, magazine->blocks[--magazine->count]);
+}
+
+void
+memPoolMagazineFree(MemPoolMagazine *magazine, void *memory)
+{
+    CF_ASSERT_NOT_NULL(magazine);
+
+    if (!memory) return;
+
+    U32 index = mem_poolIndex(magazine->pool, memory);
+
+    if (magazine->count == MemPool_MagazineSize) mem_poolMagazineSpill(magazine);
+
+    magazine->blocks[magazine->count++] = index;
+}
+
+void
+memPoolMagazineFlush(MemPoolMagazine *magazine)
+{
+    CF_ASSERT_NOT_NULL(magazine);
+    while (magazine->count) mem_poolMagazineSpill(magazine);
+}
+
+static void *
+mem_poolRealloc(MemPool *pool, MemPoolMagazine *magazine, void *memory, Size old_size,
+                Size new_size, Size align)
+{
+    CF_ASSERT(memory || !old_size, "Invalid allocation request");
+
+    bool owned = memory && memPoolOwns(pool, memory);
+    bool fits = new_size <= pool->block_size && align <= pool->block_align;
+
+    if (memory && !owned && (!fits || !new_size))
+    {
+        // Fallback block which stays in the fallback allocator
+        return memReallocAlign(pool->fallback, memory, old_size, new_size, align);
+    }
+
+    if (owned && fits && new_size)
+    {
+        // NOTE (Matteo): Blocks are resized in place as long as they fit
+        if (new_size > old_size) memClear((U8 *)memory + old_size, new_size - old_size);
+        return memory;
+    }
+
+    void *new_memory = NULL;
+
+    if (new_size)
+    {
+        if (fits) new_memory = magazine ? memPoolMagazineAlloc(magazine) : memPoolAlloc(pool);
+
+        if (!new_memory && pool->fallback.func)
+        {
+            new_memory = memAllocAlign(pool->fallback, new_size, align);
+        }
+
+        if (!new_memory) return NULL;
+
+        if (memory) memCopy(memory, new_memory, cfMin(old_size, new_size));
+    }
+
+    if (owned)
+    {
+        if (magazine)
+        {
+            memPoolMagazineFree(magazine, memory);
+        }
+        else
+        {
+            memPoolFree(pool, memory);
+        }
+    }
+    else if (memory)
+    {
+        memFreeAlign(pool->fallback, memory, old_size, align);
+    }
+
+    return new_memory;
+}
+
+static MEM_ALLOCATOR_FN(mem_poolAllocFn)
+{
+    return mem_poolRealloc(state, NULL, memory, old_size, new_size, align);
+}
+
+static MEM_ALLOCATOR_FN(mem_poolMagazineAllocFn)
+{
+    MemPoolMagazine *magazine = state;
+    return mem_poolRealloc(magazine->pool, magazine, memory, old_size, new_size, align);
+}
+
+MemAllocator
+memPoolAllocator(MemPool *pool)
+{
+    return (MemAllocator){
+        .state = pool,
+        .func = mem_poolAllocFn,
+    };
+}
+
+MemAllocator
+memPoolMagazineAllocator(MemPoolMagazine *magazine)
+{
+    return (MemAllocator){
+        .state = magazine,
+        .func = mem_poolMagazineAllocFn,
+    };
+}
+
+//--------------------//
+//   TLSF allocator   //
+//--------------------//
+
+// NOTE (Matteo): Block layout
+// Every block starts with a header holding the size of the block payload and a pointer to the
+// previous block in physical order (valid only if such block is free, and needed for coalescing).
+// The two lowest bits of the size are used as flags, since sizes are multiples of the alignment.
+// Free blocks use their payload to store the links of their free list.
+// Each pool is terminated by a zero-sized "sentinel" block, which is always marked as used.
+
+struct MemTlsfBlock
+{
+    MemTlsfBlock *prev_phys;
+    Size size;
+    // NOTE (Matteo): Valid only for free blocks
+    MemTlsfBlock *next_free;
+    MemTlsfBlock *prev_free;
+};
+
+enum
+{
+    MemTlsf_FreeBit = 1,
+    MemTlsf_PrevFreeBit = 2,
+    MemTlsf_FlagBits = MemTlsf_FreeBit | MemTlsf_PrevFreeBit,
+};
+
+#define MEM_TLSF_HEADER_SIZE offsetof(MemTlsfBlock, next_free)
+#define MEM_TLSF_MIN_SIZE (sizeof(MemTlsfBlock) - MEM_TLSF_HEADER_SIZE)
+#define MEM_TLSF_MAX_SIZE ((Size)1 << (MemTlsf_FlMax - 1) << 1)
+#define MEM_TLSF_SMALL_SIZE ((Size)1 << MemTlsf_FlShift)
+
+CF_STATIC_ASSERT(MEM_TLSF_HEADER_SIZE == MemTlsf_Align, "Block header must preserve alignment");
+CF_STATIC_ASSERT(MEM_TLSF_MIN_SIZE == MemTlsf_Align, "Minimum block size must be aligned");
+CF_STATIC_ASSERT(MEM_TLSF_SMALL_SIZE / MemTlsf_SlCount == MemTlsf_Align,
+                 "Small blocks must be binned by alignment");
+CF_STATIC_ASSERT(MemTlsf_SlCount <= 32, "Second level bitmap too small");
+CF_STATIC_ASSERT(MemTlsf_FlCount <= 32, "First level bitmap too small");
+
+//=== Block utilities ===//
+
+static inline Size
+mem_tlsfSize(MemTlsfBlock const *block)
+{
+    return block->size & ~(Size)MemTlsf_FlagBits;
+}
+
+static inline void
+mem_tlsfSetSize(MemTlsfBlock *block, Size size)
+{
+    block->size = size | (block->size & MemTlsf_FlagBits);
+}
+
+static inline bool
+mem_tlsfIsFree(MemTlsfBlock const *block)
+{
+    return block->size & MemTlsf_FreeBit;
+}
+
+static inline bool
+mem_tlsfIsPrevFree(MemTlsfBlock const *block)
+{
+    return block->size & MemTlsf_PrevFreeBit;
+}
+
+static inline U8 *
+mem_tlsfPayload(MemTlsfBlock *block)
+{
+    return (U8 *)block + MEM_TLSF_HEADER_SIZE;
+}
+
+static inline MemTlsfBlock *
+mem_tlsfFromPayload(void const *memory)
+{
+    return (MemTlsfBlock *)((U8 *)memory - MEM_TLSF_HEADER_SIZE);
+}
+
+static inline MemTlsfBlock *
+mem_tlsfNext(MemTlsfBlock *block)
+{
+    CF_ASSERT(mem_tlsfSize(block), "Sentinel blocks have no successor");
+    return (MemTlsfBlock *)(mem_tlsfPayload(block) + mem_tlsfSize(block));
+}
+
+/// Link the next physical block to the given one, and return it
+static inline MemTlsfBlock *
+mem_tlsfLinkNext(MemTlsfBlock *block)
+{
+    MemTlsfBlock *next = mem_tlsfNext(block);
+    next->prev_phys = block;
+    return next;
+}
+
+static inline void
+mem_tlsfMarkFree(MemTlsfBlock *block)
+{
+    MemTlsfBlock *next = mem_tlsfLinkNext(block);
+    next->size |= MemTlsf_PrevFreeBit;
+    block->size |= MemTlsf_FreeBit;
+}
+
+static inline void
+mem_tlsfMarkUsed(MemTlsfBlock *block)
+{
+    MemTlsfBlock *next = mem_tlsfNext(block);
+    next->size &= ~(Size)MemTlsf_PrevFreeBit;
+    block->size &= ~(Size)MemTlsf_FreeBit;
+}
+
+static inline Size
+mem_tlsfAlignUp(Size value, Size align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+/// Round the requested size to a valid block size (0 if the request cannot be satisfied)
+static inline Size
+mem_tlsfAdjustSize(Size size)
+{
+    if (!size || size >= MEM_TLSF_MAX_SIZE) return 0;
+    return cfMax(mem_tlsfAlignUp(size, MemTlsf_Align), MEM_TLSF_MIN_SIZE);
+}
+
+//=== Size class mapping ===//
+
+static inline void
+mem_tlsfMapInsert(Size size, U32 *fl, U32 *sl)
+{
+    if (size < MEM_TLSF_SMALL_SIZE)
+    {
+        // NOTE (Matteo): Small blocks are binned linearly in the first class
+        *fl = 0;
+        *sl = (U32)(size / (MEM_TLSF_SMALL_SIZE / MemTlsf_SlCount));
+    }
+    else
+    {
+        U32 msb = mem_BitMsb(size);
+        *sl = (U32)(size >> (msb - MemTlsf_SlCountLog2)) ^ (1 << MemTlsf_SlCountLog2);
+        *fl = msb - (MemTlsf_FlShift - 1);
+    }
+}
+
+/// Map the size to the first class whose blocks are all large enough to satisfy the request
+static inline void
+mem_tlsfMapSearch(Size size, U32 *fl, U32 *sl)
+{
+    if (size >= MEM_TLSF_SMALL_SIZE)
+    {
+        size += ((Size)1 << (mem_BitMsb(size) - MemTlsf_SlCountLog2)) - 1;
+    }
+
+    mem_tlsfMapInsert(size, fl, sl);
+}
+
+//=== Free lists ===//
+
+static void
+mem_tlsfRemoveFree(MemTlsf *tlsf, MemTlsfBlock *block, U32 fl, U32 sl)
+{
+    MemTlsfBlock *prev = block->prev_free;
+    MemTlsfBlock *next = block->next_free;
+
+    if (next) next->prev_free = prev;
+    if (prev) prev->next_free = next;
+
+    if (tlsf->free_lists[fl][sl] == block)
+    {
+        tlsf->free_lists[fl][sl] = next;
+
+        if (!next)
+        {
+            tlsf->sl_bitmap[fl] &= ~(1U << sl);
+            if (!tlsf->sl_bitmap[fl]) tlsf->fl_bitmap &= ~(1U << fl);
+        }
+    }
+}
+
+static void
+mem_tlsfInsertFree(MemTlsf *tlsf, MemTlsfBlock *block, U32 fl, U32 sl)
+{
+    MemTlsfBlock *head = tlsf->free_lists[fl][sl];
+
+    block->next_free = head;
+    block->prev_free = NULL;
+    if (head) head->prev_free = block;
+
+    tlsf->free_lists[fl][sl] = block;
+    tlsf->fl_bitmap |= 1U << fl;
+    tlsf->sl_bitmap[fl] |= 1U << sl;
+}
+
+static inline void
+mem_tlsfRemove(MemTlsf *tlsf, MemTlsfBlock *block)
+{
+    U32 fl, sl;
+    mem_tlsfMapInsert(mem_tlsfSize(block), &fl, &sl);
+    mem_tlsfRemoveFree(tlsf, block, fl, sl);
+}
+
+static inline void
+mem_tlsfInsert(MemTlsf *tlsf, MemTlsfBlock *block)
+{
+    U32 fl, sl;
+    mem_tlsfMapInsert(mem_tlsfSize(block), &fl, &sl);
+    mem_tlsfInsertFree(tlsf, block, fl, sl);
+}
+
+/// Find a free block large enough for the given (adjusted) size, and remove it from its list
+static MemTlsfBlock *
+mem_tlsfLocateFree(MemTlsf *tlsf, Size size)
+{
+    U32 fl, sl;
+    mem_tlsfMapSearch(size, &fl, &sl);
+
+    if (fl >= MemTlsf_FlCount) return NULL;
+
+    // NOTE (Matteo): Search for a non-empty list in the same first level class, and fallback to
+    // the next non-empty first level class
+    U32 sl_map = tlsf->sl_bitmap[fl] & (~0U << sl);
+
+    if (!sl_map)
+    {
+        U32 fl_map = fl + 1 < 32 ? tlsf->fl_bitmap & (~0U << (fl + 1)) : 0;
+        if (!fl_map) return NULL;
+
+        fl = mem_BitLsb(fl_map);
+        sl_map = tlsf->sl_bitmap[fl];
+    }
+
+    CF_ASSERT(sl_map, "Corrupted TLSF bitmaps");
+    sl = mem_BitLsb(sl_map);
+
+    MemTlsfBlock *block = tlsf->free_lists[fl][sl];
+    CF_ASSERT_NOT_NULL(block);
+    CF_ASSERT(mem_tlsfSize(block) >= size, "Free block is too small");
+
+    mem_tlsfRemoveFree(tlsf, block, fl, sl);
+
+    return block;
+}
+
+//=== Split and merge ===//
+
+static inline bool
+mem_tlsfCanSplit(MemTlsfBlock *block, Size size)
+{
+    return mem_tlsfSize(block) >= size + sizeof(MemTlsfBlock);
+}
+
+/// Split the block at the given size, returning the remaining (free) block
+static MemTlsfBlock *
+mem_tlsfSplit(MemTlsfBlock *block, Size size)
+{
+    MemTlsfBlock *remaining = (MemTlsfBlock *)(mem_tlsfPayload(block) + size);
+    Size remaining_size = mem_tlsfSize(block) - size - MEM_TLSF_HEADER_SIZE;
+
+    CF_ASSERT(remaining_size >= MEM_TLSF_MIN_SIZE, "Block split is too small");
+
+    remaining->size = remaining_size;
+    mem_tlsfSetSize(block, size);
+    mem_tlsfMarkFree(remaining);
+
+    return remaining;
+}
+
+/// Merge the block into its previous (free) block, which is returned
+static MemTlsfBlock *
+mem_tlsfAbsorb(MemTlsfBlock *prev, MemTlsfBlock *block)
+{
+    prev->size += mem_tlsfSize(block) + MEM_TLSF_HEADER_SIZE;
+    mem_tlsfLinkNext(prev);
+    return prev;
+}
+
+static MemTlsfBlock *
+mem_tlsfMergePrev(MemTlsf *tlsf, MemTlsfBlock *block)
+{
+    if (mem_tlsfIsPrevFree(block))
+    {
+        MemTlsfBlock *prev = block->prev_phys;
+        CF_ASSERT(mem_tlsfIsFree(prev), "Inconsistent free flags");
+        mem_tlsfRemove(tlsf, prev);
+        block = mem_tlsfAbsorb(prev, block);
+    }
+
+    return block;
+}
+
+static MemTlsfBlock *
+mem_tlsfMergeNext(MemTlsf *tlsf, MemTlsfBlock *block)
+{
+    MemTlsfBlock *next = mem_tlsfNext(block);
+
+    if (mem_tlsfIsFree(next))
+    {
+        mem_tlsfRemove(tlsf, next);
+        block = mem_tlsfAbsorb(block, next);
+    }
+
+    return block;
+}
+
+/// Trim the excess of a free block, returning it to the free lists
+static void
+mem_tlsfTrimFree(MemTlsf *tlsf, MemTlsfBlock *block, Size size)
+{
+    CF_ASSERT(mem_tlsfIsFree(block), "Block must be free");
+
+    if (mem_tlsfCanSplit(block, size))
+    {
+        MemTlsfBlock *remaining = mem_tlsfSplit(block, size);
+        mem_tlsfLinkNext(block);
+        remaining->size |= MemTlsf_PrevFreeBit;
+        mem_tlsfInsert(tlsf, remaining);
+    }
+}
+
+/// Trim the excess of a used block, returning it to the free lists
+static void
+mem_tlsfTrimUsed(MemTlsf *tlsf, MemTlsfBlock *block, Size size)
+{
+    CF_ASSERT(!mem_tlsfIsFree(block), "Block must be used");
+
+    if (mem_tlsfCanSplit(block, size))
+    {
+        MemTlsfBlock *remaining = mem_tlsfSplit(block, size);
+        remaining->size &= ~(Size)MemTlsf_PrevFreeBit;
+        remaining = mem_tlsfMergeNext(tlsf, remaining);
+        mem_tlsfInsert(tlsf, remaining);
+    }
+}
+
+/// Split a leading gap off a free block, returning it to the free lists
+static MemTlsfBlock *
+mem_tlsfTrimFreeLeading(MemTlsf *tlsf, MemTlsfBlock *block, Size gap)
+{
+    MemTlsfBlock *remaining = block;
+
+    if (mem_tlsfCanSplit(block, gap - MEM_TLSF_HEADER_SIZE))
+    {
+        remaining = mem_tlsfSplit(block, gap - MEM_TLSF_HEADER_SIZE);
+        remaining->size |= MemTlsf_PrevFreeBit;
+        mem_tlsfLinkNext(block);
+        mem_tlsfInsert(tlsf, block);
+    }
+
+    return remaining;
+}
+
+//=== Pools ===//
+
+static void
+mem_tlsfInitState(MemTlsf *tlsf)
+{
+    CF_ASSERT_NOT_NULL(tlsf);
+    memClearStruct(tlsf);
+}
+
+void
+memTlsfInit(MemTlsf *tlsf, void *block, Size block_size)
+{
+    mem_tlsfInitState(tlsf);
+    memTlsfAddPool(tlsf, block, block_size);
+}
+
+void
+memTlsfInitOnArena(MemTlsf *tlsf, MemArena *arena, Size grow_size)
 {
     CF_ASSERT_NOT_NULL(arena);
-    CF_ASSERT((align & (align - 1)) == 0, "Alignment is not a power of 2");
 
-    U8 *block = memory;
-    U8 const *block_end = block + old_size;
-    U8 const *alloc_end = arena->memory + arena->allocated;
-    U8 const *arena_end = arena->memory + arena->reserved;
+    mem_tlsfInitState(tlsf);
+    tlsf->arena = arena;
+    tlsf->grow_size = grow_size;
+}
+
+bool
+memTlsfAddPool(MemTlsf *tlsf, void *block, Size block_size)
+{
+    CF_ASSERT_NOT_NULL(tlsf);
+
+    U8 *pool_beg = (U8 *)mem_tlsfAlignUp((Size)block, MemTlsf_Align);
+    U8 *pool_end = (U8 *)block + block_size;
+
+    // NOTE (Matteo): Room for the header of the free block and for the sentinel
+    if (pool_end < pool_beg + 2 * MEM_TLSF_HEADER_SIZE + MEM_TLSF_MIN_SIZE) return false;
+
+    Size size = (Size)(pool_end - pool_beg) - 2 * MEM_TLSF_HEADER_SIZE;
+    size &= ~((Size)MemTlsf_Align - 1);
+
+    if (size >= MEM_TLSF_MAX_SIZE)
+    {
+        CF_ASSERT(false, "Pool is too large");
+        return false;
+    }
+
+    MemTlsfBlock *free_block = NULL;
+
+    if (tlsf->last_sentinel && (U8 *)tlsf->last_sentinel + MEM_TLSF_HEADER_SIZE == pool_beg)
+    {
+        // NOTE (Matteo): The pool is contiguous with the last one, so its sentinel is recycled as
+        // header of the new free block (which can then be merged with a free predecessor)
+        free_block = tlsf->last_sentinel;
+        free_block->size = (free_block->size & MemTlsf_PrevFreeBit) | (size + MEM_TLSF_HEADER_SIZE);
+    }
+    else
+    {
+        free_block = (MemTlsfBlock *)pool_beg;
+        free_block->prev_phys = NULL;
+        free_block->size = size;
+    }
+
+    // Setup the sentinel
+    MemTlsfBlock *sentinel = mem_tlsfLinkNext(free_block);
+    sentinel->size = 0;
+    tlsf->last_sentinel = sentinel;
+
+    mem_tlsfMarkFree(free_block);
+    free_block = mem_tlsfMergePrev(tlsf, free_block);
+    mem_tlsfInsert(tlsf, free_block);
+
+    tlsf->pool_size += (Size)(pool_end - pool_beg);
+
+    return true;
+}
+
+static bool
+mem_tlsfGrow(MemTlsf *tlsf, Size size)
+{
+    if (!tlsf->arena) return false;
+
+    // NOTE (Matteo): Account for the rounding applied by the class search, for the block and
+    // sentinel headers and for an alignment gap
+    size += (size >> MemTlsf_SlCountLog2) + 3 * MEM_TLSF_HEADER_SIZE;
+    Size pool_size = cfMax(tlsf->grow_size, size);
+    void *pool = memArenaAllocAlign(tlsf->arena, pool_size, MemTlsf_Align);
+
+    return pool && memTlsfAddPool(tlsf, pool, pool_size);
+}
+
+//=== Public API ===//
+
+static MemTlsfBlock *
+mem_tlsfLocateAligned(MemTlsf *tlsf, Size size, Size align)
+{
+    if (align <= MemTlsf_Align) return mem_tlsfLocateFree(tlsf, size);
+
+    // NOTE (Matteo): Over-allocate so that a properly aligned block can be carved out, with a
+    // leading gap large enough to be a free block on its own
+    Size const gap_min = sizeof(MemTlsfBlock);
+    Size search_size = mem_tlsfAdjustSize(size + align + gap_min);
+    if (!search_size) return NULL;
 
-    U8 *result = NULL;
+    MemTlsfBlock *block = mem_tlsfLocateFree(tlsf, search_size);
+    if (!block) return NULL;
 
-    if (!block)
-    {
-        // New allocation
-        CF_ASSERT(old_size == 0, "Allocating new block but old size given");
-        result = memArenaAllocAlign(arena, new_size, align);
-    }
-    else if (arena->memory <= block && block <= arena_end)
+    Size payload = (Size)mem_tlsfPayload(block);
+    Size aligned = mem_tlsfAlignUp(payload, align);
+    Size gap = aligned - payload;
+
+    if (gap && gap < gap_min)
     {
-        // The given block is in bounds; if it matches the last allocation it
-        // can be expanded, otherwise a new allocation is performed
-        if (block_end == alloc_end && block_end - old_size + new_size < arena_end)
-        {
-            arena->allocated += new_size - old_size;
-            result = block;
-            if (new_size > old_size)
-            {
-                mem_arenaCommitVMem(arena);
-                memClear(result + old_size, new_size - old_size);
-            }
-        }
-        else
-        {
-            result = memArenaAllocAlign(arena, new_size, align);
-            if (result) memCopy(memory, result, cfMin(old_size, new_size));
-        }
+        aligned = mem_tlsfAlignUp(aligned + cfMax(gap_min - gap, align), align);
+        gap = aligned - payload;
     }
-    else
+
+    // NOTE (Matteo): The block must be temporarily marked as free to split it
+    if (gap) block = mem_tlsfTrimFreeLeading(tlsf, block, gap);
+
+    CF_ASSERT(((Size)mem_tlsfPayload(block) & (align - 1)) == 0, "Block not aligned");
+
+    return block;
+}
+
+void *
+memTlsfAlloc(MemTlsf *tlsf, Size size, Size align)
+{
+    CF_ASSERT_NOT_NULL(tlsf);
+    CF_ASSERT(cfIsPowerOf2(align), "Alignment is not a power of 2");
+
+    Size block_size = mem_tlsfAdjustSize(size);
+    if (!block_size) return NULL;
+
+    MemTlsfBlock *block = mem_tlsfLocateAligned(tlsf, block_size, align);
+
+    if (!block && mem_tlsfGrow(tlsf, block_size + (align > MemTlsf_Align ? align : 0) +
+                                         2 * sizeof(MemTlsfBlock)))
     {
-        CF_ASSERT(false, "Block is out of arena bounds");
+        block = mem_tlsfLocateAligned(tlsf, block_size, align);
     }
 
-    return result;
+    if (!block) return NULL;
+
+    mem_tlsfTrimFree(tlsf, block, block_size);
+    mem_tlsfMarkUsed(block);
+
+    tlsf->used_size += mem_tlsfSize(block) + MEM_TLSF_HEADER_SIZE;
+
+    U8 *memory = mem_tlsfPayload(block);
+    memClear(memory, size);
+
+    return memory;
 }
 
 void
-memArenaFree(MemArena *arena, void *memory, Size size)
+memTlsfFree(MemTlsf *tlsf, void *memory)
 {
-    CF_ASSERT_NOT_NULL(arena);
+    CF_ASSERT_NOT_NULL(tlsf);
 
-    U8 const *block = memory;
-    U8 const *block_end = block + size;
-    U8 const *alloc_end = arena->memory + arena->allocated;
-    U8 const *arena_end = arena->memory + arena->reserved;
+    if (!memory) return;
 
-    if (!block)
+    MemTlsfBlock *block = mem_tlsfFromPayload(memory);
+    CF_ASSERT(!mem_tlsfIsFree(block), "Block already freed");
+
+    tlsf->used_size -= mem_tlsfSize(block) + MEM_TLSF_HEADER_SIZE;
+
+    mem_tlsfMarkFree(block);
+    block = mem_tlsfMergePrev(tlsf, block);
+    block = mem_tlsfMergeNext(tlsf, block);
+    mem_tlsfInsert(tlsf, block);
+}
+
+void *
+memTlsfRealloc(MemTlsf *tlsf, void *memory, Size old_size, Size new_size, Size align)
+{
+    CF_ASSERT_NOT_NULL(tlsf);
+
+    if (!memory) return memTlsfAlloc(tlsf, new_size, align);
+
+    if (!new_size)
     {
-        CF_ASSERT(size == 0, "Freeing null block but size given");
+        memTlsfFree(tlsf, memory);
+        return NULL;
     }
-    else if (arena->memory <= block && block <= arena_end)
+
+    MemTlsfBlock *block = mem_tlsfFromPayload(memory);
+    MemTlsfBlock *next = mem_tlsfNext(block);
+
+    Size curr_size = mem_tlsfSize(block);
+    Size block_size = mem_tlsfAdjustSize(new_size);
+
+    CF_ASSERT(!mem_tlsfIsFree(block), "Block already freed");
+    CF_ASSERT(old_size <= curr_size, "Invalid block size");
+
+    if (!block_size) return NULL;
+
+    if (block_size > curr_size &&
+        (!mem_tlsfIsFree(next) ||
+         block_size > curr_size + mem_tlsfSize(next) + MEM_TLSF_HEADER_SIZE))
     {
-        // Memory management is LIFO, so only the last allocated block can be freed
-        if (block_end == alloc_end)
+        // NOTE (Matteo): The block cannot be grown in place, so move it
+        void *new_memory = memTlsfAlloc(tlsf, new_size, align);
+
+        if (new_memory)
         {
-            arena->allocated -= size;
-#if CF_MEMORY_PROTECTION
-            // NOTE (Matteo): Decommit unused memory to trigger access violations
-            mem_arenaDecommitVm(arena);
-#endif
+            memCopy(memory, new_memory, cfMin(old_size, new_size));
+            memTlsfFree(tlsf, memory);
         }
+
+        return new_memory;
     }
-    else
+
+    tlsf->used_size -= curr_size + MEM_TLSF_HEADER_SIZE;
+
+    if (block_size > curr_size)
     {
-        CF_ASSERT(false, "Block is out of arena bounds");
+        // NOTE (Matteo): Grow in place by absorbing the next free block
+        mem_tlsfMergeNext(tlsf, block);
+        mem_tlsfMarkUsed(block);
     }
+
+    mem_tlsfTrimUsed(tlsf, block, block_size);
+
+    tlsf->used_size += mem_tlsfSize(block) + MEM_TLSF_HEADER_SIZE;
+
+    if (new_size > old_size) memClear((U8 *)memory + old_size, new_size - old_size);
+
+    return memory;
 }
 
-MemArenaState
-memArenaSave(MemArena *arena)
+Size
+memTlsfBlockSize(void *memory)
 {
-    CF_ASSERT_NOT_NULL(arena);
-    return (MemArenaState){
-        .arena = arena,
-        .allocated = arena->allocated,
-        .stack_id = ++arena->save_stack,
-    };
+    return memory ? mem_tlsfSize(mem_tlsfFromPayload(memory)) : 0;
 }
 
-void
-memArenaRestore(MemArenaState state)
+bool
+memTlsfCheck(MemTlsf *tlsf)
 {
-    MemArena *arena = state.arena;
+    CF_ASSERT_NOT_NULL(tlsf);
 
-    CF_ASSERT_NOT_NULL(arena);
-    CF_ASSERT(arena->save_stack == state.stack_id, "Restoring invalid state");
-    CF_ASSERT(arena->allocated >= state.allocated, "Restoring invalid state");
+    for (U32 fl = 0; fl < MemTlsf_FlCount; ++fl)
+    {
+        bool fl_set = tlsf->fl_bitmap & (1U << fl);
+        if (fl_set != (tlsf->sl_bitmap[fl] != 0)) return false;
 
-    arena->allocated = state.allocated;
-    arena->save_stack--;
+        for (U32 sl = 0; sl < MemTlsf_SlCount; ++sl)
+        {
+            MemTlsfBlock *block = tlsf->free_lists[fl][sl];
+            bool sl_set = tlsf->sl_bitmap[fl] & (1U << sl);
 
-#if CF_MEMORY_PROTECTION
-    // NOTE (Matteo): Decommit unused memory to trigger access violations
-    mem_arenaDecommitVm(arena);
-#endif
+            if (sl_set != (block != NULL)) return false;
+
+            for (; block; block = block->next_free)
+            {
+                U32 block_fl, block_sl;
+                mem_tlsfMapInsert(mem_tlsfSize(block), &block_fl, &block_sl);
+
+                MemTlsfBlock *next = mem_tlsfNext(block);
+
+                // NOTE (Matteo): Free blocks must be in the proper list, and fully coalesced
+                if (!mem_tlsfIsFree(block) || mem_tlsfIsPrevFree(block) || mem_tlsfIsFree(next) ||
+                    !mem_tlsfIsPrevFree(next) || next->prev_phys != block ||
+                    block_fl != fl || block_sl != sl ||
+                    (block->next_free && block->next_free->prev_free != block))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
 }
 
-bool
-memArenaSplit(MemArena *arena, MemArena *split, Size size)
+static MEM_ALLOCATOR_FN(mem_tlsfAllocFn)
 {
-    CF_ASSERT(!split->memory, "split is expected to be 0-initialized");
+    CF_ASSERT(memory || !old_size, "Invalid allocation request");
+    return memTlsfRealloc(state, memory, old_size, new_size, align);
+}
 
-    if (size > arena->reserved) return false;
+MemAllocator
+memTlsfAllocator(MemTlsf *tlsf)
+{
+    return (MemAllocator){
+        .state = tlsf,
+        .func = mem_tlsfAllocFn,
+    };
+}
 
-    Size new_reserved = arena->reserved - size;
+//-------------------------//
+//   Allocation profiler   //
+//-------------------------//
 
-    if (arena->vmem)
+#if CF_COMPILER_MSVC
+#    define MEM_RETURN_ADDRESS() _ReturnAddress()
+#else
+#    define MEM_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+/// Header stored in front of each profiled block
+typedef struct MemProfilerHeader
+{
+    MemProfilerSite *site;
+    Size offset; // Offset of the header end from the start of the backing block
+} MemProfilerHeader;
+
+void
+memProfilerInit(MemProfiler *profiler, MemAllocator backing)
+{
+    CF_ASSERT_NOT_NULL(profiler);
+    CF_ASSERT_NOT_NULL(backing.func);
+
+    memClearStruct(profiler);
+    profiler->backing = backing;
+}
+
+static MemProfilerSite *
+mem_profilerFindSite(MemProfiler *profiler, void *callsite)
+{
+    // NOTE (Matteo): Open addressing with linear probing; slots are claimed with a CAS on the key
+    // and never released, so lookups need no synchronization beyond the key itself
+    Size hash = ((Size)callsite >> 2) * 0x9E3779B97F4A7C15ull;
+    Size index = hash >> (sizeof(Size) * 8 - 9);
+
+    CF_STATIC_ASSERT(MemProfiler_MaxSites == 512, "Hash must be updated with the table size");
+
+    for (Size probe = 0; probe < MemProfiler_MaxSites; ++probe)
     {
-        // NOTE (Matteo): When VM is involved, split must occur on page boundaries
-        Size new_end = (Size)(arena->memory + new_reserved);
-        Size modulo = new_end & (arena->vmem->page_size - 1);
-        new_reserved -= modulo;
-    }
+        MemProfilerSite *site = profiler->sites + ((index + probe) & (MemProfiler_MaxSites - 1));
+        void *key = atomRead(&site->callsite);
 
-    if (new_reserved < arena->allocated) return false;
+        if (key == callsite) return site;
 
-    split->vmem = arena->vmem;
-    split->memory = arena->memory + new_reserved;
-    split->reserved = arena->reserved - new_reserved;
-    split->allocated = 0;
-    split->committed = 0;
-    split->save_stack = 0;
+        if (!key)
+        {
+            // NOTE (Matteo): A strong CAS is required, since a spurious failure would move on to
+            // the next slot and could store the same call site twice
+            void *found = atomCompareExchangePtr(&site->callsite, NULL, callsite);
+            if (!found || found == callsite) return site;
+        }
+    }
 
-    if (arena->vmem && arena->committed > new_reserved)
+    return &profiler->overflow;
+}
+
+static inline void
+mem_profilerUpdatePeak(AtomSize *peak, Size value)
+{
+    Size curr = atomRead(peak);
+    while (value > curr && !atomCompareExchangeWeak(peak, &curr, value))
     {
-        split->committed = arena->committed - new_reserved;
-        arena->committed = new_reserved;
     }
+}
 
-    arena->reserved = new_reserved;
+static void
+mem_profilerRecordAlloc(MemProfiler *profiler, MemProfilerSite *site, Size size)
+{
+    U32 bin = size ? cfMin(mem_BitMsb(size), MemProfiler_HistogramBins - 1) : 0;
 
-    return true;
+    atomFetchAdd(&site->bytes, size);
+    atomFetchInc(&site->histogram[bin]);
+    mem_profilerUpdatePeak(&site->peak, atomFetchAdd(&site->live, size) + size);
+    mem_profilerUpdatePeak(&profiler->peak, atomFetchAdd(&profiler->live, size) + size);
 }
 
-static MEM_ALLOCATOR_FN(mem_arenaAllocFn)
+static void
+mem_profilerRecordFree(MemProfiler *profiler, MemProfilerSite *site, Size size)
+{
+    atomFetchInc(&site->frees);
+    atomFetchSub(&site->live, size);
+    atomFetchSub(&profiler->live, size);
+}
+
+static void *
+mem_profilerRealloc(MemProfiler *profiler, void *memory, Size old_size, Size new_size, Size align,
+                    void *callsite)
 {
     CF_ASSERT(memory || !old_size, "Invalid allocation request");
 
-    MemArena *arena = state;
-    void *new_memory = NULL;
+    MemAllocator backing = profiler->backing;
 
-    if (new_size)
+    // NOTE (Matteo): The header is padded to the requested alignment, so that the user block is
+    // still properly aligned
+    Size header_size = cfMax(align, sizeof(MemProfilerHeader));
+
+    U8 *old_block = NULL;
+    MemProfilerHeader header = {0};
+
+    if (memory)
     {
-        new_memory = memArenaReallocAlign(arena, memory, old_size, new_size, align);
+        memCopy((U8 *)memory - sizeof(header), &header, sizeof(header));
+        old_block = (U8 *)memory - header.offset;
+        CF_ASSERT(header.offset == header_size, "Alignment mismatch between allocation and free");
+        mem_profilerRecordFree(profiler, header.site, old_size);
+    }
+
+    if (!new_size)
+    {
+        backing.func(backing.state, old_block, old_size + header.offset, 0, align);
+        return NULL;
+    }
+
+    MemProfilerSite *site = mem_profilerFindSite(profiler, callsite);
+
+    if (memory)
+    {
+        // NOTE (Matteo): The free recorded above is accounted as part of the reallocation
+        atomFetchDec(&header.site->frees);
+        atomFetchInc(&site->reallocs);
     }
     else
     {
-        memArenaFree(arena, memory, old_size);
+        atomFetchInc(&site->allocs);
     }
 
-    return new_memory;
+    U8 *new_block = backing.func(backing.state, old_block, old_size + header_size,
+                                 new_size + header_size, align);
+
+    if (!new_block)
+    {
+        // NOTE (Matteo): The old block is still valid in case of failed reallocation
+        if (memory)
+        {
+            atomFetchAdd(&header.site->live, old_size);
+            atomFetchAdd(&profiler->live, old_size);
+        }
+        return NULL;
+    }
+
+    mem_profilerRecordAlloc(profiler, site, new_size);
+
+    header.site = site;
+    header.offset = header_size;
+
+    U8 *result = new_block + header_size;
+    memCopy(&header, result - sizeof(header), sizeof(header));
+
+    return result;
+}
+
+static MEM_ALLOCATOR_FN(mem_profilerAllocFn)
+{
+    return mem_profilerRealloc(state, memory, old_size, new_size, align, MEM_RETURN_ADDRESS());
+}
+
+void *
+memProfilerAlloc(MemProfiler *profiler, Size size, Size align)
+{
+    return mem_profilerRealloc(profiler, NULL, 0, size, align, MEM_RETURN_ADDRESS());
+}
+
+void *
+memProfilerRealloc(MemProfiler *profiler, void *memory, Size old_size, Size new_size, Size align)
+{
+    return mem_profilerRealloc(profiler, memory, old_size, new_size, align, MEM_RETURN_ADDRESS());
+}
+
+void
+memProfilerFree(MemProfiler *profiler, void *memory, Size size, Size align)
+{
+    mem_profilerRealloc(profiler, memory, size, 0, align, MEM_RETURN_ADDRESS());
 }
 
 MemAllocator
-memArenaAllocator(MemArena *arena)
+memProfilerAllocator(MemProfiler *profiler)
 {
     return (MemAllocator){
-        .state = arena,
-        .func = mem_arenaAllocFn,
+        .state = profiler,
+        .func = mem_profilerAllocFn,
     };
 }
+
+static Size
+mem_profilerSortKey(MemProfilerEntry const *entry, MemProfilerSort sort)
+{
+    switch (sort)
+    {
+        case MemProfilerSort_Live: return entry->live;
+        case MemProfilerSort_Peak: return entry->peak;
+        case MemProfilerSort_Bytes: return entry->bytes;
+        case MemProfilerSort_Count: return entry->allocs + entry->reallocs;
+        default: CF_INVALID_CODE_PATH(); return 0;
+    }
+}
+
+static void
+mem_profilerReadSite(MemProfilerSite *site, MemProfilerEntry *entry)
+{
+    entry->callsite = atomRead(&site->callsite);
+    entry->allocs = atomRead(&site->allocs);
+    entry->reallocs = atomRead(&site->reallocs);
+    entry->frees = atomRead(&site->frees);
+    entry->bytes = atomRead(&site->bytes);
+    entry->live = atomRead(&site->live);
+    entry->peak = atomRead(&site->peak);
+
+    for (Size bin = 0; bin < MemProfiler_HistogramBins; ++bin)
+    {
+        entry->histogram[bin] = atomRead(&site->histogram[bin]);
+    }
+}
+
+Size
+memProfilerSnapshot(MemProfiler *profiler, MemProfilerSort sort, MemProfilerEntry *entries,
+                    Size max_entries)
+{
+    CF_ASSERT_NOT_NULL(profiler);
+
+    Size count = 0;
+
+    for (Size index = 0; index <= MemProfiler_MaxSites && max_entries; ++index)
+    {
+        MemProfilerSite *site =
+            index < MemProfiler_MaxSites ? profiler->sites + index : &profiler->overflow;
+
+        MemProfilerEntry entry;
+        mem_profilerReadSite(site, &entry);
+
+        if (!entry.allocs && !entry.reallocs) continue;
+
+        // NOTE (Matteo): Insertion sort of the top entries, which are expected to be few
+        Size key = mem_profilerSortKey(&entry, sort);
+        Size pos = count;
+
+        while (pos && mem_profilerSortKey(entries + pos - 1, sort) < key) --pos;
+
+        if (pos < max_entries)
+        {
+            if (count < max_entries) ++count;
+            for (Size i = count - 1; i > pos; --i) entries[i] = entries[i - 1];
+            entries[pos] = entry;
+        }
+    }
+
+    return count;
+}
+
+void
+memProfilerDump(MemProfiler *profiler, MemProfilerSort sort, Size max_entries, CfLog *log)
+{
+    CF_ASSERT_NOT_NULL(log);
+
+    MemProfilerEntry entries[MemProfiler_ReportMax];
+    Size count = memProfilerSnapshot(profiler, sort, entries,
+                                     cfMin(max_entries, CF_ARRAY_SIZE(entries)));
+
+    cfLogAppendF(log, "Allocation profile - live %zu bytes, peak %zu bytes\n",
+                 atomRead(&profiler->live), atomRead(&profiler->peak));
+    cfLogAppendF(log, "%-18s %10s %10s %10s %14s %14s %14s\n", "call site", "allocs", "reallocs",
+                 "frees", "bytes", "live", "peak");
+
+    for (Size index = 0; index < count; ++index)
+    {
+        MemProfilerEntry const *entry = entries + index;
+
+        if (entry->callsite)
+        {
+            cfLogAppendF(log, "%-18p ", entry->callsite);
+        }
+        else
+        {
+            cfLogAppendF(log, "%-18s ", "(overflow)");
+        }
+
+        cfLogAppendF(log, "%10zu %10zu %10zu %14zu %14zu %14zu\n", entry->allocs, entry->reallocs,
+                     entry->frees, entry->bytes, entry->live, entry->peak);
+
+        cfLogAppendC(log, "    sizes:");
+
+        for (Size bin = 0; bin < MemProfiler_HistogramBins; ++bin)
+        {
+            if (entry->histogram[bin])
+            {
+                cfLogAppendF(log, " %s%zu:%zu", bin + 1 == MemProfiler_HistogramBins ? ">=" : "",
+                             (Size)1 << bin, entry->histogram[bin]);
+            }
+        }
+
+        cfLogAppendC(log, "\n");
+    }
+}
+
@@ -3,6 +3,7 @@
 /// Foundation memory services
 /// This is not an API header, include it in implementation files only
 
+#include "atom.h"
 #include "core.h"
 
 //----------------------------//
@@ -22,6 +23,23 @@ CF_API void memCopySafe(void const *from, Size from_size, void *to, Size to_size
 #define memCopyArray(from, to, count) \
     (CF_SAME_TYPE(*(from), *(to)), memCopy(from, to, (count) * sizeof(*(from))))
 
+//=== Streaming Write/Copy ===//
+
+// NOTE (Matteo): The streaming variants are meant for large buffers which are not going to be read
+// back soon (e.g. staging copies for GPU uploads): sizes above a threshold are written with
+// non-temporal stores, which bypass the cache and avoid evicting the working set of the caller
+// and of the other cores. Smaller sizes are forwarded to the regular functions.
+
+/// Size above which the streaming functions use non-temporal stores
+CF_API Size memStreamThreshold(void);
+/// Tune the streaming threshold; not thread safe, meant to be called at startup
+CF_API void memStreamSetThreshold(Size threshold);
+
+CF_API void memStreamClear(void *mem, Size count);
+CF_API void memStreamWrite(U8 *mem, U8 value, Size count);
+/// Streaming copy; source and destination must not overlap
+CF_API void memStreamCopy(void const *from, void *to, Size count);
+
 //=== Comparison ===//
 
 CF_API I32 memCompare(void const *left, void const *right, Size count);
@@ -31,6 +49,24 @@ CF_API bool memMatch(void const *left, void const *right, Size count);
 #define memMatchArray(a, b, count) \
     (CF_SAME_TYPE(*(a), *(b)), memMatch(a, b, (count) * sizeof(*(a))))
 
+//=== SIMD dispatch ===//
+
+/// Instruction sets used by the basic memory utilities
+typedef enum MemSimd
+{
+    MemSimd_None = 0, // Plain libc calls
+    MemSimd_Sse2,
+    MemSimd_Avx2,
+} MemSimd;
+
+/// Instruction set currently used by the basic memory utilities; the best one supported by the
+/// CPU is selected through cpuid on first use
+CF_API MemSimd memSimdLevel(void);
+
+/// Force the given instruction set, clamped to the ones supported by the CPU (mainly useful for
+/// testing and benchmarking); returns the instruction set actually selected
+CF_API MemSimd memSimdSelect(MemSimd level);
+
 //=== Alignment ===//
 
 U8 const *memAlignForward(U8 const *address, Size alignment);
@@ -47,6 +83,11 @@ CF_INLINE_API void *memReallocAlign(MemAllocator a, void *mem, Size old_size, Si
 CF_INLINE_API void memFree(MemAllocator a, void *mem, Size size);
 CF_INLINE_API void memFreeAlign(MemAllocator a, void *mem, Size size, Size align);
 
+/// Allocate a block aligned to the cache line, with its size rounded up to a multiple of it, so
+/// that no cache line is shared with other blocks (avoids false sharing between threads)
+CF_INLINE_API void *memAllocCacheAligned(MemAllocator a, Size size);
+CF_INLINE_API void memFreeCacheAligned(MemAllocator a, void *mem, Size size);
+
 // NOTE (Matteo): Those are the very basics required to implement a dynamic array
 // and are offered in case the full-fledged MemBuffer is not needed or suitable.
 #if CF_COMPILER_CLANG
@@ -82,15 +123,19 @@ CF_INLINE_API void memFreeAlign(MemAllocator a, void *mem, Size size, Size align
 // NOTE (Matteo): The implementation of this API must be provided by the platform layer
 // TODO (Matteo): Improve mirror buffer API (and naming)
 
-#define VMEM_RESERVE_FN(name) void *name(Size size)
+#define VMEM_RESERVE_FN(name) void *name(Size size, VMemFlags flags)
 #define VMEM_RELEASE_FN(name) void name(void *memory, Size size)
 
-#define VMEM_COMMIT_FN(name) bool name(void *memory, Size size)
+#define VMEM_COMMIT_FN(name) bool name(void *memory, Size size, VMemFlags flags)
 #define VMEM_DECOMMIT_FN(name) void name(void *memory, Size size)
 
 #define VMEM_MIRROR_ALLOCATE_FN(name) VMemMirrorBuffer name(Size size)
 #define VMEM_MIRROR_FREE_FN(name) void name(VMemMirrorBuffer *buffer)
 
+#define VMEM_FILE_MAP_FN(name) VMemFileMap name(Str path, Size size)
+#define VMEM_FILE_UNMAP_FN(name) void name(VMemFileMap *map)
+#define VMEM_FILE_FLUSH_FN(name) bool name(VMemFileMap *map, void *memory, Size size)
+
 /// Buffer built upon two adjacent virtual memory blocks that map to the same physical memory.
 /// The memory is thus "mirrored" between the two blocks, hence the name.
 /// Access is safe in the range [0, 2 * size), where the memory in [0, size) is exactly the same as
@@ -105,6 +150,37 @@ typedef struct VMemMirrorBuffer
     void *os_handle;
 } VMemMirrorBuffer;
 
+/// Shared, writable view of a whole file, which is created if missing and grown to the requested
+/// size (the content of the grown portion is zero)
+typedef struct VMemFileMap
+{
+    // Size of the view, which is the greater of the requested size and the original file size
+    Size size;
+    // Size of the file before mapping (0 if just created)
+    Size file_size;
+    // Pointer to start of the view
+    void *data;
+    // OS specific handle
+    void *os_handle;
+} VMemFileMap;
+
+/// Optional behaviours of a single reservation, honoured by the platform layer where supported.
+/// The same flags must be given when reserving the block and when committing its pages.
+typedef U32 VMemFlags;
+enum VMemFlags_
+{
+    VMemFlags_None = 0,
+    /// Advise the OS to back reserved blocks with transparent huge pages
+    VMemFlags_TransparentHugePages = 1,
+    /// Back reserved blocks with pages from the explicit huge page pool; pages are claimed from
+    /// the pool when committed, falling back to regular pages if it is exhausted
+    VMemFlags_ExplicitHugePages = 2,
+    /// Fault in committed pages eagerly, instead of on first access
+    VMemFlags_Prefault = 4,
+
+    VMemFlags_HugePages = VMemFlags_TransparentHugePages | VMemFlags_ExplicitHugePages,
+};
+
 /// Virtual memory access API
 typedef struct VMemApi
 {
@@ -123,18 +199,41 @@ typedef struct VMemApi
     // Release a "mirror buffer"
     VMEM_MIRROR_FREE_FN((*mirrorFree));
 
+    // Map a file in memory (the returned view has null data in case of failure)
+    VMEM_FILE_MAP_FN((*fileMap));
+    // Unmap a file view
+    VMEM_FILE_UNMAP_FN((*fileUnmap));
+    // Write back a modified portion of a file view to disk, waiting for completion
+    VMEM_FILE_FLUSH_FN((*fileFlush));
+
     Size page_size;
     Size address_granularity;
+    /// Size of a huge page, 0 if not supported by the platform
+    Size huge_page_size;
 } VMemApi;
 
-#define vmemReserve(vmem, size) (vmem)->reserve(size)
+#define vmemReserve(vmem, size) (vmem)->reserve(size, VMemFlags_None)
+#define vmemReserveEx(vmem, size, flags) (vmem)->reserve(size, flags)
 #define vmemRelease(vmem, mem, size) (vmem)->release(mem, size)
-#define vmemCommit(vmem, mem, size) (vmem)->commit(mem, size)
+#define vmemCommit(vmem, mem, size) (vmem)->commit(mem, size, VMemFlags_None)
+#define vmemCommitEx(vmem, mem, size, flags) (vmem)->commit(mem, size, flags)
 #define vmemDecommit(vmem, mem, size) (vmem)->decommit(mem, size)
 
 #define vmemMirrorAllocate(vmem, size) (vmem)->mirrorAllocate(size)
 #define vmemMirrorFree(vmem, buff) (vmem)->mirrorFree(buff)
 
+#define vmemFileMap(vmem, path, size) (vmem)->fileMap(path, size)
+#define vmemFileUnmap(vmem, map) (vmem)->fileUnmap(map)
+#define vmemFileFlush(vmem, map, mem, size) (vmem)->fileFlush(map, mem, size)
+
+/// Granularity to which commits on a block reserved with the given flags should be rounded; this
+/// is larger than the address granularity when huge pages are requested, so that committed ranges
+/// can actually be backed by them (and decommitted ranges are aligned as the OS requires).
+#define vmemCommitGranularity(vmem, flags)                            \
+    (((flags)&VMemFlags_HugePages) && (vmem)->huge_page_size          \
+         ? cfMax((vmem)->huge_page_size, (vmem)->address_granularity) \
+         : (vmem)->address_granularity)
+
 //---------------------------//
 //   End-of-page allocator   //
 //---------------------------//
@@ -144,28 +243,114 @@ typedef struct VMemApi
 
 MemAllocator memEndOfPageAllocator(VMemApi *vmem);
 
+//--------------------------//
+//   Virtual memory block   //
+//--------------------------//
+
+// NOTE (Matteo): A single growable allocation backed by a reserved range of virtual memory: pages
+// are committed as the allocation grows and decommitted as it shrinks, so the block never moves
+// and reallocation never copies. It is mainly meant as storage for dynamic buffers which must keep
+// stable pointers, or can grow very large (see mem_buffer.inl).
+
+typedef struct MemVmBlock
+{
+    VMemApi *vmem;
+    U8 *base;         // Start of the reserved range (NULL if the reservation failed)
+    Size reserved;    // Size of the reserved range
+    Size committed;   // Size of the committed prefix of the range
+    Size size;        // Size of the current allocation
+    Size granularity; // Granularity of commits, depending on the flags of the reservation
+    VMemFlags flags;  // Flags of the reservation
+} MemVmBlock;
+
+/// Reserve the virtual range backing the block with the given flags, without committing any memory
+CF_API bool memVmBlockInitEx(MemVmBlock *block, VMemApi *vmem, Size reserved_size,
+                             VMemFlags flags);
+
+#define memVmBlockInit(block, vmem, reserved_size) \
+    memVmBlockInitEx(block, vmem, reserved_size, VMemFlags_None)
+
+/// Release the virtual range backing the block
+CF_API void memVmBlockShutdown(MemVmBlock *block);
+
+/// Resize the allocation in place, committing or decommitting pages as needed.
+/// Memory beyond the previous size is cleared to 0.
+/// Returns false if the requested size exceeds the reservation or cannot be committed.
+CF_API bool memVmBlockResize(MemVmBlock *block, Size size);
+
+/// Build an allocator which handles the block as its single allocation; reallocations always
+/// return the start of the block, and freeing decommits all its pages
+CF_API MemAllocator memVmBlockAllocator(MemVmBlock *block);
+
 //------------------//
 //   Memory arena   //
 //------------------//
 
+/// Configuration of a chained arena, which grows by linking a new block when the current one is
+/// exhausted
+typedef struct MemArenaChain
+{
+    MemAllocator alloc; // Allocator for the new blocks (if not set, 'vmem' is used instead)
+    VMemApi *vmem;      // API used for reserving new blocks of virtual memory
+    Size block_size;    // Minimum size of a new block (0 means that chaining is disabled)
+    Size depth;         // Number of blocks linked after the original one
+} MemArenaChain;
+
+/// Commit policy of a VM backed arena, which retains committed pages across resets (restore,
+/// free, clear) in order to avoid committing and decommitting the same pages over and over, e.g.
+/// with a temporary scope entered once per frame
+typedef struct MemArenaCommitPolicy
+{
+    Size min_commit;       // Size of the first commit; later commits double up to 'max_commit'
+    Size max_commit;       // Maximum size of a single commit
+    U32 idle_resets;       // Number of resets after which the pages that were not needed in the
+                           // meantime are decommitted (0 means never)
+    Size retain_threshold; // Maximum amount of retained bytes, the excess is always decommitted
+                           // (0 means no limit)
+} MemArenaCommitPolicy;
+
+/// Commit bookkeeping of a VM backed arena.
+/// The "avoided" counters compare against the default behavior of committing exactly the pages
+/// in use and decommitting them as soon as they are not.
+typedef struct MemArenaCommitStats
+{
+    Size commits;           // Commit calls performed
+    Size decommits;         // Decommit calls performed
+    Size commits_avoided;   // Commit calls avoided thanks to pages retained or committed in advance
+    Size decommits_avoided; // Decommit calls avoided thanks to the retention policy
+    Size high_water;        // Highest allocation offset since the last reset (or since the last
+                            // trim of the retained pages, with a policy)
+    Size next_commit;       // Size of the next commit (policy only)
+    Size eager_committed;   // Committed size according to the default behavior (policy only)
+    U32 resets;             // Resets since the last trim of the retained pages (policy only)
+} MemArenaCommitStats;
+
 /// Linear arena allocator that can use either a fixed size buffer or virtual
 /// memory as a backing store
 typedef struct MemArena
 {
     // TODO (Matteo): Use U64 explicitly for sizes?
 
-    Size reserved;   // Reserved block size in bytes
-    Size allocated;  // Allocated (used) bytes count
-    Size committed;  // VMem only - committed virtual memory in bytes
-    Size save_stack; // Stack of saved states, as a progressive state ID.
-    U8 *memory;      // Pointer to the reserved block
-    VMemApi *vmem;   // VMem only - API for virtual memory operations
+    Size reserved;        // Reserved block size in bytes
+    Size allocated;       // Allocated (used) bytes count
+    Size committed;       // VMem only - committed virtual memory in bytes
+    Size save_stack;      // Stack of saved states, as a progressive state ID.
+    U8 *memory;           // Pointer to the reserved block
+    VMemApi *vmem;        // VMem only - API for virtual memory operations
+    VMemFlags vmem_flags; // VMem only - flags of the reserved block
+    Size granularity;     // VMem only - granularity of commits, depending on the flags
+    MemArenaChain chain;  // Chained mode only - source of the additional blocks
+
+    // VMem only - optional commit policy and related bookkeeping
+    MemArenaCommitPolicy const *commit_policy;
+    MemArenaCommitStats commit_stats;
 } MemArena;
 
 /// Arena state, used for recovery after temporary allocations
 typedef struct MemArenaState
 {
     MemArena *arena;
+    U8 *memory; // Block in use when the state was saved (may differ for chained arenas)
     Size allocated;
     Size stack_id;
 } MemArenaState;
@@ -180,10 +365,15 @@ typedef struct MemArenaState
 // move the responsibility of reserving and releasing VM outside of the arena, which now works
 // always with the memory block you give it (it only needs to commit it in case of VM).
 
+/// Initialize the arena using a block of virtual memory reserved with the given flags, from which
+/// actual pages can be committed
+CF_API void memArenaInitOnVmemEx(MemArena *arena, VMemApi *vmem, void *reserved_block,
+                                 Size reserved_size, VMemFlags flags);
+
 /// Initialize the arena using a reserved block of virtual memory, from which actual pages can be
 /// committed
-CF_API void memArenaInitOnVmem(MemArena *arena, VMemApi *vmem, void *reserved_block,
-                               Size reserved_size);
+#define memArenaInitOnVmem(arena, vmem, reserved_block, reserved_size) \
+    memArenaInitOnVmemEx(arena, vmem, reserved_block, reserved_size, VMemFlags_None)
 
 /// Initialize the arena using a pre-allocated memory buffer
 CF_API void memArenaInitOnBuffer(MemArena *arena, U8 *buffer, Size buffer_size);
@@ -194,8 +384,21 @@ CF_API MemArena *memArenaBootstrapFromVmem(VMemApi *vmem, void *reserved_block,
 // TODO (Matteo): Bootstrap from buffer
 CF_API MemArena *memArenaBootstrapFromBuffer(U8 *buffer, Size buffer_size);
 
+/// Enable chaining for the arena: when the current block is exhausted, a new one of at least the
+/// given size is taken from the allocator and linked to it. Blocks are returned to the allocator as
+/// soon as the arena is restored or cleared below their start.
+CF_API void memArenaChainOnAllocator(MemArena *arena, MemAllocator alloc, Size block_size);
+
+/// Enable chaining for the arena, reserving the new blocks from virtual memory
+CF_API void memArenaChainOnVmem(MemArena *arena, VMemApi *vmem, Size block_size);
+
+/// Set the commit policy of a VM backed arena (NULL restores the default behavior).
+/// The policy is referenced, not copied, so it must outlive the arena.
+CF_API void memArenaSetCommitPolicy(MemArena *arena, MemArenaCommitPolicy const *policy);
+
 /// Free all the memory allocated by the arena. In case of a virtual memory backing
-/// store, the memory is decommitted (returned to the OS)
+/// store, the memory is decommitted (returned to the OS) unless retained by the commit policy;
+/// linked blocks are released
 CF_API void memArenaClear(MemArena *arena);
 
 /// Return the amount of remaining memory available for allocation
@@ -255,7 +458,7 @@ CF_API void memArenaRestore(MemArenaState state);
 
 /// Split the arena in two smaller ones, each one responsible of its own block.
 /// The size given is the minimum size of the chunk to split off the source arena, and can be larger
-/// to accomodate the page sizes for VM backed arenas.
+/// to accomodate the page sizes for VM backed arenas. Chained arenas cannot be split.
 CF_API bool memArenaSplit(MemArena *arena, MemArena *split, Size size);
 
 /// Build a generic allocator based on the given arena
@@ -272,4 +475,504 @@ CF_API MemAllocator memArenaAllocator(MemArena *arena);
     for (MemArenaState CF_MACRO_VAR(temp) = memArenaSave(arena); \
          CF_MACRO_VAR(temp).stack_id == arena->save_stack; memArenaRestore(CF_MACRO_VAR(temp)))
 
+//-----------------------//
+//   Persistent arena    //
+//-----------------------//
+
+// NOTE (Matteo): Arena backed by a memory mapped file, so that its content survives the process and
+// can be restored by mapping the file again, in O(1) and without any parsing.
+// Since the file can be mapped at a different address every time, data structures stored in the
+// arena must not use absolute pointers, but relative ones (see MemRelPtr); a root relative pointer
+// in the file header gives access to the whole content.
+// The header records a format and a user-defined version, which must match the ones expected on
+// open, plus a clean flag and a checksum of the arena content written on sync: a file left dirty by
+// a crash, or whose checksum does not match (verified on request, since it requires reading the
+// whole content), is discarded and the arena starts empty.
+
+/// Self-relative pointer: stores the offset of the target from the pointer itself (0 means NULL),
+/// so it stays valid as long as pointer and target are in the same block of memory, even if such
+/// block is mapped at a different address
+typedef I64 MemRelPtr;
+
+#define memRelPtrSet(rel, ptr) \
+    (*(rel) = (ptr) ? (MemRelPtr)((U8 const *)(ptr) - (U8 const *)(rel)) : 0)
+
+#define memRelPtrGet(rel, Type) ((Type *)(*(rel) ? (U8 *)(rel) + *(rel) : NULL))
+
+/// Header stored at the start of a persistent arena file
+typedef struct MemPersistHeader
+{
+    U32 magic;
+    U32 format;    // Layout of the header and pointer size
+    U32 version;   // User defined version of the content
+    U32 clean;     // Set on sync, cleared on open
+    U64 size;      // Size of the file
+    U64 allocated; // Allocated bytes of the arena at the last sync
+    U64 checksum;  // Checksum of the arena content at the last sync
+    MemRelPtr root;
+    U64 header_checksum;
+} MemPersistHeader;
+
+typedef U32 MemPersistFlags;
+enum MemPersistFlags_
+{
+    MemPersistFlags_None = 0,
+    /// Verify the checksum of the whole content on open
+    MemPersistFlags_Verify = 1,
+};
+
+typedef enum MemPersistResult
+{
+    MemPersistResult_Error = 0, // The file could not be mapped
+    MemPersistResult_Restored,  // The content of the file was restored
+    MemPersistResult_Created,   // The file was created (or was empty)
+    MemPersistResult_Outdated,  // The file had a different format or version, and was discarded
+    MemPersistResult_Corrupted, // The file was not synced or failed the checks, and was discarded
+} MemPersistResult;
+
+typedef struct MemPersist
+{
+    MemArena arena; // Arena over the file content (after the header)
+    MemPersistHeader *header;
+    VMemFileMap map;
+    VMemApi *vmem;
+} MemPersist;
+
+/// Open the given file as a persistent arena of the given size (which must be the same used for
+/// creating the file); the file is mapped as a whole, but disk space is allocated only for the
+/// pages actually written where the OS supports sparse files
+CF_API MemPersistResult memPersistOpen(MemPersist *persist, VMemApi *vmem, Str path, Size size,
+                                       U32 version, MemPersistFlags flags);
+
+/// Write the arena state and content checksum to the header, and flush the file to disk.
+/// The file is marked as dirty again afterwards, unless it is going to be closed.
+CF_API bool memPersistSync(MemPersist *persist);
+
+/// Sync and unmap the file
+CF_API bool memPersistClose(MemPersist *persist);
+
+/// Discard the arena content
+CF_API void memPersistReset(MemPersist *persist);
+
+/// Root object of the persisted content (NULL if not set)
+CF_API void *memPersistRoot(MemPersist *persist);
+
+/// Set the root object of the persisted content, which must be allocated from the arena
+CF_API void memPersistSetRoot(MemPersist *persist, void *root);
+
+//---------------------//
+//   Scratch arenas    //
+//---------------------//
+
+// NOTE (Matteo): Per-thread scratch storage
+// Each thread can bind a couple of arenas to be used for temporary allocations; having two of them
+// allows a function which receives an arena for its results to allocate its own temporaries from
+// the other one, so that the two lifetimes never interleave on the same stack.
+
+enum
+{
+    MemScratch_Count = 2,
+};
+
+typedef struct MemScratch
+{
+    MemArena arenas[MemScratch_Count];
+} MemScratch;
+
+/// Initialize the scratch storage by splitting its arenas off the given parent arena, each one of
+/// the given (minimum) size
+CF_API bool memScratchInit(MemScratch *scratch, MemArena *parent, Size arena_size);
+
+/// Bind the scratch storage to the calling thread (NULL unbinds it), returning the previous one
+CF_API MemScratch *memScratchBind(MemScratch *scratch);
+
+/// Return the scratch storage bound to the calling thread, if any
+CF_API MemScratch *memScratchCurrent(void);
+
+/// Return a scratch arena of the calling thread which is not the given one (can be NULL), or NULL
+/// if no scratch storage is bound to the thread.
+/// Allocations are expected to be enclosed in a temporary scope, e.g. MEM_ARENA_TEMP_SCOPE.
+CF_API MemArena *memScratchArena(MemArena const *conflict);
+
+//--------------------//
+//    Shared arena    //
+//--------------------//
+
+// NOTE (Matteo): Thread-safe variant of the arena
+// Space is reserved with a single atomic fetch-add on the allocation offset, while VM pages are
+// committed cooperatively: the first thread that needs pages beyond the committed watermark takes a
+// lightweight spin lock and commits them on behalf of everyone. The expected usage is a batch or
+// frame lifetime arena that is filled concurrently and then reset by a single thread.
+// Since the offset only grows, individual allocations cannot be freed.
+
+typedef struct MemSharedArena
+{
+    U8 *memory;    // Pointer to the reserved block
+    Size reserved; // Reserved block size in bytes
+    VMemApi *vmem; // VMem only - API for virtual memory operations
+
+    // NOTE (Matteo): The allocation offset is contended by all the allocating threads, and so is
+    // kept in its own cache line
+    CF_CACHELINE_PAD;
+    AtomSize allocated; // Allocated bytes count (can exceed the reserved size once exhausted)
+    CF_CACHELINE_PAD;
+    AtomSize committed;  // VMem only - committed virtual memory in bytes
+    AtomBool commit_lock; // VMem only - lock for committing memory
+    CF_CACHELINE_PAD;
+} MemSharedArena;
+
+/// Initialize the shared arena using a reserved block of virtual memory
+CF_API void memSharedArenaInitOnVmem(MemSharedArena *arena, VMemApi *vmem, void *reserved_block,
+                                     Size reserved_size);
+
+/// Initialize the shared arena using a pre-allocated memory buffer, aligned to CF_MAX_ALIGN
+CF_API void memSharedArenaInitOnBuffer(MemSharedArena *arena, U8 *buffer, Size buffer_size);
+
+/// Allocate a cleared block of the given size and alignment (thread-safe).
+/// Requests larger than the whole arena are rejected without side effects, while a request which
+/// does not fit the remaining space still consumes it, so that all the following ones fail as well
+/// until the arena is reset. The space of a request whose pages cannot be committed is lost.
+CF_API void *memSharedArenaAlloc(MemSharedArena *arena, Size size, Size align);
+
+/// Return the amount of memory allocated from the arena (thread-safe)
+CF_API Size memSharedArenaAllocated(MemSharedArena *arena);
+
+/// Free all the memory allocated by the arena, keeping the committed pages for reuse.
+/// Not thread-safe: no allocation must be in progress.
+CF_API void memSharedArenaReset(MemSharedArena *arena);
+
+/// Free all the memory allocated by the arena. In case of a virtual memory backing store, the
+/// memory is decommitted. Not thread-safe: no allocation must be in progress.
+CF_API void memSharedArenaClear(MemSharedArena *arena);
+
+/// Build a generic allocator based on the given shared arena; reallocations always move the block
+/// and frees are no-ops
+CF_API MemAllocator memSharedArenaAllocator(MemSharedArena *arena);
+
+//--------------------//
+//   Slab allocator   //
+//--------------------//
+
+/// Size classes of the slab allocator are powers of 2 in the range [MemSlab_MinSize,
+/// MemSlab_MaxSize]; larger (or more aligned) requests are forwarded to a fallback allocator.
+enum
+{
+    MemSlab_MinSize = 16,
+    MemSlab_MaxSize = 2048,
+    MemSlab_ClassCount = 8,
+    /// Size of the pages carved from the arena for each size class
+    MemSlab_PageSize = 64 * 1024,
+};
+
+/// Bookkeeping of a single size class
+typedef struct MemSlabClass
+{
+    U8 *free_list; // Intrusive list of freed blocks
+    U8 *cursor;    // Next never-used block in the current page
+    U8 *end;       // End of the current page
+    Size block_size;
+    Size pages;    // Number of pages carved from the arena
+    Size used;     // Number of blocks currently allocated
+    Size capacity; // Number of blocks carved from the pages
+} MemSlabClass;
+
+/// Size-class allocator offering O(1) allocation and deallocation of small blocks.
+/// Pages are carved from the given arena and never returned to it, so the memory footprint is
+/// bound by the peak usage of each class.
+/// NOTE: the allocator is not thread-safe; the same size and alignment given on allocation must
+/// be given on release.
+typedef struct MemSlab
+{
+    MemArena *arena;
+    MemAllocator fallback;
+    MemSlabClass classes[MemSlab_ClassCount];
+} MemSlab;
+
+/// Occupancy of a size class
+typedef struct MemSlabStats
+{
+    Size block_size;
+    Size pages;
+    Size used;
+    Size capacity;
+    /// Fraction of carved blocks currently in use
+    double occupancy;
+} MemSlabStats;
+
+CF_API void memSlabInit(MemSlab *slab, MemArena *arena, MemAllocator fallback);
+
+CF_API void *memSlabAlloc(MemSlab *slab, Size size, Size align);
+CF_API void memSlabFree(MemSlab *slab, void *memory, Size size, Size align);
+
+/// Report the occupancy of the size class at the given index (in [0, MemSlab_ClassCount))
+CF_API MemSlabStats memSlabClassStats(MemSlab *slab, Size class_index);
+
+/// Build a generic allocator based on the given slab allocator
+CF_API MemAllocator memSlabAllocator(MemSlab *slab);
+
+//--------------------//
+//   Pool allocator   //
+//--------------------//
+
+// NOTE (Matteo): Thread-safe, lock-free allocator of fixed-size blocks, carved on demand from a
+// region allocated upfront.
+// Freed blocks are kept on a lock-free stack whose head packs the index of the top block with a
+// version tag, bumped by every update: this makes the CAS immune to ABA and fits a single 64 bit
+// word on every platform, without requiring a double-width CAS.
+// Threads that allocate heavily can use a magazine, a small cache of blocks owned by the thread
+// which is refilled from (and spilled to) a shared depot of block batches, one batch per CAS.
+// Requests that do not fit a block, or that arrive when the pool is exhausted, are forwarded to the
+// fallback allocator by the generic allocator interface.
+
+enum
+{
+    MemPool_MagazineSize = 32,
+    /// Number of blocks moved between a magazine and the depot at once
+    MemPool_BatchSize = MemPool_MagazineSize / 2,
+};
+
+typedef struct MemPool
+{
+    U8 *blocks;            // Block region
+    Size block_size;       // Block stride
+    Size block_align;      // Block alignment
+    U32 capacity;          // Number of blocks in the region
+    MemAllocator backing;  // Allocator of the block region
+    MemAllocator fallback; // Allocator of the requests not served by the pool
+
+    // NOTE (Matteo): The shared state is contended by all the threads, so each member is kept in
+    // its own cache line
+    CF_CACHELINE_PAD;
+    AtomU64 free_list; // Tagged head of the stack of free blocks
+    CF_CACHELINE_PAD;
+    AtomU64 depot; // Tagged head of the stack of batches spilled by magazines
+    CF_CACHELINE_PAD;
+    AtomU32 carved; // Number of blocks carved from the region (can exceed the capacity)
+    CF_CACHELINE_PAD;
+} MemPool;
+
+/// Cache of pool blocks owned by a thread (must not be used concurrently)
+typedef struct MemPoolMagazine
+{
+    MemPool *pool;
+    U32 count;
+    U32 blocks[MemPool_MagazineSize];
+} MemPoolMagazine;
+
+/// Initialize the pool, allocating a region for the given number of blocks from the backing
+/// allocator; fails if the region cannot be allocated.
+/// The fallback allocator can be zero-initialized, in which case requests not served by the pool
+/// fail.
+CF_API bool memPoolInit(MemPool *pool, MemAllocator backing, Size block_size, Size block_align,
+                        Size capacity, MemAllocator fallback);
+
+/// Release the pool region; all the blocks and magazines must have been returned
+CF_API void memPoolShutdown(MemPool *pool);
+
+/// Allocate a cleared block from the pool (thread-safe); returns NULL if the pool is exhausted
+CF_API void *memPoolAlloc(MemPool *pool);
+
+/// Return a block to the pool (thread-safe)
+CF_API void memPoolFree(MemPool *pool, void *memory);
+
+/// Check if the given memory is a block of the pool
+CF_API bool memPoolOwns(MemPool const *pool, void const *memory);
+
+/// Build a generic allocator based on the given pool (thread-safe)
+CF_API MemAllocator memPoolAllocator(MemPool *pool);
+
+CF_API void memPoolMagazineInit(MemPoolMagazine *magazine, MemPool *pool);
+
+/// Allocate a cleared block, refilling the magazine from the pool if empty
+CF_API void *memPoolMagazineAlloc(MemPoolMagazine *magazine);
+
+/// Return a block to the magazine, spilling a batch to the pool if full; the block can come from
+/// any magazine of the same pool
+CF_API void memPoolMagazineFree(MemPoolMagazine *magazine, void *memory);
+
+/// Return all the cached blocks to the pool (e.g. before the owning thread exits)
+CF_API void memPoolMagazineFlush(MemPoolMagazine *magazine);
+
+/// Build a generic allocator based on the given magazine (to be used by the owning thread only)
+CF_API MemAllocator memPoolMagazineAllocator(MemPoolMagazine *magazine);
+
+//--------------------//
+//   TLSF allocator   //
+//--------------------//
+
+// NOTE (Matteo): Two-Level Segregated Fit allocator, as described in "TLSF: a New Dynamic Memory
+// Allocator for Real-Time Systems" (Masmano et al.); free blocks are binned by size in a two level
+// table of lists, indexed by bitmaps, so that both allocation and deallocation (including the
+// coalescing of adjacent free blocks) are O(1).
+
+enum
+{
+    /// log2 of the number of second level subdivisions of each first level class
+    MemTlsf_SlCountLog2 = 5,
+    MemTlsf_SlCount = 1 << MemTlsf_SlCountLog2,
+#if CF_PTR_SIZE == 8
+    MemTlsf_AlignLog2 = 4,
+    /// log2 of the upper bound of block sizes (4 GiB)
+    MemTlsf_FlMax = 32,
+#else
+    MemTlsf_AlignLog2 = 3,
+    /// log2 of the upper bound of block sizes (1 GiB)
+    MemTlsf_FlMax = 30,
+#endif
+    /// Alignment guaranteed for all the blocks
+    MemTlsf_Align = 1 << MemTlsf_AlignLog2,
+    /// Blocks smaller than 1 << MemTlsf_FlShift are binned linearly in the first class
+    MemTlsf_FlShift = MemTlsf_SlCountLog2 + MemTlsf_AlignLog2,
+    MemTlsf_FlCount = MemTlsf_FlMax - MemTlsf_FlShift + 1,
+};
+
+typedef struct MemTlsfBlock MemTlsfBlock;
+
+/// TLSF allocator state
+/// Memory is provided either as caller-supplied blocks (pools) or by an arena from which the
+/// allocator grows when it runs out of space (in this case memory is never returned to the arena).
+/// NOTE: the allocator is not thread-safe
+typedef struct MemTlsf
+{
+    /// Bitmap of the first level classes with a non-empty free list
+    U32 fl_bitmap;
+    /// Bitmaps of the second level classes with a non-empty free list
+    U32 sl_bitmap[MemTlsf_FlCount];
+    /// Heads of the free lists
+    MemTlsfBlock *free_lists[MemTlsf_FlCount][MemTlsf_SlCount];
+
+    /// Optional arena used to grow the allocator
+    MemArena *arena;
+    /// Minimum size of the pools allocated from the arena
+    Size grow_size;
+    /// Sentinel block at the end of the last pool (used to merge contiguous pools)
+    MemTlsfBlock *last_sentinel;
+
+    /// Total size of the pools
+    Size pool_size;
+    /// Size of the blocks currently allocated (including their headers)
+    Size used_size;
+} MemTlsf;
+
+/// Initialize the allocator over a caller-supplied block of memory
+CF_API void memTlsfInit(MemTlsf *tlsf, void *block, Size block_size);
+
+/// Initialize the allocator so that it grows by allocating pools of at least 'grow_size' bytes
+/// from the given arena (usually backed by virtual memory)
+CF_API void memTlsfInitOnArena(MemTlsf *tlsf, MemArena *arena, Size grow_size);
+
+/// Make an additional block of memory available to the allocator; returns false if the block is
+/// too small or too large to be used
+CF_API bool memTlsfAddPool(MemTlsf *tlsf, void *block, Size block_size);
+
+CF_API void *memTlsfAlloc(MemTlsf *tlsf, Size size, Size align);
+CF_API void *memTlsfRealloc(MemTlsf *tlsf, void *memory, Size old_size, Size new_size,
+                            Size align);
+CF_API void memTlsfFree(MemTlsf *tlsf, void *memory);
+
+/// Size of the block provided for the given allocation (can be larger than requested)
+CF_API Size memTlsfBlockSize(void *memory);
+
+/// Check the consistency of the free lists and of their blocks (for debugging purposes)
+CF_API bool memTlsfCheck(MemTlsf *tlsf);
+
+/// Build a generic allocator based on the given TLSF allocator
+CF_API MemAllocator memTlsfAllocator(MemTlsf *tlsf);
+
+//-------------------------//
+//   Allocation profiler   //
+//-------------------------//
+
+// NOTE (Matteo): Allocation profiler
+// The profiler wraps a backing allocator and records statistics for each call site, identified by
+// a return address (resolve it with a debugger or addr2line).
+// Blocks requested through memProfilerAlloc & co. are attributed to the code which called them.
+// The generic allocator interface only sees the return address of its allocator function, so
+// blocks requested through memAlloc & co. are attributed to those wrappers (or to their callers,
+// when they are inlined): capturing the actual call site would tax every allocation, profiled or
+// not.
+// Call sites are stored in a fixed-size, lock-free hash table, so the profiler can be shared by
+// multiple threads; sites that do not fit are accounted in a single overflow entry.
+// Each block carries a small header that refers to its call site, so that frees are attributed
+// correctly.
+
+enum
+{
+    MemProfiler_MaxSites = 512,
+    /// Size histogram bins: bin N counts sizes in [2^N, 2^(N+1)), the last one all larger sizes
+    MemProfiler_HistogramBins = 24,
+    /// Maximum number of entries in a textual report
+    MemProfiler_ReportMax = 32,
+};
+
+typedef struct MemProfilerSite
+{
+    AtomPtr callsite;
+    AtomSize allocs;   // Number of allocations
+    AtomSize reallocs; // Number of reallocations
+    AtomSize frees;    // Number of frees
+    AtomSize bytes;    // Total allocated bytes
+    AtomSize live;     // Currently allocated bytes
+    AtomSize peak;     // Peak of allocated bytes
+    AtomSize histogram[MemProfiler_HistogramBins];
+} MemProfilerSite;
+
+typedef struct MemProfiler
+{
+    MemAllocator backing;
+    AtomSize live;
+    AtomSize peak;
+    MemProfilerSite overflow;
+    MemProfilerSite sites[MemProfiler_MaxSites];
+} MemProfiler;
+
+/// Sorting key for the profiler reports (always in descending order)
+typedef enum MemProfilerSort
+{
+    MemProfilerSort_Live = 0,
+    MemProfilerSort_Peak,
+    MemProfilerSort_Bytes,
+    MemProfilerSort_Count,
+} MemProfilerSort;
+
+/// Snapshot of the statistics of a call site
+typedef struct MemProfilerEntry
+{
+    void *callsite; // NULL for the overflow entry
+    Size allocs;
+    Size reallocs;
+    Size frees;
+    Size bytes;
+    Size live;
+    Size peak;
+    Size histogram[MemProfiler_HistogramBins];
+} MemProfilerEntry;
+
+typedef struct CfLog CfLog;
+
+/// Initialize the profiler over the given backing allocator
+CF_API void memProfilerInit(MemProfiler *profiler, MemAllocator backing);
+
+/// Build a generic allocator which forwards to the backing one while recording statistics
+CF_API MemAllocator memProfilerAllocator(MemProfiler *profiler);
+
+/// Allocate a block from the backing allocator, attributing it to the calling code
+CF_API void *memProfilerAlloc(MemProfiler *profiler, Size size, Size align);
+
+/// Reallocate a profiled block, attributing it to the calling code
+CF_API void *memProfilerRealloc(MemProfiler *profiler, void *memory, Size old_size, Size new_size,
+                                Size align);
+
+/// Free a profiled block; size and alignment must match the ones used for the allocation
+CF_API void memProfilerFree(MemProfiler *profiler, void *memory, Size size, Size align);
+
+/// Take a snapshot of the top call sites, sorted by the given key; returns the number of entries
+/// written. Thread-safe, but each entry is only consistent with itself.
+CF_API Size memProfilerSnapshot(MemProfiler *profiler, MemProfilerSort sort,
+                                MemProfilerEntry *entries, Size max_entries);
+
+/// Write a report of the top call sites, sorted by the given key, to the log
+CF_API void memProfilerDump(MemProfiler *profiler, MemProfilerSort sort, Size max_entries,
+                            CfLog *log);
+
 //----------------------------//
@@ -0,0 +1,226 @@
+#include "slot_map.h"
+#include "error.h"
+#include "memory.h"
+
+//--------------//
+//   Slot map   //
+//--------------//
+
+static inline CfHandle
+slotMap_Handle(U32 index, U32 generation)
+{
+    return ((CfHandle)generation << 32) | index;
+}
+
+/// Generation of a slot after the removal of its item (0 is skipped to keep handles valid)
+static inline U32
+slotMap_NextGeneration(U32 generation)
+{
+    return generation == U32_MAX ? 1 : generation + 1;
+}
+
+/// Offset of the item slots in the storage block
+static Size
+slotMap_ItemSlotsOffset(CfSlotMap const *map, Size capacity)
+{
+    Size const align = alignof(CfSlotMapSlot);
+    return (capacity * map->item_size + align - 1) & ~(align - 1);
+}
+
+/// Offset of the slots in the storage block
+static Size
+slotMap_SlotsOffset(CfSlotMap const *map, Size capacity)
+{
+    return slotMap_ItemSlotsOffset(map, capacity) + capacity * sizeof(U32);
+}
+
+static Size
+slotMap_StorageSize(CfSlotMap const *map, Size capacity)
+{
+    return slotMap_SlotsOffset(map, capacity) + capacity * sizeof(CfSlotMapSlot);
+}
+
+static Size
+slotMap_StorageAlign(CfSlotMap const *map)
+{
+    return cfMax(map->item_align, alignof(CfSlotMapSlot));
+}
+
+static ErrorCode32
+slotMap_Grow(CfSlotMap *map, Size capacity)
+{
+    CF_ASSERT(capacity > map->capacity, "Slot map capacity too small");
+
+    // NOTE (Matteo): U32_MAX is reserved for the end of the free slot list
+    if (capacity >= U32_MAX) return Error_OutOfRange;
+
+    Size const align = slotMap_StorageAlign(map);
+    U8 *storage = memAllocAlign(map->alloc, slotMap_StorageSize(map, capacity), align);
+    if (!storage) return Error_OutOfMemory;
+
+    CfSlotMap old = *map;
+
+    map->items = storage;
+    map->item_slots = (U32 *)(storage + slotMap_ItemSlotsOffset(map, capacity));
+    map->slots = (CfSlotMapSlot *)(storage + slotMap_SlotsOffset(map, capacity));
+    map->capacity = (U32)capacity;
+
+    if (old.items)
+    {
+        memCopy(old.items, map->items, old.count * old.item_size);
+        memCopyArray(old.item_slots, map->item_slots, old.count);
+        memCopyArray(old.slots, map->slots, old.num_slots);
+
+        memFreeAlign(map->alloc, old.items, slotMap_StorageSize(&old, old.capacity), align);
+    }
+
+    return Error_None;
+}
+
+void
+cfSlotMapInitEx(CfSlotMap *map, MemAllocator alloc, Size item_size, Size item_align)
+{
+    CF_ASSERT(item_size, "Invalid item size");
+    CF_ASSERT(cfIsPowerOf2(item_align), "Invalid alignment");
+
+    // NOTE (Matteo): Items are stored contiguously, so their size must preserve the alignment
+    item_size = (item_size + item_align - 1) & ~(item_align - 1);
+    CF_ASSERT(item_size <= U32_MAX, "Slot map item too large");
+
+    memClearStruct(map);
+    map->alloc = alloc;
+    map->free_slot = U32_MAX;
+    map->item_size = (U32)item_size;
+    map->item_align = (U32)item_align;
+}
+
+void
+cfSlotMapShutdown(CfSlotMap *map)
+{
+    if (map->items)
+    {
+        memFreeAlign(map->alloc, map->items, slotMap_StorageSize(map, map->capacity),
+                     slotMap_StorageAlign(map));
+    }
+
+    map->items = NULL;
+    map->item_slots = NULL;
+    map->slots = NULL;
+    map->count = map->capacity = map->num_slots = 0;
+    map->free_slot = U32_MAX;
+}
+
+void
+cfSlotMapClear(CfSlotMap *map)
+{
+    for (U32 index = 0; index < map->count; ++index)
+    {
+        U32 slot_index = map->item_slots[index];
+        CfSlotMapSlot *slot = map->slots + slot_index;
+
+        slot->generation = slotMap_NextGeneration(slot->generation);
+        slot->index = map->free_slot;
+        map->free_slot = slot_index;
+    }
+
+    map->count = 0;
+}
+
+ErrorCode32
+cfSlotMapReserve(CfSlotMap *map, Size count)
+{
+    if (count <= map->capacity) return Error_None;
+    return slotMap_Grow(map, cfMax(count, (Size)CfSlotMap_MinCapacity));
+}
+
+void *
+cfSlotMapInsert(CfSlotMap *map, CfHandle *out_handle)
+{
+    CF_ASSERT_NOT_NULL(out_handle);
+
+    if (map->count == map->capacity &&
+        slotMap_Grow(map, cfMax((Size)map->capacity * 2, (Size)CfSlotMap_MinCapacity)))
+    {
+        return NULL;
+    }
+
+    U32 slot_index = map->free_slot;
+
+    if (slot_index != U32_MAX)
+    {
+        map->free_slot = map->slots[slot_index].index;
+    }
+    else
+    {
+        // NOTE (Matteo): Without free slots every slot is in use, so there is room for a new one
+        CF_ASSERT(map->num_slots == map->count, "Slot map free list corrupted");
+        slot_index = map->num_slots++;
+        map->slots[slot_index].generation = 1;
+    }
+
+    CfSlotMapSlot *slot = map->slots + slot_index;
+    U8 *item = map->items + (Size)map->count * map->item_size;
+
+    slot->index = map->count;
+    map->item_slots[map->count] = slot_index;
+    map->count++;
+
+    memClear(item, map->item_size);
+    *out_handle = slotMap_Handle(slot_index, slot->generation);
+
+    return item;
+}
+
+void *
+cfSlotMapGet(CfSlotMap const *map, CfHandle handle)
+{
+    U32 slot_index = cfHandleIndex(handle);
+
+    // NOTE (Matteo): The generation of a free slot was never handed out, so a matching generation
+    // implies that the slot is in use
+    if (slot_index >= map->num_slots ||
+        map->slots[slot_index].generation != cfHandleGeneration(handle))
+    {
+        return NULL;
+    }
+
+    return map->items + (Size)map->slots[slot_index].index * map->item_size;
+}
+
+bool
+cfSlotMapRemove(CfSlotMap *map, CfHandle handle, void *out_item)
+{
+    U8 *item = cfSlotMapGet(map, handle);
+    if (!item) return false;
+
+    if (out_item) memCopy(item, out_item, map->item_size);
+
+    U32 slot_index = cfHandleIndex(handle);
+    CfSlotMapSlot *slot = map->slots + slot_index;
+    U32 last = --map->count;
+
+    // NOTE (Matteo): Fill the hole with the last item, to keep the storage dense
+    if (slot->index != last)
+    {
+        U32 moved = map->item_slots[last];
+
+        memCopy(map->items + (Size)last * map->item_size, item, map->item_size);
+        map->item_slots[slot->index] = moved;
+        map->slots[moved].index = slot->index;
+    }
+
+    slot->generation = slotMap_NextGeneration(slot->generation);
+    slot->index = map->free_slot;
+    map->free_slot = slot_index;
+
+    return true;
+}
+
+CfHandle
+cfSlotMapHandleAt(CfSlotMap const *map, Size index)
+{
+    CF_ASSERT(index < map->count, "Slot map index out of range");
+
+    U32 slot_index = map->item_slots[index];
+    return slotMap_Handle(slot_index, map->slots[slot_index].generation);
+}
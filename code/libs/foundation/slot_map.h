@@ -0,0 +1,97 @@
+#pragma once
+
+/// Foundation slot map
+/// This is an API header and as such the only included header must be "core.h"
+
+#include "core.h"
+
+//------------//
+//   Handle   //
+//------------//
+
+/// Versioned reference to an item stored in a slot map.
+/// The low 32 bits are the index of the slot, the high 32 bits the generation of the slot, which
+/// changes every time its item is removed so that stale handles are detected; 0 is never valid.
+typedef U64 CfHandle;
+
+#define CF_INVALID_HANDLE ((CfHandle)0)
+
+#define cfHandleIndex(handle) ((U32)(handle))
+#define cfHandleGeneration(handle) ((U32)((handle) >> 32))
+
+//--------------//
+//   Slot map   //
+//--------------//
+
+// NOTE (Matteo): Items are stored densely (without holes) so that iteration is a linear scan;
+// handles refer to a slot, which in turn stores the current position of the item. Removal moves
+// the last item into the hole, so that insertion, removal and lookup are all O(1).
+// Item pointers are invalidated by any insertion or removal, handles only by the removal of the
+// referred item.
+
+enum
+{
+    CfSlotMap_MinCapacity = 16,
+};
+
+typedef struct CfSlotMapSlot
+{
+    /// Index of the item if the slot is in use, of the next free slot otherwise
+    U32 index;
+    U32 generation;
+} CfSlotMapSlot;
+
+typedef struct CfSlotMap
+{
+    MemAllocator alloc;
+
+    /// Dense item storage
+    U8 *items;
+    /// Slot of each item
+    U32 *item_slots;
+    /// Slot storage (allocated in the same block of the items)
+    CfSlotMapSlot *slots;
+
+    U32 count;
+    U32 capacity;
+    /// Number of slots used so far (either in use or free)
+    U32 num_slots;
+    /// Head of the list of free slots (U32_MAX if empty)
+    U32 free_slot;
+
+    U32 item_size;
+    U32 item_align;
+} CfSlotMap;
+
+/// Initialize an empty slot map; no memory is allocated until the first insertion (or reservation)
+CF_API void cfSlotMapInitEx(CfSlotMap *map, MemAllocator alloc, Size item_size, Size item_align);
+
+#define cfSlotMapInit(map, alloc, Type) cfSlotMapInitEx(map, alloc, sizeof(Type), alignof(Type))
+
+/// Release the slot map storage
+CF_API void cfSlotMapShutdown(CfSlotMap *map);
+
+/// Remove all the items, retaining the storage; all the handles are invalidated
+CF_API void cfSlotMapClear(CfSlotMap *map);
+
+/// Ensure the slot map can hold the given number of items without reallocating
+CF_API ErrorCode32 cfSlotMapReserve(CfSlotMap *map, Size count);
+
+/// Insert a new item, cleared to 0, and return a pointer to it along with its handle.
+/// Returns NULL if the storage cannot be grown.
+CF_API void *cfSlotMapInsert(CfSlotMap *map, CfHandle *out_handle);
+
+/// Retrieve the item referred by the given handle, or NULL if it was removed
+CF_API void *cfSlotMapGet(CfSlotMap const *map, CfHandle handle);
+
+/// Remove the item referred by the given handle, optionally copying it out.
+/// Returns false if the handle is stale.
+CF_API bool cfSlotMapRemove(CfSlotMap *map, CfHandle handle, void *out_item);
+
+/// Handle of the item at the given position of the dense storage.
+/// Iterating backwards allows to remove the current item, since it is replaced by the last one.
+CF_API CfHandle cfSlotMapHandleAt(CfSlotMap const *map, Size index);
+
+#define cfSlotMapContains(map, handle) (cfSlotMapGet(map, handle) != NULL)
+#define cfSlotMapGetT(map, handle, Type) ((Type *)cfSlotMapGet(map, handle))
+#define cfSlotMapItems(map, Type) ((Type *)(map)->items)
@@ -268,18 +268,8 @@ strBuilderAppendStr(StrBuilder *sb, Str what)
 {
     strBuilderValidate(sb);
 
-    // Write over the previous null terminator
-    Size nul_pos = sb->len - 1;
-
-    ErrorCode32 err = memBufferResizeAlloc(sb, sb->len + what.len, sb->alloc);
-    if (err) return err;
-
-    memCopy(what.ptr, sb->ptr + nul_pos, what.len);
-
-    // Null terminate again
-    sb->ptr[sb->len - 1] = 0;
-
-    return Error_None;
+    // Insert before the null terminator, which is moved at the end
+    return memBufferInsertRangeAlloc(sb, sb->len - 1, what.ptr, what.len, sb->alloc);
 }
 
 ErrorCode32
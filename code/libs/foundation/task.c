@@ -40,12 +40,91 @@ typedef struct
 {
     Task task;
     AtomSize sequence;
+    /// Position of the queued task + 1, reset by the thread that takes ownership of the task
+    /// (either the consumer, or a change of priority that moves the task to another ring)
+    AtomSize claim;
 } TaskQueueCell;
 
+/// Bounded MPMC ring, one for each priority level
 typedef struct
 {
+    // NOTE (Matteo): Read and write indices are kept in separate cache lines to avoid false sharing
+    CF_CACHELINE_PAD;
+    AtomSize enqueue_pos;
+    CF_CACHELINE_PAD;
+    AtomSize dequeue_pos;
+    CF_CACHELINE_PAD;
+    TaskQueueCell *buffer;
+} TaskRing;
+
+/// Number of tasks stored in each segment of a spill list
+#define TASK_SPILL_SEGMENT_SIZE 64
+
+/// Position of the first spilled task; 0 is never used, so that inline tasks can have a spill ID
+/// which is always reported as completed
+#define TASK_SPILL_START 1
+
+typedef struct TaskSpillSegment TaskSpillSegment;
+
+struct TaskSpillSegment
+{
+    AtomPtr next;
+    /// Position of the first task stored in the segment
+    Size base;
+    /// Next segment in the list of the retired ones
+    TaskSpillSegment *retired_next;
+    /// Cells are used once: the sequence is 0 if empty, position + 1 if full, position + 2 if taken
+    TaskQueueCell cells[TASK_SPILL_SEGMENT_SIZE];
+};
+
+/// Unbounded MPMC list of segments, holding the tasks that overflow the ring of the same priority.
+/// Segments are unlinked once all their tasks have been taken, but freed only when no thread is
+/// accessing the list, since a thread could still be reading them.
+typedef struct
+{
+    CF_CACHELINE_PAD;
+    AtomSize enqueue_pos;
+    AtomPtr tail;
+    CF_CACHELINE_PAD;
+    AtomSize dequeue_pos;
+    AtomPtr head;
+    CF_CACHELINE_PAD;
+    /// Number of threads accessing the segments
+    AtomSize active;
+    /// Segments unlinked from the list, waiting to be freed
+    AtomPtr retired;
+} TaskSpill;
+
+/// Chase-Lev work stealing deque, owned by a worker: the owner pushes and pops tasks at the
+/// bottom (LIFO, for locality), while the other threads steal them from the top (FIFO)
+typedef struct
+{
+    // NOTE (Matteo): The top index is contended by thieves, while the bottom one is written by the
+    // owner only, so they are kept in separate cache lines
+    CF_CACHELINE_PAD;
+    AtomOffset top;
+    CF_CACHELINE_PAD;
+    AtomOffset bottom;
+    Task *buffer;
+    Size mask;
+} TaskDeque;
+
+typedef struct
+{
+    TaskDeque deque;
+
+    CF_CACHELINE_PAD;
+
     TaskQueue *queue;
     Task curr_task;
+    MemScratch scratch;
+    bool has_scratch;
+
+    Size index;   // Index of the worker
+    Size next_id; // Sequence number of the next task pushed on the deque
+    Size ticks;   // Number of tasks taken, used for starvation protection
+    Size spins;   // Number of spins before parking, adapted to the load
+    U32 rng;      // State of the random victim selection
 } TaskWorkerSlot;
 
 // TODO (Matteo): Better cache line alignment strategy to avoid wasting memory
@@ -55,17 +134,18 @@ struct TaskQueue
     // TODO (Matteo): Is this padding required?
     CF_CACHELINE_PAD;
 
-    TaskQueueCell *buffer;
     Size buffer_mask;
-    // TODO (Matteo): Should the semaphore be kept in a different cache line from the buffer?
-    CfSemaphore semaphore;
+    // TODO (Matteo): Should the event be kept in a different cache line from the buffer?
+    CfEventCount event;
     AtomBool stop;
 
-    // NOTE (Matteo): Read and write indices are kept in separate cache lines to avoid false sharing
-    CF_CACHELINE_PAD;
-    AtomSize enqueue_pos;
-    CF_CACHELINE_PAD;
-    AtomSize dequeue_pos;
+    TaskRing rings[TaskPriority_Count];
+
+    TaskOverflow overflow;
+    MemAllocator spill_alloc;
+    TaskSpill spills[TaskPriority_Count];
+    /// Signaled when a cell of the rings is released, if producers can block
+    CfEventCount room;
 
     // TODO (Matteo): Is this padding required?
     CF_CACHELINE_PAD;
@@ -73,72 +153,125 @@ struct TaskQueue
     Size num_workers;
     CfThread *workers;
     TaskWorkerSlot *worker_slots;
+
+    MemArena *scratch_parent;
+    Size scratch_size;
+
+    /// Size of the deque of each worker (0 if work stealing is disabled)
+    Size deque_size;
 };
 
-//===================================//
-// Internals
+// NOTE (Matteo): Task IDs encode where the task was queued: odd IDs refer to a position in the
+// ring (or the spill list, if bit 3 is set) of the given priority, even IDs to a sequence number
+// of a worker deque.
+#define TASK_RING_ID(pos, priority) (((pos) << 4) | ((Size)(priority) << 1) | 1)
+#define TASK_SPILL_ID(pos, priority) (TASK_RING_ID(pos, priority) | 8)
+#define TASK_RING_POS(id) ((id) >> 4)
+#define TASK_RING_PRIORITY(id) (((id) >> 1) & 3)
+#define TASK_IS_RING_ID(id) ((id)&1)
+#define TASK_IS_SPILL_ID(id) (((id)&9) == 9)
 
-static bool taskDequeue(TaskQueue *queue, Task *out_task);
+/// ID of the tasks executed inline on overflow
+#define TASK_INLINE_ID TASK_SPILL_ID(0, 0)
 
-static CF_THREAD_FN(taskThreadProc)
+/// Bounds of the number of spins performed by idle workers before parking
+#define TASK_SPIN_MIN 16
+#define TASK_SPIN_MAX 2048
+
+/// Every given number of tasks, workers look for tasks in the lower priority rings first, so that
+/// a steady stream of high priority work cannot starve them
+#define TASK_STARVATION_PERIOD 16
+
+/// Worker slot of the current thread (NULL for threads that are not workers)
+static CF_THREAD_LOCAL TaskWorkerSlot *g_task_worker = NULL;
+
+//===================================//
+// Work stealing deque
+
+static bool
+taskDequePush(TaskDeque *deque, Task const *task)
 {
-    TaskWorkerSlot *slot = args;
-    TaskQueue *queue = slot->queue;
+    Offset bottom = atomRead(&deque->bottom);
+    Offset top = atomRead(&deque->top);
+    atomAcquireFence();
 
-    while (!atomRead(&queue->stop))
-    {
-        Task *task = &slot->curr_task;
+    if (bottom - top > (Offset)deque->mask) return false; // Full
 
-        if (taskDequeue(queue, task))
-        {
-            task->fn(task->data, &task->canceled);
-        }
-        else
-        {
-            cfSemaWait(&queue->semaphore);
-        }
-    }
+    deque->buffer[(Size)bottom & deque->mask] = *task;
+    atomReleaseFence();
+    atomWrite(&deque->bottom, bottom + 1);
+
+    return true;
 }
 
-static void
-taskClear(TaskQueue *queue)
+static bool
+taskDequePop(TaskDeque *deque, Task *out_task)
 {
-    CF_ASSERT_NOT_NULL(queue->buffer);
-    CF_ASSERT(atomRead(&queue->stop), "Cannot flush while running");
+    Offset bottom = atomRead(&deque->bottom) - 1;
+    Task *cell = deque->buffer + ((Size)bottom & deque->mask);
+
+    // NOTE (Matteo): The task must be copied to the output (i.e. the worker slot) before it leaves
+    // the deque, otherwise for a while it would be found neither queued nor in progress, and
+    // reported as completed before even starting. Only the owner writes the cells, so the copy is
+    // safe even if the deque turns out to be empty; in that case it is discarded by the caller.
+    *out_task = *cell;
+    atomReleaseFence();
+    atomWrite(&deque->bottom, bottom);
 
-    Size buffer_size = queue->buffer_mask + 1;
+    // NOTE (Matteo): The bottom index must be published before reading the top one, otherwise the
+    // owner and a thief could both take the last task
+    atomSequentialFence();
 
-    atomWrite(&queue->enqueue_pos, 0);
-    atomWrite(&queue->dequeue_pos, 0);
+    Offset top = atomRead(&deque->top);
 
-    for (Size i = 0; i != buffer_size; i += 1)
+    if (top > bottom)
     {
-        atomWrite(&queue->buffer[i].sequence, i);
+        // Empty
+        atomWrite(&deque->bottom, bottom + 1);
+        return false;
     }
-}
 
-static Task *
-taskFindInQueue(TaskQueue *queue, TaskId id)
-{
-    Task *task = NULL;
+    // NOTE (Matteo): The task could have been canceled while being copied
+    if (cell->canceled) out_task->canceled = true;
 
-    Size pos = ~id;
-    TaskQueueCell *cell = queue->buffer + (pos & queue->buffer_mask);
-    Size seq = atomRead(&cell->sequence);
+    if (top == bottom)
+    {
+        // NOTE (Matteo): Last task, race against the thieves for it
+        bool taken = (atomCompareExchange(&deque->top, top, top + 1) == top);
+        atomWrite(&deque->bottom, bottom + 1);
+        return taken;
+    }
+
+    return true;
+}
 
+static bool
+taskDequeSteal(TaskDeque *deque, Task *out_task)
+{
+    Offset top = atomRead(&deque->top);
+    atomSequentialFence();
+    Offset bottom = atomRead(&deque->bottom);
     atomAcquireFence();
 
-    if (seq == pos + 1) task = &cell->task;
+    if (top >= bottom) return false; // Empty
 
-    return task;
+    *out_task = deque->buffer[(Size)top & deque->mask];
+
+    // NOTE (Matteo): The task must be read before releasing its cell to the owner
+    atomReleaseFence();
+    return (atomCompareExchange(&deque->top, top, top + 1) == top);
 }
 
 static Task *
-taskFindInProgress(TaskQueue *queue, TaskId id)
+taskDequeFind(TaskDeque *deque, TaskId id)
 {
-    for (Size i = 0; i < queue->num_workers; ++i)
+    Offset top = atomRead(&deque->top);
+    Offset bottom = atomRead(&deque->bottom);
+    atomAcquireFence();
+
+    for (Offset pos = top; pos < bottom; ++pos)
     {
-        Task *task = &queue->worker_slots[i].curr_task;
+        Task *task = deque->buffer + ((Size)pos & deque->mask);
         if (task->id == id) return task;
     }
 
@@ -146,224 +279,1398 @@ taskFindInProgress(TaskQueue *queue, TaskId id)
 }
 
 //===================================//
-// Config/init/shutdown
+// Spill list
 
-bool
-taskConfig(TaskQueueConfig *config)
+static inline void
+taskSpillEnter(TaskSpill *spill)
 {
-    Size buffer_size = config->buffer_size;
-
-    if (buffer_size <= 2) return false;
-    if (buffer_size & (buffer_size - 1)) return false;
-
-    if (config->num_workers == 0)
-    {
-        config->num_workers = cfNumCores();
-    }
-
-    config->footprint = sizeof(TaskQueue) + buffer_size * sizeof(TaskQueueCell) +
-                        config->num_workers * (sizeof(CfThread) + sizeof(TaskWorkerSlot));
+    atomFetchInc(&spill->active);
+    // NOTE (Matteo): The registration must be visible before any segment is read
+    atomSequentialFence();
+}
 
-    return true;
+static void
+taskSpillFree(TaskQueue *queue, TaskSpillSegment *segment)
+{
+    memFreeStruct(queue->spill_alloc, segment);
 }
 
-TaskQueue *
-taskInit(TaskQueueConfig *config, void *memory)
+/// Free the retired segments, if no thread is accessing the list
+static void
+taskSpillReclaim(TaskQueue *queue, TaskSpill *spill)
 {
-    TaskQueue *queue = memory;
+    TaskSpillSegment *list = atomExchangePtr(&spill->retired, NULL);
+    if (!list) return;
 
-    atomInit(&queue->stop, true);
-    cfSemaInit(&queue->semaphore, 0);
+    // NOTE (Matteo): Retired segments were unlinked already, so they cannot be reached by threads
+    // entering from now on; if no thread is active, none is left which could be reading them
+    atomSequentialFence();
 
-    Size buffer_size = config->buffer_size;
+    if (!atomRead(&spill->active))
+    {
+        while (list)
+        {
+            TaskSpillSegment *next = list->retired_next;
+            taskSpillFree(queue, list);
+            list = next;
+        }
 
-    CF_ASSERT(buffer_size >= 2, "Buffer size is too small");
-    CF_ASSERT((buffer_size & (buffer_size - 1)) == 0, "Buffer size is not a power of 2");
+        return;
+    }
 
-    queue->buffer_mask = buffer_size - 1;
-    queue->buffer = (TaskQueueCell *)(queue + 1);
-    taskClear(queue);
+    // NOTE (Matteo): Give the segments back, they are freed by the next thread which leaves the
+    // list last (or when the queue is cleared)
+    TaskSpillSegment *last = list;
+    while (last->retired_next) last = last->retired_next;
 
-    CF_ASSERT(config->num_workers > 0, "Invalid number of workers");
+    void *head = atomRead(&spill->retired);
+    for (;;)
+    {
+        last->retired_next = head;
+        atomReleaseFence();
 
-    Size workers_offset = buffer_size * sizeof(*queue->buffer);
-    Size slots_offset = workers_offset + config->num_workers * (sizeof(*queue->workers));
+        void *found = atomCompareExchangePtr(&spill->retired, head, list);
+        if (found == head) break;
+        head = found;
+    }
+}
 
-    queue->num_workers = config->num_workers;
-    queue->workers = (CfThread *)((U8 *)queue->buffer + workers_offset);
-    queue->worker_slots = (TaskWorkerSlot *)((U8 *)queue->buffer + slots_offset);
+static inline void
+taskSpillLeave(TaskQueue *queue, TaskSpill *spill)
+{
+    // NOTE (Matteo): Reading the segments must be complete before deregistering
+    atomReleaseFence();
 
-    return queue;
+    if (atomFetchDec(&spill->active) == 1 && atomRead(&spill->retired))
+    {
+        taskSpillReclaim(queue, spill);
+    }
 }
 
-void
-taskShutdown(TaskQueue *queue)
+static void
+taskSpillRetire(TaskSpill *spill, TaskSpillSegment *segment)
 {
-    taskStopProcessing(queue, true);
-}
+    void *head = atomRead(&spill->retired);
+    for (;;)
+    {
+        segment->retired_next = head;
+        atomReleaseFence();
 
-//===================================//
-// Start/stop processing
+        void *found = atomCompareExchangePtr(&spill->retired, head, segment);
+        if (found == head) break;
+        head = found;
+    }
+}
 
-bool
-taskStartProcessing(TaskQueue *queue)
+/// Cell storing the given position, searched from the given segment onwards; returns NULL if the
+/// position precedes the segment or follows the last one
+static TaskQueueCell *
+taskSpillCell(TaskSpillSegment *segment, Size pos)
 {
-    if (atomExchange(&queue->stop, false))
+    if (!segment || pos < segment->base) return NULL;
+
+    while (pos - segment->base >= TASK_SPILL_SEGMENT_SIZE)
     {
-        for (Size i = 0; i < queue->num_workers; ++i)
-        {
-            TaskWorkerSlot *slot = queue->worker_slots + i;
-            slot->queue = queue;
-            queue->workers[i] = cfThreadStart(taskThreadProc, .args = slot);
-        }
+        segment = atomRead(&segment->next);
+        atomAcquireFence();
 
-        return true;
+        if (!segment) return NULL;
     }
 
-    return false;
+    return segment->cells + (pos - segment->base);
 }
 
-bool
-taskStopProcessing(TaskQueue *queue, bool flush)
+/// Allocate the first segment of the list, or return the one allocated by another thread
+static TaskSpillSegment *
+taskSpillStart(TaskQueue *queue, TaskSpill *spill)
 {
-    if (!atomExchange(&queue->stop, true))
-    {
-        cfSemaSignal(&queue->semaphore, queue->num_workers);
-        cfThreadWaitAll(queue->workers, queue->num_workers, DURATION_INFINITE);
+    TaskSpillSegment *first = memAllocStruct(queue->spill_alloc, TaskSpillSegment);
+    if (!first) return NULL;
 
-        if (flush) taskClear(queue);
+    first->base = TASK_SPILL_START;
+    atomReleaseFence();
 
-        return true;
+    TaskSpillSegment *head = atomCompareExchangePtr(&spill->head, NULL, first);
+
+    if (head)
+    {
+        taskSpillFree(queue, first);
+        atomAcquireFence();
+        first = head;
     }
 
-    return false;
-}
+    atomCompareExchangePtr(&spill->tail, NULL, first);
 
-//===================================//
-// Enqueue/dequeue logic
+    return first;
+}
 
-TaskId
-taskEnqueue(TaskQueue *queue, TaskFn fn, void *data)
+/// Segment following the given one, which is allocated and linked if needed; returns NULL if the
+/// allocation fails
+static TaskSpillSegment *
+taskSpillNext(TaskQueue *queue, TaskSpill *spill, TaskSpillSegment *segment)
 {
-    TaskQueueCell *cell = NULL;
-    Size pos = atomRead(&queue->enqueue_pos);
+    TaskSpillSegment *next = atomRead(&segment->next);
+    atomAcquireFence();
 
-    for (;;)
+    if (!next)
     {
-        cell = queue->buffer + (pos & queue->buffer_mask);
-
-        Size seq = atomRead(&cell->sequence);
-        atomAcquireFence();
+        TaskSpillSegment *fresh = memAllocStruct(queue->spill_alloc, TaskSpillSegment);
+        if (!fresh) return NULL;
 
-        Offset dif = (Offset)seq - (Offset)pos;
+        fresh->base = segment->base + TASK_SPILL_SEGMENT_SIZE;
+        atomReleaseFence();
 
-        if (dif < 0) return 0; // Full
+        next = atomCompareExchangePtr(&segment->next, NULL, fresh);
 
-        if (dif > 0)
+        if (next)
         {
-            pos = atomRead(&queue->enqueue_pos);
+            taskSpillFree(queue, fresh);
+            atomAcquireFence();
         }
-        else if (atomCompareExchangeWeak(&queue->enqueue_pos, &pos, pos + 1))
+        else
         {
-            break;
+            next = fresh;
         }
     }
 
-    CF_ASSERT_NOT_NULL(cell);
-
-    cell->task.id = ~pos;
-    cell->task.fn = fn;
-    cell->task.data = data;
-    cell->task.canceled = false;
-    atomReleaseFence();
-    atomWrite(&cell->sequence, pos + 1);
+    // NOTE (Matteo): The tail is advanced before leaving the list, so that it never points to a
+    // segment which has been freed
+    TaskSpillSegment *tail = atomRead(&spill->tail);
+    atomAcquireFence();
 
-    cfSemaSignalOne(&queue->semaphore);
+    while (tail->base < next->base)
+    {
+        TaskSpillSegment *found = atomCompareExchangePtr(&spill->tail, tail, next);
+        if (found == tail) break;
 
-    CF_ASSERT(cell->task.id, "This should be always > 0");
+        tail = found;
+        atomAcquireFence();
+    }
 
-    return cell->task.id;
+    return next;
 }
 
-static bool
-taskDequeue(TaskQueue *queue, Task *out_task)
+static TaskId
+taskSpillEnqueue(TaskQueue *queue, TaskPriority priority, TaskFn fn, void *data)
 {
-    TaskQueueCell *cell = NULL;
-    Size pos = atomRead(&queue->dequeue_pos);
+    TaskSpill *spill = queue->spills + priority;
+    TaskId id = 0;
 
-    for (;;)
-    {
-        cell = queue->buffer + (pos & queue->buffer_mask);
+    taskSpillEnter(spill);
 
-        Size seq = atomRead(&cell->sequence);
-        atomAcquireFence();
+    TaskSpillSegment *segment = atomRead(&spill->tail);
+    atomAcquireFence();
 
-        Offset dif = (Offset)seq - (Offset)(pos + 1);
+    if (!segment) segment = taskSpillStart(queue, spill);
 
-        if (dif < 0) return false; // Empty
+    // NOTE (Matteo): A position is claimed only after the segment storing it has been linked, so
+    // that a failed allocation cannot leave a hole in the list
+    while (segment)
+    {
+        Size pos = atomRead(&spill->enqueue_pos);
 
-        if (dif > 0)
+        CF_ASSERT(pos >= segment->base, "Spill list tail is ahead of the enqueue position");
+
+        if (pos - segment->base >= TASK_SPILL_SEGMENT_SIZE)
         {
-            pos = atomRead(&queue->dequeue_pos);
+            segment = taskSpillNext(queue, spill, segment);
         }
-        else if (atomCompareExchangeWeak(&queue->dequeue_pos, &pos, pos + 1))
+        else if (atomCompareExchange(&spill->enqueue_pos, pos, pos + 1) == pos)
         {
+            TaskQueueCell *cell = segment->cells + (pos - segment->base);
+
+            cell->task.id = id = TASK_SPILL_ID(pos, priority);
+            cell->task.fn = fn;
+            cell->task.data = data;
+            cell->task.canceled = false;
+            atomWrite(&cell->claim, pos + 1);
+            atomReleaseFence();
+            atomWrite(&cell->sequence, pos + 1);
+
             break;
         }
     }
 
-    CF_ASSERT_NOT_NULL(cell);
+    taskSpillLeave(queue, spill);
 
-    *out_task = cell->task;
-    atomReleaseFence();
-    atomWrite(&cell->sequence, pos + queue->buffer_mask + 1);
+    if (id) cfEventNotifyOne(&queue->event);
 
-    return true;
+    return id;
 }
 
-//===================================//
-// Misc
-
-bool
-taskTryWork(TaskQueue *queue)
+/// Head of the list, after unlinking the segments whose tasks have all been taken (except the
+/// last one, which is still needed by the producers)
+static TaskSpillSegment *
+taskSpillHead(TaskSpill *spill, Size dequeue_pos)
 {
-    Task task;
+    TaskSpillSegment *head = atomRead(&spill->head);
+    atomAcquireFence();
 
-    if (taskDequeue(queue, &task))
+    while (head && dequeue_pos >= head->base + TASK_SPILL_SEGMENT_SIZE)
     {
-        // TODO (Matteo): This task cannot be canceled after it is dequeued
-        task.fn(task.data, &task.canceled);
-        return true;
+        TaskSpillSegment *next = atomRead(&head->next);
+        atomAcquireFence();
+
+        if (!next) break;
+
+        if (atomCompareExchangePtr(&spill->head, head, next) == head)
+        {
+            taskSpillRetire(spill, head);
+        }
+
+        head = atomRead(&spill->head);
+        atomAcquireFence();
     }
 
-    return false;
+    return head;
 }
 
-bool
-taskCompleted(TaskQueue *queue, TaskId id)
+static inline bool
+taskSpillPending(TaskQueue *queue, TaskPriority priority)
 {
-    CF_ASSERT(id, "Invalid task ID");
-
-    if (taskFindInQueue(queue, id)) return false;
-    if (taskFindInProgress(queue, id)) return false;
-
-    return true;
+    TaskSpill *spill = queue->spills + priority;
+    return queue->overflow == TaskOverflow_Spill &&
+           atomRead(&spill->dequeue_pos) != atomRead(&spill->enqueue_pos);
 }
 
-bool
-taskCancel(TaskQueue *queue, TaskId id)
+static bool
+taskSpillDequeue(TaskQueue *queue, TaskPriority priority, Task *out_task)
 {
-    CF_ASSERT(id, "Invalid task ID");
+    // NOTE (Matteo): Checked first so that the list is not contended while nothing is spilled
+    if (!taskSpillPending(queue, priority)) return false;
 
-    Task *task = taskFindInQueue(queue, id);
+    TaskSpill *spill = queue->spills + priority;
+    bool found = false;
 
-    if (!task) task = taskFindInProgress(queue, id);
+    taskSpillEnter(spill);
 
-    if (task)
+    for (;;)
     {
-        task->canceled = true;
-        return true;
-    }
+        Size pos = atomRead(&spill->dequeue_pos);
+        TaskSpillSegment *head = taskSpillHead(spill, pos);
+        TaskQueueCell *cell = taskSpillCell(head, pos);
 
-    return false;
+        if (!cell)
+        {
+            // NOTE (Matteo): A stale position could precede the head
+            if (head && pos < head->base) continue;
+            break; // Empty
+        }
+
+        Size seq = atomRead(&cell->sequence);
+        atomAcquireFence();
+
+        Offset dif = (Offset)seq - (Offset)(pos + 1);
+
+        if (dif < 0) break; // Empty
+        if (dif > 0) continue;
+        if (atomCompareExchange(&spill->dequeue_pos, pos, pos + 1) != pos) continue;
+
+        *out_task = cell->task;
+
+        // NOTE (Matteo): The task is skipped if it has been moved to a ring in the meantime
+        bool owned = (atomExchange(&cell->claim, 0) == pos + 1);
+
+        atomReleaseFence();
+        atomWrite(&cell->sequence, pos + 2);
+
+        if (owned)
+        {
+            found = true;
+            break;
+        }
+    }
+
+    taskSpillLeave(queue, spill);
+
+    return found;
+}
+
+/// Free all the segments of the list; the queue must be idle
+static void
+taskSpillClear(TaskQueue *queue, TaskSpill *spill)
+{
+    CF_ASSERT(!atomRead(&spill->active), "Cannot clear the spill list while in use");
+
+    TaskSpillSegment *segment = atomRead(&spill->head);
+    while (segment)
+    {
+        TaskSpillSegment *next = atomRead(&segment->next);
+        taskSpillFree(queue, segment);
+        segment = next;
+    }
+
+    segment = atomRead(&spill->retired);
+    while (segment)
+    {
+        TaskSpillSegment *next = segment->retired_next;
+        taskSpillFree(queue, segment);
+        segment = next;
+    }
+
+    atomWrite(&spill->head, NULL);
+    atomWrite(&spill->tail, NULL);
+    atomWrite(&spill->retired, NULL);
+    atomWrite(&spill->enqueue_pos, TASK_SPILL_START);
+    atomWrite(&spill->dequeue_pos, TASK_SPILL_START);
+}
+
+/// Spill list storing the task with the given ID, if any
+static inline TaskSpill *
+taskSpillOf(TaskQueue *queue, TaskId id)
+{
+    return TASK_IS_SPILL_ID(id) ? queue->spills + TASK_RING_PRIORITY(id) : NULL;
+}
+
+//===================================//
+// Internals
+
+static bool taskDequeue(TaskQueue *queue, TaskPriority priority, Task *out_task);
+
+/// Worker slot of the current thread, if it belongs to the given queue
+static inline TaskWorkerSlot *
+taskCurrentWorker(TaskQueue *queue)
+{
+    TaskWorkerSlot *worker = g_task_worker;
+    return (worker && worker->queue == queue) ? worker : NULL;
+}
+
+static bool
+taskSteal(TaskQueue *queue, TaskWorkerSlot *thief, Task *out_task)
+{
+    if (!queue->deque_size) return false;
+
+    Size start = 0;
+
+    if (thief)
+    {
+        thief->rng ^= thief->rng << 13;
+        thief->rng ^= thief->rng >> 17;
+        thief->rng ^= thief->rng << 5;
+        start = thief->rng % queue->num_workers;
+    }
+
+    for (Size i = 0; i < queue->num_workers; ++i)
+    {
+        TaskWorkerSlot *victim = queue->worker_slots + (start + i) % queue->num_workers;
+        if (victim != thief && taskDequeSteal(&victim->deque, out_task)) return true;
+    }
+
+    return false;
+}
+
+/// Retrieve the next task to execute: the oldest high priority one, then the most recent one
+/// pushed on the local deque, then the oldest normal priority one, then the oldest one of another
+/// worker, and finally the oldest low priority one
+static bool
+taskNext(TaskQueue *queue, TaskWorkerSlot *worker, Task *out_task)
+{
+    if (worker && (++worker->ticks % TASK_STARVATION_PERIOD) == 0)
+    {
+        for (Size priority = TaskPriority_Count; priority-- > 0;)
+        {
+            if (taskDequeue(queue, (TaskPriority)priority, out_task)) return true;
+        }
+    }
+
+    if (taskDequeue(queue, TaskPriority_High, out_task)) return true;
+    if (worker && queue->deque_size && taskDequePop(&worker->deque, out_task)) return true;
+    if (taskDequeue(queue, TaskPriority_Normal, out_task)) return true;
+    if (taskSteal(queue, worker, out_task)) return true;
+    if (taskDequeue(queue, TaskPriority_Low, out_task)) return true;
+
+    // NOTE (Matteo): Failed steals may leave a copy of a task in the output, which must not be
+    // reported as in progress
+    out_task->id = 0;
+    return false;
+}
+
+/// Wait for the next task to execute, returns false if the queue is stopped.
+/// Idle workers spin for a while before parking, since under bursty load new tasks are likely to
+/// arrive soon; the number of spins adapts to the load, and parked workers are woken only when
+/// tasks are enqueued.
+static bool
+taskIdle(TaskQueue *queue, TaskWorkerSlot *worker, Task *out_task)
+{
+    if (taskNext(queue, worker, out_task)) return true;
+
+    for (Size spin = 0; spin < worker->spins; ++spin)
+    {
+        atomSpinPause();
+
+        if (atomRead(&queue->stop)) return false;
+
+        if (taskNext(queue, worker, out_task))
+        {
+            // NOTE (Matteo): Spinning paid off, spin longer next time
+            worker->spins = cfMin(worker->spins * 2, (Size)TASK_SPIN_MAX);
+            return true;
+        }
+    }
+
+    worker->spins = cfMax(worker->spins / 2, (Size)TASK_SPIN_MIN);
+
+    for (;;)
+    {
+        U32 key = cfEventPrepareWait(&queue->event);
+
+        if (atomRead(&queue->stop))
+        {
+            cfEventCancelWait(&queue->event);
+            return false;
+        }
+
+        if (taskNext(queue, worker, out_task))
+        {
+            cfEventCancelWait(&queue->event);
+            return true;
+        }
+
+        cfEventWait(&queue->event, key);
+
+        if (taskNext(queue, worker, out_task)) return true;
+    }
+}
+
+static CF_THREAD_FN(taskThreadProc)
+{
+    TaskWorkerSlot *slot = args;
+    TaskQueue *queue = slot->queue;
+
+    g_task_worker = slot;
+
+    // NOTE (Matteo): Scratch arenas are bound to the worker thread only when it starts, and their
+    // memory is committed on first use
+    if (slot->has_scratch) memScratchBind(&slot->scratch);
+
+    Task *task = &slot->curr_task;
+
+    while (!atomRead(&queue->stop))
+    {
+        if (!taskIdle(queue, slot, task)) break;
+
+        task->fn(task->data, &task->canceled);
+        // NOTE (Matteo): Clear the slot so that the task is not reported as in progress anymore
+        task->id = 0;
+    }
+
+    g_task_worker = NULL;
+}
+
+static void
+taskClear(TaskQueue *queue)
+{
+    CF_ASSERT(atomRead(&queue->stop), "Cannot flush while running");
+
+    Size buffer_size = queue->buffer_mask + 1;
+
+    for (Size priority = 0; priority < TaskPriority_Count; ++priority)
+    {
+        TaskRing *ring = queue->rings + priority;
+
+        atomWrite(&ring->enqueue_pos, 0);
+        atomWrite(&ring->dequeue_pos, 0);
+
+        for (Size i = 0; i != buffer_size; i += 1)
+        {
+            atomWrite(&ring->buffer[i].sequence, i);
+        }
+    }
+
+    for (Size i = 0; i != queue->num_workers; i += 1)
+    {
+        atomWrite(&queue->worker_slots[i].deque.top, 0);
+        atomWrite(&queue->worker_slots[i].deque.bottom, 0);
+    }
+
+    for (Size priority = 0; priority < TaskPriority_Count; ++priority)
+    {
+        taskSpillClear(queue, queue->spills + priority);
+    }
+}
+
+/// Cell storing the task with the given ring (or spill) ID, if still queued.
+/// Spilled tasks must be accessed only while registered on their spill list.
+static TaskQueueCell *
+taskFindCell(TaskQueue *queue, TaskId id)
+{
+    Size pos = TASK_RING_POS(id);
+    TaskQueueCell *cell = NULL;
+
+    if (TASK_IS_SPILL_ID(id))
+    {
+        TaskSpillSegment *head = atomRead(&queue->spills[TASK_RING_PRIORITY(id)].head);
+        atomAcquireFence();
+
+        cell = taskSpillCell(head, pos);
+        if (!cell) return NULL;
+    }
+    else
+    {
+        cell = queue->rings[TASK_RING_PRIORITY(id)].buffer + (pos & queue->buffer_mask);
+    }
+
+    Size seq = atomRead(&cell->sequence);
+    atomAcquireFence();
+
+    return (seq == pos + 1) ? cell : NULL;
+}
+
+static Task *
+taskFindInQueue(TaskQueue *queue, TaskId id)
+{
+    Task *task = NULL;
+
+    if (TASK_IS_RING_ID(id))
+    {
+        TaskQueueCell *cell = taskFindCell(queue, id);
+        if (cell) task = &cell->task;
+    }
+    else if (queue->deque_size)
+    {
+        TaskWorkerSlot *owner = queue->worker_slots + (id >> 1) % queue->num_workers;
+        task = taskDequeFind(&owner->deque, id);
+    }
+
+    return task;
+}
+
+static Task *
+taskFindInProgress(TaskQueue *queue, TaskId id)
+{
+    for (Size i = 0; i < queue->num_workers; ++i)
+    {
+        Task *task = &queue->worker_slots[i].curr_task;
+        if (task->id == id) return task;
+    }
+
+    return NULL;
+}
+
+//===================================//
+// Config/init/shutdown
+
+bool
+taskConfig(TaskQueueConfig *config)
+{
+    Size buffer_size = config->buffer_size;
+
+    if (buffer_size <= 2) return false;
+    if (buffer_size & (buffer_size - 1)) return false;
+    if (config->deque_size & (config->deque_size - 1)) return false;
+    if (config->overflow == TaskOverflow_Spill && !config->spill_alloc.func) return false;
+
+    if (config->num_workers == 0)
+    {
+        config->num_workers = cfNumCores();
+    }
+
+    config->footprint = sizeof(TaskQueue) +
+                        TaskPriority_Count * buffer_size * sizeof(TaskQueueCell) +
+                        config->num_workers * (sizeof(CfThread) + sizeof(TaskWorkerSlot) +
+                                               config->deque_size * sizeof(Task));
+
+    return true;
+}
+
+TaskQueue *
+taskInit(TaskQueueConfig *config, void *memory)
+{
+    TaskQueue *queue = memory;
+
+    atomInit(&queue->stop, true);
+    cfEventInit(&queue->event);
+    cfEventInit(&queue->room);
+
+    Size buffer_size = config->buffer_size;
+
+    CF_ASSERT(buffer_size >= 2, "Buffer size is too small");
+    CF_ASSERT((buffer_size & (buffer_size - 1)) == 0, "Buffer size is not a power of 2");
+
+    CF_ASSERT(config->num_workers > 0, "Invalid number of workers");
+    CF_ASSERT(cfIsPowerOf2(config->deque_size), "Deque size is not a power of 2");
+
+    TaskQueueCell *buffers = (TaskQueueCell *)(queue + 1);
+
+    Size workers_offset = TaskPriority_Count * buffer_size * sizeof(*buffers);
+    Size slots_offset = workers_offset + config->num_workers * (sizeof(*queue->workers));
+    Size deques_offset = slots_offset + config->num_workers * (sizeof(*queue->worker_slots));
+
+    queue->buffer_mask = buffer_size - 1;
+
+    for (Size priority = 0; priority < TaskPriority_Count; ++priority)
+    {
+        queue->rings[priority].buffer = buffers + priority * buffer_size;
+    }
+
+    queue->num_workers = config->num_workers;
+    queue->workers = (CfThread *)((U8 *)buffers + workers_offset);
+    queue->worker_slots = (TaskWorkerSlot *)((U8 *)buffers + slots_offset);
+    memClear(queue->worker_slots, queue->num_workers * sizeof(*queue->worker_slots));
+
+    queue->deque_size = config->deque_size;
+
+    queue->overflow = config->overflow;
+    queue->spill_alloc = config->spill_alloc;
+
+    for (Size priority = 0; priority < TaskPriority_Count; ++priority)
+    {
+        TaskSpill *spill = queue->spills + priority;
+        atomInit(&spill->head, NULL);
+        atomInit(&spill->tail, NULL);
+        atomInit(&spill->retired, NULL);
+        atomInit(&spill->active, 0);
+    }
+
+    Task *deques = (Task *)((U8 *)buffers + deques_offset);
+
+    for (Size i = 0; i < queue->num_workers; ++i)
+    {
+        TaskWorkerSlot *slot = queue->worker_slots + i;
+        slot->index = i;
+        slot->next_id = 1;
+        slot->spins = TASK_SPIN_MIN;
+        slot->rng = (U32)(i + 1) * 0x9E3779B9u;
+        slot->deque.buffer = deques + i * queue->deque_size;
+        slot->deque.mask = queue->deque_size - 1;
+    }
+
+    taskClear(queue);
+
+    queue->scratch_parent = config->scratch_parent;
+    queue->scratch_size = config->scratch_size;
+
+    return queue;
+}
+
+void
+taskShutdown(TaskQueue *queue)
+{
+    // NOTE (Matteo): Clearing also frees the spill lists, even if the queue was already stopped
+    taskStopProcessing(queue, false);
+    taskClear(queue);
+}
+
+//===================================//
+// Start/stop processing
+
+bool
+taskStartProcessing(TaskQueue *queue)
+{
+    if (atomExchange(&queue->stop, false))
+    {
+        for (Size i = 0; i < queue->num_workers; ++i)
+        {
+            TaskWorkerSlot *slot = queue->worker_slots + i;
+            slot->queue = queue;
+
+            // NOTE (Matteo): Arenas are split off the parent only once, and reused across restarts
+            if (queue->scratch_parent && !slot->has_scratch)
+            {
+                slot->has_scratch =
+                    memScratchInit(&slot->scratch, queue->scratch_parent, queue->scratch_size);
+            }
+
+            queue->workers[i] = cfThreadStart(taskThreadProc, .args = slot);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool
+taskStopProcessing(TaskQueue *queue, bool flush)
+{
+    if (!atomExchange(&queue->stop, true))
+    {
+        // NOTE (Matteo): A single system call wakes up all the parked workers (and the blocked
+        // producers, which must give up)
+        cfEventNotifyAll(&queue->event);
+        cfEventNotifyAll(&queue->room);
+        cfThreadWaitAll(queue->workers, queue->num_workers, DURATION_INFINITE);
+
+        // NOTE (Matteo): Workers are started again from scratch, so their handles must be released
+        for (Size i = 0; i < queue->num_workers; ++i) cfThreadDestroy(queue->workers[i]);
+
+        if (flush) taskClear(queue);
+
+        return true;
+    }
+
+    return false;
+}
+
+//===================================//
+// Enqueue/dequeue logic
+
+/// Reserve a cell at the end of the given ring, returns NULL if the ring is full
+static TaskQueueCell *
+taskRingReserve(TaskQueue *queue, TaskRing *ring, Size *out_pos)
+{
+    TaskQueueCell *cell = NULL;
+    Size pos = atomRead(&ring->enqueue_pos);
+
+    for (;;)
+    {
+        cell = ring->buffer + (pos & queue->buffer_mask);
+
+        Size seq = atomRead(&cell->sequence);
+        atomAcquireFence();
+
+        Offset dif = (Offset)seq - (Offset)pos;
+
+        if (dif < 0) return NULL; // Full
+
+        if (dif > 0)
+        {
+            pos = atomRead(&ring->enqueue_pos);
+        }
+        else if (atomCompareExchangeWeak(&ring->enqueue_pos, &pos, pos + 1))
+        {
+            break;
+        }
+    }
+
+    CF_ASSERT_NOT_NULL(cell);
+
+    *out_pos = pos;
+    return cell;
+}
+
+/// Reserve a contiguous range of at most 'count' cells at the end of the given ring, returns the
+/// number of reserved cells (0 if the ring is full)
+static Size
+taskRingReserveRange(TaskQueue *queue, TaskRing *ring, Size count, Size *out_pos)
+{
+    Size pos = atomRead(&ring->enqueue_pos);
+
+    count = cfMin(count, queue->buffer_mask + 1);
+
+    for (;;)
+    {
+        // NOTE (Matteo): As for a single cell, the range only covers cells already released by the
+        // consumers, so that filling them never waits. Consumers may release their cells out of
+        // order, hence the range stops at the first cell which is still busy.
+        Size reserved = 0;
+        Offset dif = 0;
+
+        for (; reserved < count; ++reserved)
+        {
+            TaskQueueCell *cell = ring->buffer + ((pos + reserved) & queue->buffer_mask);
+            dif = (Offset)atomRead(&cell->sequence) - (Offset)(pos + reserved);
+            if (dif) break;
+        }
+
+        atomAcquireFence();
+
+        if (!reserved)
+        {
+            if (dif < 0) return 0; // Full
+            pos = atomRead(&ring->enqueue_pos);
+        }
+        else if (atomCompareExchangeWeak(&ring->enqueue_pos, &pos, pos + reserved))
+        {
+            *out_pos = pos;
+            return reserved;
+        }
+    }
+}
+
+/// Fill a reserved cell and make it available to the consumers, without waking any worker
+static TaskId
+taskRingFill(TaskQueueCell *cell, Size pos, TaskPriority priority, TaskFn fn, void *data,
+             bool canceled)
+{
+    cell->task.id = TASK_RING_ID(pos, priority);
+    cell->task.fn = fn;
+    cell->task.data = data;
+    cell->task.canceled = canceled;
+    atomWrite(&cell->claim, pos + 1);
+    atomReleaseFence();
+    atomWrite(&cell->sequence, pos + 1);
+
+    CF_ASSERT(cell->task.id, "This should be always > 0");
+
+    return cell->task.id;
+}
+
+/// Fill a reserved cell and make it available to the consumers
+static TaskId
+taskRingPublish(TaskQueue *queue, TaskQueueCell *cell, Size pos, TaskPriority priority,
+                TaskFn fn, void *data, bool canceled)
+{
+    TaskId id = taskRingFill(cell, pos, priority, fn, data, canceled);
+    cfEventNotifyOne(&queue->event);
+    return id;
+}
+
+/// Check if the given ring has a free cell at its end
+static bool
+taskRingHasRoom(TaskQueue *queue, TaskRing *ring)
+{
+    Size pos = atomRead(&ring->enqueue_pos);
+    Size seq = atomRead(&ring->buffer[pos & queue->buffer_mask].sequence);
+    atomAcquireFence();
+
+    return (Offset)seq - (Offset)pos >= 0;
+}
+
+/// Wait for room in the given ring, returns false if the queue is not processing
+static bool
+taskWaitRoom(TaskQueue *queue, TaskRing *ring)
+{
+    if (atomRead(&queue->stop)) return false;
+
+    // NOTE (Matteo): Workers cannot block, otherwise all of them could end up waiting for room
+    // that nobody makes; they execute pending tasks instead
+    if (taskCurrentWorker(queue))
+    {
+        if (!taskTryWork(queue)) atomSpinPause();
+        return true;
+    }
+
+    U32 key = cfEventPrepareWait(&queue->room);
+
+    if (atomRead(&queue->stop))
+    {
+        cfEventCancelWait(&queue->room);
+        return false;
+    }
+
+    if (taskRingHasRoom(queue, ring))
+    {
+        cfEventCancelWait(&queue->room);
+        return true;
+    }
+
+    cfEventWait(&queue->room, key);
+    return true;
+}
+
+/// Handle a task which does not fit the ring of the given priority, according to the overflow mode
+static TaskId
+taskOverflow(TaskQueue *queue, TaskPriority priority, TaskFn fn, void *data)
+{
+    switch (queue->overflow)
+    {
+        case TaskOverflow_Spill: return taskSpillEnqueue(queue, priority, fn, data);
+
+        case TaskOverflow_Inline:
+        {
+            bool canceled = false;
+            fn(data, &canceled);
+            return TASK_INLINE_ID;
+        }
+
+        case TaskOverflow_Block:
+        {
+            TaskRing *ring = queue->rings + priority;
+            Size pos;
+
+            for (;;)
+            {
+                TaskQueueCell *cell = taskRingReserve(queue, ring, &pos);
+                if (cell) return taskRingPublish(queue, cell, pos, priority, fn, data, false);
+                if (!taskWaitRoom(queue, ring)) return 0;
+            }
+        }
+
+        default: return 0;
+    }
+}
+
+TaskId
+taskEnqueue(TaskQueue *queue, TaskFn fn, void *data)
+{
+    return taskEnqueuePriority(queue, fn, data, TaskPriority_Normal);
+}
+
+TaskId
+taskEnqueuePriority(TaskQueue *queue, TaskFn fn, void *data, TaskPriority priority)
+{
+    CF_ASSERT(priority < TaskPriority_Count, "Invalid task priority");
+
+    TaskWorkerSlot *worker = taskCurrentWorker(queue);
+
+    // NOTE (Matteo): Tasks spawned by a worker are pushed on its own deque, if there is room, so
+    // that they are likely executed by the same worker while their data is still in cache
+    if (worker && queue->deque_size && priority == TaskPriority_Normal)
+    {
+        Task task = {
+            .id = (worker->next_id * queue->num_workers + worker->index) << 1,
+            .fn = fn,
+            .data = data,
+        };
+
+        if (taskDequePush(&worker->deque, &task))
+        {
+            worker->next_id++;
+            cfEventNotifyOne(&queue->event);
+            return task.id;
+        }
+    }
+
+    // NOTE (Matteo): While tasks are spilled, new ones are spilled as well to preserve the order
+    if (!taskSpillPending(queue, priority))
+    {
+        Size pos;
+        TaskQueueCell *cell = taskRingReserve(queue, queue->rings + priority, &pos);
+        if (cell) return taskRingPublish(queue, cell, pos, priority, fn, data, false);
+    }
+
+    return taskOverflow(queue, priority, fn, data);
+}
+
+Size
+taskEnqueueBatch(TaskQueue *queue, TaskFn const *fns, void *const *datas, Size count)
+{
+    return taskEnqueueBatchPriority(queue, fns, datas, count, TaskPriority_Normal, NULL);
+}
+
+Size
+taskEnqueueBatchPriority(TaskQueue *queue, TaskFn const *fns, void *const *datas, Size count,
+                         TaskPriority priority, TaskId *out_ids)
+{
+    CF_ASSERT(priority < TaskPriority_Count, "Invalid task priority");
+    CF_ASSERT_NOT_NULL(fns);
+
+    TaskRing *ring = queue->rings + priority;
+    Size queued = 0;
+
+    while (queued < count)
+    {
+        Size pos;
+        Size reserved = taskSpillPending(queue, priority)
+                            ? 0
+                            : taskRingReserveRange(queue, ring, count - queued, &pos);
+
+        for (Size i = 0; i < reserved; ++i)
+        {
+            TaskQueueCell *cell = ring->buffer + ((pos + i) & queue->buffer_mask);
+
+            CF_ASSERT(atomRead(&cell->sequence) == pos + i, "Cell not released");
+
+            Size index = queued + i;
+            TaskId id = taskRingFill(cell, pos + i, priority, fns[index],
+                                     datas ? datas[index] : NULL, false);
+            if (out_ids) out_ids[index] = id;
+        }
+
+        // NOTE (Matteo): A single notification wakes as many idle workers as needed, at most
+        if (reserved) cfEventNotify(&queue->event, reserved);
+
+        queued += reserved;
+
+        if (queue->overflow != TaskOverflow_Block) break;
+        if (!reserved && !taskWaitRoom(queue, ring)) return queued;
+    }
+
+    // NOTE (Matteo): The tasks which do not fit the ring overflow one at a time
+    for (; queued < count; ++queued)
+    {
+        TaskId id = taskOverflow(queue, priority, fns[queued], datas ? datas[queued] : NULL);
+        if (!id) break;
+        if (out_ids) out_ids[queued] = id;
+    }
+
+    return queued;
+}
+
+static bool
+taskRingDequeue(TaskQueue *queue, TaskPriority priority, Task *out_task)
+{
+    TaskRing *ring = queue->rings + priority;
+
+    for (;;)
+    {
+        TaskQueueCell *cell = NULL;
+        Size pos = atomRead(&ring->dequeue_pos);
+
+        for (;;)
+        {
+            cell = ring->buffer + (pos & queue->buffer_mask);
+
+            Size seq = atomRead(&cell->sequence);
+            atomAcquireFence();
+
+            Offset dif = (Offset)seq - (Offset)(pos + 1);
+
+            if (dif < 0) return false; // Empty
+
+            if (dif > 0)
+            {
+                pos = atomRead(&ring->dequeue_pos);
+            }
+            else if (atomCompareExchangeWeak(&ring->dequeue_pos, &pos, pos + 1))
+            {
+                break;
+            }
+        }
+
+        CF_ASSERT_NOT_NULL(cell);
+
+        *out_task = cell->task;
+
+        // NOTE (Matteo): The task is skipped if it has been moved to another ring in the meantime
+        bool owned = (atomExchange(&cell->claim, 0) == pos + 1);
+
+        atomReleaseFence();
+        atomWrite(&cell->sequence, pos + queue->buffer_mask + 1);
+
+        if (queue->overflow == TaskOverflow_Block) cfEventNotifyOne(&queue->room);
+
+        if (owned) return true;
+    }
+}
+
+static bool
+taskDequeue(TaskQueue *queue, TaskPriority priority, Task *out_task)
+{
+    return taskRingDequeue(queue, priority, out_task) ||
+           taskSpillDequeue(queue, priority, out_task);
+}
+
+static TASK_QUEUE_FN(taskNop)
+{
+    CF_UNUSED(data);
+    CF_UNUSED(canceled);
+}
+
+static TaskId
+taskMove(TaskQueue *queue, TaskId id, TaskPriority priority)
+{
+    TaskQueueCell *cell = taskFindCell(queue, id);
+
+    if (!cell) return 0;
+    if (TASK_RING_PRIORITY(id) == priority) return id;
+
+    Size pos = TASK_RING_POS(id);
+    Task task = cell->task;
+
+    // NOTE (Matteo): Room in the target ring is reserved before claiming the task, so that the
+    // task cannot be lost if the ring is full
+    Size new_pos;
+    TaskQueueCell *new_cell = taskRingReserve(queue, queue->rings + priority, &new_pos);
+    if (!new_cell) return 0;
+
+    // NOTE (Matteo): The task copy must be complete before the claim; if the claim succeeds the
+    // cell could not be recycled in the meantime, so the copy is valid
+    atomReleaseFence();
+
+    if (atomCompareExchange(&cell->claim, pos + 1, 0) != pos + 1)
+    {
+        // NOTE (Matteo): The task was taken by a consumer, the reserved cell is wasted
+        taskRingPublish(queue, new_cell, new_pos, priority, taskNop, NULL, false);
+        return 0;
+    }
+
+    return taskRingPublish(queue, new_cell, new_pos, priority, task.fn, task.data, task.canceled);
+}
+
+TaskId
+taskSetPriority(TaskQueue *queue, TaskId id, TaskPriority priority)
+{
+    CF_ASSERT(id, "Invalid task ID");
+    CF_ASSERT(priority < TaskPriority_Count, "Invalid task priority");
+
+    // NOTE (Matteo): Tasks on the worker deques are already being processed with the normal
+    // priority, and cannot be moved
+    if (!TASK_IS_RING_ID(id)) return 0;
+
+    TaskSpill *spill = taskSpillOf(queue, id);
+
+    if (spill) taskSpillEnter(spill);
+    TaskId new_id = taskMove(queue, id, priority);
+    if (spill) taskSpillLeave(queue, spill);
+
+    return new_id;
+}
+
+//===================================//
+// Misc
+
+bool
+taskTryWork(TaskQueue *queue)
+{
+    Task task;
+
+    if (taskNext(queue, taskCurrentWorker(queue), &task))
+    {
+        // TODO (Matteo): This task cannot be canceled after it is dequeued
+        task.fn(task.data, &task.canceled);
+        return true;
+    }
+
+    return false;
+}
+
+bool
+taskCompleted(TaskQueue *queue, TaskId id)
+{
+    CF_ASSERT(id, "Invalid task ID");
+
+    TaskSpill *spill = taskSpillOf(queue, id);
+
+    if (spill) taskSpillEnter(spill);
+    bool queued = (taskFindInQueue(queue, id) != NULL);
+    if (spill) taskSpillLeave(queue, spill);
+
+    return !queued && !taskFindInProgress(queue, id);
+}
+
+bool
+taskCancel(TaskQueue *queue, TaskId id)
+{
+    CF_ASSERT(id, "Invalid task ID");
+
+    TaskSpill *spill = taskSpillOf(queue, id);
+
+    if (spill) taskSpillEnter(spill);
+
+    Task *task = taskFindInQueue(queue, id);
+
+    if (!task) task = taskFindInProgress(queue, id);
+    if (task) task->canceled = true;
+
+    if (spill) taskSpillLeave(queue, spill);
+
+    return (task != NULL);
+}
+
+//===================================//
+// Task graphs
+
+static void taskNodeRelease(TaskNode *node);
+
+static TASK_QUEUE_FN(taskNodeProc)
+{
+    TaskNode *node = data;
+    TaskGroup *group = node->group;
+
+    node->fn(node->data, canceled);
+
+    // NOTE (Matteo): Successors spawned by a worker end up on its deque, and are likely to run
+    // while the results of this task are still in cache
+    for (Size i = 0; i < node->num_successors; ++i) taskNodeRelease(node->successors[i]);
+
+    // NOTE (Matteo): The node must not be accessed after this point, since its owner can
+    // legitimately free it once the group is completed
+    if (group)
+    {
+        atomReleaseFence();
+        atomFetchDec(&group->pending);
+    }
+}
+
+static void
+taskNodeRelease(TaskNode *node)
+{
+    // NOTE (Matteo): The last thread to release the node must see the writes of all the others,
+    // that is the results of the parents and the queue set on submission
+    atomReleaseFence();
+    if (atomFetchDec(&node->pending) != 1) return;
+
+    atomAcquireFence();
+
+    if (!taskEnqueue(node->queue, taskNodeProc, node))
+    {
+        bool canceled = false;
+        taskNodeProc(node, &canceled);
+    }
+}
+
+void
+taskGroupInit(TaskGroup *group)
+{
+    atomInit(&group->pending, 0);
+}
+
+bool
+taskGroupCompleted(TaskGroup *group)
+{
+    if (atomRead(&group->pending)) return false;
+    atomAcquireFence();
+    return true;
+}
+
+void
+taskWait(TaskQueue *queue, TaskGroup *group)
+{
+    while (!taskGroupCompleted(group))
+    {
+        if (!taskTryWork(queue)) cfYield();
+    }
+}
+
+void
+taskNodeInit(TaskNode *node, TaskFn fn, void *data, TaskGroup *group)
+{
+    CF_ASSERT_NOT_NULL(fn);
+
+    memClearStruct(node);
+    node->fn = fn;
+    node->data = data;
+    node->group = group;
+    atomInit(&node->pending, 1);
+
+    if (group) atomFetchInc(&group->pending);
+}
+
+void
+taskNodeDepend(TaskNode *node, TaskNode *parent)
+{
+    CF_ASSERT(!parent->queue, "Dependencies must be declared before submitting the parent");
+    CF_ASSERT(!node->queue, "Dependencies must be declared before submitting the node");
+    CF_ASSERT(parent->num_successors < TaskNode_MaxSuccessors, "Too many successors");
+
+    parent->successors[parent->num_successors++] = node;
+    atomFetchInc(&node->pending);
+}
+
+void
+taskSubmit(TaskQueue *queue, TaskNode *node)
+{
+    CF_ASSERT(!node->queue, "Node already submitted");
+
+    node->queue = queue;
+
+    // NOTE (Matteo): Release the reference held since initialization, the node starts now if its
+    // parents are already completed
+    taskNodeRelease(node);
+}
+
+//===================================//
+// Parallel for
+
+// NOTE (Matteo): Ranges are split with lazy binary splitting: a task processes its range one grain
+// at a time, and hands out half of the remaining range only if there is no work available to
+// thieves (i.e. the local deque, or the shared buffer, is empty). This adapts the number of tasks
+// to the actual load without tuning the grain size for each kernel and thread count.
+
+typedef struct TaskFor
+{
+    TaskQueue *queue;
+    TaskForFn fn;
+    void *context;
+    Size grain;
+} TaskFor;
+
+typedef struct TaskForRange
+{
+    TaskFor *pfor;
+    AtomSize *pending;
+    Size begin;
+    Size end;
+} TaskForRange;
+
+static void taskForRun(TaskFor *pfor, Size begin, Size end);
+
+static TASK_QUEUE_FN(taskForProc)
+{
+    CF_UNUSED(canceled);
+
+    TaskForRange *range = data;
+    AtomSize *pending = range->pending;
+
+    taskForRun(range->pfor, range->begin, range->end);
+
+    atomReleaseFence();
+    atomFetchDec(pending);
+}
+
+/// Check if there is no work available for idle workers
+static bool
+taskForStarving(TaskQueue *queue, TaskWorkerSlot *worker)
+{
+    if (worker && queue->deque_size)
+    {
+        return atomRead(&worker->deque.bottom) <= atomRead(&worker->deque.top);
+    }
+
+    TaskRing *ring = queue->rings + TaskPriority_Normal;
+    return atomRead(&ring->enqueue_pos) == atomRead(&ring->dequeue_pos);
+}
+
+static void
+taskForRun(TaskFor *pfor, Size begin, Size end)
+{
+    TaskQueue *queue = pfor->queue;
+    TaskWorkerSlot *worker = taskCurrentWorker(queue);
+    Size slot = worker ? worker->index + 1 : 0;
+
+    // NOTE (Matteo): Each split halves the range, so the number of children is bounded by the
+    // bit width of the range size
+    TaskForRange children[CF_PTR_SIZE * 8];
+    Size num_children = 0;
+
+    AtomSize pending;
+    atomInit(&pending, 0);
+
+    while (begin < end)
+    {
+        Size count = end - begin;
+
+        if (count > pfor->grain && taskForStarving(queue, worker))
+        {
+            CF_ASSERT(num_children < CF_ARRAY_SIZE(children), "Too many splits");
+
+            Size middle = begin + count / 2;
+            TaskForRange *child = children + num_children;
+
+            child->pfor = pfor;
+            child->pending = &pending;
+            child->begin = middle;
+            child->end = end;
+
+            atomFetchInc(&pending);
+
+            if (taskEnqueue(queue, taskForProc, child))
+            {
+                num_children++;
+                end = middle;
+                continue;
+            }
+
+            // NOTE (Matteo): The queue is full, there is enough work around
+            atomFetchDec(&pending);
+        }
+
+        Size chunk_end = begin + cfMin(count, pfor->grain);
+        pfor->fn(begin, chunk_end, slot, pfor->context);
+        begin = chunk_end;
+    }
+
+    // NOTE (Matteo): Children reference the stack of this task, so they must be joined before
+    // returning; help the queue in the meantime
+    while (atomRead(&pending))
+    {
+        if (!taskTryWork(queue)) cfYield();
+    }
+
+    atomAcquireFence();
+}
+
+Size
+taskSlotCount(TaskQueue *queue)
+{
+    return queue->num_workers + 1;
+}
+
+void
+taskParallelFor(TaskQueue *queue, Size begin, Size end, Size grain, TaskForFn fn, void *context)
+{
+    CF_ASSERT_NOT_NULL(fn);
+    CF_ASSERT(begin <= end, "Invalid range");
+
+    if (!grain)
+    {
+        // NOTE (Matteo): Aim at a few chunks per thread, lazy splitting takes care of the balance
+        grain = cfMax((Size)1, (end - begin) / (8 * taskSlotCount(queue)));
+    }
+
+    TaskFor pfor = {.queue = queue, .fn = fn, .context = context, .grain = grain};
+
+    taskForRun(&pfor, begin, end);
 }
@@ -1,15 +1,48 @@
 #pragma once
 
+#include "atom.h"
 #include "core.h"
 
+typedef struct MemArena MemArena;
+
+/// Behavior of the enqueue functions when the FIFO buffer of the requested priority is full
+typedef enum TaskOverflow
+{
+    /// The enqueue fails, returning 0
+    TaskOverflow_Fail = 0,
+    /// The task is spilled to an unbounded list, whose segments are allocated on demand; spilled
+    /// tasks are executed after the buffered ones of the same priority, preserving the FIFO order
+    TaskOverflow_Spill,
+    /// The task is executed immediately by the calling thread
+    TaskOverflow_Inline,
+    /// The caller is blocked until there is room in the buffer; workers execute pending tasks
+    /// while waiting, since otherwise nobody could make room. The enqueue fails only if the queue
+    /// is not processing.
+    TaskOverflow_Block,
+} TaskOverflow;
+
 /// Task queue configuration struct
 typedef struct TaskQueueConfig
 {
-    /// [In] Size of the internal FIFO buffer
+    /// [In] Size of the internal FIFO buffers (one for each priority level)
     Size buffer_size;
     /// [In] Number of worker threads that service the queue (a default value of 0 means to use a
     /// number of workers equal to the number of logical cores on the machine)
     Size num_workers;
+    /// [In] Optional arena from which the scratch arenas of each worker are split (see MemScratch)
+    MemArena *scratch_parent;
+    /// [In] Size of each scratch arena split for the workers
+    Size scratch_size;
+    /// [In] Size of the local deque of each worker, which must be a power of 2 (a default value of
+    /// 0 disables work stealing, so that all the tasks go through the shared FIFO buffer).
+    /// Tasks enqueued by a worker are pushed on its own deque and executed LIFO, while idle
+    /// workers steal the oldest tasks from the others; the FIFO buffer is used as a fallback.
+    Size deque_size;
+    /// [In] Behavior of the enqueue functions when the FIFO buffer is full (fail by default)
+    TaskOverflow overflow;
+    /// [In] Allocator of the spill list, required by TaskOverflow_Spill; it must be thread safe,
+    /// since segments are allocated and freed by both the producers and the workers
+    MemAllocator spill_alloc;
     /// [Out] Memory footprint of the configured queue
     Size footprint;
 } TaskQueueConfig;
@@ -22,6 +55,21 @@ typedef TASK_QUEUE_FN((*TaskFn));
 /// Task identifier
 typedef Size TaskId;
 
+/// Priority of a task.
+/// Each priority has its own FIFO buffer, drained from the highest priority to the lowest; workers
+/// periodically check the lower priorities first, so that they cannot starve.
+typedef enum TaskPriority
+{
+    /// Latency critical work (e.g. the content displayed to the user)
+    TaskPriority_High = 0,
+    /// Default priority, the only one used by tasks spawned on the worker deques
+    TaskPriority_Normal,
+    /// Speculative work (e.g. prefetching)
+    TaskPriority_Low,
+
+    TaskPriority_Count,
+} TaskPriority;
+
 /// Opaque type representing the task queue
 typedef struct TaskQueue TaskQueue;
 
@@ -29,7 +77,8 @@ typedef struct TaskQueue TaskQueue;
 bool taskConfig(TaskQueueConfig *config);
 
 /// Initializes the task queue in the given block of memory.
-/// The size of the block is specified by the 'footprint' member of the config struct.
+/// The size of the block is specified by the 'footprint' member of the config struct; the block
+/// should be aligned to the cache line, to avoid false sharing with the surrounding data.
 /// The queue is idle upon initialization, and processing must be explicitly started.
 TaskQueue *taskInit(TaskQueueConfig *config, void *memory);
 
@@ -41,9 +90,31 @@ bool taskStartProcessing(TaskQueue *queue);
 /// Stop processing of queued tasks, optionally flushing them.
 bool taskStopProcessing(TaskQueue *queue, bool flush);
 
-/// Enqueue a task for processing
+/// Enqueue a task for processing, with normal priority.
+/// Returns the ID of the task, or 0 if the buffer is full and the overflow mode does not handle it
+/// (see TaskOverflow); tasks executed inline get an ID which is always reported as completed.
 TaskId taskEnqueue(TaskQueue *queue, TaskFn fn, void *data);
 
+/// Enqueue a task for processing with the given priority
+TaskId taskEnqueuePriority(TaskQueue *queue, TaskFn fn, void *data, TaskPriority priority);
+
+/// Enqueue a batch of tasks for processing, with normal priority; 'datas' can be NULL.
+/// The tasks occupy a contiguous range of the buffer, which is claimed at once, and a single
+/// notification wakes the idle workers. Returns the number of tasks enqueued, which is less than
+/// 'count' only if the buffer is full and the overflow mode does not handle the remaining tasks,
+/// which are left to the caller; otherwise they overflow one at a time.
+Size taskEnqueueBatch(TaskQueue *queue, TaskFn const *fns, void *const *datas, Size count);
+
+/// Enqueue a batch of tasks for processing with the given priority, optionally storing their IDs
+Size taskEnqueueBatchPriority(TaskQueue *queue, TaskFn const *fns, void *const *datas, Size count,
+                              TaskPriority priority, TaskId *out_ids);
+
+/// Boost or demote a task which is still queued, moving it to the buffer of the given priority.
+/// Returns the new ID of the task (the old one is not valid anymore), or 0 if the task is not
+/// queued anymore, is queued on a worker deque, or the buffer of the given priority is full (moved
+/// tasks never overflow).
+TaskId taskSetPriority(TaskQueue *queue, TaskId id, TaskPriority priority);
+
 /// Assist the task queue by performing a pending task, if present, on the current thread
 bool taskTryWork(TaskQueue *queue);
 
@@ -53,3 +124,83 @@ bool taskCompleted(TaskQueue *queue, TaskId id);
 /// Mark the given task as canceled. The execution of the task is not prevented,
 /// the user should check the value of the 'canceled' pointer inside the task code.
 bool taskCancel(TaskQueue *queue, TaskId id);
+
+//===================================//
+// Task graphs
+
+enum
+{
+    /// Maximum number of tasks that can depend on a single task node
+    TaskNode_MaxSuccessors = 8,
+};
+
+/// Set of tasks that can be waited on as a whole
+typedef struct TaskGroup
+{
+    /// Number of tasks of the group not completed yet
+    AtomSize pending;
+} TaskGroup;
+
+/// Task which is enqueued automatically once all its parents are completed.
+/// The node is provided by the user and must stay alive until the task is completed.
+typedef struct TaskNode TaskNode;
+
+struct TaskNode
+{
+    TaskFn fn;
+    void *data;
+    TaskGroup *group;
+    TaskQueue *queue;
+
+    /// Nodes that depend on this one
+    TaskNode *successors[TaskNode_MaxSuccessors];
+    Size num_successors;
+
+    /// Number of parents not completed yet, plus one until the node is submitted
+    AtomSize pending;
+};
+
+/// Initialize an empty task group
+void taskGroupInit(TaskGroup *group);
+
+/// Check if all the tasks of the group have been completed
+bool taskGroupCompleted(TaskGroup *group);
+
+/// Wait for all the tasks of the group to be completed; the calling thread helps the queue by
+/// performing pending tasks instead of sleeping
+void taskWait(TaskQueue *queue, TaskGroup *group);
+
+/// Initialize a task node, optionally adding it to the given group
+void taskNodeInit(TaskNode *node, TaskFn fn, void *data, TaskGroup *group);
+
+/// Declare that the node must be executed after the given parent is completed.
+/// Dependencies must be declared before the parent is submitted.
+void taskNodeDepend(TaskNode *node, TaskNode *parent);
+
+/// Submit the node for processing, which starts as soon as all its parents are completed.
+/// If the queue is full the node is executed on the calling thread.
+void taskSubmit(TaskQueue *queue, TaskNode *node);
+
+//===================================//
+// Parallel for
+
+#define TASK_FOR_FN(name) void name(Size begin, Size end, Size slot, void *context)
+
+/// Type of the procedure that processes a range of a parallel for.
+/// 'slot' identifies the executing thread, and can be used to index per-thread data (e.g. for
+/// reductions) without synchronization: workers use slots from 1 to the number of workers, while
+/// slot 0 is used by any thread that is not a worker of the queue.
+typedef TASK_FOR_FN((*TaskForFn));
+
+/// Number of slots that can be passed to a parallel for procedure (number of workers + 1)
+Size taskSlotCount(TaskQueue *queue);
+
+/// Process the range [begin, end) in parallel, calling the given procedure on sub-ranges of at
+/// most 'grain' items (0 means to pick a grain automatically).
+/// The range is split lazily, only when there are idle workers to steal the split half, and the
+/// calling thread participates in the processing; the function returns once the whole range has
+/// been processed.
+/// NOTE: when using slots, no other thread that is not a worker must help the queue concurrently,
+/// since it would share slot 0 with the calling thread.
+void taskParallelFor(TaskQueue *queue, Size begin, Size end, Size grain, TaskForFn fn,
+                     void *context);
@@ -3,8 +3,10 @@
 //------------------------------------------------------------------------------
 // OS primitives implementation
 
-#ifdef CF_OS_WIN32
+#if CF_OS_WIN32
 #    include "threading_win32.c"
+#elif CF_OS_LINUX
+#    include "threading_linux.c"
 #else
 #    error "Threading API not implemented for this platform"
 #endif
@@ -97,3 +99,76 @@ cfSemaSignal(CfSemaphore *sema, Size count)
     semaHandleSignal(sema->handle, count);
 #endif
 }
+
+//------------------------------------------------------------------------------
+// Event count implementation
+
+// NOTE (Matteo): Event count as described by Dmitry Vyukov: a waiter registers itself before
+// checking the condition again, while a notifier checks for registered waiters after publishing
+// the condition; the sequential fences guarantee that either the waiter sees the condition, or
+// the notifier sees the waiter.
+
+static void eventWaitAddress(AtomU32 *address, U32 expected);
+static void eventWakeAddress(AtomU32 *address, Size count);
+
+CF_API void
+cfEventInit(CfEventCount *event)
+{
+    atomInit(&event->epoch, 0);
+    atomInit(&event->waiters, 0);
+}
+
+CF_API U32
+cfEventPrepareWait(CfEventCount *event)
+{
+    atomFetchInc(&event->waiters);
+    atomSequentialFence();
+    return atomRead(&event->epoch);
+}
+
+CF_API void
+cfEventCancelWait(CfEventCount *event)
+{
+    atomFetchDec(&event->waiters);
+}
+
+CF_API void
+cfEventWait(CfEventCount *event, U32 key)
+{
+    // NOTE (Matteo): The loop handles spurious wakeups, the wait is over only after a notification
+    while (atomRead(&event->epoch) == key) eventWaitAddress(&event->epoch, key);
+
+    atomFetchDec(&event->waiters);
+    atomAcquireFence();
+}
+
+CF_API void
+cfEventNotify(CfEventCount *event, Size count)
+{
+    atomSequentialFence();
+
+    if (count && atomRead(&event->waiters))
+    {
+        atomFetchInc(&event->epoch);
+        eventWakeAddress(&event->epoch, count);
+    }
+}
+
+CF_API void
+cfEventNotifyOne(CfEventCount *event)
+{
+    cfEventNotify(event, 1);
+}
+
+CF_API void
+cfEventNotifyAll(CfEventCount *event)
+{
+    cfEventNotify(event, SIZE_MAX);
+}
+
+CF_API Size
+cfEventWaiters(CfEventCount *event)
+{
+    atomSequentialFence();
+    return atomRead(&event->waiters);
+}
@@ -157,4 +157,37 @@ CF_API void cfSemaWait(CfSemaphore *sema);
 CF_API void cfSemaSignalOne(CfSemaphore *sema);
 CF_API void cfSemaSignal(CfSemaphore *sema, Size count);
 
+//-----------------//
+//   Event count   //
+//-----------------//
+
+/// Lightweight primitive which allows threads to wait for a condition that is checked without
+/// locks (e.g. a lock-free queue becoming non-empty).
+/// Waiting is split in two phases, so that notifications issued between the check of the
+/// condition and the actual wait are not lost:
+///
+///     U32 key = cfEventPrepareWait(event);
+///     if (condition) cfEventCancelWait(event);
+///     else cfEventWait(event, key);
+///
+/// Notifications are cheap when no thread is waiting, since no system call is issued.
+typedef struct CfEventCount
+{
+    /// Incremented by each notification, it is the word the waiters sleep on
+    AtomU32 epoch;
+    /// Number of threads that are waiting, or preparing to
+    AtomU32 waiters;
+} CfEventCount;
+
+CF_API void cfEventInit(CfEventCount *event);
+CF_API U32 cfEventPrepareWait(CfEventCount *event);
+CF_API void cfEventCancelWait(CfEventCount *event);
+CF_API void cfEventWait(CfEventCount *event, U32 key);
+/// Wake up to the given number of waiting threads (on Win32 either one or all threads are woken)
+CF_API void cfEventNotify(CfEventCount *event, Size count);
+CF_API void cfEventNotifyOne(CfEventCount *event);
+CF_API void cfEventNotifyAll(CfEventCount *event);
+/// Number of threads that are waiting, or preparing to (useful to size notifications)
+CF_API Size cfEventWaiters(CfEventCount *event);
+
 //------------------------------------------------------------------------------
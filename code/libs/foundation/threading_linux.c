@@ -0,0 +1,675 @@
+#include "threading.h"
+
+#include "error.h"
+#include "time.h"
+
+#include "atom.inl"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// NOTE (Matteo): The opaque storage of the threading primitives is sized after the Win32 SRW locks
+// and condition variables (a single pointer), which is too small for the pthread equivalents.
+// Mutexes, reader/writer locks and condition variables are thus built directly upon futexes, which
+// require a single 32 bit word.
+
+//------------------------------------------------------------------------------
+// Misc implementation
+
+static inline struct timespec
+linuxTimespec(Duration duration)
+{
+    return (struct timespec){.tv_sec = duration.seconds, .tv_nsec = duration.nanos};
+}
+
+static inline struct timespec
+linuxDeadline(Duration duration)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    Duration deadline = timeAdd((Duration){.seconds = now.tv_sec, .nanos = (U32)now.tv_nsec},
+                                duration);
+
+    return linuxTimespec(deadline);
+}
+
+void
+cfSleep(Duration duration)
+{
+    struct timespec req = linuxTimespec(duration);
+    while (nanosleep(&req, &req) == -1 && errno == EINTR) continue;
+}
+
+void
+cfYield(void)
+{
+    sched_yield();
+}
+
+U32
+cfCurrentThreadId(void)
+{
+    return (U32)syscall(SYS_gettid);
+}
+
+Size
+cfNumCores(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (Size)count : 1;
+}
+
+//------------------------------------------------------------------------------
+// Futex helpers
+
+static inline U32 volatile *
+linuxFutexWord(void *data)
+{
+    return (U32 volatile *)data;
+}
+
+/// Wait until the futex word changes from the expected value, or the timeout expires.
+/// Returns false on timeout.
+static bool
+linuxFutexWait(U32 volatile *word, U32 expected, Duration duration)
+{
+    struct timespec timeout;
+    struct timespec *timeout_ptr = NULL;
+
+    if (!timeIsInfinite(duration))
+    {
+        timeout = linuxTimespec(duration);
+        timeout_ptr = &timeout;
+    }
+
+    long result = syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, timeout_ptr, NULL, 0);
+    return (result == 0 || errno != ETIMEDOUT);
+}
+
+static void
+linuxFutexWake(U32 volatile *word, I32 count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+//------------------------------------------------------------------------------
+// Thread implementation
+
+CF_STATIC_ASSERT(sizeof(pthread_t) <= sizeof(Size), "pthread_t does not fit a thread handle");
+
+typedef struct LinuxThreadData
+{
+    CfThreadFn proc;
+    void *args;
+    pthread_t thread;
+    AtomBool running;
+    bool joined;
+} LinuxThreadData;
+
+static void *
+linuxThreadProc(void *data_ptr)
+{
+    LinuxThreadData *data = data_ptr;
+
+    data->proc(data->args);
+
+    atomWrite(&data->running, false);
+    atomReleaseFence();
+
+    return NULL;
+}
+
+CfThread
+cfThreadCreate(CfThreadParms *parms)
+{
+    CF_ASSERT_NOT_NULL(parms);
+
+    CfThread thread = {0};
+
+    // NOTE (Matteo): The thread data must outlive the creation routine, since the thread handle
+    // needs to track the join status; it is released by cfThreadDestroy.
+    LinuxThreadData *data = calloc(1, sizeof(*data));
+    if (!data) return thread;
+
+    data->proc = parms->fn;
+    data->args = parms->args;
+    atomInit(&data->running, true);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (parms->stack_size) pthread_attr_setstacksize(&attr, parms->stack_size);
+
+    if (pthread_create(&data->thread, &attr, linuxThreadProc, data) == 0)
+    {
+        if (parms->debug_name)
+        {
+            // NOTE (Matteo): Linux thread names are limited to 16 bytes, including the terminator
+            Char8 buffer[16] = {0};
+            Size len = 0;
+            while (len < sizeof(buffer) - 1 && parms->debug_name[len])
+            {
+                buffer[len] = parms->debug_name[len];
+                ++len;
+            }
+            pthread_setname_np(data->thread, buffer);
+        }
+
+        thread.handle = (Size)data;
+    }
+    else
+    {
+        free(data);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    return thread;
+}
+
+void
+cfThreadDestroy(CfThread thread)
+{
+    LinuxThreadData *data = (LinuxThreadData *)thread.handle;
+    if (data)
+    {
+        if (!data->joined) pthread_detach(data->thread);
+        free(data);
+    }
+}
+
+bool
+cfThreadIsRunning(CfThread thread)
+{
+    LinuxThreadData *data = (LinuxThreadData *)thread.handle;
+    return data && atomRead(&data->running);
+}
+
+bool
+cfThreadWait(CfThread thread, Duration duration)
+{
+    LinuxThreadData *data = (LinuxThreadData *)thread.handle;
+
+    if (!data) return false;
+    if (data->joined) return true;
+
+    I32 result = 0;
+
+    if (timeIsInfinite(duration))
+    {
+        result = pthread_join(data->thread, NULL);
+    }
+    else
+    {
+        struct timespec deadline = linuxDeadline(duration);
+        result = pthread_timedjoin_np(data->thread, NULL, &deadline);
+    }
+
+    data->joined = (result == 0);
+
+    return data->joined;
+}
+
+bool
+cfThreadWaitAll(CfThread *threads, Size num_threads, Duration duration)
+{
+    // NOTE (Matteo): Each thread is waited for the remaining portion of the given duration
+    Clock clock;
+    clockStart(&clock);
+
+    for (Size i = 0; i < num_threads; ++i)
+    {
+        Duration remaining = duration;
+
+        if (!timeIsInfinite(duration))
+        {
+            Duration elapsed = clockElapsed(&clock);
+            if (timeIsGe(elapsed, duration)) return false;
+            remaining = timeSub(duration, elapsed);
+        }
+
+        if (!cfThreadWait(threads[i], remaining)) return false;
+    }
+
+    return true;
+}
+
+Size
+cfThreadWaitAny(CfThread *threads, Size num_threads, Duration duration)
+{
+    // NOTE (Matteo): pthreads offer no way to wait for multiple threads, so poll their status
+    Clock clock;
+    clockStart(&clock);
+
+    for (;;)
+    {
+        for (Size i = 0; i < num_threads; ++i)
+        {
+            if (!cfThreadIsRunning(threads[i])) return i;
+        }
+
+        if (!timeIsInfinite(duration) && timeIsGe(clockElapsed(&clock), duration)) break;
+
+        cfSleep(timeDurationMs(1));
+    }
+
+    return num_threads;
+}
+
+//------------------------------------------------------------------------------
+// Mutex implementation
+
+// NOTE (Matteo): Mutex based on "Futexes are tricky" by Ulrich Drepper
+// State: 0 = unlocked, 1 = locked, 2 = locked with waiters
+
+enum
+{
+    LinuxMutex_Unlocked = 0,
+    LinuxMutex_Locked = 1,
+    LinuxMutex_Contended = 2,
+};
+
+CF_STATIC_ASSERT(sizeof(((CfMutex *)0)->data) >= sizeof(U32), "Invalid Mutex internal size");
+
+static inline AtomU32 *
+linuxMutexState(CfMutex *mutex)
+{
+    return (AtomU32 *)(mutex->data);
+}
+
+static void
+linuxMutexLock(AtomU32 *state)
+{
+    U32 curr = atomCompareExchange(state, LinuxMutex_Unlocked, LinuxMutex_Locked);
+
+    if (curr != LinuxMutex_Unlocked)
+    {
+        if (curr != LinuxMutex_Contended) curr = atomExchange(state, LinuxMutex_Contended);
+
+        while (curr != LinuxMutex_Unlocked)
+        {
+            linuxFutexWait(linuxFutexWord(state), LinuxMutex_Contended, DURATION_INFINITE);
+            curr = atomExchange(state, LinuxMutex_Contended);
+        }
+    }
+
+    atomAcquireFence();
+}
+
+static bool
+linuxMutexTryLock(AtomU32 *state)
+{
+    if (atomCompareExchange(state, LinuxMutex_Unlocked, LinuxMutex_Locked) == LinuxMutex_Unlocked)
+    {
+        atomAcquireFence();
+        return true;
+    }
+
+    return false;
+}
+
+static void
+linuxMutexUnlock(AtomU32 *state)
+{
+    atomReleaseFence();
+    if (atomFetchSub(state, 1) != LinuxMutex_Locked)
+    {
+        atomWrite(state, LinuxMutex_Unlocked);
+        linuxFutexWake(linuxFutexWord(state), 1);
+    }
+}
+
+void
+cfMutexInit(CfMutex *mutex)
+{
+    CF_ASSERT_NOT_NULL(mutex);
+    atomInit(linuxMutexState(mutex), LinuxMutex_Unlocked);
+#if CF_THREADING_DEBUG
+    mutex->internal = 0;
+#endif
+}
+
+void
+cfMutexShutdown(CfMutex *mutex)
+{
+    CF_ASSERT_NOT_NULL(mutex);
+#if CF_THREADING_DEBUG
+    CF_ASSERT(mutex->internal == 0, "Shutting down an acquired mutex");
+#endif
+}
+
+bool
+cfMutexTryAcquire(CfMutex *mutex)
+{
+    CF_ASSERT_NOT_NULL(mutex);
+
+    if (!linuxMutexTryLock(linuxMutexState(mutex)))
+    {
+#if CF_THREADING_DEBUG
+        CF_ASSERT(mutex->internal != cfCurrentThreadId(), "Attempted to lock recursively");
+#endif
+        return false;
+    }
+
+#if CF_THREADING_DEBUG
+    mutex->internal = cfCurrentThreadId();
+#endif
+    return true;
+}
+
+void
+cfMutexAcquire(CfMutex *mutex)
+{
+    CF_ASSERT_NOT_NULL(mutex);
+#if CF_THREADING_DEBUG
+    if (!linuxMutexTryLock(linuxMutexState(mutex)))
+    {
+        CF_ASSERT(mutex->internal != cfCurrentThreadId(), "Attempted to lock recursively");
+        linuxMutexLock(linuxMutexState(mutex));
+    }
+    mutex->internal = cfCurrentThreadId();
+#else
+    linuxMutexLock(linuxMutexState(mutex));
+#endif
+}
+
+void
+cfMutexRelease(CfMutex *mutex)
+{
+    CF_ASSERT_NOT_NULL(mutex);
+#if CF_THREADING_DEBUG
+    mutex->internal = 0;
+#endif
+    linuxMutexUnlock(linuxMutexState(mutex));
+}
+
+//------------------------------------------------------------------------------
+// RwLock implementation
+
+// NOTE (Matteo): Simple futex based reader/writer lock; the state word holds the number of
+// readers, or a special value when held by a writer. Waiters are woken all at once on release,
+// which is fine for the low contention expected on these locks.
+
+#define LINUX_RW_WRITER U32_MAX
+
+CF_STATIC_ASSERT(sizeof(((CfRwLock *)0)->data) >= sizeof(U32), "Invalid RwLock internal size");
+
+static inline AtomU32 *
+linuxRwState(CfRwLock *lock)
+{
+    return (AtomU32 *)(lock->data);
+}
+
+void
+cfRwInit(CfRwLock *lock)
+{
+    CF_ASSERT_NOT_NULL(lock);
+    atomInit(linuxRwState(lock), 0);
+#if CF_THREADING_DEBUG
+    lock->reserved0 = 0;
+    lock->reserved1 = 0;
+#endif
+}
+
+void
+cfRwShutdown(CfRwLock *lock)
+{
+    CF_ASSERT_NOT_NULL(lock);
+#if CF_THREADING_DEBUG
+    CF_ASSERT(lock->reserved0 == 0, "Shutting down a read/write lock acquired for writing");
+    CF_ASSERT(lock->reserved1 == 0, "Shutting down a read/write lock acquired for reading");
+#endif
+}
+
+bool
+cfRwTryLockReader(CfRwLock *lock)
+{
+    CF_ASSERT_NOT_NULL(lock);
+
+    AtomU32 *state = linuxRwState(lock);
+    U32 curr = atomRead(state);
+
+    while (curr != LINUX_RW_WRITER && curr + 1 != LINUX_RW_WRITER)
+    {
+        if (atomCompareExchangeWeak(state, &curr, curr + 1))
+        {
+            atomAcquireFence();
+#if CF_THREADING_DEBUG
+            atomFetchInc((AtomU32 *)&lock->reserved1);
+#endif
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+cfRwLockReader(CfRwLock *lock)
+{
+    CF_ASSERT_NOT_NULL(lock);
+
+    while (!cfRwTryLockReader(lock))
+    {
+        linuxFutexWait(linuxFutexWord(linuxRwState(lock)), LINUX_RW_WRITER, DURATION_INFINITE);
+    }
+}
+
+void
+cfRwUnlockReader(CfRwLock *lock)
+{
+    CF_ASSERT_NOT_NULL(lock);
+#if CF_THREADING_DEBUG
+    atomFetchDec((AtomU32 *)&lock->reserved1);
+#endif
+    atomReleaseFence();
+    if (atomFetchDec(linuxRwState(lock)) == 1)
+    {
+        linuxFutexWake(linuxFutexWord(linuxRwState(lock)), I32_MAX);
+    }
+}
+
+bool
+cfRwTryLockWriter(CfRwLock *lock)
+{
+    CF_ASSERT_NOT_NULL(lock);
+
+    if (atomCompareExchange(linuxRwState(lock), 0, LINUX_RW_WRITER) != 0)
+    {
+#if CF_THREADING_DEBUG
+        CF_ASSERT(lock->reserved0 != cfCurrentThreadId(), "Attempted to lock recursively");
+#endif
+        return false;
+    }
+
+    atomAcquireFence();
+#if CF_THREADING_DEBUG
+    lock->reserved0 = cfCurrentThreadId();
+#endif
+    return true;
+}
+
+void
+cfRwLockWriter(CfRwLock *lock)
+{
+    CF_ASSERT_NOT_NULL(lock);
+
+    AtomU32 *state = linuxRwState(lock);
+
+    while (!cfRwTryLockWriter(lock))
+    {
+        U32 curr = atomRead(state);
+        if (curr) linuxFutexWait(linuxFutexWord(state), curr, DURATION_INFINITE);
+    }
+}
+
+void
+cfRwUnlockWriter(CfRwLock *lock)
+{
+    CF_ASSERT_NOT_NULL(lock);
+#if CF_THREADING_DEBUG
+    lock->reserved0 = 0;
+#endif
+    atomReleaseFence();
+    atomWrite(linuxRwState(lock), 0);
+    linuxFutexWake(linuxFutexWord(linuxRwState(lock)), I32_MAX);
+}
+
+//------------------------------------------------------------------------------
+// ConditionVariable implementation
+
+// NOTE (Matteo): The futex word is a sequence number, incremented on every signal, so that a
+// waiter can detect signals that occurred between the lock release and the actual wait.
+
+CF_STATIC_ASSERT(sizeof(((CfConditionVariable *)0)->data) >= sizeof(U32),
+                 "Invalid CfConditionVariable internal size");
+
+static inline AtomU32 *
+linuxCvSequence(CfConditionVariable *cv)
+{
+    return (AtomU32 *)(cv->data);
+}
+
+void
+cfCvInit(CfConditionVariable *cv)
+{
+    CF_ASSERT_NOT_NULL(cv);
+    atomInit(linuxCvSequence(cv), 0);
+}
+
+void
+cfCvShutdown(CfConditionVariable *cv)
+{
+    CF_ASSERT_NOT_NULL(cv);
+}
+
+bool
+cfCvWaitMutex(CfConditionVariable *cv, CfMutex *mutex, Duration duration)
+{
+    CF_ASSERT_NOT_NULL(cv);
+    CF_ASSERT_NOT_NULL(mutex);
+#if CF_THREADING_DEBUG
+    CF_ASSERT(mutex->internal != 0, "Attempted wait on unlocked mutex");
+#endif
+
+    U32 seq = atomRead(linuxCvSequence(cv));
+
+    cfMutexRelease(mutex);
+    bool result = linuxFutexWait(linuxFutexWord(linuxCvSequence(cv)), seq, duration);
+    cfMutexAcquire(mutex);
+
+    return result;
+}
+
+bool
+cfCvWaitRwLock(CfConditionVariable *cv, CfRwLock *lock, Duration duration)
+{
+    CF_ASSERT_NOT_NULL(cv);
+    CF_ASSERT_NOT_NULL(lock);
+#if CF_THREADING_DEBUG
+    CF_ASSERT(lock->reserved0 != 0 || lock->reserved1 != 0,
+              "Attempted wait on unlocked read/write lock");
+#endif
+
+    U32 seq = atomRead(linuxCvSequence(cv));
+    bool writer = (atomRead(linuxRwState(lock)) == LINUX_RW_WRITER);
+
+    if (writer)
+    {
+        cfRwUnlockWriter(lock);
+    }
+    else
+    {
+        cfRwUnlockReader(lock);
+    }
+
+    bool result = linuxFutexWait(linuxFutexWord(linuxCvSequence(cv)), seq, duration);
+
+    if (writer)
+    {
+        cfRwLockWriter(lock);
+    }
+    else
+    {
+        cfRwLockReader(lock);
+    }
+
+    return result;
+}
+
+void
+cfCvSignalOne(CfConditionVariable *cv)
+{
+    CF_ASSERT_NOT_NULL(cv);
+    atomFetchInc(linuxCvSequence(cv));
+    linuxFutexWake(linuxFutexWord(linuxCvSequence(cv)), 1);
+}
+
+void
+cfCvSignalAll(CfConditionVariable *cv)
+{
+    CF_ASSERT_NOT_NULL(cv);
+    atomFetchInc(linuxCvSequence(cv));
+    linuxFutexWake(linuxFutexWord(linuxCvSequence(cv)), I32_MAX);
+}
+
+//------------------------------------------------------------------------------
+// Address wait implementation (used by the event count)
+
+static void
+eventWaitAddress(AtomU32 *address, U32 expected)
+{
+    linuxFutexWait(linuxFutexWord(address), expected, DURATION_INFINITE);
+}
+
+static void
+eventWakeAddress(AtomU32 *address, Size count)
+{
+    linuxFutexWake(linuxFutexWord(address), (I32)cfMin(count, (Size)I32_MAX));
+}
+
+//------------------------------------------------------------------------------
+// Semaphore implementation
+
+// NOTE (Matteo): The semaphore handle is a heap allocated POSIX semaphore; as for the Win32
+// semaphore handle, there is no API to release it at the moment.
+
+static CfSemaphoreHandle
+semaHandleCreate(Size init_count)
+{
+    sem_t *sema = calloc(1, sizeof(*sema));
+
+    if (sema && sem_init(sema, 0, (U32)cfMin(init_count, (Size)SEM_VALUE_MAX)) != 0)
+    {
+        free(sema);
+        sema = NULL;
+    }
+
+    CF_ASSERT_NOT_NULL(sema);
+
+    return sema;
+}
+
+static void
+semaHandleWait(CfSemaphoreHandle handle)
+{
+    while (sem_wait(handle) == -1 && errno == EINTR) continue;
+}
+
+static void
+semaHandleSignal(CfSemaphoreHandle handle, Size count)
+{
+    CF_ASSERT(handle, "Semaphore not initialized");
+    if (!handle) return;
+
+    while (count--) sem_post(handle);
+}
+
+//------------------------------------------------------------------------------
@@ -438,6 +438,29 @@ cfCvSignalAll(CfConditionVariable *cv)
     WakeAllConditionVariable((CONDITION_VARIABLE *)(cv->data));
 }
 
+//------------------------------------------------------------------------------
+// Address wait implementation (used by the event count)
+
+static void
+eventWaitAddress(AtomU32 *address, U32 expected)
+{
+    WaitOnAddress((void volatile *)address, &expected, sizeof(expected), INFINITE);
+}
+
+static void
+eventWakeAddress(AtomU32 *address, Size count)
+{
+    // NOTE (Matteo): Win32 does not allow to wake a specific number of threads
+    if (count == 1)
+    {
+        WakeByAddressSingle((void *)address);
+    }
+    else
+    {
+        WakeByAddressAll((void *)address);
+    }
+}
+
 //------------------------------------------------------------------------------
 // Semaphore implementation
 
@@ -125,7 +125,7 @@ timeSub(Duration lhs, Duration rhs)
 //   OS-specific services   //
 //--------------------------//
 
-#ifdef CF_OS_WIN32
+#if CF_OS_WIN32
 
 #    include "math.inl"
 #    include "win32.inl"
@@ -235,6 +235,94 @@ timeGetLocal(SystemTime sys_time)
     return win32CalendarTime(&local);
 }
 
+#elif CF_OS_LINUX
+
+#    include "error.h"
+
+#    include <time.h>
+
+typedef struct LinuxClock
+{
+    struct timespec start;
+} LinuxClock;
+
+CF_STATIC_ASSERT(sizeof(Clock) >= sizeof(LinuxClock), "Clock type is too small on Linux");
+
+static CalendarTime
+linuxCalendarTime(struct tm const *tm, U32 nanos)
+{
+    return (CalendarTime){.year = (U16)(tm->tm_year + 1900),
+                          .month = (U8)(tm->tm_mon + 1),
+                          .day = (U8)tm->tm_mday,
+                          .week_day = (U8)tm->tm_wday,
+                          .hour = (U8)tm->tm_hour,
+                          .minute = (U8)tm->tm_min,
+                          .second = (U8)tm->tm_sec,
+                          .milliseconds = (U16)(nanos / CF_NS_PER_MS)};
+}
+
+void
+clockStart(Clock *clock)
+{
+    CF_ASSERT_NOT_NULL(clock);
+
+    LinuxClock *self = (LinuxClock *)clock->opaque;
+    CF_ASSERT_NOT_NULL(self);
+
+    int result = clock_gettime(CLOCK_MONOTONIC, &self->start);
+    CF_ASSERT(result == 0, "System monotonic clock is not available");
+    CF_UNUSED(result);
+}
+
+Duration
+clockElapsed(Clock *clock)
+{
+    CF_ASSERT_NOT_NULL(clock);
+
+    LinuxClock *self = (LinuxClock *)clock->opaque;
+    CF_ASSERT_NOT_NULL(self);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    Duration start = {.seconds = self->start.tv_sec, .nanos = (U32)self->start.tv_nsec};
+    Duration curr = {.seconds = now.tv_sec, .nanos = (U32)now.tv_nsec};
+
+    return timeSub(curr, start);
+}
+
+// NOTE (Matteo): System time is represented as nanoseconds since the UNIX epoch
+
+SystemTime
+timeGetSystem(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (U64)now.tv_sec * CF_NS_PER_SEC + (U64)now.tv_nsec;
+}
+
+CalendarTime
+timeGetUtc(SystemTime sys_time)
+{
+    time_t secs = (time_t)(sys_time / CF_NS_PER_SEC);
+    struct tm out = {0};
+
+    if (!gmtime_r(&secs, &out)) CF_ASSERT_FAIL("Invalid system time");
+
+    return linuxCalendarTime(&out, (U32)(sys_time % CF_NS_PER_SEC));
+}
+
+CalendarTime
+timeGetLocal(SystemTime sys_time)
+{
+    time_t secs = (time_t)(sys_time / CF_NS_PER_SEC);
+    struct tm out = {0};
+
+    if (!localtime_r(&secs, &out)) CF_ASSERT_FAIL("Invalid system time");
+
+    return linuxCalendarTime(&out, (U32)(sys_time % CF_NS_PER_SEC));
+}
+
 #else
 #    error "Time API not implemented for this platform"
 #endif
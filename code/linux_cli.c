@@ -0,0 +1,13 @@
+#include "linux_platform.c"
+
+/// Cross-platform entry point for console applications
+extern I32 consoleMain(Platform *platform, CommandLine *cmd_line);
+
+I32
+main(I32 argc, Cstr argv[])
+{
+    linuxPlatformInit();
+    I32 result = consoleMain(&g_platform, &(CommandLine){.arg = argv, .len = (Size)argc});
+    linuxPlatformShutdown();
+    return result;
+}
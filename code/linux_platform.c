@@ -0,0 +1,877 @@
+#if !defined(_GNU_SOURCE)
+#    define _GNU_SOURCE
+#endif
+
+#include "platform.h"
+
+// Foundation library
+#include "foundation/core.h"
+
+#include "foundation/colors.h"
+#include "foundation/error.h"
+#include "foundation/io.h"
+#include "foundation/memory.h"
+#include "foundation/paths.h"
+#include "foundation/strings.h"
+
+#include "foundation/atom.inl"
+#include "foundation/math.inl"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// NOTE (Matteo): Not exposed by older headers, the kernel just returns EINVAL if unsupported
+#if !defined(MADV_POPULATE_WRITE)
+#    define MADV_POPULATE_WRITE 23
+#endif
+
+//------------------------------------------------------------------------------
+// Platform API
+//------------------------------------------------------------------------------
+
+//---- Virtual memory ----//
+
+static VMEM_RESERVE_FN(linuxVmReserve);
+static VMEM_COMMIT_FN(linuxVmCommit);
+static VMEM_DECOMMIT_FN(linuxVmDecommit);
+static VMEM_RELEASE_FN(linuxVmRelease);
+
+static VMEM_MIRROR_ALLOCATE_FN(linuxMirrorAllocate);
+static VMEM_MIRROR_FREE_FN(linuxMirrorFree);
+
+static VMEM_FILE_MAP_FN(linuxFileMap);
+static VMEM_FILE_UNMAP_FN(linuxFileUnmap);
+static VMEM_FILE_FLUSH_FN(linuxFileFlush);
+
+//---- Heap allocation ----//
+
+static MEM_ALLOCATOR_FN(linuxAlloc);
+
+//---- File system ----//
+
+static bool linuxPathBuffer(Str path, Char8 *buffer, Size buffer_size);
+
+static IO_FILE_COPY(linuxFileCopy);
+static IO_FILE_OPEN(linuxFileOpen);
+static IO_FILE_CLOSE(linuxFileClose);
+static IO_FILE_SIZE(linuxFileSize);
+static IO_FILE_SEEK(linuxFileSeek);
+static IO_FILE_READ(linuxFileRead);
+static IO_FILE_READ_AT(linuxFileReadAt);
+static IO_FILE_WRITE(linuxFileWrite);
+static IO_FILE_WRITE_AT(linuxFileWriteAt);
+static IO_FILE_PROPERTIES(linuxFileProperties);
+static IO_FILE_PROPERTIES_P(linuxFilePropertiesP);
+
+static IO_DIRECTORY_OPEN(linuxDirectoryOpen);
+
+// NOTE (Matteo): File handles are file descriptors stored in the pointer value
+#define LINUX_FILE_HANDLE(fd) ((IoFile *)(Offset)(fd))
+#define LINUX_FILE_DESC(file) ((I32)(Offset)(file))
+
+//---- Global platform API ----//
+
+// NOTE (Matteo): a global here should be quite safe
+static Platform g_platform = {
+    .vmem =
+        &(VMemApi){
+            .reserve = linuxVmReserve,
+            .release = linuxVmRelease,
+            .commit = linuxVmCommit,
+            .decommit = linuxVmDecommit,
+            .mirrorAllocate = linuxMirrorAllocate,
+            .mirrorFree = linuxMirrorFree,
+            .fileMap = linuxFileMap,
+            .fileUnmap = linuxFileUnmap,
+            .fileFlush = linuxFileFlush,
+        },
+    .file =
+        &(IoFileApi){
+            .invalid = LINUX_FILE_HANDLE(-1),
+            .std_in = LINUX_FILE_HANDLE(-1),
+            .std_out = LINUX_FILE_HANDLE(-1),
+            .std_err = LINUX_FILE_HANDLE(-1),
+            .copy = linuxFileCopy,
+            .open = linuxFileOpen,
+            .close = linuxFileClose,
+            .size = linuxFileSize,
+            .properties = linuxFileProperties,
+            .propertiesP = linuxFilePropertiesP,
+            .seek = linuxFileSeek,
+            .read = linuxFileRead,
+            .readAt = linuxFileReadAt,
+            .write = linuxFileWrite,
+            .writeAt = linuxFileWriteAt,
+            .dirOpen = linuxDirectoryOpen,
+        },
+    .paths = &(Paths){0},
+};
+
+//------------------------------------------------------------------------------
+// Main entry point
+//------------------------------------------------------------------------------
+
+static void
+linuxPathsInit(Paths *g_paths)
+{
+    // Clear shared buffer
+    memClear(g_paths->buffer, CF_ARRAY_SIZE(g_paths->buffer));
+
+    // Point string views to assigned positions
+    g_paths->base.ptr = g_paths->buffer;
+    g_paths->lib_name.ptr = g_paths->buffer + 1 * Paths_Size;
+    g_paths->data.ptr = g_paths->buffer + 2 * Paths_Size;
+
+    // Retrieve executable full path
+    ssize_t len = readlink("/proc/self/exe", g_paths->buffer, Paths_Size - 1);
+    CF_ASSERT(len > 0 && len < Paths_Size - 1, "Executable path is too long");
+    g_paths->base.len = (Size)len;
+
+    // Split executable full path
+    Str ext;
+    g_paths->exe_name = pathSplitNameExt(g_paths->base, &ext);
+    CF_ASSERT(strValid(g_paths->exe_name), "Invalid executable file name");
+    g_paths->base.len -= g_paths->exe_name.len;
+
+    // Build library filename
+    strPrint((Char8 *)g_paths->lib_name.ptr, Paths_Size, "lib%.*s%s",
+             (I32)(g_paths->exe_name.len - ext.len), g_paths->exe_name.ptr, "_lib.so");
+
+    g_paths->lib_name.len = strLength(g_paths->lib_name.ptr);
+
+    // Build data path from base path
+    strPrint((Char8 *)g_paths->data.ptr, Paths_Size, "%.*sdata/", (I32)g_paths->base.len,
+             g_paths->base.ptr);
+    g_paths->data.len = strLength(g_paths->data.ptr);
+}
+
+static Size
+linuxHugePageSize(void)
+{
+    // NOTE (Matteo): The PMD size is the one used for transparent huge pages, and the default one
+    // for the explicit huge page pool on all the architectures we care about
+    Size size = 0;
+
+    FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+    if (file)
+    {
+        unsigned long value = 0;
+        if (fscanf(file, "%lu", &value) == 1) size = (Size)value;
+        fclose(file);
+    }
+
+    return cfIsPowerOf2(size) ? size : 0;
+}
+
+static void
+linuxPlatformInit(void)
+{
+    // ** Init memory management **
+
+    Size page_size = (Size)sysconf(_SC_PAGESIZE);
+
+    g_platform.vmem->page_size = page_size;
+    // NOTE (Matteo): mmap has page granularity, unlike VirtualAlloc
+    g_platform.vmem->address_granularity = page_size;
+    g_platform.vmem->huge_page_size = linuxHugePageSize();
+
+#if CF_MEMORY_PROTECTION
+    CF_UNUSED(linuxAlloc);
+    g_platform.heap = memEndOfPageAllocator(g_platform.vmem);
+#else
+    g_platform.heap.state = &g_platform;
+    g_platform.heap.func = linuxAlloc;
+#endif
+
+    // ** Init IO pipes **
+
+    g_platform.file->std_in = LINUX_FILE_HANDLE(STDIN_FILENO);
+    g_platform.file->std_out = LINUX_FILE_HANDLE(STDOUT_FILENO);
+    g_platform.file->std_err = LINUX_FILE_HANDLE(STDERR_FILENO);
+
+    // ** Init paths **
+
+    linuxPathsInit(g_platform.paths);
+
+    // ** Start time tracking **
+
+    clockStart(&g_platform.clock);
+}
+
+static void
+linuxPlatformShutdown(void)
+{
+    CF_ASSERT(g_platform.heap_blocks == 0, "Potential memory leak");
+    CF_ASSERT(g_platform.heap_size == 0, "Potential memory leak");
+}
+
+//------------------------------------------------------------------------------
+// API implementation
+//------------------------------------------------------------------------------
+
+//------------//
+//   Memory   //
+//------------//
+
+static void *
+linuxVmReserveHuge(Size size, VMemFlags flags, Size huge_page_size)
+{
+    if (!huge_page_size || (size & (huge_page_size - 1))) return MAP_FAILED;
+
+    if (flags & VMemFlags_ExplicitHugePages)
+    {
+        // NOTE (Matteo): As for regular pages, only the address range is reserved (MAP_NORESERVE)
+        // and pages are claimed from the huge page pool on commit (see linuxVmCommit)
+        void *mem = mmap(NULL, size, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) return mem;
+    }
+
+    if (flags & VMemFlags_TransparentHugePages)
+    {
+        // NOTE (Matteo): The kernel backs a range with huge pages only if it is aligned to their
+        // size, so over-reserve and trim the excess on both sides
+        Size reserve_size = size + huge_page_size;
+        U8 *mem = mmap(NULL, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                       -1, 0);
+
+        if (mem != MAP_FAILED)
+        {
+            U8 *aligned = (U8 *)memAlignForward(mem, huge_page_size);
+            Size head = (Size)(aligned - mem);
+            Size tail = reserve_size - head - size;
+
+            if (head) munmap(mem, head);
+            if (tail) munmap(aligned + size, tail);
+
+            // NOTE (Matteo): Failure here is not fatal, the range is simply backed by regular pages
+            madvise(aligned, size, MADV_HUGEPAGE);
+
+            return aligned;
+        }
+    }
+
+    return MAP_FAILED;
+}
+
+VMEM_RESERVE_FN(linuxVmReserve)
+{
+    void *mem = MAP_FAILED;
+
+    if (flags & VMemFlags_HugePages)
+    {
+        mem = linuxVmReserveHuge(size, flags, g_platform.vmem->huge_page_size);
+    }
+
+    if (mem == MAP_FAILED)
+    {
+        mem = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+
+    if (mem == MAP_FAILED) return NULL;
+
+    g_platform.reserved_size += size;
+
+    return mem;
+}
+
+static bool
+linuxVmPrefault(U8 *memory, Size size, bool touch_fallback)
+{
+    // NOTE (Matteo): MADV_POPULATE_WRITE (Linux 5.14) faults in the whole range with a single
+    // syscall, and fails if the pages cannot be provided (e.g. the huge page pool is exhausted);
+    // on older kernels fall back to touching every page, if allowed (touching a range of explicit
+    // huge pages raises SIGBUS when the pool is exhausted)
+    if (madvise(memory, size, MADV_POPULATE_WRITE) == 0) return true;
+    if (errno != EINVAL || !touch_fallback) return false;
+
+    Size page_size = g_platform.vmem->page_size;
+    for (U8 volatile *page = memory; page < memory + size; page += page_size)
+    {
+        *page = *page;
+    }
+
+    return true;
+}
+
+static bool
+linuxVmDiscard(void *memory, Size size)
+{
+    // NOTE (Matteo): MADV_DONTNEED releases the physical pages immediately (they read as zero if
+    // committed again), while PROT_NONE restores the reserved-only state.
+    // Kernels older than 5.18 do not support MADV_DONTNEED on explicit huge pages, so the range is
+    // replaced by a fresh reservation instead.
+    if (madvise(memory, size, MADV_DONTNEED) == 0) return mprotect(memory, size, PROT_NONE) == 0;
+
+    return mmap(memory, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                -1, 0) != MAP_FAILED;
+}
+
+static bool
+linuxVmCommitRegular(void *memory, Size size, VMemFlags flags)
+{
+    // NOTE (Matteo): Replace the range with regular pages, which is possible because commits on
+    // huge page reservations are aligned to the huge page size
+    if (mmap(memory, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (flags & VMemFlags_TransparentHugePages) madvise(memory, size, MADV_HUGEPAGE);
+
+    return !(flags & VMemFlags_Prefault) || linuxVmPrefault(memory, size, true);
+}
+
+VMEM_COMMIT_FN(linuxVmCommit)
+{
+    if (mprotect(memory, size, PROT_READ | PROT_WRITE) != 0)
+    {
+        CF_ASSERT(false, "Memory not previously reserved");
+        return false;
+    }
+
+    // NOTE (Matteo): Explicit huge pages are reserved without claiming them from the pool, so they
+    // are faulted in here: if the pool is exhausted the range falls back to regular pages, instead
+    // of raising SIGBUS on first access
+    if ((flags & (VMemFlags_Prefault | VMemFlags_ExplicitHugePages)) &&
+        !linuxVmPrefault(memory, size, !(flags & VMemFlags_ExplicitHugePages)) &&
+        !((flags & VMemFlags_ExplicitHugePages) && linuxVmCommitRegular(memory, size, flags)))
+    {
+        linuxVmDiscard(memory, size);
+        return false;
+    }
+
+    g_platform.committed_size += size;
+    return true;
+}
+
+VMEM_DECOMMIT_FN(linuxVmDecommit)
+{
+    if (linuxVmDiscard(memory, size))
+    {
+        g_platform.committed_size -= size;
+    }
+    else
+    {
+        CF_ASSERT(false, "VM decommit failed");
+    }
+}
+
+VMEM_RELEASE_FN(linuxVmRelease)
+{
+    // NOTE (Matteo): Unlike VirtualFree, munmap requires the size of the region
+    if (munmap(memory, size) == 0)
+    {
+        g_platform.reserved_size -= size;
+    }
+    else
+    {
+        CF_ASSERT(false, "VM release failed");
+    }
+}
+
+static I32
+linuxMirrorCreateFile(Size size)
+{
+    I32 fd = memfd_create("cf_mirror", MFD_CLOEXEC);
+
+    if (fd < 0)
+    {
+        // NOTE (Matteo): memfd_create is not available before Linux 3.17 (or may be filtered by
+        // seccomp), so fall back to an anonymous POSIX shared memory object, unlinked right away
+        static AtomU32 counter;
+        Char8 name[64];
+
+        for (Size try = 0; try < 16 && fd < 0; ++try)
+        {
+            strPrint(name, CF_ARRAY_SIZE(name), "/cf_mirror_%d_%u", (I32)getpid(),
+                     atomFetchInc(&counter));
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (fd >= 0) shm_unlink(name);
+        }
+    }
+
+    if (fd >= 0 && ftruncate(fd, (off_t)size) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+VMEM_MIRROR_ALLOCATE_FN(linuxMirrorAllocate)
+{
+    // NOTE (Matteo): Size is rounded to virtual memory granularity because the mapping addresses
+    // must be aligned as such.
+    Size granularity = g_platform.vmem->address_granularity;
+    Size buffer_size = (size + granularity - 1) & ~(granularity - 1);
+
+    VMemMirrorBuffer buffer = {0};
+
+    I32 fd = linuxMirrorCreateFile(buffer_size);
+    if (fd < 0) return buffer;
+
+    // NOTE (Matteo): Reserve the whole range first and then map the two views over it with
+    // MAP_FIXED; since the range is owned by us, this cannot race with other threads mapping
+    // memory (unlike the brute force strategy required on older Windows versions)
+    U8 *address = mmap(NULL, buffer_size * 2, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (address != MAP_FAILED)
+    {
+        U8 *view1 = mmap(address, buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+                         0);
+        U8 *view2 = mmap(address + buffer_size, buffer_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0);
+
+        if (view1 != MAP_FAILED && view2 != MAP_FAILED)
+        {
+            CF_ASSERT(view1 == address, "Logic error");
+            buffer.data = view1;
+            buffer.size = buffer_size;
+        }
+        else
+        {
+            munmap(address, buffer_size * 2);
+        }
+    }
+
+    // NOTE (Matteo): The mappings keep the file alive, so there's no OS handle to keep around
+    close(fd);
+
+    return buffer;
+}
+
+VMEM_MIRROR_FREE_FN(linuxMirrorFree)
+{
+    if (buffer->data && munmap(buffer->data, buffer->size * 2) != 0)
+    {
+        CF_ASSERT(false, "Mirror buffer release failed");
+    }
+
+    buffer->size = 0;
+    buffer->data = 0;
+    buffer->os_handle = 0;
+}
+
+VMEM_FILE_MAP_FN(linuxFileMap)
+{
+    VMemFileMap map = {0};
+
+    Char8 buffer[1024] = {0};
+    if (!linuxPathBuffer(path, buffer, CF_ARRAY_SIZE(buffer))) return map;
+
+    I32 fd = open(buffer, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return map;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0)
+    {
+        Size file_size = (Size)info.st_size;
+        Size view_size = cfMax(size, file_size);
+
+        // NOTE (Matteo): Growing the file with ftruncate does not allocate disk space, so the
+        // mapped size can be generous: only the pages actually written end up on disk
+        if (view_size && (file_size == view_size || ftruncate(fd, (off_t)view_size) == 0))
+        {
+            void *data = mmap(NULL, view_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                map.data = data;
+                map.size = view_size;
+                map.file_size = file_size;
+            }
+        }
+    }
+
+    // NOTE (Matteo): The mapping keeps the file alive, so there's no OS handle to keep around
+    close(fd);
+
+    return map;
+}
+
+VMEM_FILE_UNMAP_FN(linuxFileUnmap)
+{
+    if (map->data && munmap(map->data, map->size) != 0)
+    {
+        CF_ASSERT(false, "File unmap failed");
+    }
+
+    *map = (VMemFileMap){0};
+}
+
+VMEM_FILE_FLUSH_FN(linuxFileFlush)
+{
+    CF_ASSERT((U8 *)memory >= (U8 *)map->data &&
+                  (U8 *)memory + size <= (U8 *)map->data + map->size,
+              "Range out of the file view");
+
+    // NOTE (Matteo): msync requires a page aligned address
+    Size page_size = g_platform.vmem->page_size;
+    Size offset = (Size)memory & (page_size - 1);
+
+    return !msync((U8 *)memory - offset, size + offset, MS_SYNC);
+}
+
+// NOTE (Matteo): Blocks aligned beyond the guarantees of malloc are over-allocated, and the address
+// of the underlying block is stored right before the aligned one. Since realloc does not preserve
+// the alignment, the content is moved whenever the reallocated block ends up at a different offset.
+static void *
+linuxAllocAligned(void *memory, Size old_size, Size new_size, Size align)
+{
+    U8 *old_base = NULL;
+    Size old_offset = 0;
+
+    if (memory)
+    {
+        old_base = ((U8 **)memory)[-1];
+        old_offset = (Size)((U8 *)memory - old_base);
+    }
+
+    if (!new_size)
+    {
+        free(old_base);
+        return NULL;
+    }
+
+    // NOTE (Matteo): malloc alignment is at least the size of a pointer, so 'align' extra bytes
+    // leave room for the base address too
+    U8 *new_base = realloc(old_base, new_size + align);
+    if (!new_base) return NULL;
+
+    U8 *new_mem = (U8 *)memAlignForward(new_base + sizeof(new_base), align);
+
+    if (memory && new_base + old_offset != new_mem)
+    {
+        memCopy(new_base + old_offset, new_mem, cfMin(old_size, new_size));
+    }
+
+    if (new_size > old_size) memClear(new_mem + old_size, new_size - old_size);
+
+    ((U8 **)new_mem)[-1] = new_base;
+
+    return new_mem;
+}
+
+// NOTE (Matteo): The heap can be used by multiple threads, so the statistics are updated atomically
+MEM_ALLOCATOR_FN(linuxAlloc)
+{
+    CF_UNUSED(state);
+
+    void *old_mem = memory;
+    void *new_mem = NULL;
+
+    CF_ASSERT(cfIsPowerOf2(align), "Alignment is not a power of 2");
+
+    if (align > alignof(max_align_t))
+    {
+        new_mem = linuxAllocAligned(old_mem, old_size, new_size, align);
+    }
+    else if (new_size)
+    {
+        // NOTE (Matteo): Memory is cleared to match the behavior of the Win32 heap allocator
+        if (old_mem)
+        {
+            new_mem = realloc(old_mem, new_size);
+            if (new_mem && new_size > old_size)
+            {
+                memClear((U8 *)new_mem + old_size, new_size - old_size);
+            }
+        }
+        else
+        {
+            new_mem = calloc(1, new_size);
+        }
+    }
+    else
+    {
+        free(old_mem);
+    }
+
+    // NOTE (Matteo): A failed realloc leaves the old block untouched
+    if (old_mem && (new_mem || !new_size))
+    {
+        CF_ASSERT(old_size > 0, "Freeing valid pointer but given size is 0");
+        atomFetchDec((AtomSize *)&g_platform.heap_blocks);
+        atomFetchSub((AtomSize *)&g_platform.heap_size, old_size);
+    }
+
+    if (new_mem)
+    {
+        atomFetchInc((AtomSize *)&g_platform.heap_blocks);
+        atomFetchAdd((AtomSize *)&g_platform.heap_size, new_size);
+    }
+
+    return new_mem;
+}
+
+//-----------------//
+//   File system   //
+//-----------------//
+
+typedef struct LinuxDirIterator
+{
+    DIR *dir;
+    I32 dir_fd;
+    Char8 buffer[sizeof(IoDirectory) - sizeof(DIR *) - sizeof(I32) - sizeof(I32)];
+} LinuxDirIterator;
+
+// NOTE (Matteo): Ensure that there is room for a reasonably sized buffer
+CF_STATIC_ASSERT(sizeof(((LinuxDirIterator *)0)->buffer) >= 512,
+                 "FsIterator buffer size is too small");
+
+// NOTE (Matteo): Paths are not null terminated, so they must be copied to a local buffer
+static bool
+linuxPathBuffer(Str path, Char8 *buffer, Size buffer_size)
+{
+    if (path.len >= buffer_size) return false;
+    memCopy(path.ptr, buffer, path.len);
+    buffer[path.len] = 0;
+    return true;
+}
+
+static IoFileProperties
+linuxFileStatProperties(struct stat const *info)
+{
+    IoFileProperties props = {0};
+
+    props.exists = true;
+    props.last_write = (SystemTime)info->st_mtim.tv_sec * 1000000000 +
+                       (SystemTime)info->st_mtim.tv_nsec;
+    props.size = (Size)info->st_size;
+    if (S_ISDIR(info->st_mode)) props.attributes |= IoFileAttributes_Directory;
+    if (S_ISLNK(info->st_mode)) props.attributes |= IoFileAttributes_Symlink;
+
+    return props;
+}
+
+IO_FILE_COPY(linuxFileCopy)
+{
+    Char8 src_name[1024];
+    Char8 dst_name[1024];
+
+    if (!linuxPathBuffer(source, src_name, CF_ARRAY_SIZE(src_name)) ||
+        !linuxPathBuffer(dest, dst_name, CF_ARRAY_SIZE(dst_name)))
+    {
+        return false;
+    }
+
+    I32 src = open(src_name, O_RDONLY | O_CLOEXEC);
+    if (src < 0) return false;
+
+    I32 flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (overwrite ? 0 : O_EXCL);
+    I32 dst = open(dst_name, flags, 0644);
+    if (dst < 0)
+    {
+        close(src);
+        return false;
+    }
+
+    bool result = true;
+    U8 buffer[4096];
+
+    for (;;)
+    {
+        ssize_t read_bytes = read(src, buffer, sizeof(buffer));
+        if (read_bytes == 0) break;
+        if (read_bytes < 0 || write(dst, buffer, (Size)read_bytes) != read_bytes)
+        {
+            result = false;
+            break;
+        }
+    }
+
+    close(dst);
+    close(src);
+
+    return result;
+}
+
+IO_FILE_OPEN(linuxFileOpen)
+{
+    IoFile *result = LINUX_FILE_HANDLE(-1);
+
+    if (mode != 0)
+    {
+        I32 flags = O_CLOEXEC;
+
+        if (mode & IoOpenMode_Write)
+        {
+            flags |= (mode & IoOpenMode_Read) ? O_RDWR : O_WRONLY;
+            // Overwrite creation mode
+            flags |= O_CREAT | (mode == IoOpenMode_Append ? O_APPEND : O_TRUNC);
+        }
+        else
+        {
+            flags |= O_RDONLY;
+        }
+
+        Char8 buffer[1024] = {0};
+        if (linuxPathBuffer(filename, buffer, CF_ARRAY_SIZE(buffer)))
+        {
+            result = LINUX_FILE_HANDLE(open(buffer, flags, 0644));
+        }
+    }
+
+    return result;
+}
+
+IO_FILE_CLOSE(linuxFileClose)
+{
+    close(LINUX_FILE_DESC(file));
+}
+
+IO_FILE_SIZE(linuxFileSize)
+{
+    struct stat info;
+    if (fstat(LINUX_FILE_DESC(file), &info) != 0) return SIZE_MAX;
+    return (Size)info.st_size;
+}
+
+IO_FILE_PROPERTIES(linuxFileProperties)
+{
+    struct stat info;
+    if (fstat(LINUX_FILE_DESC(file), &info) != 0) return (IoFileProperties){0};
+    return linuxFileStatProperties(&info);
+}
+
+IO_FILE_PROPERTIES_P(linuxFilePropertiesP)
+{
+    Char8 buffer[1024] = {0};
+    struct stat info;
+
+    if (!linuxPathBuffer(path, buffer, CF_ARRAY_SIZE(buffer)) || lstat(buffer, &info) != 0)
+    {
+        return (IoFileProperties){0};
+    }
+
+    return linuxFileStatProperties(&info);
+}
+
+IO_FILE_SEEK(linuxFileSeek)
+{
+    CF_ASSERT(offset > 0 || pos == IoSeekPos_Current,
+              "Negative offset is supported only if seeking from the current position");
+
+    // NOTE (Matteo): IoSeekPos values match SEEK_SET, SEEK_CUR and SEEK_END
+    off_t result = lseek(LINUX_FILE_DESC(file), offset, pos);
+
+    return result < 0 ? SIZE_MAX : (Size)result;
+}
+
+IO_FILE_READ(linuxFileRead)
+{
+    ssize_t read_bytes = read(LINUX_FILE_DESC(file), buffer, buffer_size);
+    return read_bytes < 0 ? SIZE_MAX : (Size)read_bytes;
+}
+
+IO_FILE_READ_AT(linuxFileReadAt)
+{
+    ssize_t read_bytes = pread(LINUX_FILE_DESC(file), buffer, buffer_size, (off_t)offset);
+    return read_bytes < 0 ? SIZE_MAX : (Size)read_bytes;
+}
+
+IO_FILE_WRITE(linuxFileWrite)
+{
+    ssize_t written_bytes = write(LINUX_FILE_DESC(file), data, data_size);
+    if (written_bytes < 0) return false;
+
+    CF_ASSERT((Size)written_bytes == data_size, "Incorrect number of bytes written");
+
+    return true;
+}
+
+IO_FILE_WRITE_AT(linuxFileWriteAt)
+{
+    ssize_t written_bytes = pwrite(LINUX_FILE_DESC(file), data, data_size, (off_t)offset);
+    if (written_bytes < 0) return false;
+
+    CF_ASSERT((Size)written_bytes == data_size, "Incorrect number of bytes written");
+
+    return true;
+}
+
+static IO_DIRECTORY_NEXT(linuxDirectoryNext)
+{
+    CF_ASSERT_NOT_NULL(self);
+
+    LinuxDirIterator *iter = (LinuxDirIterator *)self->opaque;
+    struct dirent *entry = NULL;
+
+    // NOTE (Matteo): Skip "." for consistency with the Win32 implementation, which yields ".."
+    do
+    {
+        entry = readdir(iter->dir);
+    } while (entry && !strcmp(entry->d_name, "."));
+
+    if (!entry) return false;
+
+    Size size = strLength(entry->d_name);
+
+    // NOTE (Matteo): Truncation is considered an error
+    if (size >= CF_ARRAY_SIZE(iter->buffer)) return false;
+
+    memCopy(entry->d_name, iter->buffer, size + 1);
+
+    filename->ptr = iter->buffer;
+    filename->len = size;
+
+    if (props)
+    {
+        struct stat info;
+        if (fstatat(iter->dir_fd, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            *props = linuxFileStatProperties(&info);
+        }
+        else
+        {
+            *props = (IoFileProperties){0};
+        }
+    }
+
+    return true;
+}
+
+static IO_DIRECTORY_CLOSE(linuxDirectoryClose)
+{
+    CF_ASSERT_NOT_NULL(self);
+
+    LinuxDirIterator *iter = (LinuxDirIterator *)self->opaque;
+    closedir(iter->dir);
+}
+
+IO_DIRECTORY_OPEN(linuxDirectoryOpen)
+{
+    CF_ASSERT_NOT_NULL(self);
+
+    LinuxDirIterator *iter = (LinuxDirIterator *)self->opaque;
+    Char8 buffer[1024];
+
+    if (!linuxPathBuffer(path, buffer, CF_ARRAY_SIZE(buffer)))
+    {
+        CF_ASSERT(false, "Path overflow");
+        return false;
+    }
+
+    iter->dir = opendir(buffer);
+    if (!iter->dir) return false;
+
+    iter->dir_fd = dirfd(iter->dir);
+
+    self->next = linuxDirectoryNext;
+    self->close = linuxDirectoryClose;
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
@@ -6,6 +6,7 @@
 #include "foundation/list.h"
 #include "foundation/memory.h"
 #include "foundation/strings.h"
+#include "foundation/time.h"
 
 // TODO (Matteo): Get rid of it and use platform API only
 #include <stdio.h>
@@ -49,6 +50,7 @@ freeListAllocGetBlock(FreeListAlloc *alloc, Size size)
         {
             free_block = block;
         }
+        cursor = cursor->next;
     }
 
     if (free_block)
@@ -56,12 +58,14 @@ freeListAllocGetBlock(FreeListAlloc *alloc, Size size)
         // NOTE (Matteo): Free block found -> to avoid wasting memory, split it if too large
         double fill_ratio = (double)size / (double)free_block->size;
 
-        if (fill_ratio <= 0.25)
+        // NOTE (Matteo): The split must leave room for the header of the next block
+        if (fill_ratio <= 0.25 && free_block->size / 2 >= size + sizeof(*free_block))
         {
-            // Compute the beginning and end addresses of the block, and its midpoint
+            // Compute the beginning and end addresses of the block, and its midpoint (aligned
+            // for the header of the next block)
             Size beg = (Size)free_block;
             Size end = beg + free_block->size + sizeof(*free_block);
-            Size mid = (beg + end) / 2;
+            Size mid = ((beg + end) / 2) & ~(alignof(MemoryHeader) - 1);
 
             // Place the next block at the midpoint
             MemoryHeader *next_block = (MemoryHeader *)mid;
@@ -141,6 +145,148 @@ freeListAllocator(FreeListAlloc *alloc)
 
 //======================================================//
 
+// Allocator benchmark: random sizes in [8, 1024] bytes, allocated and released in random order
+// over a fixed set of live slots
+
+#define BENCH_SLOTS 1024
+#define BENCH_OPS 200000
+#define BENCH_MAX_SIZE 1024
+
+typedef struct BenchSlot
+{
+    void *ptr;
+    Size size;
+} BenchSlot;
+
+static U32
+benchRand(U32 *state)
+{
+    // xorshift32
+    U32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static Duration
+benchAllocator(MemAllocator alloc, BenchSlot *slots)
+{
+    U32 rng = 0x12345678;
+
+    Clock clock;
+    clockStart(&clock);
+
+    for (Size op = 0; op < BENCH_OPS; ++op)
+    {
+        BenchSlot *slot = slots + benchRand(&rng) % BENCH_SLOTS;
+
+        if (slot->ptr)
+        {
+            memFree(alloc, slot->ptr, slot->size);
+            slot->ptr = NULL;
+        }
+        else
+        {
+            slot->size = 8 + benchRand(&rng) % (BENCH_MAX_SIZE - 8 + 1);
+            slot->ptr = memAlloc(alloc, slot->size);
+            CF_ASSERT_NOT_NULL(slot->ptr);
+        }
+    }
+
+    return clockElapsed(&clock);
+}
+
+static void
+benchRelease(MemAllocator alloc, BenchSlot *slots)
+{
+    for (Size index = 0; index < BENCH_SLOTS; ++index)
+    {
+        if (slots[index].ptr) memFree(alloc, slots[index].ptr, slots[index].size);
+        slots[index].ptr = NULL;
+    }
+}
+
+static void
+benchPrint(Cstr name, Duration elapsed)
+{
+    printf("%-12s %8.2f ns/op\n", name, timeGetSeconds(elapsed) * 1e9 / BENCH_OPS);
+}
+
+static void
+benchAllocators(Platform *platform)
+{
+    printf("-------------------------\n");
+    printf("Allocator benchmark\n");
+    printf("-------------------------\n");
+
+    Size const storage_size = CF_MB(64);
+    BenchSlot slots[BENCH_SLOTS] = {0};
+
+    // Heap
+    {
+        MemAllocator alloc = platform->heap;
+        benchPrint("heap", benchAllocator(alloc, slots));
+        benchRelease(alloc, slots);
+    }
+
+    // Free list
+    {
+        FreeListAlloc fl = {0};
+        U8 *fl_buffer = memAlloc(platform->heap, storage_size);
+        freeListAllocInit(&fl, fl_buffer, storage_size);
+
+        MemAllocator alloc = freeListAllocator(&fl);
+        benchPrint("free list", benchAllocator(alloc, slots));
+        benchRelease(alloc, slots);
+
+        memFree(platform->heap, fl_buffer, storage_size);
+    }
+
+    // Slab
+    {
+        void *storage = vmemReserve(platform->vmem, storage_size);
+        MemArena arena;
+        MemSlab slab;
+        memArenaInitOnVmem(&arena, platform->vmem, storage, storage_size);
+        memSlabInit(&slab, &arena, platform->heap);
+
+        MemAllocator alloc = memSlabAllocator(&slab);
+        benchPrint("slab", benchAllocator(alloc, slots));
+
+        for (Size index = 0; index < MemSlab_ClassCount; ++index)
+        {
+            MemSlabStats stats = memSlabClassStats(&slab, index);
+            printf("  class %4zu: %2zu pages, %5zu/%5zu blocks used (%5.1f%%)\n", stats.block_size,
+                   stats.pages, stats.used, stats.capacity, 100.0 * stats.occupancy);
+        }
+
+        benchRelease(alloc, slots);
+
+        memArenaClear(&arena);
+        vmemRelease(platform->vmem, storage, storage_size);
+    }
+
+    // TLSF
+    {
+        void *storage = vmemReserve(platform->vmem, storage_size);
+        MemArena arena;
+        MemTlsf tlsf;
+        memArenaInitOnVmem(&arena, platform->vmem, storage, storage_size);
+        memTlsfInitOnArena(&tlsf, &arena, CF_MB(1));
+
+        MemAllocator alloc = memTlsfAllocator(&tlsf);
+        benchPrint("tlsf", benchAllocator(alloc, slots));
+        printf("  pool: %zu KB, used: %zu KB\n", tlsf.pool_size >> 10, tlsf.used_size >> 10);
+        benchRelease(alloc, slots);
+
+        memArenaClear(&arena);
+        vmemRelease(platform->vmem, storage, storage_size);
+    }
+}
+
+//======================================================//
+
 #define ALLOC_SIZE CF_MB(1)
 #define BUFF_SIZE 1024
 
@@ -169,19 +315,19 @@ consoleMain(Platform *platform, CommandLine *cmd_line)
     F32Bits u32 = {.f32 = 2.0};
 
     printf("%u ->\t%f\n", u32.u32, (double)u32.f32);
-    printf("%llu ->\t%f\n", u64.u64, u64.f64);
+    printf("%llu ->\t%f\n", (unsigned long long)u64.u64, u64.f64);
 
     u64.u64 = 3203822394;
     u32.u32 = 3203822394;
 
     printf("%u ->\t%f\n", u32.u32, (double)u32.f32);
-    printf("%llu ->\t%f\n", u64.u64, u64.f64);
+    printf("%llu ->\t%f\n", (unsigned long long)u64.u64, u64.f64);
 
     u64.f64 = 1;
     u32.f32 = 1;
 
     printf("%u ->\t%f\n", u32.u32, (double)u32.f32);
-    printf("%llu ->\t%f\n", u64.u64, u64.f64);
+    printf("%llu ->\t%f\n", (unsigned long long)u64.u64, u64.f64);
 
     //======================================================//
 
@@ -219,5 +365,9 @@ consoleMain(Platform *platform, CommandLine *cmd_line)
 
     memFree(g_heap, fl_buffer, ALLOC_SIZE);
 
+    //======================================================//
+
+    benchAllocators(platform);
+
     return 0;
 }
@@ -3,14 +3,389 @@
 
 #include "foundation/error.h"
 #include "foundation/memory.h"
+#include "foundation/task.h"
+#include "foundation/threading.h"
+#include "foundation/time.h"
 
 #include <stdio.h>
 
+static void
+testHugePages(VMemApi *vmem)
+{
+    // NOTE (Matteo): Huge pages degrade silently to regular pages if not supported
+    VMemFlags const flags = VMemFlags_HugePages | VMemFlags_Prefault;
+
+    Size const granularity = vmemCommitGranularity(vmem, flags);
+    Size const storage_size = 64 * granularity;
+    void *storage = vmemReserveEx(vmem, storage_size, flags);
+
+    MemArena arena;
+    memArenaInitOnVmemEx(&arena, vmem, storage, storage_size, flags);
+    CF_ASSERT(arena.granularity == granularity, "Granularity not taken from the flags");
+
+    U8 *bytes = memArenaAllocArray(&arena, U8, 3 * granularity / 2);
+    CF_ASSERT_NOT_NULL(bytes);
+    CF_ASSERT((arena.committed & (granularity - 1)) == 0, "Commit not aligned to granularity");
+    CF_ASSERT(arena.committed == 2 * granularity, "Unexpected commit size");
+
+    bytes[3 * granularity / 2 - 1] = 0xFF;
+
+    // A split keeps the granularity of the original reservation, while the other arenas on the
+    // same API are not affected
+    MemArena split = {0};
+    CF_ASSERT(memArenaSplit(&arena, &split, storage_size / 2), "Split failed");
+    CF_ASSERT(split.granularity == granularity, "Split lost the granularity");
+    CF_ASSERT(vmemCommitGranularity(vmem, VMemFlags_None) == vmem->address_granularity,
+              "Default granularity changed");
+
+    memArenaClear(&split);
+    memArenaClear(&arena);
+    CF_ASSERT(arena.committed == 0, "Memory not decommitted");
+
+    vmemRelease(vmem, storage, storage_size);
+}
+
+static CF_THREAD_FN(scratchThreadProc)
+{
+    MemScratch *scratch = args;
+
+    CF_ASSERT(!memScratchCurrent(), "Scratch storage must not be shared between threads");
+    memScratchBind(scratch);
+    CF_ASSERT(memScratchCurrent() == scratch, "Scratch storage not bound");
+}
+
+static TASK_QUEUE_FN(scratchTask)
+{
+    CF_UNUSED(canceled);
+
+    MemArena *arena = memScratchArena(NULL);
+    CF_ASSERT_NOT_NULL(arena);
+
+    MEM_ARENA_TEMP_SCOPE(arena)
+    {
+        U8 *bytes = memArenaAllocArray(arena, U8, 4096);
+        memWrite(bytes, 0xAB, 4096);
+        *(MemArena **)data = arena;
+    }
+}
+
+static void
+testScratch(VMemApi *vmem)
+{
+    Size const storage_size = CF_MB(256);
+    void *storage = vmemReserve(vmem, storage_size);
+
+    MemArena parent;
+    memArenaInitOnVmem(&parent, vmem, storage, storage_size);
+
+    CF_ASSERT(!memScratchArena(NULL), "No scratch storage expected");
+
+    MemScratch scratch;
+    CF_ASSERT(memScratchInit(&scratch, &parent, CF_MB(16)), "Scratch initialization failed");
+    CF_ASSERT(!memScratchBind(&scratch), "No scratch storage expected");
+
+    // The two arenas never alias, so a callee can allocate temporaries next to caller results
+    MemArena *outer = memScratchArena(NULL);
+    MemArena *inner = memScratchArena(outer);
+    CF_ASSERT(outer && inner && outer != inner, "Scratch arenas alias");
+    CF_ASSERT(memScratchArena(inner) == outer, "Scratch arenas alias");
+
+    MEM_ARENA_TEMP_SCOPE(outer)
+    {
+        U32 *result = memArenaAllocArray(outer, U32, 256);
+
+        MEM_ARENA_TEMP_SCOPE(inner)
+        {
+            U32 *temp = memArenaAllocArray(inner, U32, 256);
+            for (U32 i = 0; i < 256; ++i) temp[i] = i;
+            for (U32 i = 0; i < 256; ++i) result[i] = temp[255 - i];
+        }
+
+        CF_ASSERT(inner->allocated == 0, "Scratch memory not released");
+        for (U32 i = 0; i < 256; ++i) CF_ASSERT(result[i] == 255 - i, "Scratch data corrupted");
+    }
+
+    CF_ASSERT(outer->allocated == 0, "Scratch memory not released");
+
+    // Binding is per thread
+    MemScratch thread_scratch;
+    CF_ASSERT(memScratchInit(&thread_scratch, &parent, CF_MB(16)), "Scratch init failed");
+    CfThread thread = cfThreadStart(scratchThreadProc, .args = &thread_scratch);
+    cfThreadWaitAll(&thread, 1, DURATION_INFINITE);
+    CF_ASSERT(memScratchCurrent() == &scratch, "Binding of the main thread changed");
+
+    // A failed initialization leaves the parent untouched (only the first split fits)
+    {
+        Size const reserved = parent.reserved;
+        MemScratch failed;
+        Size const half = (parent.reserved - parent.allocated) / 2 + vmem->address_granularity;
+        CF_ASSERT(!memScratchInit(&failed, &parent, half), "Scratch init should fail");
+        CF_ASSERT(parent.reserved == reserved, "Parent arena leaked a split");
+    }
+
+    // Task workers get their own scratch storage
+    TaskQueueConfig config = {
+        .buffer_size = 16,
+        .num_workers = 2,
+        .scratch_parent = &parent,
+        .scratch_size = CF_MB(16),
+    };
+    CF_ASSERT(taskConfig(&config), "Invalid task queue configuration");
+
+    void *queue_memory = memArenaAllocAlign(&parent, config.footprint, CF_CACHELINE_SIZE);
+    TaskQueue *queue = taskInit(&config, queue_memory);
+    taskStartProcessing(queue);
+
+    MemArena *used[8] = {0};
+    TaskId ids[8] = {0};
+    for (Size i = 0; i < CF_ARRAY_SIZE(ids); ++i)
+    {
+        ids[i] = taskEnqueue(queue, scratchTask, used + i);
+    }
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(ids); ++i)
+    {
+        while (!taskCompleted(queue, ids[i])) cfSleep(timeDurationMs(1));
+        CF_ASSERT(used[i] && used[i] != outer && used[i] != inner,
+                  "Worker used the main thread scratch storage");
+    }
+
+    taskShutdown(queue);
+
+    memScratchBind(NULL);
+    memArenaClear(&parent);
+    vmemRelease(vmem, storage, storage_size);
+}
+
+static void
+testChainedBlocks(MemArena *arena)
+{
+    U8 *const first_block = arena->memory;
+    CF_ASSERT(!arena->chain.depth, "Arena already chained");
+
+    // Fill the original block, then keep allocating across block boundaries
+    U32 *first = memArenaAllocArray(arena, U32, 256);
+    CF_ASSERT_NOT_NULL(first);
+    for (U32 i = 0; i < 256; ++i) first[i] = i;
+
+    MemArenaState state = memArenaSave(arena);
+
+    U32 *blocks[64];
+    for (U32 i = 0; i < CF_ARRAY_SIZE(blocks); ++i)
+    {
+        blocks[i] = memArenaAllocArray(arena, U32, 256);
+        CF_ASSERT_NOT_NULL(blocks[i]);
+        for (U32 j = 0; j < 256; ++j) blocks[i][j] = i;
+    }
+
+    CF_ASSERT(arena->chain.depth > 1, "Arena did not link new blocks");
+
+    // Larger than a block
+    U8 *large = memArenaAllocArray(arena, U8, 4 * arena->chain.block_size);
+    CF_ASSERT_NOT_NULL(large);
+    memWrite(large, 0xFF, 4 * arena->chain.block_size);
+
+    for (U32 i = 0; i < CF_ARRAY_SIZE(blocks); ++i)
+    {
+        for (U32 j = 0; j < 256; ++j) CF_ASSERT(blocks[i][j] == i, "Chained data corrupted");
+    }
+
+    // Blocks of previous blocks can be reallocated (moved), and freeing them is harmless
+    blocks[0] = memArenaReallocArray(arena, blocks[0], 256, 512);
+    CF_ASSERT(blocks[0][255] == 0 && blocks[0][511] == 0, "Reallocated data corrupted");
+    memArenaFreeArray(arena, blocks[1], 256);
+
+    // Restoring rolls back across block boundaries
+    memArenaRestore(state);
+    CF_ASSERT(arena->memory == first_block, "Linked blocks not released");
+    CF_ASSERT(!arena->chain.depth, "Linked blocks not released");
+    for (U32 i = 0; i < 256; ++i) CF_ASSERT(first[i] == i, "Original data corrupted");
+
+    MEM_ARENA_TEMP_SCOPE(arena)
+    {
+        for (U32 i = 0; i < 16; ++i) CF_ASSERT_NOT_NULL(memArenaAllocArray(arena, U32, 1024));
+        CF_ASSERT(arena->chain.depth, "Arena did not link new blocks");
+    }
+
+    CF_ASSERT(!arena->chain.depth, "Linked blocks not released");
+
+    for (U32 i = 0; i < 16; ++i) CF_ASSERT_NOT_NULL(memArenaAllocArray(arena, U32, 1024));
+    memArenaClear(arena);
+    CF_ASSERT(arena->memory == first_block && !arena->chain.depth, "Linked blocks not released");
+}
+
+static void
+testChain(Platform *platform)
+{
+    // Buffer arena growing on the heap
+    {
+        U8 buffer[1024];
+        MemArena arena;
+        memArenaInitOnBuffer(&arena, buffer, sizeof(buffer));
+        memArenaChainOnAllocator(&arena, platform->heap, 4096);
+        testChainedBlocks(&arena);
+        CF_ASSERT(platform->heap_blocks == 0, "Linked blocks leaked");
+    }
+
+    // VM arena growing on VM
+    {
+        VMemApi *vmem = platform->vmem;
+        Size const storage_size = vmem->address_granularity;
+        void *storage = vmemReserve(vmem, storage_size);
+
+        MemArena arena;
+        memArenaInitOnVmem(&arena, vmem, storage, storage_size);
+        memArenaChainOnVmem(&arena, vmem, 2 * storage_size);
+        testChainedBlocks(&arena);
+
+        vmemRelease(vmem, storage, storage_size);
+    }
+}
+
+static void
+testCommitPolicy(VMemApi *vmem)
+{
+    Size const granularity = vmem->address_granularity;
+    Size const storage_size = 1024 * granularity;
+    void *storage = vmemReserve(vmem, storage_size);
+
+    MemArenaCommitPolicy const policy = {
+        .min_commit = 4 * granularity,
+        .max_commit = 64 * granularity,
+        .idle_resets = 8,
+        .retain_threshold = 128 * granularity,
+    };
+
+    MemArena storage_arena;
+    MemArena *arena = &storage_arena;
+    memArenaInitOnVmem(arena, vmem, storage, storage_size);
+    memArenaSetCommitPolicy(arena, &policy);
+
+    MemArenaCommitStats const *stats = &arena->commit_stats;
+
+    // Frame loop with temporary scopes of varying size and a final clear: pages are committed once
+    // and retained
+    for (Size frame = 0; frame < 100; ++frame)
+    {
+        MEM_ARENA_TEMP_SCOPE(arena)
+        {
+            Size size = (frame & 1 ? 2 : 24) * granularity + frame;
+            U8 *bytes = memArenaAllocArray(arena, U8, size);
+            CF_ASSERT_NOT_NULL(bytes);
+            bytes[size - 1] = 1;
+        }
+
+        CF_ASSERT_NOT_NULL(memArenaAllocArray(arena, U8, 4 * granularity));
+        memArenaClear(arena);
+    }
+
+    // NOTE (Matteo): The excess of the geometric growth can be trimmed once, after idle resets
+    CF_ASSERT(stats->commits <= 4, "Too many commits");
+    CF_ASSERT(stats->decommits <= 1, "Retained pages were decommitted");
+    CF_ASSERT(stats->commits_avoided > 0, "No commit avoided");
+    CF_ASSERT(arena->committed >= 24 * granularity, "High-water mark not retained");
+
+    // Retained pages are released after enough idle resets
+    Size committed = arena->committed;
+    Size decommits = stats->decommits;
+
+    for (Size frame = 0; frame < policy.idle_resets; ++frame)
+    {
+        MEM_ARENA_TEMP_SCOPE(arena)
+        {
+            CF_ASSERT_NOT_NULL(memArenaAllocArray(arena, U8, granularity));
+        }
+    }
+
+    CF_ASSERT(stats->decommits == decommits + 1, "Idle pages not decommitted");
+    CF_ASSERT(arena->committed < committed, "Idle pages not decommitted");
+    CF_ASSERT(arena->committed <= 2 * granularity, "Idle pages not decommitted");
+
+    // Retained pages above the threshold are released immediately
+    MEM_ARENA_TEMP_SCOPE(arena)
+    {
+        CF_ASSERT_NOT_NULL(memArenaAllocArray(arena, U8, 512 * granularity));
+    }
+
+    CF_ASSERT(arena->committed <= policy.retain_threshold + granularity, "Threshold exceeded");
+
+    memArenaSetCommitPolicy(arena, NULL);
+    memArenaClear(arena);
+    CF_ASSERT(arena->committed == 0, "Memory not decommitted");
+
+    fprintf(stdout, "Commit policy: %zu commits (%zu avoided), %zu decommits (%zu avoided)\n",
+            stats->commits, stats->commits_avoided, stats->decommits, stats->decommits_avoided);
+
+    vmemRelease(vmem, storage, storage_size);
+}
+
+// NOTE (Matteo): VM API which fails commits once the given budget of bytes is exhausted
+static VMemApi *g_commit_backing = NULL;
+static Size g_commit_budget = 0;
+
+static VMEM_COMMIT_FN(failingCommit)
+{
+    if (size > g_commit_budget) return false;
+    g_commit_budget -= size;
+    return g_commit_backing->commit(memory, size, flags);
+}
+
+static void
+testCommitFailure(VMemApi *platform_vmem)
+{
+    VMemApi vmem = *platform_vmem;
+    vmem.commit = failingCommit;
+    g_commit_backing = platform_vmem;
+
+    Size const granularity = vmem.address_granularity;
+    Size const storage_size = 64 * granularity;
+    void *storage = vmemReserve(&vmem, storage_size);
+
+    MemArena arena;
+    memArenaInitOnVmem(&arena, &vmem, storage, storage_size);
+
+    g_commit_budget = granularity;
+
+    U8 *first = memArenaAllocArray(&arena, U8, granularity / 2);
+    CF_ASSERT_NOT_NULL(first);
+
+    // A failed commit leaves the arena as it was
+    Size allocated = arena.allocated;
+    Size commits = arena.commit_stats.commits;
+    CF_ASSERT(!memArenaAllocArray(&arena, U8, 2 * granularity), "Commit failure not reported");
+    CF_ASSERT(arena.allocated == allocated, "Allocation not rolled back");
+    CF_ASSERT(arena.committed == granularity, "Failed commit accounted");
+    CF_ASSERT(arena.commit_stats.commits == commits, "Failed commit accounted");
+
+    // Growing in place fails as well, keeping the original block valid
+    CF_ASSERT(!memArenaReallocArray(&arena, first, granularity / 2, 2 * granularity),
+              "Commit failure not reported");
+    CF_ASSERT(arena.allocated == allocated, "Reallocation not rolled back");
+    first[0] = 1;
+
+    // Chained blocks which cannot be committed are given back
+    memArenaChainOnVmem(&arena, &vmem, storage_size);
+    CF_ASSERT(!memArenaAllocArray(&arena, U8, storage_size), "Commit failure not reported");
+    CF_ASSERT(arena.chain.depth == 0 && arena.memory == storage, "Chained block not released");
+
+    g_commit_budget = SIZE_MAX;
+    CF_ASSERT_NOT_NULL(memArenaAllocArray(&arena, U8, 2 * granularity));
+
+    memArenaClear(&arena);
+    vmemRelease(&vmem, storage, storage_size);
+}
+
 I32
 consoleMain(Platform *platform, CommandLine *cmd_line)
 {
     CF_UNUSED(cmd_line);
 
+    testHugePages(platform->vmem);
+    testScratch(platform->vmem);
+    testChain(platform);
+    testCommitPolicy(platform->vmem);
+    testCommitFailure(platform->vmem);
+
     MemArena arena;
     Size const storage_size = 1024 * 1024 * 1024;
     void *storage = vmemReserve(platform->vmem, storage_size);
@@ -33,20 +408,22 @@ consoleMain(Platform *platform, CommandLine *cmd_line)
         CF_ASSERT(ints[i] == i, "");
     }
 
-    MEM_ARENA_TEMP_END(&arena);
-
     for (I32 i = 1024; i < 2048; ++i)
     {
         ints[i] = i;
     }
 
-    memArenaClear(&arena);
+    MEM_ARENA_TEMP_END(&arena);
 
-    for (I32 i = 0; i < 512; ++i)
+    // NOTE (Matteo): The memory allocated before the temporary scope is still valid, while the
+    // rest can be decommitted (as everything after clearing)
+    for (I32 i = 0; i < 1024; ++i)
     {
         CF_ASSERT(ints[i] == i, "");
     }
 
+    memArenaClear(&arena);
+
     vmemRelease(platform->vmem, storage, storage_size);
 
     return 0;
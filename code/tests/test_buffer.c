@@ -5,6 +5,7 @@
 #include "foundation/error.h"
 #include "foundation/mem_buffer.inl"
 #include "foundation/memory.h"
+#include "foundation/time.h"
 
 #include <stdio.h>
 
@@ -26,6 +27,198 @@ bufferPrint(UsizeBuffer *a)
     fflush(out);
 }
 
+static void
+testVmBuffer(VMemApi *vmem)
+{
+    Size const max_items = 1 << 20;
+    Size const num_items = 100000;
+
+    UsizeBuffer buffer = {0};
+    MemVmBlock block = {0};
+
+    CF_ASSERT(!memBufferInitVm(&buffer, &block, vmem, max_items), "VM buffer init FAILED");
+
+    MemAllocator alloc = memVmBlockAllocator(&block);
+
+    CF_ASSERT(!memBufferPushAlloc(&buffer, 0, alloc), "VM buffer push FAILED");
+    Size *base = buffer.ptr;
+
+    for (Size i = 1; i < num_items; ++i)
+    {
+        CF_ASSERT(!memBufferPushAlloc(&buffer, i, alloc), "VM buffer push FAILED");
+        CF_ASSERT(buffer.ptr == base, "VM buffer moved while growing");
+    }
+
+    for (Size i = 0; i < num_items; ++i)
+    {
+        CF_ASSERT(buffer.ptr[i] == i, "VM buffer push FAILED");
+    }
+
+    CF_ASSERT(block.committed >= num_items * sizeof(*buffer.ptr), "VM buffer not committed");
+
+    // Shrinking decommits the pages beyond the size of the buffer
+    Size committed = block.committed;
+    buffer.len = 1000;
+    CF_ASSERT(!memBufferTrim(&buffer, alloc), "VM buffer trim FAILED");
+    CF_ASSERT(buffer.cap == buffer.len, "VM buffer trim FAILED");
+    CF_ASSERT(block.committed < committed, "VM buffer not decommitted");
+    CF_ASSERT(buffer.ptr == base && buffer.ptr[999] == 999, "VM buffer trim corrupted items");
+
+    // Memory committed again must be cleared
+    CF_ASSERT(!memBufferResizeAlloc(&buffer, num_items, alloc), "VM buffer resize FAILED");
+    for (Size i = 1000; i < num_items; ++i)
+    {
+        CF_ASSERT(buffer.ptr[i] == 0, "VM buffer growth not cleared");
+    }
+
+    // Growth is bounded by the reservation, but not by the geometric growth policy
+    CF_ASSERT(!memBufferResizeAlloc(&buffer, max_items, alloc), "VM buffer resize FAILED");
+    CF_ASSERT(memBufferPushAlloc(&buffer, 0, alloc) == Error_OutOfMemory,
+              "VM buffer push UNEXPECTED SUCCESS");
+
+    memBufferShutdownVm(&buffer, &block);
+    CF_ASSERT(!buffer.ptr && !buffer.cap && !block.base, "VM buffer shutdown FAILED");
+}
+
+static void
+bufferCheck(UsizeBuffer *buffer, Size const *expected, Size count)
+{
+    CF_ASSERT(buffer->len == count, "Unexpected buffer size");
+    CF_ASSERT(memMatchArray(buffer->ptr, expected, count), "Unexpected buffer content");
+}
+
+static void
+testRanges(MemAllocator alloc)
+{
+    UsizeBuffer buffer = {0};
+    Size const items[] = {10, 11, 12};
+    MemSlice(Size const) slice = {.ptr = items, .len = CF_ARRAY_SIZE(items)};
+
+    CF_ASSERT(!memBufferAppendAlloc(&buffer, slice, alloc), "Buffer append FAILED");
+    CF_ASSERT(!memBufferAppendAlloc(&buffer, slice, alloc), "Buffer append FAILED");
+    bufferCheck(&buffer, (Size[]){10, 11, 12, 10, 11, 12}, 6);
+
+    CF_ASSERT(!memBufferInsertRangeAlloc(&buffer, 1, items, 2, alloc), "Buffer insert FAILED");
+    bufferCheck(&buffer, (Size[]){10, 10, 11, 11, 12, 10, 11, 12}, 8);
+
+    CF_ASSERT(!memBufferInsertRangeAlloc(&buffer, 8, items + 2, 1, alloc), "Buffer insert FAILED");
+    bufferCheck(&buffer, (Size[]){10, 10, 11, 11, 12, 10, 11, 12, 12}, 9);
+
+    CF_ASSERT(!memBufferRemoveRange(&buffer, 2, 4), "Buffer remove FAILED");
+    bufferCheck(&buffer, (Size[]){10, 10, 11, 12, 12}, 5);
+
+    // Shrinking, growing and same-size replacements
+    CF_ASSERT(!memBufferReplaceRange(&buffer, 1, 3, items, 1), "Buffer replace FAILED");
+    bufferCheck(&buffer, (Size[]){10, 10, 12}, 3);
+
+    CF_ASSERT(!memBufferReplaceRangeAlloc(&buffer, 0, 1, items, 3, alloc), "Buffer replace FAILED");
+    bufferCheck(&buffer, (Size[]){10, 11, 12, 10, 12}, 5);
+
+    CF_ASSERT(!memBufferReplaceRange(&buffer, 3, 2, items + 1, 2), "Buffer replace FAILED");
+    bufferCheck(&buffer, (Size[]){10, 11, 12, 11, 12}, 5);
+
+    // Out of range and capacity failures leave the buffer untouched
+    CF_ASSERT(memBufferRemoveRange(&buffer, 4, 2) == Error_OutOfRange, "Buffer remove UNEXPECTED");
+    CF_ASSERT(memBufferInsertRange(&buffer, 6, items, 1) == Error_OutOfRange,
+              "Buffer insert UNEXPECTED");
+    CF_ASSERT(memBufferInsertRange(&buffer, 0, items, buffer.cap) == Error_BufferFull,
+              "Buffer insert UNEXPECTED");
+    bufferCheck(&buffer, (Size[]){10, 11, 12, 11, 12}, 5);
+
+    CF_ASSERT(!memBufferTrim(&buffer, alloc) && buffer.cap == 5, "Buffer trim FAILED");
+    bufferCheck(&buffer, (Size[]){10, 11, 12, 11, 12}, 5);
+
+    CF_ASSERT(!memBufferAppendAlloc(&buffer, slice, alloc), "Buffer append after trim FAILED");
+    bufferCheck(&buffer, (Size[]){10, 11, 12, 11, 12, 10, 11, 12}, 8);
+
+    memBufferFree(&buffer, alloc);
+}
+
+//=== Benchmark ===//
+
+#define BENCH_LEN 100000
+#define BENCH_RANGE 1000
+
+static void
+benchPrint(Cstr name, Duration per_item, Duration range)
+{
+    double item_ms = timeGetSeconds(per_item) * 1e3;
+    double range_ms = timeGetSeconds(range) * 1e3;
+    fprintf(stdout, "%-8s per item %9.3f ms - range %7.3f ms (%.0fx)\n", name, item_ms, range_ms,
+            item_ms / range_ms);
+}
+
+static void
+benchRanges(MemAllocator alloc)
+{
+    fprintf(stdout, "-------------------------\n");
+    fprintf(stdout, "Range operations (%d items on %d)\n", BENCH_RANGE, BENCH_LEN);
+    fprintf(stdout, "-------------------------\n");
+
+    UsizeBuffer items = {0};
+    UsizeBuffer a = {0};
+    UsizeBuffer b = {0};
+
+    CF_ASSERT(!memBufferResizeAlloc(&items, BENCH_RANGE, alloc), "Buffer resize FAILED");
+    for (Size i = 0; i < items.len; ++i) items.ptr[i] = i;
+
+    Clock clock;
+    Duration per_item, range;
+
+    // Insertion at the front
+    CF_ASSERT(!memBufferResizeAlloc(&a, BENCH_LEN, alloc), "Buffer resize FAILED");
+    CF_ASSERT(!memBufferResizeAlloc(&b, BENCH_LEN, alloc), "Buffer resize FAILED");
+
+    clockStart(&clock);
+    for (Size i = 0; i < items.len; ++i)
+    {
+        CF_ASSERT(!memBufferInsertAlloc(&a, i, items.ptr[i], alloc), "Buffer insert FAILED");
+    }
+    per_item = clockElapsed(&clock);
+
+    clockStart(&clock);
+    CF_ASSERT(!memBufferInsertRangeAlloc(&b, 0, items.ptr, items.len, alloc),
+              "Buffer insert FAILED");
+    range = clockElapsed(&clock);
+
+    CF_ASSERT(a.len == b.len && memMatchArray(a.ptr, b.ptr, a.len), "Insert results differ");
+    benchPrint("insert", per_item, range);
+
+    // Removal from the front
+    clockStart(&clock);
+    for (Size i = 0; i < items.len; ++i) memBufferStableRemove(&a, 0);
+    per_item = clockElapsed(&clock);
+
+    clockStart(&clock);
+    CF_ASSERT(!memBufferRemoveRange(&b, 0, items.len), "Buffer remove FAILED");
+    range = clockElapsed(&clock);
+
+    CF_ASSERT(a.len == b.len && memMatchArray(a.ptr, b.ptr, a.len), "Remove results differ");
+    benchPrint("remove", per_item, range);
+
+    // Append to empty buffers
+    memBufferFree(&a, alloc);
+    memBufferFree(&b, alloc);
+
+    clockStart(&clock);
+    for (Size i = 0; i < items.len; ++i)
+    {
+        CF_ASSERT(!memBufferPushAlloc(&a, items.ptr[i], alloc), "Buffer push FAILED");
+    }
+    per_item = clockElapsed(&clock);
+
+    clockStart(&clock);
+    CF_ASSERT(!memBufferAppendAlloc(&b, items, alloc), "Buffer append FAILED");
+    range = clockElapsed(&clock);
+
+    CF_ASSERT(a.len == b.len && memMatchArray(a.ptr, b.ptr, a.len), "Append results differ");
+    benchPrint("append", per_item, range);
+
+    memBufferFree(&a, alloc);
+    memBufferFree(&b, alloc);
+    memBufferFree(&items, alloc);
+}
+
 I32
 consoleMain(Platform *platform, CommandLine *cmd_line)
 {
@@ -104,5 +297,11 @@ consoleMain(Platform *platform, CommandLine *cmd_line)
         CF_ASSERT(buffer.ptr[i] == test_insert[i], "Buffer insert FAILED");
     }
 
+    memBufferFree(&buffer, std_alloc);
+
+    testVmBuffer(platform->vmem);
+    testRanges(std_alloc);
+    benchRanges(std_alloc);
+
     return 0;
 }
@@ -0,0 +1,399 @@
+#include "platform.h"
+
+#include "foundation/core.h"
+#include "foundation/error.h"
+#include "foundation/hash_map.h"
+#include "foundation/memory.h"
+#include "foundation/strings.h"
+#include "foundation/time.h"
+
+#include <stdio.h>
+
+static U32
+mapRand(U32 *state)
+{
+    U32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+//=== Correctness ===//
+
+#define REF_KEYS 4096
+
+static void
+mapCheck(CfHashMap *map, U64 const *ref, bool const *present)
+{
+    Size count = 0;
+
+    for (Size i = 0; i < REF_KEYS; ++i)
+    {
+        U64 key = i * 0x10001;
+        U64 *value = cfHashMapFindT(map, &key, U64);
+
+        if (present[i])
+        {
+            CF_ASSERT(value && *value == ref[i], "Missing or wrong value");
+            ++count;
+        }
+        else
+        {
+            CF_ASSERT(!value, "Removed key found");
+        }
+    }
+
+    CF_ASSERT(map->count == count, "Wrong map count");
+
+    Size cursor = 0;
+    Size iterated = 0;
+    void *key_ptr;
+    void *value_ptr;
+
+    while (cfHashMapNext(map, &cursor, &key_ptr, &value_ptr))
+    {
+        U64 key = *(U64 *)key_ptr;
+        Size index = (Size)(key / 0x10001);
+        CF_ASSERT(index < REF_KEYS && present[index], "Unexpected key iterated");
+        CF_ASSERT(*(U64 *)value_ptr == ref[index], "Wrong value iterated");
+        ++iterated;
+    }
+
+    CF_ASSERT(iterated == count, "Wrong iteration count");
+}
+
+static void
+testRandom(MemAllocator alloc)
+{
+    static U64 ref[REF_KEYS];
+    static bool present[REF_KEYS];
+
+    CfHashMap map;
+    cfHashMapInit(&map, alloc, U64, U64, NULL, NULL);
+
+    U32 rng = 0x12345678;
+
+    for (Size iter = 0; iter < 200000; ++iter)
+    {
+        // NOTE (Matteo): Draw keys from a subset that changes slowly, so that the map goes through
+        // both growth and heavy insert/remove churn
+        Size range = 64 + (iter / 50) % (REF_KEYS - 64);
+        Size index = mapRand(&rng) % range;
+        U64 key = index * 0x10001;
+
+        if (mapRand(&rng) % 3)
+        {
+            U64 value = mapRand(&rng);
+            CF_ASSERT(!cfHashMapPut(&map, &key, &value), "Map put FAILED");
+            ref[index] = value;
+            present[index] = true;
+        }
+        else
+        {
+            U64 value = 0;
+            bool removed = cfHashMapRemove(&map, &key, &value);
+            CF_ASSERT(removed == present[index], "Wrong removal result");
+            CF_ASSERT(!removed || value == ref[index], "Wrong removed value");
+            present[index] = false;
+        }
+
+        if (iter % 10000 == 0) mapCheck(&map, ref, present);
+    }
+
+    mapCheck(&map, ref, present);
+
+    cfHashMapClear(&map);
+    memClearArray(present, REF_KEYS);
+    mapCheck(&map, ref, present);
+
+    cfHashMapShutdown(&map);
+}
+
+static void
+testReserve(MemAllocator alloc)
+{
+    CfHashMap map;
+    cfHashMapInit(&map, alloc, U32, U32, NULL, NULL);
+
+    CF_ASSERT(!cfHashMapReserve(&map, 1000), "Map reserve FAILED");
+
+    U8 *storage = map.slots;
+    Size capacity = map.capacity;
+
+    for (U32 i = 0; i < 1000; ++i)
+    {
+        bool inserted = false;
+        U32 *value = cfHashMapInsert(&map, &i, &inserted);
+        CF_ASSERT(value && inserted, "Map insert FAILED");
+        *value = i * i;
+    }
+
+    CF_ASSERT(map.slots == storage && map.capacity == capacity, "Map reallocated after reserve");
+
+    for (U32 i = 0; i < 1000; ++i)
+    {
+        bool inserted = true;
+        U32 *value = cfHashMapInsert(&map, &i, &inserted);
+        CF_ASSERT(value && !inserted && *value == i * i, "Existing entry not found");
+    }
+
+    cfHashMapShutdown(&map);
+}
+
+static Cstr const g_extensions[] = {".jpg", ".jpeg", ".bmp", ".png", ".gif", ".tga", ".psd"};
+
+static void
+testStrings(MemArena *arena)
+{
+    MemArenaState state = memArenaSave(arena);
+
+    CfHashMap map;
+    cfHashMapInit(&map, memArenaAllocator(arena), Str, Size, cfHashKeyStrInsensitive,
+                  cfHashKeyStrEqualInsensitive);
+    CF_ASSERT(!cfHashMapReserve(&map, CF_ARRAY_SIZE(g_extensions)), "Map reserve FAILED");
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(g_extensions); ++i)
+    {
+        Str key = strFromCstr(g_extensions[i]);
+        CF_ASSERT(!cfHashMapPut(&map, &key, &i), "Map put FAILED");
+    }
+
+    Str const hits[] = {strLiteral(".PNG"), strLiteral(".Jpeg"), strLiteral(".psd")};
+    Str const misses[] = {strLiteral(".pn"), strLiteral(".pngg"), strLiteral("png"), {0}};
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(hits); ++i)
+    {
+        Size *index = cfHashMapFindT(&map, &hits[i], Size);
+        CF_ASSERT(index && strEqualInsensitive(strFromCstr(g_extensions[*index]), hits[i]),
+                  "String key not found");
+    }
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(misses); ++i)
+    {
+        CF_ASSERT(!cfHashMapFind(&map, &misses[i]), "Unexpected string key found");
+    }
+
+    // NOTE (Matteo): Case insensitive hashing must be consistent with the comparison
+    Str upper = strLiteral("SOME LONGER KEY, WITH PUNCTUATION [@`{]");
+    Str lower = strLiteral("some longer key, with punctuation [@`{]");
+    CF_ASSERT(cfHashKeyStrInsensitive(&upper, sizeof(Str)) ==
+                  cfHashKeyStrInsensitive(&lower, sizeof(Str)),
+              "Inconsistent case insensitive hash");
+
+    cfHashMapShutdown(&map);
+    memArenaRestore(state);
+}
+
+//=== Benchmark ===//
+
+// NOTE (Matteo): Reference implementation of a chained hash map, with nodes allocated from a pool
+// and per-bucket singly linked lists; uses the same hash function of the benchmarked map.
+// Lookups are kept out of line, like the ones of the benchmarked map, for a fair comparison.
+
+#if CF_COMPILER_MSVC
+#    define CHAIN_NOINLINE __declspec(noinline)
+#else
+#    define CHAIN_NOINLINE __attribute__((noinline))
+#endif
+
+typedef struct ChainNode
+{
+    U64 key;
+    U64 value;
+    U32 next;
+} ChainNode;
+
+typedef struct ChainMap
+{
+    MemAllocator alloc;
+    U32 *buckets;
+    ChainNode *nodes;
+    Size bucket_count;
+    Size count;
+} ChainMap;
+
+#define CHAIN_NIL U32_MAX
+
+static void
+chainInit(ChainMap *map, MemAllocator alloc, Size capacity)
+{
+    map->alloc = alloc;
+    map->bucket_count = 1;
+    while (map->bucket_count < capacity) map->bucket_count <<= 1;
+    map->buckets = memAllocArray(alloc, U32, map->bucket_count);
+    map->nodes = memAllocArray(alloc, ChainNode, capacity);
+    map->count = 0;
+    memWrite((U8 *)map->buckets, 0xFF, map->bucket_count * sizeof(*map->buckets));
+}
+
+static void
+chainShutdown(ChainMap *map, Size capacity)
+{
+    memFreeArray(map->alloc, map->buckets, map->bucket_count);
+    memFreeArray(map->alloc, map->nodes, capacity);
+}
+
+static void
+chainPut(ChainMap *map, U64 key, U64 value)
+{
+    Size bucket = cfHashKeyBytes(&key, sizeof(key)) & (map->bucket_count - 1);
+    ChainNode *node = map->nodes + map->count;
+    node->key = key;
+    node->value = value;
+    node->next = map->buckets[bucket];
+    map->buckets[bucket] = (U32)map->count++;
+}
+
+static CHAIN_NOINLINE U64 *
+chainFind(ChainMap *map, U64 key)
+{
+    Size bucket = cfHashKeyBytes(&key, sizeof(key)) & (map->bucket_count - 1);
+
+    for (U32 index = map->buckets[bucket]; index != CHAIN_NIL; index = map->nodes[index].next)
+    {
+        if (map->nodes[index].key == key) return &map->nodes[index].value;
+    }
+
+    return NULL;
+}
+
+static void
+benchLookup(MemAllocator alloc, Size count)
+{
+    Size const lookups = 1 << 22;
+    U32 rng = 0xCAFEBABE;
+
+    U64 *keys = memAllocArray(alloc, U64, count);
+    U64 *probes = memAllocArray(alloc, U64, 4096);
+
+    for (Size i = 0; i < count; ++i) keys[i] = ((U64)mapRand(&rng) << 32) | mapRand(&rng);
+
+    // NOTE (Matteo): Half of the probes hit, the other half miss
+    for (Size i = 0; i < 4096; ++i)
+    {
+        probes[i] = (i & 1) ? keys[mapRand(&rng) % count] : ((U64)mapRand(&rng) << 32);
+    }
+
+    CfHashMap map;
+    ChainMap chain;
+    cfHashMapInit(&map, alloc, U64, U64, NULL, NULL);
+    chainInit(&chain, alloc, count);
+
+    for (Size i = 0; i < count; ++i)
+    {
+        CF_ASSERT(!cfHashMapPut(&map, keys + i, &i), "Map put FAILED");
+        chainPut(&chain, keys[i], i);
+    }
+
+    Clock clock;
+    U64 sum_linear = 0, sum_chain = 0, sum_swiss = 0;
+    Size lookups_linear = cfClamp(((Size)1 << 26) / count, (Size)1024, lookups);
+
+    clockStart(&clock);
+    for (Size i = 0; i < lookups_linear; ++i)
+    {
+        U64 probe = probes[i & 4095];
+        for (Size j = 0; j < count; ++j)
+        {
+            if (keys[j] == probe)
+            {
+                sum_linear += j;
+                break;
+            }
+        }
+    }
+    double linear_ns = timeGetSeconds(clockElapsed(&clock)) * 1e9 / (double)lookups_linear;
+
+    clockStart(&clock);
+    for (Size i = 0; i < lookups; ++i)
+    {
+        U64 *value = chainFind(&chain, probes[i & 4095]);
+        if (value) sum_chain += *value;
+    }
+    double chain_ns = timeGetSeconds(clockElapsed(&clock)) * 1e9 / (double)lookups;
+
+    clockStart(&clock);
+    for (Size i = 0; i < lookups; ++i)
+    {
+        U64 *value = cfHashMapFindT(&map, probes + (i & 4095), U64);
+        if (value) sum_swiss += *value;
+    }
+    double swiss_ns = timeGetSeconds(clockElapsed(&clock)) * 1e9 / (double)lookups;
+
+    CF_ASSERT(sum_chain == sum_swiss, "Lookup results differ");
+    CF_ASSERT(lookups_linear != lookups || sum_linear == sum_swiss, "Lookup results differ");
+
+    fprintf(stdout, "%8zu | %9.1f | %9.1f | %9.1f\n", count, linear_ns, chain_ns, swiss_ns);
+
+    cfHashMapShutdown(&map);
+    chainShutdown(&chain, count);
+    memFreeArray(alloc, probes, 4096);
+    memFreeArray(alloc, keys, count);
+}
+
+static void
+benchChurn(MemAllocator alloc)
+{
+    Size const count = 1 << 16;
+    Size const ops = 1 << 22;
+    U32 rng = 0xDEADBEEF;
+
+    CfHashMap map;
+    cfHashMapInit(&map, alloc, U64, U64, NULL, NULL);
+    CF_ASSERT(!cfHashMapReserve(&map, count), "Map reserve FAILED");
+
+    for (U64 key = 0; key < count; ++key) cfHashMapPut(&map, &key, &key);
+
+    // NOTE (Matteo): Remove a random key and insert a new one, keeping the load constant; with
+    // tombstones this pattern would fill the table with deleted slots and require rehashing
+    Clock clock;
+    clockStart(&clock);
+    for (Size i = 0; i < ops; ++i)
+    {
+        U64 old_key = i + (mapRand(&rng) % count);
+        U64 new_key = i + count;
+        cfHashMapRemove(&map, &old_key, NULL);
+        if (map.count < count) cfHashMapPut(&map, &new_key, &new_key);
+    }
+    double churn_ns = timeGetSeconds(clockElapsed(&clock)) * 1e9 / (double)ops;
+
+    fprintf(stdout, "Churn (%zu entries, capacity %zu): %.1f ns per remove + insert\n", map.count,
+            map.capacity, churn_ns);
+
+    cfHashMapShutdown(&map);
+}
+
+I32
+consoleMain(Platform *platform, CommandLine *cmd_line)
+{
+    CF_UNUSED(cmd_line);
+
+    Size const storage_size = CF_MB(64);
+    void *storage = vmemReserve(platform->vmem, storage_size);
+
+    MemArena arena;
+    memArenaInitOnVmem(&arena, platform->vmem, storage, storage_size);
+
+    testRandom(platform->heap);
+    testRandom(memArenaAllocator(&arena));
+    testReserve(platform->heap);
+    testStrings(&arena);
+
+    fprintf(stdout, "-------------------------------------------\n");
+    fprintf(stdout, "Lookup (ns) - 50%% hits\n");
+    fprintf(stdout, "-------------------------------------------\n");
+    fprintf(stdout, "   Count |    Linear |   Chained |     Swiss\n");
+
+    for (Size count = 4; count <= (1 << 20); count <<= 2)
+    {
+        benchLookup(platform->heap, count);
+    }
+
+    benchChurn(platform->heap);
+
+    memArenaClear(&arena);
+    vmemRelease(platform->vmem, storage, storage_size);
+
+    return 0;
+}
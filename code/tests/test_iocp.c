@@ -11,6 +11,10 @@
 #include <stdio.h>
 
 static MemAllocator g_heap;
+// NOTE (Matteo): IO contexts are allocated by the issuing thread and released by the completion
+// callback on a thread pool worker, so they come from a lock-free pool
+static MemPool g_io_pool;
+static MemAllocator g_io_alloc;
 
 #define IO_CALLBACK(name) void name(void *context, ULONG result, ULONG_PTR bytes)
 
@@ -45,7 +49,7 @@ ioCallback(TP_CALLBACK_INSTANCE *Instance,     //
     CF_ASSERT(Overlapped == &ioctxt->ovp, "");
 
     CloseThreadpoolIo(Io);
-    memFreeStruct(g_heap, ioctxt);
+    memFreeStruct(g_io_alloc, ioctxt);
 }
 
 static TP_IO *
@@ -67,7 +71,7 @@ static IO_CALLBACK(fileIoCallback)
 static void
 fileBeginWrite(Cstr filename, U8 const *buffer, Size size, FileIoToken *token)
 {
-    IoContext *context = memAllocStruct(g_heap, IoContext);
+    IoContext *context = memAllocStruct(g_io_alloc, IoContext);
     context->callback = fileIoCallback;
     context->user_data = token;
 
@@ -91,6 +95,13 @@ consoleMain(Platform *platform, CommandLine *cmd_line)
     CF_UNUSED(cmd_line);
 
     g_heap = platform->heap;
+
+    if (!memPoolInit(&g_io_pool, g_heap, sizeof(IoContext), alignof(IoContext), 64, g_heap))
+    {
+        return -1;
+    }
+    g_io_alloc = memPoolAllocator(&g_io_pool);
+
     Size big_block_size = CF_GB(1);
     U8 *big_block = memAlloc(g_heap, big_block_size);
     FileIoToken token = {0};
@@ -103,6 +114,7 @@ consoleMain(Platform *platform, CommandLine *cmd_line)
     }
 
     memFree(g_heap, big_block, big_block_size);
+    memPoolShutdown(&g_io_pool);
     printf("%s\n", token.success ? "SUCCESS" : "FAILURE");
 
     return 0;
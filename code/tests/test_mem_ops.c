@@ -0,0 +1,473 @@
+
+#include "platform.h"
+
+#include "foundation/core.h"
+#include "foundation/atom.inl"
+#include "foundation/error.h"
+#include "foundation/memory.h"
+#include "foundation/threading.h"
+#include "foundation/time.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static Cstr const g_simd_names[] = {"libc", "sse2", "avx2"};
+
+//=== Correctness ===//
+
+#define CHECK_MAX_SIZE 1100
+#define CHECK_GUARD 64
+#define CHECK_BUFFER_SIZE (CHECK_MAX_SIZE + 2 * CHECK_GUARD)
+
+static void
+checkFillPattern(U8 *buffer, Size size, U8 seed)
+{
+    for (Size i = 0; i < size; ++i) buffer[i] = (U8)(seed + i * 7);
+}
+
+static I32
+checkSign(I32 value)
+{
+    return (value > 0) - (value < 0);
+}
+
+static void
+checkCopyAndWrite(U8 *src, U8 *dst, U8 *ref)
+{
+    for (Size size = 0; size <= CHECK_MAX_SIZE; size += (size < 300 ? 1 : 97))
+    {
+        for (Size src_off = 0; src_off < 32; src_off += 3)
+        {
+            for (Size dst_off = 0; dst_off < 32; dst_off += 5)
+            {
+                checkFillPattern(src, CHECK_BUFFER_SIZE, 1);
+                checkFillPattern(dst, CHECK_BUFFER_SIZE, 2);
+                checkFillPattern(ref, CHECK_BUFFER_SIZE, 2);
+
+                memCopy(src + CHECK_GUARD + src_off, dst + CHECK_GUARD + dst_off, size);
+                memmove(ref + CHECK_GUARD + dst_off, src + CHECK_GUARD + src_off, size); // NOLINT
+                CF_ASSERT(!memcmp(dst, ref, CHECK_BUFFER_SIZE), "memCopy mismatch");
+
+                memWrite(dst + CHECK_GUARD + dst_off, 0xA5, size);
+                memset(ref + CHECK_GUARD + dst_off, 0xA5, size); // NOLINT
+                CF_ASSERT(!memcmp(dst, ref, CHECK_BUFFER_SIZE), "memWrite mismatch");
+            }
+        }
+
+        // Overlapping copies, in both directions
+        for (Size shift = 1; shift < 40; shift += 13)
+        {
+            checkFillPattern(dst, CHECK_BUFFER_SIZE, 3);
+            checkFillPattern(ref, CHECK_BUFFER_SIZE, 3);
+            memCopy(dst + CHECK_GUARD, dst + CHECK_GUARD - shift, size);
+            memmove(ref + CHECK_GUARD - shift, ref + CHECK_GUARD, size); // NOLINT
+            CF_ASSERT(!memcmp(dst, ref, CHECK_BUFFER_SIZE), "Overlapping memCopy mismatch");
+
+            checkFillPattern(dst, CHECK_BUFFER_SIZE, 4);
+            checkFillPattern(ref, CHECK_BUFFER_SIZE, 4);
+            memCopy(dst + CHECK_GUARD - shift, dst + CHECK_GUARD, size);
+            memmove(ref + CHECK_GUARD, ref + CHECK_GUARD - shift, size); // NOLINT
+            CF_ASSERT(!memcmp(dst, ref, CHECK_BUFFER_SIZE), "Overlapping memCopy mismatch");
+        }
+    }
+}
+
+static void
+checkStream(U8 *src, U8 *dst, U8 *ref)
+{
+    // NOTE (Matteo): Lower the threshold so that the non-temporal kernels are exercised
+    Size threshold = memStreamThreshold();
+    memStreamSetThreshold(64);
+
+    for (Size size = 0; size <= CHECK_MAX_SIZE; size += (size < 300 ? 1 : 97))
+    {
+        for (Size off = 0; off < 32; off += 3)
+        {
+            checkFillPattern(src, CHECK_BUFFER_SIZE, 6);
+            checkFillPattern(dst, CHECK_BUFFER_SIZE, 7);
+            checkFillPattern(ref, CHECK_BUFFER_SIZE, 7);
+
+            memStreamCopy(src + CHECK_GUARD + off, dst + CHECK_GUARD + 31 - off, size);
+            memcpy(ref + CHECK_GUARD + 31 - off, src + CHECK_GUARD + off, size); // NOLINT
+            CF_ASSERT(!memcmp(dst, ref, CHECK_BUFFER_SIZE), "memStreamCopy mismatch");
+
+            memStreamWrite(dst + CHECK_GUARD + off, 0x3C, size);
+            memset(ref + CHECK_GUARD + off, 0x3C, size); // NOLINT
+            CF_ASSERT(!memcmp(dst, ref, CHECK_BUFFER_SIZE), "memStreamWrite mismatch");
+        }
+    }
+
+    memStreamSetThreshold(threshold);
+}
+
+static void
+checkCompare(U8 *left, U8 *right)
+{
+    for (Size size = 0; size <= CHECK_MAX_SIZE; size += (size < 300 ? 1 : 97))
+    {
+        for (Size offset = 0; offset < 32; offset += 7)
+        {
+            U8 *l = left + CHECK_GUARD + offset;
+            U8 *r = right + CHECK_GUARD;
+
+            checkFillPattern(l, size, 5);
+            checkFillPattern(r, size, 5);
+
+            CF_ASSERT(memMatch(l, r, size), "memMatch false negative");
+            CF_ASSERT(memCompare(l, r, size) == 0, "memCompare false negative");
+
+            // Place a single difference at several positions, including both ends
+            Size const step = size > 64 ? size / 16 : 1;
+            for (Size pos = 0; pos < size; pos += step)
+            {
+                for (I32 delta = -1; delta <= 1; delta += 2)
+                {
+                    U8 saved = r[pos];
+                    r[pos] = (U8)(r[pos] + delta);
+
+                    // Bytes past the end must be ignored
+                    l[size] = 0x00;
+                    r[size] = 0xFF;
+
+                    CF_ASSERT(!memMatch(l, r, size), "memMatch false positive");
+                    CF_ASSERT(checkSign(memCompare(l, r, size)) == checkSign(memcmp(l, r, size)),
+                              "memCompare wrong ordering");
+
+                    r[pos] = saved;
+                }
+            }
+        }
+    }
+}
+
+static void
+checkAlignedBlock(U8 const *block, Size size, Size align, U8 seed, Size filled)
+{
+    CF_ASSERT(((Size)block & (align - 1)) == 0, "Block is not aligned");
+
+    for (Size i = 0; i < size; ++i)
+    {
+        U8 expected = i < filled ? (U8)(seed + i * 7) : 0;
+        CF_ASSERT(block[i] == expected, i < filled ? "Content not preserved" : "Block not cleared");
+    }
+}
+
+static void
+checkAlignedAlloc(MemAllocator heap)
+{
+    static Size const sizes[] = {1, 100, 3000, 40, 70000, 8};
+
+    // NOTE (Matteo): The default alignment is not guaranteed by the end-of-page allocator used for
+    // memory protection, only over-alignment is
+    for (Size align = 2 * CF_MAX_ALIGN; align <= 4096; align *= 2)
+    {
+        U8 *block = NULL;
+        Size size = 0;
+
+        // NOTE (Matteo): Interleave small allocations so that reallocations move the block
+        U8 *other[CF_ARRAY_SIZE(sizes)] = {0};
+
+        for (Size i = 0; i < CF_ARRAY_SIZE(sizes); ++i)
+        {
+            Size new_size = sizes[i];
+            Size filled = cfMin(size, new_size);
+
+            block = memReallocAlign(heap, block, size, new_size, align);
+            CF_ASSERT_NOT_NULL(block);
+            checkAlignedBlock(block, new_size, align, (U8)align, filled);
+
+            checkFillPattern(block, new_size, (U8)align);
+            size = new_size;
+
+            other[i] = memAllocAlign(heap, 24, align);
+            CF_ASSERT_NOT_NULL(other[i]);
+            checkAlignedBlock(other[i], 24, align, 0, 0);
+        }
+
+        for (Size i = 0; i < CF_ARRAY_SIZE(sizes); ++i) memFreeAlign(heap, other[i], 24, align);
+        memFreeAlign(heap, block, size, align);
+    }
+
+    U8 *line = memAllocCacheAligned(heap, 1);
+    checkAlignedBlock(line, CF_CACHELINE_SIZE, CF_CACHELINE_SIZE, 0, 0);
+    memFreeCacheAligned(heap, line, 1);
+}
+
+//=== Benchmark ===//
+
+#define BENCH_MIN_SIZE 1
+#define BENCH_MAX_SIZE CF_MB(64)
+#define BENCH_BYTES CF_MB(32)
+
+typedef enum BenchOp
+{
+    BenchOp_Copy = 0,
+    BenchOp_Write,
+    BenchOp_Compare,
+    BenchOp_Match,
+    BenchOp_Count,
+} BenchOp;
+
+static Cstr const g_bench_op_names[BenchOp_Count] = {"memCopy", "memWrite", "memCompare",
+                                                     "memMatch"};
+
+static I32 volatile g_bench_sink;
+
+static double
+benchRun(BenchOp op, bool libc, U8 *src, U8 *dst, Size size)
+{
+    Size reps = cfClamp(BENCH_BYTES / size, (Size)2, (Size)1 << 20);
+    I32 sink = 0;
+
+    Clock clock;
+    clockStart(&clock);
+
+    for (Size rep = 0; rep < reps; ++rep)
+    {
+        switch (op)
+        {
+            case BenchOp_Copy:
+                if (libc) memcpy(dst, src, size); // NOLINT
+                else memCopy(src, dst, size);
+                break;
+
+            case BenchOp_Write:
+                if (libc) memset(dst, (I32)rep, size); // NOLINT
+                else memWrite(dst, (U8)rep, size);
+                break;
+
+            case BenchOp_Compare:
+                sink += libc ? memcmp(src, dst, size) : memCompare(src, dst, size);
+                break;
+
+            case BenchOp_Match:
+                sink += libc ? !memcmp(src, dst, size) : memMatch(src, dst, size);
+                break;
+
+            default: CF_INVALID_CODE_PATH(); break;
+        }
+    }
+
+    double secs = timeGetSeconds(clockElapsed(&clock));
+    g_bench_sink = sink;
+
+    // Throughput in GB/s
+    return (double)(reps * size) / (secs * 1e9);
+}
+
+static void
+benchMemOps(MemAllocator heap)
+{
+    U8 *src = memAlloc(heap, BENCH_MAX_SIZE);
+    U8 *dst = memAlloc(heap, BENCH_MAX_SIZE);
+
+    MemSimd max_level = memSimdSelect(MemSimd_Avx2);
+
+    for (BenchOp op = 0; op < BenchOp_Count; ++op)
+    {
+        printf("-------------------------\n");
+        printf("%s throughput (GB/s)\n", g_bench_op_names[op]);
+        printf("-------------------------\n");
+        printf("%10s %8s", "size", "libc");
+        for (MemSimd level = MemSimd_Sse2; level <= max_level; ++level)
+        {
+            printf(" %8s", g_simd_names[level]);
+        }
+        printf("\n");
+
+        // NOTE (Matteo): Comparisons must scan the whole buffers to be meaningful
+        memWrite(src, 0x5A, BENCH_MAX_SIZE);
+        memWrite(dst, 0x5A, BENCH_MAX_SIZE);
+
+        for (Size size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size <<= 1)
+        {
+            printf("%10zu %8.2f", size, benchRun(op, true, src, dst, size));
+
+            for (MemSimd level = MemSimd_Sse2; level <= max_level; ++level)
+            {
+                memSimdSelect(level);
+                printf(" %8.2f", benchRun(op, false, src, dst, size));
+            }
+
+            printf("\n");
+        }
+    }
+
+    memSimdSelect(max_level);
+
+    memFree(heap, src, BENCH_MAX_SIZE);
+    memFree(heap, dst, BENCH_MAX_SIZE);
+}
+
+//=== Cache pollution ===//
+
+// NOTE (Matteo): A victim thread chases pointers through a working set which fits in the cache,
+// while the main thread copies large buffers; the slowdown of the victim measures how much of its
+// working set is evicted by the copies.
+
+#define POLLUTION_WORKING_SET CF_MB(4)
+#define POLLUTION_BUFFER_SIZE CF_MB(64)
+#define POLLUTION_ROUNDS 16
+#define POLLUTION_BATCH 4096
+
+typedef struct PollutionNode
+{
+    U32 next;
+    U8 pad[CF_CACHELINE_SIZE - sizeof(U32)];
+} PollutionNode;
+
+typedef struct PollutionVictim
+{
+    PollutionNode *nodes;
+    AtomSize loads;
+    AtomBool stop;
+    U32 sink;
+} PollutionVictim;
+
+static CF_THREAD_FN(pollutionVictimProc)
+{
+    PollutionVictim *victim = args;
+    U32 index = 0;
+
+    while (!atomRead(&victim->stop))
+    {
+        for (Size i = 0; i < POLLUTION_BATCH; ++i) index = victim->nodes[index].next;
+        atomFetchAdd(&victim->loads, POLLUTION_BATCH);
+    }
+
+    victim->sink = index;
+}
+
+typedef enum PollutionMode
+{
+    PollutionMode_Idle = 0,
+    PollutionMode_Copy,
+    PollutionMode_Stream,
+} PollutionMode;
+
+static void
+pollutionRun(PollutionVictim *victim, PollutionMode mode, U8 *src, U8 *dst, Duration idle_time)
+{
+    static Cstr const names[] = {"idle", "memCopy", "memStreamCopy"};
+
+    Size loads_start = atomRead(&victim->loads);
+
+    Clock clock;
+    clockStart(&clock);
+
+    if (mode == PollutionMode_Idle)
+    {
+        cfSleep(idle_time);
+    }
+    else
+    {
+        for (Size round = 0; round < POLLUTION_ROUNDS; ++round)
+        {
+            if (mode == PollutionMode_Copy) memCopy(src, dst, POLLUTION_BUFFER_SIZE);
+            else memStreamCopy(src, dst, POLLUTION_BUFFER_SIZE);
+        }
+    }
+
+    double secs = timeGetSeconds(clockElapsed(&clock));
+    Size loads = atomRead(&victim->loads) - loads_start;
+
+    printf("%-14s victim %6.2f ns/load", names[mode], secs * 1e9 / (double)cfMax(loads, 1));
+    if (mode != PollutionMode_Idle)
+    {
+        double bytes = (double)(POLLUTION_ROUNDS * POLLUTION_BUFFER_SIZE);
+        printf(" - copy %6.2f GB/s", bytes / secs / 1e9);
+    }
+    printf("\n");
+}
+
+static void
+benchCachePollution(MemAllocator heap)
+{
+    printf("-------------------------\n");
+    printf("Cache pollution (%zu KB working set)\n", (Size)POLLUTION_WORKING_SET >> 10);
+    printf("-------------------------\n");
+
+    Size const node_count = POLLUTION_WORKING_SET / sizeof(PollutionNode);
+
+    PollutionVictim victim = {0};
+    victim.nodes = memAllocArray(heap, PollutionNode, node_count);
+
+    // NOTE (Matteo): Build a single random cycle (Sattolo's algorithm) to defeat the prefetcher
+    U32 rng = 0x9E3779B9;
+    for (Size i = 0; i < node_count; ++i) victim.nodes[i].next = (U32)i;
+    for (Size i = node_count - 1; i > 0; --i)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        Size j = rng % i;
+        U32 temp = victim.nodes[i].next;
+        victim.nodes[i].next = victim.nodes[j].next;
+        victim.nodes[j].next = temp;
+    }
+
+    U8 *src = memAlloc(heap, POLLUTION_BUFFER_SIZE);
+    U8 *dst = memAlloc(heap, POLLUTION_BUFFER_SIZE);
+    memWrite(src, 0x11, POLLUTION_BUFFER_SIZE);
+    memWrite(dst, 0x22, POLLUTION_BUFFER_SIZE);
+
+    CfThread thread = cfThreadStart(pollutionVictimProc, .args = &victim);
+
+    // NOTE (Matteo): Warm up with the regular copy, so that the idle run can last as long
+    Clock clock;
+    clockStart(&clock);
+    for (Size round = 0; round < POLLUTION_ROUNDS; ++round)
+    {
+        memCopy(src, dst, POLLUTION_BUFFER_SIZE);
+    }
+    Duration copy_time = clockElapsed(&clock);
+
+    pollutionRun(&victim, PollutionMode_Idle, src, dst, copy_time);
+    pollutionRun(&victim, PollutionMode_Copy, src, dst, copy_time);
+    pollutionRun(&victim, PollutionMode_Stream, src, dst, copy_time);
+
+    atomWrite(&victim.stop, true);
+    cfThreadWait(thread, DURATION_INFINITE);
+    cfThreadDestroy(thread);
+
+    memFree(heap, src, POLLUTION_BUFFER_SIZE);
+    memFree(heap, dst, POLLUTION_BUFFER_SIZE);
+    memFreeArray(heap, victim.nodes, node_count);
+}
+
+I32
+consoleMain(Platform *platform, CommandLine *cmd_line)
+{
+    CF_UNUSED(cmd_line);
+
+    MemSimd detected = memSimdLevel();
+    printf("Detected instruction set: %s\n", g_simd_names[detected]);
+
+    U8 *buffers[3];
+    for (Size i = 0; i < CF_ARRAY_SIZE(buffers); ++i)
+    {
+        buffers[i] = memAlloc(platform->heap, CHECK_BUFFER_SIZE);
+    }
+
+    for (MemSimd level = MemSimd_None; level <= detected; ++level)
+    {
+        CF_ASSERT(memSimdSelect(level) == level, "Supported instruction set not selected");
+        checkCopyAndWrite(buffers[0], buffers[1], buffers[2]);
+        checkStream(buffers[0], buffers[1], buffers[2]);
+        checkCompare(buffers[0], buffers[1]);
+    }
+
+    CF_ASSERT(memSimdSelect(MemSimd_Avx2) == detected, "Instruction set not clamped");
+
+    checkAlignedAlloc(platform->heap);
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(buffers); ++i)
+    {
+        memFree(platform->heap, buffers[i], CHECK_BUFFER_SIZE);
+    }
+
+    benchMemOps(platform->heap);
+    benchCachePollution(platform->heap);
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+
+#include "platform.h"
+
+#include "foundation/core.h"
+#include "foundation/atom.inl"
+#include "foundation/error.h"
+#include "foundation/log.h"
+#include "foundation/memory.h"
+#include "foundation/threading.h"
+
+#include <stdio.h>
+
+#define PROFILER_THREADS 8
+#define PROFILER_ITERS 10000
+
+#if CF_COMPILER_MSVC
+#    define PROFILER_NOINLINE __declspec(noinline)
+#else
+#    define PROFILER_NOINLINE __attribute__((noinline))
+#endif
+
+// NOTE (Matteo): Two distinct call sites, shared by all the threads. The result is returned
+// through a pointer so that the calls cannot be turned into tail calls, which would attribute
+// both of them to the caller.
+
+static PROFILER_NOINLINE void
+profilerAllocSmall(MemProfiler *profiler, U8 **block)
+{
+    *block = memProfilerAlloc(profiler, 24, CF_MAX_ALIGN);
+}
+
+static PROFILER_NOINLINE void
+profilerAllocLarge(MemProfiler *profiler, U8 **block)
+{
+    *block = memProfilerAlloc(profiler, 4000, CF_MAX_ALIGN);
+}
+
+static CF_THREAD_FN(profilerThreadProc)
+{
+    MemProfiler *profiler = args;
+
+    for (Size iter = 0; iter < PROFILER_ITERS; ++iter)
+    {
+        U8 *small, *large;
+        profilerAllocSmall(profiler, &small);
+        profilerAllocLarge(profiler, &large);
+
+        CF_ASSERT(((Size)large & (CF_MAX_ALIGN - 1)) == 0, "Block not aligned");
+        for (Size i = 0; i < 24; ++i) CF_ASSERT(!small[i], "Block not cleared");
+
+        small = memProfilerRealloc(profiler, small, 24, 48, CF_MAX_ALIGN);
+
+        memProfilerFree(profiler, small, 48, CF_MAX_ALIGN);
+        memProfilerFree(profiler, large, 4000, CF_MAX_ALIGN);
+    }
+}
+
+I32
+consoleMain(Platform *platform, CommandLine *cmd_line)
+{
+    CF_UNUSED(cmd_line);
+
+    MemProfiler *profiler = memAllocStruct(platform->heap, MemProfiler);
+    memProfilerInit(profiler, platform->heap);
+
+    CfThread threads[PROFILER_THREADS];
+    for (Size i = 0; i < PROFILER_THREADS; ++i)
+    {
+        threads[i] = cfThreadStart(profilerThreadProc, .args = profiler);
+    }
+    cfThreadWaitAll(threads, PROFILER_THREADS, DURATION_INFINITE);
+    for (Size i = 0; i < PROFILER_THREADS; ++i) cfThreadDestroy(threads[i]);
+
+    // Keep a few blocks alive
+    U8 *live[4];
+    for (Size i = 0; i < CF_ARRAY_SIZE(live); ++i) profilerAllocLarge(profiler, live + i);
+
+    MemProfilerEntry entries[8];
+    Size count = memProfilerSnapshot(profiler, MemProfilerSort_Bytes, entries, 8);
+
+    CF_ASSERT(count == 3, "Unexpected number of call sites");
+    CF_ASSERT(entries[0].callsite != entries[1].callsite &&
+                  entries[0].callsite != entries[2].callsite &&
+                  entries[1].callsite != entries[2].callsite,
+              "Call sites not reported separately");
+
+    Size const total = PROFILER_THREADS * PROFILER_ITERS;
+
+    // Sorted by total bytes: large blocks first
+    CF_ASSERT(entries[0].allocs == total + CF_ARRAY_SIZE(live), "Wrong allocation count");
+    CF_ASSERT(entries[0].live == 4000 * CF_ARRAY_SIZE(live), "Wrong live size");
+    CF_ASSERT(entries[0].frees == total, "Wrong free count");
+    CF_ASSERT(entries[0].histogram[11] == entries[0].allocs, "Wrong size histogram");
+
+    // Reallocated blocks are attributed to the reallocation site
+    CF_ASSERT(entries[1].reallocs == total && entries[1].frees == total, "Wrong realloc count");
+    CF_ASSERT(entries[2].allocs == total && entries[2].frees == 0, "Wrong small block count");
+    CF_ASSERT(entries[1].live == 0 && entries[2].live == 0, "Leaked blocks");
+
+    CfLog log = cfLogCreate(platform->vmem, CF_MB(1));
+    memProfilerDump(profiler, MemProfilerSort_Count, MemProfiler_ReportMax, &log);
+    fprintf(stdout, "%s", cfLogCstring(&log));
+    cfLogDestroy(&log, platform->vmem);
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(live); ++i)
+    {
+        memProfilerFree(profiler, live[i], 4000, CF_MAX_ALIGN);
+    }
+
+    // Blocks requested through the generic interface are accounted as well
+    MemAllocator alloc = memProfilerAllocator(profiler);
+    U8 *block = memAlloc(alloc, 100);
+    CF_ASSERT(atomRead(&profiler->live) == 100, "Generic allocation not accounted");
+    block = memRealloc(alloc, block, 100, 200);
+    CF_ASSERT(atomRead(&profiler->live) == 200, "Generic reallocation not accounted");
+    memFree(alloc, block, 200);
+
+    CF_ASSERT(atomRead(&profiler->live) == 0, "Leaked blocks");
+    memFreeStruct(platform->heap, profiler);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+
+#include "platform.h"
+
+#include "foundation/core.h"
+#include "foundation/error.h"
+#include "foundation/log.h"
+#include "foundation/memory.h"
+#include "foundation/strings.h"
+
+#include <stdio.h>
+
+static void
+testMirrorWrap(VMemApi *vmem)
+{
+    VMemMirrorBuffer buffer = vmemMirrorAllocate(vmem, 1);
+    CF_ASSERT_NOT_NULL(buffer.data);
+    CF_ASSERT(buffer.size >= vmem->address_granularity, "Mirror buffer size not rounded");
+
+    U8 *bytes = buffer.data;
+
+    // Write across the wrap boundary, then read back from both views
+    Size const count = 256;
+    Size const start = buffer.size - count / 2;
+
+    for (Size i = 0; i < count; ++i) bytes[start + i] = (U8)i;
+
+    for (Size i = 0; i < count; ++i)
+    {
+        Size pos = (start + i) & (buffer.size - 1);
+        CF_ASSERT(bytes[pos] == (U8)i, "Mirrored write not visible in the first view");
+        CF_ASSERT(bytes[pos + buffer.size] == (U8)i,
+                  "Mirrored write not visible in the second view");
+    }
+
+    vmemMirrorFree(vmem, &buffer);
+    CF_ASSERT(!buffer.data && !buffer.size, "Mirror buffer not cleared");
+}
+
+static void
+testLogWrap(VMemApi *vmem)
+{
+    CfLog log = cfLogCreate(vmem, 4096);
+    CF_ASSERT_NOT_NULL(log.buffer);
+
+    // Fill the log up to the end of the buffer, so that the next entry wraps around
+    Char8 filler[64];
+    memClear(filler, sizeof(filler));
+    memWrite((U8 *)filler, '.', sizeof(filler) - 1);
+
+    while (log.write_pos + sizeof(filler) < log.size) cfLogAppendC(&log, filler);
+
+    Cstr const entry = "This entry crosses the end of the buffer";
+    cfLogAppendC(&log, entry);
+    cfLogAppendC(&log, entry);
+
+    CF_ASSERT(log.write_pos > log.size, "Log did not wrap around");
+
+    Str content = cfLogString(&log);
+    Size entry_len = strLength(entry);
+
+    CF_ASSERT(content.len == log.size - 1, "Unexpected log content size");
+    CF_ASSERT(memMatch(content.ptr + content.len - entry_len, entry, entry_len),
+              "Wrapped log entry is corrupted");
+    CF_ASSERT(memMatch(content.ptr + content.len - 2 * entry_len, entry, entry_len),
+              "Wrapped log entry is corrupted");
+
+    cfLogDestroy(&log, vmem);
+}
+
+I32
+consoleMain(Platform *platform, CommandLine *cmd_line)
+{
+    CF_UNUSED(cmd_line);
+
+    testMirrorWrap(platform->vmem);
+    testLogWrap(platform->vmem);
+
+    return 0;
+}
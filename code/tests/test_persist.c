@@ -0,0 +1,202 @@
+#include "platform.h"
+
+#include "foundation/core.h"
+#include "foundation/error.h"
+#include "foundation/memory.h"
+#include "foundation/strings.h"
+#include "foundation/time.h"
+
+#include <stdio.h>
+
+#define PERSIST_VERSION 1
+#define PERSIST_SIZE CF_MB(64)
+
+// NOTE (Matteo): Mimics the file list of the image viewer: a flat array of entries referring to
+// names packed in a separate blob, all through relative pointers
+typedef struct PersistEntry
+{
+    MemRelPtr name;
+    U32 name_len;
+    U32 flags;
+    U64 size;
+} PersistEntry;
+
+typedef struct PersistRoot
+{
+    MemRelPtr entries;
+    Size count;
+} PersistRoot;
+
+static void
+persistBuild(MemArena *arena, Size count)
+{
+    PersistRoot *root = memArenaAllocStruct(arena, PersistRoot);
+    PersistEntry *entries = memArenaAllocArray(arena, PersistEntry, count);
+
+    for (Size i = 0; i < count; ++i)
+    {
+        Char8 buffer[64];
+        Size len = (Size)strPrint(buffer, CF_ARRAY_SIZE(buffer), "image_%08zu.png", i);
+        Char8 *name = memArenaAllocArray(arena, Char8, len);
+        memCopy(buffer, name, len);
+
+        memRelPtrSet(&entries[i].name, name);
+        entries[i].name_len = (U32)len;
+        entries[i].size = i * 1024;
+    }
+
+    memRelPtrSet(&root->entries, entries);
+    root->count = count;
+}
+
+static void
+persistCheck(PersistRoot *root, Size count)
+{
+    CF_ASSERT(root && root->count == count, "Wrong root");
+
+    PersistEntry *entries = memRelPtrGet(&root->entries, PersistEntry);
+    CF_ASSERT_NOT_NULL(entries);
+
+    for (Size i = 0; i < count; ++i)
+    {
+        Char8 buffer[64];
+        Size len = (Size)strPrint(buffer, CF_ARRAY_SIZE(buffer), "image_%08zu.png", i);
+        Char8 const *name = memRelPtrGet(&entries[i].name, Char8);
+
+        CF_ASSERT(entries[i].name_len == len && memMatch(name, buffer, len), "Wrong name");
+        CF_ASSERT(entries[i].size == i * 1024, "Wrong size");
+    }
+}
+
+static void
+testPersist(VMemApi *vmem, Str path)
+{
+    MemPersist persist;
+    Size const count = 1000;
+
+    // New file
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION, 0) ==
+                  MemPersistResult_Created,
+              "File not created");
+    CF_ASSERT(!memPersistRoot(&persist), "Root of a new file must be NULL");
+    persistBuild(&persist.arena, count);
+    memPersistSetRoot(&persist, persist.arena.memory);
+    CF_ASSERT(memPersistClose(&persist), "Close failed");
+
+    // Restore, with and without verification
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION, 0) ==
+                  MemPersistResult_Restored,
+              "File not restored");
+    persistCheck(memPersistRoot(&persist), count);
+
+    // Allocation continues after the restored content
+    Size allocated = persist.arena.allocated;
+    CF_ASSERT(memArenaAllocArray(&persist.arena, U64, 8), "Allocation failed");
+    CF_ASSERT(persist.arena.allocated > allocated, "Arena state not restored");
+    CF_ASSERT(memPersistSync(&persist), "Sync failed");
+    allocated = persist.arena.allocated;
+    CF_ASSERT(memPersistClose(&persist), "Close failed");
+
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION,
+                             MemPersistFlags_Verify) == MemPersistResult_Restored,
+              "File not restored");
+    CF_ASSERT(persist.arena.allocated == allocated, "Arena state not restored");
+    persistCheck(memPersistRoot(&persist), count);
+    CF_ASSERT(memPersistClose(&persist), "Close failed");
+
+    // Unclean shutdown: the file is unmapped without syncing
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION, 0) ==
+                  MemPersistResult_Restored,
+              "File not restored");
+    vmemFileUnmap(vmem, &persist.map);
+
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION, 0) ==
+                  MemPersistResult_Corrupted,
+              "Unclean shutdown not detected");
+    CF_ASSERT(!memPersistRoot(&persist) && !persist.arena.allocated, "Content not discarded");
+    persistBuild(&persist.arena, count);
+    memPersistSetRoot(&persist, persist.arena.memory);
+    CF_ASSERT(memPersistClose(&persist), "Close failed");
+
+    // Corrupted content, detected only by the full verification
+    {
+        VMemFileMap map = vmemFileMap(vmem, path, 0);
+        CF_ASSERT_NOT_NULL(map.data);
+        CF_ASSERT(map.size == PERSIST_SIZE, "Wrong file size");
+        ((U8 *)map.data)[4096 + 100] ^= 0x5A;
+        vmemFileUnmap(vmem, &map);
+    }
+
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION,
+                             MemPersistFlags_Verify) == MemPersistResult_Corrupted,
+              "Corruption not detected");
+    persistBuild(&persist.arena, count);
+    memPersistSetRoot(&persist, persist.arena.memory);
+    CF_ASSERT(memPersistClose(&persist), "Close failed");
+
+    // Version mismatch
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION + 1, 0) ==
+                  MemPersistResult_Outdated,
+              "Version mismatch not detected");
+    CF_ASSERT(!memPersistRoot(&persist), "Content not discarded");
+    memPersistReset(&persist);
+    CF_ASSERT(memPersistClose(&persist), "Close failed");
+}
+
+static void
+benchPersist(VMemApi *vmem, Str path)
+{
+    Size const count = 200000;
+    MemPersist persist;
+    Clock clock;
+
+    // Cold start: the content is built from scratch
+    clockStart(&clock);
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION, 0) !=
+                  MemPersistResult_Error,
+              "Open failed");
+    memPersistReset(&persist);
+    persistBuild(&persist.arena, count);
+    memPersistSetRoot(&persist, persist.arena.memory);
+    double cold = timeGetSeconds(clockElapsed(&clock));
+
+    CF_ASSERT(memPersistClose(&persist), "Close failed");
+
+    // Warm start: the content is restored from the file
+    clockStart(&clock);
+    CF_ASSERT(memPersistOpen(&persist, vmem, path, PERSIST_SIZE, PERSIST_VERSION, 0) ==
+                  MemPersistResult_Restored,
+              "File not restored");
+    PersistRoot *root = memPersistRoot(&persist);
+    double warm = timeGetSeconds(clockElapsed(&clock));
+
+    persistCheck(root, count);
+
+    clockStart(&clock);
+    CF_ASSERT(memPersistSync(&persist), "Sync failed");
+    double sync = timeGetSeconds(clockElapsed(&clock));
+
+    fprintf(stdout, "Persistent arena (%zu entries, %zu bytes)\n", count, persist.arena.allocated);
+    fprintf(stdout, "  Build: %8.3f ms\n", 1000 * cold);
+    fprintf(stdout, "  Open:  %8.3f ms\n", 1000 * warm);
+    fprintf(stdout, "  Sync:  %8.3f ms\n", 1000 * sync);
+
+    CF_ASSERT(memPersistClose(&persist), "Close failed");
+}
+
+I32
+consoleMain(Platform *platform, CommandLine *cmd_line)
+{
+    CF_UNUSED(cmd_line);
+
+    Str path = strLiteral("test_persist.bin");
+    remove("test_persist.bin");
+
+    testPersist(platform->vmem, path);
+    remove("test_persist.bin");
+
+    benchPersist(platform->vmem, path);
+    remove("test_persist.bin");
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+
+#include "platform.h"
+
+#include "foundation/core.h"
+#include "foundation/error.h"
+#include "foundation/memory.h"
+
+#include <stdio.h>
+
+/// Fallback allocator which keeps track of the requests forwarded by the slab
+typedef struct SlabFallback
+{
+    MemAllocator backing;
+    Size blocks; // Number of live blocks
+    Size calls;  // Number of requests received
+} SlabFallback;
+
+static MEM_ALLOCATOR_FN(slabFallbackFn)
+{
+    SlabFallback *fallback = state;
+
+    fallback->calls++;
+    if (!memory) fallback->blocks++;
+    if (!new_size) fallback->blocks--;
+
+    return fallback->backing.func(fallback->backing.state, memory, old_size, new_size, align);
+}
+
+static Size
+slabUsed(MemSlab *slab, Size class_index)
+{
+    return memSlabClassStats(slab, class_index).used;
+}
+
+static void
+testSlabClasses(MemSlab *slab, SlabFallback *fallback)
+{
+    // Requests map to the smallest class that fits both size and alignment
+    Size const sizes[] = {1, 16, 17, 32, 33, 1024, 1025, 2048, 8, 8};
+    Size const aligns[] = {1, 16, 1, 32, 1, 8, 1, 16, 64, 2048};
+    Size const classes[] = {0, 0, 1, 1, 2, 6, 7, 7, 2, 7};
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(sizes); ++i)
+    {
+        Size used = slabUsed(slab, classes[i]);
+
+        U8 *block = memSlabAlloc(slab, sizes[i], aligns[i]);
+        CF_ASSERT_NOT_NULL(block);
+        CF_ASSERT(((Size)block & (aligns[i] - 1)) == 0, "Block not aligned");
+        CF_ASSERT(slabUsed(slab, classes[i]) == used + 1, "Wrong size class");
+
+        memSlabFree(slab, block, sizes[i], aligns[i]);
+        CF_ASSERT(slabUsed(slab, classes[i]) == used, "Wrong size class");
+    }
+
+    CF_ASSERT(fallback->calls == 0, "Small request forwarded to the fallback");
+
+    // Requests larger than the largest class, by size or alignment, go to the fallback
+    U8 *large = memSlabAlloc(slab, MemSlab_MaxSize + 1, 1);
+    U8 *aligned = memSlabAlloc(slab, 16, 2 * MemSlab_MaxSize);
+    CF_ASSERT(large && aligned, "Fallback allocation failed");
+    CF_ASSERT(((Size)aligned & (2 * MemSlab_MaxSize - 1)) == 0, "Block not aligned");
+    CF_ASSERT(fallback->blocks == 2, "Large request not forwarded to the fallback");
+
+    for (Size index = 0; index < MemSlab_ClassCount; ++index)
+    {
+        CF_ASSERT(slabUsed(slab, index) == 0, "Large request served by a size class");
+    }
+
+    memSlabFree(slab, large, MemSlab_MaxSize + 1, 1);
+    memSlabFree(slab, aligned, 16, 2 * MemSlab_MaxSize);
+    CF_ASSERT(fallback->blocks == 0, "Large block not returned to the fallback");
+}
+
+static void
+testSlabRealloc(MemSlab *slab, SlabFallback *fallback)
+{
+    MemAllocator alloc = memSlabAllocator(slab);
+
+    U8 *block = memAlloc(alloc, 24);
+    for (U8 i = 0; i < 24; ++i) block[i] = i;
+
+    // Growing within the class keeps the block in place, clearing the new bytes
+    U8 *same = memRealloc(alloc, block, 24, 32);
+    CF_ASSERT(same == block, "Block moved within its size class");
+    for (Size i = 24; i < 32; ++i) CF_ASSERT(!same[i], "Memory not cleared");
+
+    // Growing across classes moves the block, preserving its content
+    U8 *grown = memRealloc(alloc, same, 32, 100);
+    CF_ASSERT(grown != same, "Block not moved to a larger class");
+    CF_ASSERT(slabUsed(slab, 1) == 0 && slabUsed(slab, 3) == 1, "Wrong size class");
+    for (U8 i = 0; i < 24; ++i) CF_ASSERT(grown[i] == i, "Content lost on reallocation");
+    for (Size i = 24; i < 100; ++i) CF_ASSERT(!grown[i], "Memory not cleared");
+
+    // Growing past the largest class moves the block to the fallback, and back
+    U8 *large = memRealloc(alloc, grown, 100, 4 * MemSlab_MaxSize);
+    CF_ASSERT(fallback->blocks == 1 && slabUsed(slab, 3) == 0, "Block not moved to fallback");
+    for (U8 i = 0; i < 24; ++i) CF_ASSERT(large[i] == i, "Content lost on reallocation");
+
+    U8 *larger = memRealloc(alloc, large, 4 * MemSlab_MaxSize, 8 * MemSlab_MaxSize);
+    CF_ASSERT(fallback->blocks == 1, "Large reallocation not forwarded to the fallback");
+    for (U8 i = 0; i < 24; ++i) CF_ASSERT(larger[i] == i, "Content lost on reallocation");
+
+    U8 *shrunk = memRealloc(alloc, larger, 8 * MemSlab_MaxSize, 20);
+    CF_ASSERT(fallback->blocks == 0 && slabUsed(slab, 1) == 1, "Block not moved from fallback");
+    for (U8 i = 0; i < 20; ++i) CF_ASSERT(shrunk[i] == i, "Content lost on reallocation");
+
+    memFree(alloc, shrunk, 20);
+    CF_ASSERT(slabUsed(slab, 1) == 0, "Block not freed");
+}
+
+static void
+testSlabReuse(MemSlab *slab)
+{
+    // Size class of 256 bytes, not used by the other tests
+    Size const class_index = 4;
+    Size const block_size = 256;
+    Size const page_blocks = MemSlab_PageSize / block_size;
+
+    U8 *first = memSlabAlloc(slab, block_size, 1);
+    U8 *second = memSlabAlloc(slab, block_size, 1);
+
+    MemSlabStats stats = memSlabClassStats(slab, class_index);
+    CF_ASSERT(stats.block_size == block_size, "Wrong block size");
+    CF_ASSERT(stats.pages == 1 && stats.capacity == page_blocks, "Wrong page count");
+    CF_ASSERT(stats.used == 2, "Wrong used block count");
+    CF_ASSERT(stats.occupancy == 2.0 / (double)page_blocks, "Wrong occupancy");
+
+    // Freed blocks are reused in LIFO order, cleared, without carving new blocks
+    memWrite(first, 0xAB, block_size);
+    memWrite(second, 0xCD, block_size);
+    memSlabFree(slab, first, block_size, 1);
+    memSlabFree(slab, second, block_size, 1);
+    CF_ASSERT(slabUsed(slab, class_index) == 0, "Wrong used block count");
+
+    CF_ASSERT(memSlabAlloc(slab, block_size, 1) == second, "Free block not reused");
+    CF_ASSERT(memSlabAlloc(slab, block_size, 1) == first, "Free block not reused");
+    for (Size i = 0; i < block_size; ++i) CF_ASSERT(!first[i] && !second[i], "Block not cleared");
+
+    stats = memSlabClassStats(slab, class_index);
+    CF_ASSERT(stats.pages == 1 && stats.capacity == page_blocks, "Reuse carved new blocks");
+
+    // Filling the page carves a new one on the next allocation
+    U8 *blocks[MemSlab_PageSize / 256];
+    blocks[0] = first;
+    blocks[1] = second;
+    for (Size i = 2; i < page_blocks; ++i) blocks[i] = memSlabAlloc(slab, block_size, 1);
+
+    stats = memSlabClassStats(slab, class_index);
+    CF_ASSERT(stats.pages == 1 && stats.used == page_blocks, "Wrong page count");
+    CF_ASSERT(stats.occupancy == 1.0, "Wrong occupancy");
+
+    U8 *extra = memSlabAlloc(slab, block_size, 1);
+    stats = memSlabClassStats(slab, class_index);
+    CF_ASSERT(stats.pages == 2 && stats.capacity == 2 * page_blocks, "New page not carved");
+    CF_ASSERT(stats.used == page_blocks + 1, "Wrong used block count");
+
+    memSlabFree(slab, extra, block_size, 1);
+    for (Size i = 0; i < page_blocks; ++i) memSlabFree(slab, blocks[i], block_size, 1);
+
+    // Pages are retained once carved
+    stats = memSlabClassStats(slab, class_index);
+    CF_ASSERT(stats.pages == 2 && stats.used == 0 && stats.occupancy == 0.0, "Wrong stats");
+}
+
+I32
+consoleMain(Platform *platform, CommandLine *cmd_line)
+{
+    CF_UNUSED(cmd_line);
+
+    Size const storage_size = CF_MB(64);
+    void *storage = vmemReserve(platform->vmem, storage_size);
+
+    MemArena arena;
+    memArenaInitOnVmem(&arena, platform->vmem, storage, storage_size);
+
+    SlabFallback fallback = {.backing = platform->heap};
+    MemSlab slab;
+    memSlabInit(&slab, &arena, (MemAllocator){.state = &fallback, .func = slabFallbackFn});
+
+    testSlabClasses(&slab, &fallback);
+    testSlabRealloc(&slab, &fallback);
+    testSlabReuse(&slab);
+
+    for (Size index = 0; index < MemSlab_ClassCount; ++index)
+    {
+        MemSlabStats stats = memSlabClassStats(&slab, index);
+        CF_ASSERT(stats.used == 0, "Leaked blocks");
+        fprintf(stdout, "Class %4zu: %zu pages, %zu blocks\n", stats.block_size, stats.pages,
+                stats.capacity);
+    }
+
+    CF_ASSERT(fallback.blocks == 0, "Leaked fallback blocks");
+
+    memArenaClear(&arena);
+    vmemRelease(platform->vmem, storage, storage_size);
+
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include "platform.h"
+
+#include "foundation/core.h"
+#include "foundation/error.h"
+#include "foundation/hash_map.h"
+#include "foundation/memory.h"
+#include "foundation/slot_map.h"
+#include "foundation/time.h"
+
+#include <stdio.h>
+
+typedef struct SlotItem
+{
+    U64 key;
+    U64 payload[3];
+} SlotItem;
+
+static U32
+slotRand(U32 *state)
+{
+    U32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+//=== Correctness ===//
+
+#define REF_COUNT 2048
+
+static void
+slotCheck(CfSlotMap *map, CfHandle const *handles, bool const *present)
+{
+    Size count = 0;
+
+    for (Size i = 0; i < REF_COUNT; ++i)
+    {
+        if (!handles[i]) continue;
+
+        SlotItem *item = cfSlotMapGetT(map, handles[i], SlotItem);
+
+        if (present[i])
+        {
+            CF_ASSERT(item && item->key == i && item->payload[2] == i * 3, "Missing or wrong item");
+            ++count;
+        }
+        else
+        {
+            CF_ASSERT(!item, "Stale handle resolved");
+        }
+    }
+
+    CF_ASSERT(map->count == count, "Wrong slot map count");
+
+    // Dense iteration must visit every item exactly once, and agree with the handles
+    SlotItem *items = cfSlotMapItems(map, SlotItem);
+    for (Size index = 0; index < map->count; ++index)
+    {
+        Size key = (Size)items[index].key;
+        CF_ASSERT(key < REF_COUNT && present[key], "Unexpected item iterated");
+        CF_ASSERT(cfSlotMapHandleAt(map, index) == handles[key], "Wrong handle for item");
+    }
+}
+
+static void
+testRandom(MemAllocator alloc)
+{
+    CfSlotMap map;
+    cfSlotMapInit(&map, alloc, SlotItem);
+
+    CfHandle handles[REF_COUNT] = {0};
+    bool present[REF_COUNT] = {0};
+    U32 rng = 0x12345678;
+
+    CF_ASSERT(!cfSlotMapGet(&map, CF_INVALID_HANDLE), "Invalid handle resolved");
+
+    for (Size round = 0; round < 50000; ++round)
+    {
+        Size key = slotRand(&rng) % REF_COUNT;
+
+        if (present[key])
+        {
+            SlotItem removed;
+            CF_ASSERT(cfSlotMapRemove(&map, handles[key], &removed), "Remove failed");
+            CF_ASSERT(removed.key == key, "Wrong item removed");
+            CF_ASSERT(!cfSlotMapRemove(&map, handles[key], NULL), "Stale handle removed");
+            present[key] = false;
+        }
+        else
+        {
+            CfHandle stale = handles[key];
+            SlotItem *item = cfSlotMapInsert(&map, handles + key);
+            CF_ASSERT(item && handles[key] != CF_INVALID_HANDLE, "Insert failed");
+            CF_ASSERT(item->key == 0 && item->payload[0] == 0, "Item not cleared");
+            CF_ASSERT(!stale || stale != handles[key], "Handle reused");
+
+            item->key = key;
+            item->payload[2] = key * 3;
+            present[key] = true;
+        }
+
+        if (round % 1000 == 0) slotCheck(&map, handles, present);
+    }
+
+    slotCheck(&map, handles, present);
+
+    // Backward iteration allows removing the current item
+    for (Size index = map.count; index-- > 0;)
+    {
+        SlotItem *item = cfSlotMapItems(&map, SlotItem) + index;
+        if (item->key & 1)
+        {
+            present[item->key] = false;
+            CF_ASSERT(cfSlotMapRemove(&map, cfSlotMapHandleAt(&map, index), NULL),
+                      "Remove failed");
+        }
+    }
+
+    slotCheck(&map, handles, present);
+
+    // Clear invalidates every handle
+    cfSlotMapClear(&map);
+    for (Size i = 0; i < REF_COUNT; ++i) present[i] = false;
+    slotCheck(&map, handles, present);
+
+    cfSlotMapShutdown(&map);
+}
+
+static void
+testReserve(MemAllocator alloc)
+{
+    CfSlotMap map;
+    cfSlotMapInit(&map, alloc, U16);
+
+    CF_ASSERT(!cfSlotMapReserve(&map, 1000), "Reserve failed");
+    CF_ASSERT(map.capacity >= 1000, "Capacity not reserved");
+
+    U8 *storage = map.items;
+    CfHandle handles[1000];
+
+    for (U16 i = 0; i < 1000; ++i)
+    {
+        U16 *item = cfSlotMapInsert(&map, handles + i);
+        *item = i;
+    }
+
+    CF_ASSERT(map.items == storage, "Storage reallocated despite reservation");
+
+    for (U16 i = 0; i < 1000; ++i)
+    {
+        CF_ASSERT(*cfSlotMapGetT(&map, handles[i], U16) == i, "Wrong item");
+    }
+
+    cfSlotMapShutdown(&map);
+}
+
+//=== Benchmark ===//
+
+static I64 volatile g_bench_sink;
+
+static void
+benchLookup(MemAllocator alloc, Size count)
+{
+    Size const lookups = 1 << 22;
+
+    CfSlotMap slots;
+    cfSlotMapInit(&slots, alloc, SlotItem);
+
+    CfHashMap map;
+    cfHashMapInit(&map, alloc, U64, SlotItem, NULL, NULL);
+
+    CfHandle *handles = memAllocArray(alloc, CfHandle, count);
+    U32 *order = memAllocArray(alloc, U32, lookups);
+    U32 rng = 0xCAFEBABE;
+
+    for (Size i = 0; i < count; ++i)
+    {
+        SlotItem *item = cfSlotMapInsert(&slots, handles + i);
+        item->key = i;
+
+        SlotItem value = {.key = i};
+        cfHashMapPut(&map, &i, &value);
+    }
+
+    for (Size i = 0; i < lookups; ++i) order[i] = slotRand(&rng) % (U32)count;
+
+    Clock clock;
+    I64 sum = 0;
+
+    clockStart(&clock);
+    for (Size i = 0; i < lookups; ++i)
+    {
+        sum += (I64)cfSlotMapGetT(&slots, handles[order[i]], SlotItem)->key;
+    }
+    double slot_ns = 1e9 * timeGetSeconds(clockElapsed(&clock)) / (double)lookups;
+
+    clockStart(&clock);
+    for (Size i = 0; i < lookups; ++i)
+    {
+        U64 key = order[i];
+        sum -= (I64)cfHashMapFindT(&map, &key, SlotItem)->key;
+    }
+    double hash_ns = 1e9 * timeGetSeconds(clockElapsed(&clock)) / (double)lookups;
+
+    CF_ASSERT(sum == 0, "Lookup mismatch");
+
+    clockStart(&clock);
+    for (Size rep = 0; rep < lookups / count; ++rep)
+    {
+        SlotItem *items = cfSlotMapItems(&slots, SlotItem);
+        for (Size i = 0; i < slots.count; ++i) sum += (I64)items[i].key;
+    }
+    double iter_ns = 1e9 * timeGetSeconds(clockElapsed(&clock)) /
+                     (double)((lookups / count) * count);
+
+    g_bench_sink = sum;
+
+    fprintf(stdout, "%8zu | %9.2f | %9.2f | %9.2f\n", count, slot_ns, hash_ns, iter_ns);
+
+    memFreeArray(alloc, order, lookups);
+    memFreeArray(alloc, handles, count);
+    cfHashMapShutdown(&map);
+    cfSlotMapShutdown(&slots);
+}
+
+I32
+consoleMain(Platform *platform, CommandLine *cmd_line)
+{
+    CF_UNUSED(cmd_line);
+
+    Size const storage_size = CF_MB(16);
+    void *storage = vmemReserve(platform->vmem, storage_size);
+
+    MemArena arena;
+    memArenaInitOnVmem(&arena, platform->vmem, storage, storage_size);
+
+    testRandom(platform->heap);
+    testRandom(memArenaAllocator(&arena));
+    testReserve(platform->heap);
+
+    fprintf(stdout, "-------------------------------------------\n");
+    fprintf(stdout, "Lookup (ns)\n");
+    fprintf(stdout, "-------------------------------------------\n");
+    fprintf(stdout, "   Count |  Slot map |  Hash map |   Iterate\n");
+
+    for (Size count = 16; count <= (1 << 20); count <<= 2)
+    {
+        benchLookup(platform->heap, count);
+    }
+
+    memArenaClear(&arena);
+    vmemRelease(platform->vmem, storage, storage_size);
+
+    return 0;
+}
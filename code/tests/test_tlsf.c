@@ -0,0 +1,175 @@
+
+#include "platform.h"
+
+#include "foundation/core.h"
+#include "foundation/error.h"
+#include "foundation/memory.h"
+
+#include <stdio.h>
+
+typedef struct TlsfSlot
+{
+    U8 *ptr;
+    Size size;
+    U8 tag;
+} TlsfSlot;
+
+static U32
+tlsfRand(U32 *state)
+{
+    U32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void
+tlsfFill(TlsfSlot *slot)
+{
+    memWrite(slot->ptr, slot->tag, slot->size);
+}
+
+static void
+tlsfVerify(TlsfSlot const *slot)
+{
+    for (Size i = 0; i < slot->size; ++i)
+    {
+        CF_ASSERT(slot->ptr[i] == slot->tag, "Allocation corrupted");
+    }
+}
+
+static void
+testTlsfFixed(void)
+{
+    static U8 block[64 * 1024];
+
+    MemTlsf tlsf;
+    memTlsfInit(&tlsf, block, sizeof(block));
+    CF_ASSERT(memTlsfCheck(&tlsf), "Invalid TLSF state");
+
+    // Exhaust the pool, then release everything and check that it is coalesced back
+    U8 *ptrs[1024] = {0};
+    Size count = 0;
+
+    while (count < CF_ARRAY_SIZE(ptrs) && (ptrs[count] = memTlsfAlloc(&tlsf, 100, 8))) ++count;
+
+    CF_ASSERT(count > 1 && count < CF_ARRAY_SIZE(ptrs), "Pool not exhausted");
+    CF_ASSERT(memTlsfCheck(&tlsf), "Invalid TLSF state");
+
+    for (Size i = 0; i < count; i += 2) memTlsfFree(&tlsf, ptrs[i]);
+    CF_ASSERT(memTlsfCheck(&tlsf), "Invalid TLSF state");
+    for (Size i = 1; i < count; i += 2) memTlsfFree(&tlsf, ptrs[i]);
+    CF_ASSERT(memTlsfCheck(&tlsf), "Invalid TLSF state");
+    CF_ASSERT(tlsf.used_size == 0, "Leaked memory");
+
+    void *big = memTlsfAlloc(&tlsf, sizeof(block) / 2, 8);
+    CF_ASSERT_NOT_NULL(big);
+    memTlsfFree(&tlsf, big);
+
+    // Over-aligned allocations
+    for (Size align = 32; align <= 4096; align <<= 1)
+    {
+        void *ptr = memTlsfAlloc(&tlsf, 48, align);
+        CF_ASSERT_NOT_NULL(ptr);
+        CF_ASSERT(((Size)ptr & (align - 1)) == 0, "Allocation not aligned");
+        CF_ASSERT(memTlsfCheck(&tlsf), "Invalid TLSF state");
+        memTlsfFree(&tlsf, ptr);
+    }
+
+    CF_ASSERT(tlsf.used_size == 0, "Leaked memory");
+}
+
+static void
+testTlsfRandom(VMemApi *vmem)
+{
+    Size const storage_size = CF_GB(1);
+    void *storage = vmemReserve(vmem, storage_size);
+
+    MemArena arena;
+    memArenaInitOnVmem(&arena, vmem, storage, storage_size);
+
+    MemTlsf tlsf;
+    memTlsfInitOnArena(&tlsf, &arena, CF_KB(256));
+
+    MemAllocator alloc = memTlsfAllocator(&tlsf);
+
+    TlsfSlot slots[512] = {0};
+    U32 rng = 0x12345678;
+
+    for (Size iter = 0; iter < 100000; ++iter)
+    {
+        TlsfSlot *slot = slots + tlsfRand(&rng) % CF_ARRAY_SIZE(slots);
+        U32 op = tlsfRand(&rng) % 4;
+        Size size = 1 + tlsfRand(&rng) % ((tlsfRand(&rng) & 15) ? 256 : 16384);
+
+        if (slot->ptr) tlsfVerify(slot);
+
+        if (!slot->ptr)
+        {
+            Size align = (Size)1 << (tlsfRand(&rng) % 8);
+            slot->ptr = memAllocAlign(alloc, size, align);
+            CF_ASSERT_NOT_NULL(slot->ptr);
+            CF_ASSERT(((Size)slot->ptr & (align - 1)) == 0, "Allocation not aligned");
+
+            for (Size i = 0; i < size; ++i) CF_ASSERT(!slot->ptr[i], "Memory not cleared");
+
+            slot->size = size;
+            slot->tag = (U8)tlsfRand(&rng);
+            tlsfFill(slot);
+        }
+        else if (op == 0)
+        {
+            memFree(alloc, slot->ptr, slot->size);
+            slot->ptr = NULL;
+        }
+        else
+        {
+            slot->ptr = memRealloc(alloc, slot->ptr, slot->size, size);
+            CF_ASSERT_NOT_NULL(slot->ptr);
+
+            for (Size i = slot->size; i < size; ++i)
+            {
+                CF_ASSERT(!slot->ptr[i], "Memory not cleared");
+            }
+
+            slot->size = cfMin(slot->size, size);
+            tlsfVerify(slot);
+            slot->size = size;
+            tlsfFill(slot);
+        }
+
+        CF_ASSERT(memTlsfBlockSize(slot->ptr) >= (slot->ptr ? slot->size : 0),
+                  "Block too small");
+
+        if (iter % 1024 == 0) CF_ASSERT(memTlsfCheck(&tlsf), "Invalid TLSF state");
+    }
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(slots); ++i)
+    {
+        if (slots[i].ptr)
+        {
+            tlsfVerify(slots + i);
+            memFree(alloc, slots[i].ptr, slots[i].size);
+        }
+    }
+
+    CF_ASSERT(memTlsfCheck(&tlsf), "Invalid TLSF state");
+    CF_ASSERT(tlsf.used_size == 0, "Leaked memory");
+
+    fprintf(stdout, "TLSF pool size: %llu KB\n", (unsigned long long)(tlsf.pool_size >> 10));
+
+    memArenaClear(&arena);
+    vmemRelease(vmem, storage, storage_size);
+}
+
+I32
+consoleMain(Platform *platform, CommandLine *cmd_line)
+{
+    CF_UNUSED(cmd_line);
+
+    testTlsfFixed();
+    testTlsfRandom(platform->vmem);
+
+    return 0;
+}
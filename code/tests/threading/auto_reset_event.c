@@ -15,6 +15,18 @@ cfArEventInit(CfAutoResetEvent *event)
 
 CF_API void
 cfArEventWait(CfAutoResetEvent *event)
+{
+    I32 prev_status = atomFetchDec(&event->status);
+    atomAcquireFence();
+    CF_ASSERT(prev_status <= 1, "");
+    if (prev_status < 1)
+    {
+        cfSemaWait(&event->sema);
+    }
+}
+
+CF_API void
+cfArEventSignal(CfAutoResetEvent *event)
 {
     I32 prev_status = atomRead(&event->status);
 
@@ -41,15 +53,3 @@ cfArEventWait(CfAutoResetEvent *event)
         cfSemaSignalOne(&event->sema);
     }
 }
-
-CF_API void
-cfArEventSignal(CfAutoResetEvent *event)
-{
-    I32 prev_status = atomFetchDec(&event->status);
-    atomAcquireFence();
-    CF_ASSERT(prev_status <= 1, "");
-    if (prev_status < 1)
-    {
-        cfSemaWait(&event->sema);
-    }
-}
@@ -4,9 +4,16 @@
 
 #include <stdio.h>
 
+#if !CF_OS_WIN32
+#    define sscanf_s sscanf
+#endif
+
 bool testBenaphore(Platform *platform);
 bool testAutoResetEvent(Platform *platform);
 bool testMpmcQueue(Platform *platform);
+bool testSharedArena(Platform *platform);
+bool testPool(Platform *platform);
+bool testTask(Platform *platform);
 bool testBasic(Platform *platform);
 
 I32
@@ -32,6 +39,9 @@ consoleMain(Platform *platform, CommandLine *cmd_line)
             case 0: result = testBenaphore(platform); break;
             case 1: result = testAutoResetEvent(platform); break;
             case 2: result = testMpmcQueue(platform); break;
+            case 3: result = testSharedArena(platform); break;
+            case 4: result = testPool(platform); break;
+            case 5: result = testTask(platform); break;
             default: break;
         }
     }
@@ -81,6 +81,11 @@ testAutoResetEvent(Platform *platform)
     atomInit(&test.counter, 0);
     atomInit(&test.success, true);
 
+    for (I32 i = 0; i < THREAD_COUNT; ++i)
+    {
+        cfArEventInit(test.events + i);
+    }
+
     for (I32 i = 0; i < THREAD_COUNT; ++i)
     {
         thread_data[i].id = i;
@@ -21,53 +21,77 @@ typedef struct QueueCell
     Size data;
 } QueueCell;
 
+// NOTE (Matteo): The read and write positions are allocated separately from the queue, either in
+// the same cache line or in two different cache lines, in order to measure the cost of false
+// sharing between producers and consumers
 typedef struct MpmcQueue
 {
-    CF_CACHELINE_PAD;
-
     QueueCell *buffer;
     Size buffer_mask;
 
-    CF_CACHELINE_PAD;
-
-    AtomSize enqueue_pos;
-
-    CF_CACHELINE_PAD;
-
-    AtomSize dequeue_pos;
-
-    CF_CACHELINE_PAD;
+    AtomSize *enqueue_pos;
+    AtomSize *dequeue_pos;
+    bool isolated;
 } MpmcQueue;
 
 static void
-mpmcInit(MpmcQueue *queue, Size buffer_size, MemAllocator alloc)
+mpmcInit(MpmcQueue *queue, Size buffer_size, MemAllocator alloc, bool isolated)
 {
-    queue->buffer = memAllocArray(alloc, QueueCell, buffer_size);
-    queue->buffer_mask = buffer_size - 1;
-
     CF_ASSERT(buffer_size >= 2, "Buffer size is too small");
     CF_ASSERT((buffer_size & (buffer_size - 1)) == 0, "Buffer size is not a power of 2");
 
+    queue->buffer_mask = buffer_size - 1;
+    queue->isolated = isolated;
+
+    if (isolated)
+    {
+        queue->buffer = memAllocCacheAligned(alloc, buffer_size * sizeof(*queue->buffer));
+        queue->enqueue_pos = memAllocCacheAligned(alloc, sizeof(AtomSize));
+        queue->dequeue_pos = memAllocCacheAligned(alloc, sizeof(AtomSize));
+
+        CF_ASSERT(((Size)queue->enqueue_pos & (CF_CACHELINE_SIZE - 1)) == 0 &&
+                      ((Size)queue->dequeue_pos & (CF_CACHELINE_SIZE - 1)) == 0,
+                  "Positions are not aligned to the cache line");
+    }
+    else
+    {
+        queue->buffer = memAllocArray(alloc, QueueCell, buffer_size);
+        queue->enqueue_pos = memAllocArray(alloc, AtomSize, 2);
+        queue->dequeue_pos = queue->enqueue_pos + 1;
+    }
+
     for (Size i = 0; i != buffer_size; i += 1)
     {
         atomWrite(&queue->buffer[i].sequence, i);
     }
 
-    atomWrite(&queue->enqueue_pos, 0);
-    atomWrite(&queue->dequeue_pos, 0);
+    atomWrite(queue->enqueue_pos, 0);
+    atomWrite(queue->dequeue_pos, 0);
 }
 
 static void
 mpmcShutdown(MpmcQueue *queue, MemAllocator alloc)
 {
-    memFreeArray(alloc, queue->buffer, queue->buffer_mask + 1);
+    Size buffer_size = queue->buffer_mask + 1;
+
+    if (queue->isolated)
+    {
+        memFreeCacheAligned(alloc, queue->buffer, buffer_size * sizeof(*queue->buffer));
+        memFreeCacheAligned(alloc, queue->enqueue_pos, sizeof(AtomSize));
+        memFreeCacheAligned(alloc, queue->dequeue_pos, sizeof(AtomSize));
+    }
+    else
+    {
+        memFreeArray(alloc, queue->buffer, buffer_size);
+        memFreeArray(alloc, queue->enqueue_pos, 2);
+    }
 }
 
 static bool
 mpmcEnqueue(MpmcQueue *queue, Size data)
 {
     QueueCell *cell = NULL;
-    Size pos = atomRead(&queue->enqueue_pos);
+    Size pos = atomRead(queue->enqueue_pos);
 
     for (;;)
     {
@@ -82,9 +106,9 @@ mpmcEnqueue(MpmcQueue *queue, Size data)
 
         if (dif > 0)
         {
-            pos = atomRead(&queue->enqueue_pos);
+            pos = atomRead(queue->enqueue_pos);
         }
-        else if (atomCompareExchangeWeak(&queue->enqueue_pos, &pos, pos + 1))
+        else if (atomCompareExchangeWeak(queue->enqueue_pos, &pos, pos + 1))
         {
             break;
         }
@@ -103,7 +127,7 @@ static bool
 mpmcDequeue(MpmcQueue *queue, Size *data)
 {
     QueueCell *cell = NULL;
-    Size pos = atomRead(&queue->dequeue_pos);
+    Size pos = atomRead(queue->dequeue_pos);
 
     for (;;)
     {
@@ -118,9 +142,9 @@ mpmcDequeue(MpmcQueue *queue, Size *data)
 
         if (dif > 0)
         {
-            pos = atomRead(&queue->dequeue_pos);
+            pos = atomRead(queue->dequeue_pos);
         }
-        else if (atomCompareExchangeWeak(&queue->dequeue_pos, &pos, pos + 1))
+        else if (atomCompareExchangeWeak(queue->dequeue_pos, &pos, pos + 1))
         {
             break;
         }
@@ -167,13 +191,12 @@ static CF_THREAD_FN(thread_func)
     }
 }
 
-bool
-testMpmcQueue(Platform *platform)
+static U64
+mpmcRun(MemAllocator alloc, bool isolated)
 {
-    MemAllocator alloc = platform->heap;
     MpmcQueue queue = {0};
 
-    mpmcInit(&queue, 1024, alloc);
+    mpmcInit(&queue, 1024, alloc, isolated);
 
     atomInit(&g_start, false);
 
@@ -193,9 +216,21 @@ testMpmcQueue(Platform *platform)
     U64 end = __rdtsc();
     U64 time = end - start;
 
-    printf("cycles/op=%llu\n", time / (BATCH_SIZE * ITER_COUNT * 2 * THREAD_COUNT));
+    for (Size i = 0; i != THREAD_COUNT; ++i) cfThreadDestroy(threads[i]);
 
     mpmcShutdown(&queue, alloc);
 
+    return time / (BATCH_SIZE * ITER_COUNT * 2 * THREAD_COUNT);
+}
+
+bool
+testMpmcQueue(Platform *platform)
+{
+    U64 shared = mpmcRun(platform->heap, false);
+    U64 isolated = mpmcRun(platform->heap, true);
+
+    printf("cycles/op: shared cache line=%llu, isolated cache lines=%llu\n",
+           (unsigned long long)shared, (unsigned long long)isolated);
+
     return true;
 }
@@ -0,0 +1,261 @@
+#include "foundation/core.h"
+
+#include "foundation/atom.h"
+#include "foundation/atom.inl"
+#include "foundation/memory.h"
+#include "foundation/threading.h"
+#include "foundation/time.h"
+
+#include "platform.h"
+
+// TODO (Matteo): Replace with platform API
+#include <stdio.h>
+
+#define POOL_MAX_THREADS 64
+#define POOL_ITER_COUNT 50000
+#define POOL_LIVE_COUNT 32
+#define POOL_SHARED_COUNT 256
+#define POOL_CAPACITY (POOL_MAX_THREADS * POOL_LIVE_COUNT + POOL_SHARED_COUNT * 4)
+
+typedef struct PoolObject
+{
+    U64 tag;
+    U8 payload[56];
+} PoolObject;
+
+typedef enum PoolMode
+{
+    PoolMode_Heap,
+    PoolMode_Pool,
+    PoolMode_Magazine,
+} PoolMode;
+
+typedef struct PoolThreadData
+{
+    MemAllocator heap;
+    MemPool *pool;
+    AtomSize *shared;
+    PoolMode mode;
+    U64 tag;
+    bool check;
+} PoolThreadData;
+
+static AtomBool g_pool_start;
+
+static PoolObject *
+poolObjectAlloc(PoolThreadData *data, MemAllocator alloc)
+{
+    PoolObject *object = memAllocStruct(alloc, PoolObject);
+    CF_ASSERT_NOT_NULL(object);
+
+    if (data->check)
+    {
+        U8 const *bytes = (U8 const *)object;
+        for (Size i = 0; i < sizeof(*object); ++i) CF_ASSERT(!bytes[i], "Block not cleared");
+    }
+
+    object->tag = data->tag;
+    return object;
+}
+
+static void
+poolObjectFree(PoolThreadData *data, MemAllocator alloc, PoolObject *object, U64 expected_tag)
+{
+    // NOTE (Matteo): A block shared by two threads would have its tag overwritten
+    if (data->check) CF_ASSERT(object->tag == expected_tag, "Block overlap");
+    memFreeStruct(alloc, object);
+}
+
+static CF_THREAD_FN(poolThreadProc)
+{
+    PoolThreadData *data = args;
+    PoolObject *live[POOL_LIVE_COUNT] = {0};
+    U32 rng = (U32)data->tag * 0x9E3779B9u | 1;
+
+    MemPoolMagazine magazine;
+    MemAllocator alloc = data->heap;
+
+    switch (data->mode)
+    {
+        case PoolMode_Heap: break;
+        case PoolMode_Pool: alloc = memPoolAllocator(data->pool); break;
+        case PoolMode_Magazine:
+            memPoolMagazineInit(&magazine, data->pool);
+            alloc = memPoolMagazineAllocator(&magazine);
+            break;
+    }
+
+    while (!atomRead(&g_pool_start)) cfYield();
+
+    for (Size iter = 0; iter != POOL_ITER_COUNT; ++iter)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+
+        PoolObject **slot = live + (rng % POOL_LIVE_COUNT);
+
+        if (*slot) poolObjectFree(data, alloc, *slot, data->tag);
+        *slot = poolObjectAlloc(data, alloc);
+
+        if (data->check)
+        {
+            // NOTE (Matteo): Trade an object with another thread, so that blocks are freed by a
+            // thread different from the allocating one
+            AtomSize *shared = data->shared + (rng >> 8) % POOL_SHARED_COUNT;
+            (*slot)->tag = (Size)shared;
+            atomReleaseFence();
+            PoolObject *other = (PoolObject *)atomExchange(shared, (Size)*slot);
+            atomAcquireFence();
+            *slot = NULL;
+
+            if (other) poolObjectFree(data, alloc, other, (Size)shared);
+        }
+    }
+
+    for (Size i = 0; i != POOL_LIVE_COUNT; ++i)
+    {
+        if (live[i]) poolObjectFree(data, alloc, live[i], data->tag);
+    }
+
+    if (data->mode == PoolMode_Magazine) memPoolMagazineFlush(&magazine);
+}
+
+static double
+poolRun(PoolThreadData *data, Size num_threads)
+{
+    CfThread threads[POOL_MAX_THREADS];
+
+    atomWrite(&g_pool_start, false);
+
+    for (Size i = 0; i != num_threads; ++i)
+    {
+        threads[i] = cfThreadStart(poolThreadProc, .args = data + i);
+    }
+
+    cfSleep(timeDurationMs(1));
+
+    Clock clock;
+    clockStart(&clock);
+    atomWrite(&g_pool_start, true);
+
+    cfThreadWaitAll(threads, num_threads, DURATION_INFINITE);
+
+    double elapsed = timeGetSeconds(clockElapsed(&clock));
+
+    for (Size i = 0; i != num_threads; ++i) cfThreadDestroy(threads[i]);
+
+    return elapsed;
+}
+
+static double
+poolRunMode(PoolThreadData *data, Size num_threads, PoolMode mode)
+{
+    for (Size i = 0; i != num_threads; ++i) data[i].mode = mode;
+    return poolRun(data, num_threads);
+}
+
+/// Count the blocks available in the pool by draining it, then return them
+static Size
+poolDrain(MemPool *pool)
+{
+    Size count = 0;
+    void *list = NULL;
+    void *block;
+
+    while ((block = memPoolAlloc(pool)) != NULL)
+    {
+        *(void **)block = list;
+        list = block;
+        ++count;
+    }
+
+    while (list)
+    {
+        block = list;
+        list = *(void **)block;
+        memPoolFree(pool, block);
+    }
+
+    return count;
+}
+
+bool
+testPool(Platform *platform)
+{
+    MemPool pool;
+    CF_ASSERT(memPoolInit(&pool, platform->heap, sizeof(PoolObject), alignof(PoolObject),
+                          POOL_CAPACITY, platform->heap),
+              "Pool init FAILED");
+
+    static AtomSize shared[POOL_SHARED_COUNT];
+    PoolThreadData data[POOL_MAX_THREADS] = {0};
+
+    for (Size i = 0; i != POOL_MAX_THREADS; ++i)
+    {
+        data[i].heap = platform->heap;
+        data[i].pool = &pool;
+        data[i].shared = shared;
+        data[i].tag = i + 1;
+    }
+
+    // Stress test: all the threads allocate concurrently, trading blocks with each other
+    for (Size i = 0; i != POOL_MAX_THREADS; ++i) data[i].check = true;
+
+    for (Size i = 0; i != POOL_MAX_THREADS; ++i)
+    {
+        data[i].mode = (i & 1) ? PoolMode_Magazine : PoolMode_Pool;
+    }
+
+    poolRun(data, POOL_MAX_THREADS);
+
+    for (Size i = 0; i != POOL_SHARED_COUNT; ++i)
+    {
+        void *object = (void *)atomRead(shared + i);
+        if (object) memFreeStruct(memPoolAllocator(&pool), (PoolObject *)object);
+        atomWrite(shared + i, 0);
+    }
+
+    // No block must be lost, whether it ended up in the free list or in the depot
+    CF_ASSERT(poolDrain(&pool) == POOL_CAPACITY, "Pool blocks lost");
+
+    for (Size i = 0; i != POOL_MAX_THREADS; ++i) data[i].check = false;
+
+    // Requests that do not fit the pool blocks go to the fallback
+    {
+        MemAllocator alloc = memPoolAllocator(&pool);
+        U8 *small = memAlloc(alloc, 16);
+        U8 *large = memAlloc(alloc, 4 * sizeof(PoolObject));
+        CF_ASSERT(memPoolOwns(&pool, small) && !memPoolOwns(&pool, large), "Wrong block source");
+
+        small = memRealloc(alloc, small, 16, sizeof(PoolObject));
+        CF_ASSERT(memPoolOwns(&pool, small), "Pool block not resized in place");
+
+        small = memRealloc(alloc, small, sizeof(PoolObject), 2 * sizeof(PoolObject));
+        CF_ASSERT(!memPoolOwns(&pool, small), "Large block not moved to the fallback");
+
+        memFree(alloc, small, 2 * sizeof(PoolObject));
+        memFree(alloc, large, 4 * sizeof(PoolObject));
+    }
+
+    // Scaling benchmark, compared with the heap
+    printf("threads     heap (ns/op)     pool (ns/op) magazine (ns/op)\n");
+
+    for (Size num_threads = 1; num_threads <= POOL_MAX_THREADS; num_threads *= 2)
+    {
+        double ops = (double)(num_threads * POOL_ITER_COUNT);
+
+        double heap_time = poolRunMode(data, num_threads, PoolMode_Heap);
+        double pool_time = poolRunMode(data, num_threads, PoolMode_Pool);
+        double magazine_time = poolRunMode(data, num_threads, PoolMode_Magazine);
+
+        printf("%7zu   %14.2f   %14.2f   %14.2f\n", num_threads, 1e9 * heap_time / ops,
+               1e9 * pool_time / ops, 1e9 * magazine_time / ops);
+    }
+
+    CF_ASSERT(poolDrain(&pool) == POOL_CAPACITY, "Pool blocks lost");
+
+    memPoolShutdown(&pool);
+
+    return true;
+}
@@ -0,0 +1,202 @@
+#include "foundation/core.h"
+
+#include "foundation/atom.h"
+#include "foundation/atom.inl"
+#include "foundation/memory.h"
+#include "foundation/threading.h"
+#include "foundation/time.h"
+
+#include "platform.h"
+
+// TODO (Matteo): Replace with platform API
+#include <stdio.h>
+
+#define ARENA_MAX_THREADS 16
+#define ARENA_ITER_COUNT 100000
+
+typedef struct ArenaThreadData
+{
+    MemSharedArena *shared;
+    MemArena *locked;
+    CfMutex *mutex;
+    U8 tag;
+    bool check;
+} ArenaThreadData;
+
+static AtomBool g_arena_start;
+
+static VMEM_COMMIT_FN(arenaFailingCommit)
+{
+    CF_UNUSED(memory);
+    CF_UNUSED(size);
+    CF_UNUSED(flags);
+    return false;
+}
+
+static Size
+arenaRequestSize(Size iter)
+{
+    // NOTE (Matteo): Mix of small and odd-sized requests
+    return 8 + (iter * 37) % 248;
+}
+
+static CF_THREAD_FN(arenaSharedProc)
+{
+    ArenaThreadData *data = args;
+
+    while (!atomRead(&g_arena_start)) cfYield();
+
+    for (Size iter = 0; iter != ARENA_ITER_COUNT; ++iter)
+    {
+        Size size = arenaRequestSize(iter);
+        Size align = (iter & 7) ? 8 : 64;
+        U8 *block = memSharedArenaAlloc(data->shared, size, align);
+
+        CF_ASSERT_NOT_NULL(block);
+        CF_ASSERT(((Size)block & (align - 1)) == 0, "Block not aligned");
+
+        if (data->check)
+        {
+            // NOTE (Matteo): Blocks must be cleared and not overlap with blocks of other threads,
+            // which would overwrite the tag
+            for (Size i = 0; i != size; ++i) CF_ASSERT(!block[i], "Block not cleared");
+            memWrite(block, data->tag, size);
+            cfYield();
+            for (Size i = 0; i != size; ++i) CF_ASSERT(block[i] == data->tag, "Block overlap");
+        }
+        else
+        {
+            block[0] = block[size - 1] = data->tag;
+        }
+    }
+}
+
+static CF_THREAD_FN(arenaLockedProc)
+{
+    ArenaThreadData *data = args;
+
+    while (!atomRead(&g_arena_start)) cfYield();
+
+    for (Size iter = 0; iter != ARENA_ITER_COUNT; ++iter)
+    {
+        Size size = arenaRequestSize(iter);
+        Size align = (iter & 7) ? 8 : 64;
+
+        cfMutexAcquire(data->mutex);
+        U8 *block = memArenaAllocAlign(data->locked, size, align);
+        cfMutexRelease(data->mutex);
+
+        CF_ASSERT_NOT_NULL(block);
+        block[0] = block[size - 1] = data->tag;
+    }
+}
+
+static double
+arenaRun(CfThreadFn proc, ArenaThreadData *data, Size num_threads)
+{
+    CfThread threads[ARENA_MAX_THREADS];
+
+    atomWrite(&g_arena_start, false);
+
+    for (Size i = 0; i != num_threads; ++i)
+    {
+        threads[i] = cfThreadStart(proc, .args = data + i);
+    }
+
+    cfSleep(timeDurationMs(1));
+
+    Clock clock;
+    clockStart(&clock);
+    atomWrite(&g_arena_start, true);
+
+    cfThreadWaitAll(threads, num_threads, DURATION_INFINITE);
+
+    return timeGetSeconds(clockElapsed(&clock));
+}
+
+bool
+testSharedArena(Platform *platform)
+{
+    VMemApi *vmem = platform->vmem;
+    Size const storage_size = CF_GB(4);
+    void *storage = vmemReserve(vmem, storage_size);
+
+    MemSharedArena shared;
+    memSharedArenaInitOnVmem(&shared, vmem, storage, storage_size / 2);
+
+    MemArena locked;
+    memArenaInitOnVmem(&locked, vmem, (U8 *)storage + storage_size / 2, storage_size / 2);
+
+    CfMutex mutex;
+    cfMutexInit(&mutex);
+
+    ArenaThreadData data[ARENA_MAX_THREADS] = {0};
+
+    for (Size i = 0; i != ARENA_MAX_THREADS; ++i)
+    {
+        data[i].shared = &shared;
+        data[i].locked = &locked;
+        data[i].mutex = &mutex;
+        data[i].tag = (U8)(i + 1);
+    }
+
+    // Stress test: all the threads allocate concurrently and validate their blocks
+    for (Size i = 0; i != ARENA_MAX_THREADS; ++i) data[i].check = true;
+
+    arenaRun(arenaSharedProc, data, ARENA_MAX_THREADS);
+
+    Size allocated = memSharedArenaAllocated(&shared);
+    CF_ASSERT(allocated <= atomRead(&shared.committed), "Allocated memory not committed");
+    memSharedArenaClear(&shared);
+    CF_ASSERT(!atomRead(&shared.committed), "Memory not decommitted");
+
+    for (Size i = 0; i != ARENA_MAX_THREADS; ++i) data[i].check = false;
+
+    // Exhaustion must be reported as a failed allocation
+    {
+        alignas(CF_MAX_ALIGN) U8 buffer[1024];
+        MemSharedArena small;
+        memSharedArenaInitOnBuffer(&small, buffer, sizeof(buffer));
+
+        // Requests larger than the whole arena do not consume any space
+        CF_ASSERT(!memSharedArenaAlloc(&small, 2048, 8), "Oversized request allocated memory");
+        CF_ASSERT(!memSharedArenaAllocated(&small), "Oversized request consumed space");
+
+        CF_ASSERT_NOT_NULL(memSharedArenaAlloc(&small, 1000, 8));
+        CF_ASSERT(!memSharedArenaAlloc(&small, 100, 8), "Exhausted arena allocated memory");
+    }
+
+    // Commit failures must be reported as failed allocations, without publishing the pages
+    {
+        VMemApi failing = *vmem;
+        failing.commit = arenaFailingCommit;
+
+        MemSharedArena uncommitted;
+        memSharedArenaInitOnVmem(&uncommitted, &failing, storage, vmem->address_granularity);
+        CF_ASSERT(!memSharedArenaAlloc(&uncommitted, 64, 8), "Uncommitted memory allocated");
+        CF_ASSERT(!atomRead(&uncommitted.committed), "Failed commit published");
+    }
+
+    // Scaling benchmark, compared with a mutex-protected arena
+    printf("threads   shared (ns/op)   locked (ns/op)\n");
+
+    for (Size num_threads = 1; num_threads <= ARENA_MAX_THREADS; num_threads *= 2)
+    {
+        double ops = (double)(num_threads * ARENA_ITER_COUNT);
+
+        double shared_time = arenaRun(arenaSharedProc, data, num_threads);
+        memSharedArenaReset(&shared);
+
+        double locked_time = arenaRun(arenaLockedProc, data, num_threads);
+        memArenaClear(&locked);
+
+        printf("%7zu   %14.2f   %14.2f\n", num_threads, 1e9 * shared_time / ops,
+               1e9 * locked_time / ops);
+    }
+
+    cfMutexShutdown(&mutex);
+    memSharedArenaClear(&shared);
+    vmemRelease(vmem, storage, storage_size);
+
+    return true;
+}
@@ -0,0 +1,1454 @@
+#include "foundation/core.h"
+
+#include "foundation/atom.h"
+#include "foundation/atom.inl"
+#include "foundation/memory.h"
+#include "foundation/task.h"
+#include "foundation/threading.h"
+#include "foundation/time.h"
+
+#include "platform.h"
+
+// TODO (Matteo): Replace with platform API
+#include <stdio.h>
+
+#define TASK_MAX_WORKERS 64
+#define TASK_BUFFER_SIZE 4096
+#define TASK_DEQUE_SIZE 1024
+
+#define FIB_N 32
+#define FIB_CUTOFF 16
+
+#define SORT_COUNT (1 << 20)
+#define SORT_CUTOFF 2048
+
+#define PIPE_COUNT 64
+#define PIPE_STAGES 4
+#define PIPE_WORK 20000
+#define PIPE_FRAME_MS 16
+
+#define FOR_PIXELS (1 << 23)
+#define FOR_POINTS (1 << 16)
+#define FOR_ITERATIONS 256
+
+#define BROWSE_FILES 64
+#define BROWSE_PREFETCH 4
+#define BROWSE_LOAD_MS 2
+#define BROWSE_FLIP_MS 1
+#define BROWSE_BURST 8
+
+#define WAKE_COUNT 2048
+#define WAKE_BURST 64
+
+#define BATCH_MAX 1024
+#define BATCH_TASKS (1 << 18)
+
+#define OVERFLOW_BUFFER_SIZE 16
+#define OVERFLOW_ORDER 1000
+#define OVERFLOW_COUNT 20000
+
+//=== Helpers ===//
+
+/// Create a task queue with the given configuration, without starting it
+static TaskQueue *
+taskTestCreateEx(MemAllocator heap, TaskQueueConfig *config, Size *footprint)
+{
+    CF_ASSERT(taskConfig(config), "Invalid task queue configuration");
+
+    *footprint = config->footprint;
+
+    return taskInit(config, memAllocCacheAligned(heap, config->footprint));
+}
+
+static TaskQueue *
+taskTestCreate(MemAllocator heap, Size num_workers, Size deque_size, Size *footprint)
+{
+    TaskQueueConfig config = {
+        .buffer_size = TASK_BUFFER_SIZE,
+        .num_workers = num_workers,
+        .deque_size = deque_size,
+    };
+
+    TaskQueue *queue = taskTestCreateEx(heap, &config, footprint);
+    taskStartProcessing(queue);
+
+    return queue;
+}
+
+static void
+taskTestDestroy(MemAllocator heap, TaskQueue *queue, Size footprint)
+{
+    taskShutdown(queue);
+    memFreeCacheAligned(heap, queue, footprint);
+}
+
+/// Enqueue a task, or run it on the current thread if the queue is full
+static void
+taskSpawn(TaskQueue *queue, TaskFn fn, void *data)
+{
+    if (!taskEnqueue(queue, fn, data))
+    {
+        bool canceled = false;
+        fn(data, &canceled);
+    }
+}
+
+/// Wait for the pending child tasks, helping the queue in the meantime
+static void
+taskJoin(TaskQueue *queue, AtomSize *pending)
+{
+    while (atomRead(pending))
+    {
+        if (!taskTryWork(queue)) cfYield();
+    }
+
+    atomAcquireFence();
+}
+
+static void
+taskDone(AtomSize *pending)
+{
+    atomReleaseFence();
+    atomFetchDec(pending);
+}
+
+//=== Fibonacci ===//
+
+typedef struct FibTask
+{
+    TaskQueue *queue;
+    AtomSize *parent_pending;
+    U32 n;
+    U64 result;
+} FibTask;
+
+static U64
+fibSerial(U32 n)
+{
+    return n < 2 ? n : fibSerial(n - 1) + fibSerial(n - 2);
+}
+
+static TASK_QUEUE_FN(fibTask)
+{
+    CF_UNUSED(canceled);
+
+    FibTask *task = data;
+
+    if (task->n < FIB_CUTOFF)
+    {
+        task->result = fibSerial(task->n);
+    }
+    else
+    {
+        AtomSize pending;
+        atomInit(&pending, 1);
+
+        FibTask child = {.queue = task->queue, .parent_pending = &pending, .n = task->n - 2};
+        FibTask inline_child = {.queue = task->queue, .n = task->n - 1};
+
+        taskSpawn(task->queue, fibTask, &child);
+        fibTask(&inline_child, canceled);
+        taskJoin(task->queue, &pending);
+
+        task->result = inline_child.result + child.result;
+    }
+
+    if (task->parent_pending) taskDone(task->parent_pending);
+}
+
+static double
+fibRun(TaskQueue *queue, U64 expected)
+{
+    FibTask root = {.queue = queue, .n = FIB_N};
+    bool canceled = false;
+
+    Clock clock;
+    clockStart(&clock);
+    fibTask(&root, &canceled);
+    double elapsed = timeGetSeconds(clockElapsed(&clock));
+
+    CF_ASSERT(root.result == expected, "Wrong Fibonacci number");
+
+    return elapsed;
+}
+
+//=== Parallel sort ===//
+
+typedef struct SortTask
+{
+    TaskQueue *queue;
+    AtomSize *parent_pending;
+    U32 *items;
+    Size count;
+} SortTask;
+
+/// Hoare partition around the median of three, returns the size of the lower partition
+static Size
+sortPartition(U32 *items, Size count)
+{
+    U32 a = items[0], b = items[count / 2], c = items[count - 1];
+    U32 pivot = cfMax(cfMin(a, b), cfMin(cfMax(a, b), c));
+
+    Size i = 0;
+    Size j = count - 1;
+
+    for (;;)
+    {
+        while (items[i] < pivot) ++i;
+        while (items[j] > pivot) --j;
+
+        if (i >= j) return j + 1;
+
+        U32 temp = items[i];
+        items[i++] = items[j];
+        items[j--] = temp;
+    }
+}
+
+static void
+sortSerial(U32 *items, Size count)
+{
+    while (count > 16)
+    {
+        Size lower = sortPartition(items, count);
+        sortSerial(items + lower, count - lower);
+        count = lower;
+    }
+
+    for (Size i = 1; i < count; ++i)
+    {
+        U32 item = items[i];
+        Size j = i;
+        for (; j > 0 && items[j - 1] > item; --j) items[j] = items[j - 1];
+        items[j] = item;
+    }
+}
+
+static TASK_QUEUE_FN(sortTask)
+{
+    SortTask *task = data;
+    U32 *items = task->items;
+    Size count = task->count;
+
+    AtomSize pending;
+    atomInit(&pending, 0);
+
+    SortTask children[64];
+    Size num_children = 0;
+
+    // NOTE (Matteo): The upper partition is spawned as a task, while the lower one is sorted on
+    // the current thread; this bounds the stack depth of the task
+    while (count > SORT_CUTOFF && num_children < CF_ARRAY_SIZE(children))
+    {
+        Size lower = sortPartition(items, count);
+
+        SortTask *child = children + num_children++;
+        child->queue = task->queue;
+        child->parent_pending = &pending;
+        child->items = items + lower;
+        child->count = count - lower;
+
+        atomFetchInc(&pending);
+        taskSpawn(task->queue, sortTask, child);
+
+        count = lower;
+    }
+
+    if (count > SORT_CUTOFF)
+    {
+        SortTask rest = {.queue = task->queue, .items = items, .count = count};
+        sortTask(&rest, canceled);
+    }
+    else
+    {
+        sortSerial(items, count);
+    }
+
+    taskJoin(task->queue, &pending);
+
+    if (task->parent_pending) taskDone(task->parent_pending);
+}
+
+static double
+sortRun(TaskQueue *queue, U32 *items, Size count)
+{
+    U32 rng = 0x2545F491;
+
+    for (Size i = 0; i < count; ++i)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        items[i] = rng;
+    }
+
+    SortTask root = {.queue = queue, .items = items, .count = count};
+    bool canceled = false;
+
+    Clock clock;
+    clockStart(&clock);
+    sortTask(&root, &canceled);
+    double elapsed = timeGetSeconds(clockElapsed(&clock));
+
+    for (Size i = 1; i < count; ++i) CF_ASSERT(items[i - 1] <= items[i], "Items not sorted");
+
+    return elapsed;
+}
+
+//=== Completion of tasks spawned by workers ===//
+
+typedef struct SpawnTask
+{
+    TaskQueue *queue;
+    AtomSize ids[16];
+    AtomSize counter;
+} SpawnTask;
+
+static TASK_QUEUE_FN(countTask)
+{
+    CF_UNUSED(canceled);
+    atomFetchInc((AtomSize *)data);
+}
+
+static TASK_QUEUE_FN(spawnTask)
+{
+    CF_UNUSED(canceled);
+
+    SpawnTask *task = data;
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(task->ids); ++i)
+    {
+        TaskId id = taskEnqueue(task->queue, countTask, &task->counter);
+        CF_ASSERT(id, "Enqueue failed");
+        atomWrite(task->ids + i, id);
+    }
+}
+
+static void
+spawnRun(TaskQueue *queue)
+{
+    SpawnTask task = {.queue = queue};
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(task.ids); ++i) atomInit(task.ids + i, 0);
+    atomInit(&task.counter, 0);
+
+    TaskId id = taskEnqueue(queue, spawnTask, &task);
+    while (!taskCompleted(queue, id)) cfYield();
+
+    // NOTE (Matteo): Children IDs are published before the parent completes
+    for (Size i = 0; i < CF_ARRAY_SIZE(task.ids); ++i)
+    {
+        TaskId child = atomRead(task.ids + i);
+        CF_ASSERT(child, "Child not spawned");
+        while (!taskCompleted(queue, child)) cfYield();
+    }
+
+    CF_ASSERT(atomRead(&task.counter) == CF_ARRAY_SIZE(task.ids), "Child tasks not completed");
+}
+
+//=== Task graphs ===//
+
+// NOTE (Matteo): Mimics the loading of images (read -> decode -> convert -> upload), where each
+// stage must observe the results of the previous one
+
+typedef struct PipeItem
+{
+    Size stage;
+    U64 value;
+} PipeItem;
+
+typedef struct PipeStage
+{
+    PipeItem *item;
+    Size index;
+} PipeStage;
+
+static TASK_QUEUE_FN(pipeStageTask)
+{
+    CF_UNUSED(canceled);
+
+    PipeStage *stage = data;
+    PipeItem *item = stage->item;
+
+    CF_ASSERT(item->stage == stage->index, "Pipeline stage executed out of order");
+
+    U64 value = item->value;
+    for (Size i = 0; i < PIPE_WORK; ++i) value = value * 6364136223846793005 + 1442695040888963407;
+
+    item->value = value;
+    item->stage++;
+}
+
+typedef struct DiamondData
+{
+    AtomSize order;
+    Size a, b, c, d;
+} DiamondData;
+
+static TASK_QUEUE_FN(diamondA)
+{
+    CF_UNUSED(canceled);
+    DiamondData *diamond = data;
+    diamond->a = atomFetchInc(&diamond->order);
+}
+
+static TASK_QUEUE_FN(diamondB)
+{
+    CF_UNUSED(canceled);
+    DiamondData *diamond = data;
+    diamond->b = atomFetchInc(&diamond->order);
+}
+
+static TASK_QUEUE_FN(diamondC)
+{
+    CF_UNUSED(canceled);
+    DiamondData *diamond = data;
+    diamond->c = atomFetchInc(&diamond->order);
+}
+
+static TASK_QUEUE_FN(diamondD)
+{
+    CF_UNUSED(canceled);
+    DiamondData *diamond = data;
+    diamond->d = atomFetchInc(&diamond->order);
+}
+
+static void
+graphDiamond(TaskQueue *queue)
+{
+    for (Size rep = 0; rep < 1000; ++rep)
+    {
+        DiamondData diamond = {0};
+        TaskGroup group;
+        TaskNode a, b, c, d;
+
+        atomInit(&diamond.order, 0);
+        taskGroupInit(&group);
+        taskNodeInit(&a, diamondA, &diamond, &group);
+        taskNodeInit(&b, diamondB, &diamond, &group);
+        taskNodeInit(&c, diamondC, &diamond, &group);
+        taskNodeInit(&d, diamondD, &diamond, &group);
+
+        taskNodeDepend(&b, &a);
+        taskNodeDepend(&c, &a);
+        taskNodeDepend(&d, &b);
+        taskNodeDepend(&d, &c);
+
+        // NOTE (Matteo): The submission order must not matter
+        if (rep & 1)
+        {
+            taskSubmit(queue, &d);
+            taskSubmit(queue, &c);
+            taskSubmit(queue, &b);
+            taskSubmit(queue, &a);
+        }
+        else
+        {
+            taskSubmit(queue, &a);
+            taskSubmit(queue, &b);
+            taskSubmit(queue, &c);
+            taskSubmit(queue, &d);
+        }
+
+        taskWait(queue, &group);
+
+        CF_ASSERT(atomRead(&diamond.order) == 4, "Diamond not completed");
+        CF_ASSERT(diamond.a == 0 && diamond.d == 3, "Diamond executed out of order");
+    }
+}
+
+static void
+pipeReset(PipeItem *items, PipeStage (*stages)[PIPE_STAGES])
+{
+    for (Size i = 0; i < PIPE_COUNT; ++i)
+    {
+        items[i].stage = 0;
+        items[i].value = i;
+
+        for (Size j = 0; j < PIPE_STAGES; ++j)
+        {
+            stages[i][j].item = items + i;
+            stages[i][j].index = j;
+        }
+    }
+}
+
+static void
+pipeCheck(PipeItem *items)
+{
+    for (Size i = 0; i < PIPE_COUNT; ++i)
+    {
+        CF_ASSERT(items[i].stage == PIPE_STAGES, "Pipeline not completed");
+    }
+}
+
+/// Run the pipelines as task graphs, returns the time to complete all of them
+static double
+pipeRunGraph(TaskQueue *queue)
+{
+    static PipeItem items[PIPE_COUNT];
+    static PipeStage stages[PIPE_COUNT][PIPE_STAGES];
+    static TaskNode nodes[PIPE_COUNT][PIPE_STAGES];
+
+    pipeReset(items, stages);
+
+    Clock clock;
+    clockStart(&clock);
+
+    TaskGroup group;
+    taskGroupInit(&group);
+
+    for (Size i = 0; i < PIPE_COUNT; ++i)
+    {
+        for (Size j = 0; j < PIPE_STAGES; ++j)
+        {
+            taskNodeInit(&nodes[i][j], pipeStageTask, &stages[i][j], &group);
+            if (j) taskNodeDepend(&nodes[i][j], &nodes[i][j - 1]);
+        }
+
+        for (Size j = PIPE_STAGES; j-- > 0;) taskSubmit(queue, &nodes[i][j]);
+    }
+
+    taskWait(queue, &group);
+
+    double elapsed = timeGetSeconds(clockElapsed(&clock));
+
+    pipeCheck(items);
+
+    return elapsed;
+}
+
+/// Run the pipelines by polling the completion of each stage once per frame, like the image
+/// viewer does, returns the time to complete all of them
+static double
+pipeRunPolling(TaskQueue *queue)
+{
+    static PipeItem items[PIPE_COUNT];
+    static PipeStage stages[PIPE_COUNT][PIPE_STAGES];
+    TaskId ids[PIPE_COUNT] = {0};
+
+    pipeReset(items, stages);
+
+    Clock clock;
+    clockStart(&clock);
+
+    for (Size done = 0; done < PIPE_COUNT;)
+    {
+        for (Size i = 0; i < PIPE_COUNT; ++i)
+        {
+            if (ids[i] && !taskCompleted(queue, ids[i])) continue;
+
+            // NOTE (Matteo): Read the stage only after the completion of the task that updates it
+            atomAcquireFence();
+            Size stage = items[i].stage;
+
+            if (stage < PIPE_STAGES)
+            {
+                ids[i] = taskEnqueue(queue, pipeStageTask, &stages[i][stage]);
+                CF_ASSERT(ids[i], "Enqueue failed");
+            }
+            else if (ids[i])
+            {
+                ids[i] = 0;
+                ++done;
+            }
+        }
+
+        cfSleep(timeDurationMs(PIPE_FRAME_MS));
+    }
+
+    double elapsed = timeGetSeconds(clockElapsed(&clock));
+
+    pipeCheck(items);
+
+    return elapsed;
+}
+
+//=== Parallel for ===//
+
+typedef struct ForData
+{
+    U32 *pixels;
+    U64 *sums; // One per slot, padded to avoid false sharing
+    AtomSize calls;
+    float scale;
+} ForData;
+
+#define FOR_SUM(data, slot) ((data)->sums[(slot)*8])
+
+/// Memory bound kernel: swizzle RGBA to BGRA, summing the alpha channel
+static TASK_FOR_FN(forSwizzle)
+{
+    ForData *data = context;
+    U64 sum = 0;
+
+    for (Size i = begin; i < end; ++i)
+    {
+        U32 p = data->pixels[i];
+        data->pixels[i] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+        sum += p >> 24;
+    }
+
+    FOR_SUM(data, slot) += sum;
+    atomFetchInc(&data->calls);
+}
+
+/// Compute bound kernel: escape time of points along an ellipse in the complex plane
+static TASK_FOR_FN(forEscape)
+{
+    ForData *data = context;
+    U64 sum = 0;
+
+    for (Size i = begin; i < end; ++i)
+    {
+        float t = (float)i * data->scale;
+        float cx = -0.5f + 1.2f * (t - 0.5f);
+        float cy = 0.8f * (2 * t - 1) * (1 - t);
+        float x = 0, y = 0;
+        Size iter = 0;
+
+        while (iter < FOR_ITERATIONS && x * x + y * y < 4)
+        {
+            float temp = x * x - y * y + cx;
+            y = 2 * x * y + cy;
+            x = temp;
+            ++iter;
+        }
+
+        sum += iter;
+    }
+
+    FOR_SUM(data, slot) += sum;
+    atomFetchInc(&data->calls);
+}
+
+static U64
+forReduce(ForData *data, Size num_slots)
+{
+    U64 total = 0;
+    for (Size slot = 0; slot < num_slots; ++slot) total += FOR_SUM(data, slot);
+    return total;
+}
+
+static void
+forReset(ForData *data, Size num_slots)
+{
+    for (Size slot = 0; slot < num_slots; ++slot) FOR_SUM(data, slot) = 0;
+    atomWrite(&data->calls, 0);
+
+    for (Size i = 0; i < FOR_PIXELS; ++i) data->pixels[i] = (U32)(i * 2654435761u);
+}
+
+/// Run the kernel serially and in parallel, returns the parallel time and fills the serial one
+static double
+forRun(TaskQueue *queue, ForData *data, TaskForFn fn, Size count, Size grain, double *serial)
+{
+    Size num_slots = taskSlotCount(queue);
+    Clock clock;
+
+    forReset(data, num_slots);
+    clockStart(&clock);
+    fn(0, count, 0, data);
+    *serial = timeGetSeconds(clockElapsed(&clock));
+    U64 expected = forReduce(data, num_slots);
+
+    forReset(data, num_slots);
+    clockStart(&clock);
+    taskParallelFor(queue, 0, count, grain, fn, data);
+    double elapsed = timeGetSeconds(clockElapsed(&clock));
+
+    CF_ASSERT(forReduce(data, num_slots) == expected, "Wrong reduction");
+
+    if (fn == forSwizzle)
+    {
+        for (Size i = 0; i < count; ++i)
+        {
+            U32 p = (U32)(i * 2654435761u);
+            U32 q = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+            CF_ASSERT(data->pixels[i] == q, "Pixel not processed exactly once");
+        }
+    }
+
+    return elapsed;
+}
+
+static void
+forCheck(TaskQueue *queue, ForData *data)
+{
+    double serial;
+
+    // Empty and small ranges run on the calling thread
+    forReset(data, taskSlotCount(queue));
+    taskParallelFor(queue, 10, 10, 0, forSwizzle, data);
+    CF_ASSERT(atomRead(&data->calls) == 0, "Empty range processed");
+
+    taskParallelFor(queue, 0, 1, 0, forSwizzle, data);
+    CF_ASSERT(atomRead(&data->calls) == 1, "Single item range not processed");
+
+    // Every grain size must process each item exactly once
+    Size const grains[] = {0, 1, 100, FOR_PIXELS};
+    for (Size i = 0; i < CF_ARRAY_SIZE(grains); ++i)
+    {
+        forRun(queue, data, forSwizzle, i ? FOR_PIXELS : 1000, grains[i], &serial);
+    }
+
+    forRun(queue, data, forEscape, FOR_POINTS, 0, &serial);
+}
+
+//=== Priorities ===//
+
+typedef struct PrioLog
+{
+    AtomSize count;
+    Size order[512];
+} PrioLog;
+
+typedef struct PrioItem
+{
+    PrioLog *log;
+    Size tag;
+    AtomSize runs;
+} PrioItem;
+
+static TASK_QUEUE_FN(prioTask)
+{
+    CF_UNUSED(canceled);
+
+    PrioItem *item = data;
+    PrioLog *log = item->log;
+
+    atomFetchInc(&item->runs);
+
+    if (log)
+    {
+        Size index = atomFetchInc(&log->count);
+        if (index < CF_ARRAY_SIZE(log->order)) log->order[index] = item->tag;
+    }
+}
+
+static void
+prioInit(PrioItem *items, Size count, PrioLog *log)
+{
+    if (log) atomInit(&log->count, 0);
+
+    for (Size i = 0; i < count; ++i)
+    {
+        items[i].log = log;
+        items[i].tag = i;
+        atomInit(&items[i].runs, 0);
+    }
+}
+
+static void
+prioWait(PrioItem *items, Size count)
+{
+    for (Size i = 0; i < count; ++i)
+    {
+        // NOTE (Matteo): Only the workers apply the starvation protection, so don't help them
+        while (!atomRead(&items[i].runs)) cfYield();
+    }
+
+    atomAcquireFence();
+}
+
+static void
+prioCheck(TaskQueue *queue)
+{
+    static PrioLog log;
+    static PrioItem items[300];
+
+    // NOTE (Matteo): Tasks are queued while the queue is stopped, to control the execution order
+    taskStopProcessing(queue, true);
+
+    // Drain order: high to low, FIFO within the same priority
+    prioInit(items, 6, &log);
+    taskEnqueuePriority(queue, prioTask, items + 0, TaskPriority_Low);
+    taskEnqueuePriority(queue, prioTask, items + 1, TaskPriority_Normal);
+    taskEnqueuePriority(queue, prioTask, items + 2, TaskPriority_High);
+    taskEnqueuePriority(queue, prioTask, items + 3, TaskPriority_Low);
+    taskEnqueuePriority(queue, prioTask, items + 4, TaskPriority_Normal);
+    taskEnqueuePriority(queue, prioTask, items + 5, TaskPriority_High);
+
+    while (taskTryWork(queue)) {}
+
+    Size const drain_order[] = {2, 5, 1, 4, 0, 3};
+    CF_ASSERT(atomRead(&log.count) == 6, "Tasks not executed");
+    for (Size i = 0; i < 6; ++i) CF_ASSERT(log.order[i] == drain_order[i], "Wrong drain order");
+
+    // Boost and demote
+    prioInit(items, 3, &log);
+    TaskId low = taskEnqueuePriority(queue, prioTask, items + 0, TaskPriority_Low);
+    TaskId boosted = taskEnqueuePriority(queue, prioTask, items + 1, TaskPriority_Low);
+    TaskId demoted = taskEnqueuePriority(queue, prioTask, items + 2, TaskPriority_High);
+
+    boosted = taskSetPriority(queue, boosted, TaskPriority_High);
+    demoted = taskSetPriority(queue, demoted, TaskPriority_Low);
+    CF_ASSERT(boosted && demoted, "Priority not changed");
+    CF_ASSERT(taskSetPriority(queue, low, TaskPriority_Low) == low, "Priority changed");
+
+    while (taskTryWork(queue)) {}
+
+    Size const boost_order[] = {1, 0, 2};
+    CF_ASSERT(atomRead(&log.count) == 3, "Moved tasks not executed exactly once");
+    for (Size i = 0; i < 3; ++i) CF_ASSERT(log.order[i] == boost_order[i], "Wrong boost order");
+    for (Size i = 0; i < 3; ++i) CF_ASSERT(atomRead(&items[i].runs) == 1, "Task run twice");
+
+    CF_ASSERT(taskCompleted(queue, boosted) && taskCompleted(queue, demoted), "Wrong status");
+    CF_ASSERT(!taskSetPriority(queue, boosted, TaskPriority_Low), "Completed task moved");
+
+    // Starvation protection: a low priority task runs even if high priority work keeps coming
+    prioInit(items, 300, &log);
+    taskEnqueuePriority(queue, prioTask, items, TaskPriority_Low);
+    for (Size i = 1; i < 300; ++i)
+    {
+        taskEnqueuePriority(queue, prioTask, items + i, TaskPriority_High);
+    }
+
+    taskStartProcessing(queue);
+    prioWait(items, 300);
+
+    Size low_index = 0;
+    while (log.order[low_index] != 0) ++low_index;
+    CF_ASSERT(low_index < 300 - 1, "Low priority task starved");
+
+    // Stress: concurrent priority changes must never lose or duplicate a task
+    prioInit(items, 300, NULL);
+    TaskId ids[300];
+    U32 rng = 0x1234567;
+
+    for (Size i = 0; i < 300; ++i)
+    {
+        ids[i] = taskEnqueuePriority(queue, prioTask, items + i, (TaskPriority)(i % 3));
+        CF_ASSERT(ids[i], "Enqueue failed");
+    }
+
+    for (Size round = 0; round < 2000; ++round)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+
+        Size index = rng % 300;
+        if (!ids[index]) continue;
+
+        ids[index] = taskSetPriority(queue, ids[index], (TaskPriority)((rng >> 16) % 3));
+    }
+
+    prioWait(items, 300);
+
+    // NOTE (Matteo): Wait for the queue to be idle before checking that no task ran twice
+    for (Size i = 0; i < 300; ++i)
+    {
+        if (ids[i]) while (!taskCompleted(queue, ids[i])) cfYield();
+    }
+
+    for (Size i = 0; i < 300; ++i)
+    {
+        CF_ASSERT(atomRead(&items[i].runs) == 1, "Task lost or run twice");
+    }
+}
+
+// NOTE (Matteo): Simulates the image viewer browsing rapidly through a folder: at each flip the
+// focused image is loaded along with some prefetched neighbours, on a single worker
+
+typedef struct BrowseFile
+{
+    Clock *clock;
+    TaskId id;
+    bool queued;
+    AtomSize done; // Completion time in ns + 1, 0 if not loaded
+} BrowseFile;
+
+static TASK_QUEUE_FN(browseLoadTask)
+{
+    CF_UNUSED(canceled);
+
+    BrowseFile *file = data;
+    Clock load;
+
+    clockStart(&load);
+    while (timeGetSeconds(clockElapsed(&load)) < BROWSE_LOAD_MS * 1e-3) {}
+
+    Duration now = clockElapsed(file->clock);
+    atomReleaseFence();
+    atomWrite(&file->done, (Size)(timeGetSeconds(now) * 1e9) + 1);
+}
+
+static void
+browseEnqueue(TaskQueue *queue, BrowseFile *file, TaskPriority priority, bool priorities)
+{
+    if (!file->queued)
+    {
+        file->queued = true;
+        file->id = taskEnqueuePriority(queue, browseLoadTask, file,
+                                       priorities ? priority : TaskPriority_Normal);
+        CF_ASSERT(file->id, "Enqueue failed");
+    }
+    else if (priorities && file->id && !atomRead(&file->done))
+    {
+        // NOTE (Matteo): The task may have started in the meantime, and keeps its ID
+        TaskId id = taskSetPriority(queue, file->id, priority);
+        if (id) file->id = id;
+    }
+}
+
+/// Returns the average time to display of the image the user stops on after a burst of flips,
+/// in ms
+static double
+browseRun(TaskQueue *queue, bool priorities, double *out_max)
+{
+    static BrowseFile files[BROWSE_FILES];
+    Clock clock;
+
+    clockStart(&clock);
+
+    for (Size i = 0; i < BROWSE_FILES; ++i)
+    {
+        files[i].clock = &clock;
+        files[i].id = 0;
+        files[i].queued = false;
+        atomInit(&files[i].done, 0);
+    }
+
+    Size const num_bursts = (BROWSE_FILES - BROWSE_PREFETCH - 1) / BROWSE_BURST;
+    double total = 0;
+    double max = 0;
+    Size curr = 0;
+
+    for (Size burst = 0; burst < num_bursts; ++burst)
+    {
+        double focus_time = 0;
+
+        for (Size flip = 0; flip < BROWSE_BURST; ++flip, ++curr)
+        {
+            focus_time = timeGetSeconds(clockElapsed(&clock));
+
+            browseEnqueue(queue, files + curr, TaskPriority_High, priorities);
+
+            // NOTE (Matteo): The previously focused image is not urgent anymore
+            if (curr) browseEnqueue(queue, files + curr - 1, TaskPriority_Low, priorities);
+
+            for (Size i = 1; i <= BROWSE_PREFETCH; ++i)
+            {
+                browseEnqueue(queue, files + curr + i, TaskPriority_Low, priorities);
+            }
+
+            if (flip + 1 < BROWSE_BURST) cfSleep(timeDurationMs(BROWSE_FLIP_MS));
+        }
+
+        // NOTE (Matteo): The user stops on the last image, and waits for it to be displayed
+        BrowseFile *focused = files + curr - 1;
+        while (!atomRead(&focused->done)) cfYield();
+
+        double latency = (double)(atomRead(&focused->done) - 1) * 1e-9 - focus_time;
+        total += latency;
+        max = cfMax(max, latency);
+    }
+
+    for (Size i = 0; i < BROWSE_FILES; ++i)
+    {
+        if (files[i].queued) while (!atomRead(&files[i].done)) cfYield();
+    }
+
+    *out_max = 1000 * max;
+    return 1000 * total / (double)num_bursts;
+}
+
+//=== Wakeup latency ===//
+
+typedef struct WakeData
+{
+    Clock *clock;
+    U32 *latencies;
+    AtomSize done;
+} WakeData;
+
+typedef struct WakeTask
+{
+    WakeData *data;
+    Size index;
+    Size enqueue_ns;
+} WakeTask;
+
+static Size
+wakeNow(Clock *clock)
+{
+    Duration now = clockElapsed(clock);
+    return (Size)now.seconds * 1000000000 + now.nanos;
+}
+
+static TASK_QUEUE_FN(wakeTask)
+{
+    CF_UNUSED(canceled);
+
+    WakeTask *task = data;
+    WakeData *wake = task->data;
+
+    wake->latencies[task->index] = (U32)(wakeNow(wake->clock) - task->enqueue_ns);
+
+    atomReleaseFence();
+    atomFetchInc(&wake->done);
+}
+
+/// Measure the enqueue-to-start latency of tasks enqueued in bursts of the given size, with
+/// pauses long enough for the workers to go idle in between
+static void
+wakeRun(TaskQueue *queue, Size burst, Cstr label)
+{
+    static WakeTask tasks[WAKE_COUNT];
+    static U32 latencies[WAKE_COUNT];
+
+    Clock clock;
+    clockStart(&clock);
+
+    WakeData wake = {.clock = &clock, .latencies = latencies};
+    atomInit(&wake.done, 0);
+
+    for (Size i = 0; i < WAKE_COUNT;)
+    {
+        for (Size j = 0; j < burst && i < WAKE_COUNT; ++j, ++i)
+        {
+            tasks[i].data = &wake;
+            tasks[i].index = i;
+            tasks[i].enqueue_ns = wakeNow(&clock);
+            CF_ASSERT(taskEnqueue(queue, wakeTask, tasks + i), "Enqueue failed");
+        }
+
+        while (atomRead(&wake.done) < i) cfYield();
+        cfSleep(timeDurationUs(200));
+    }
+
+    atomAcquireFence();
+    sortSerial(latencies, WAKE_COUNT);
+
+    printf("%-10s %10.2f %10.2f %10.2f %10.2f\n", label, 1e-3 * latencies[WAKE_COUNT / 2],
+           1e-3 * latencies[WAKE_COUNT * 9 / 10], 1e-3 * latencies[WAKE_COUNT * 99 / 100],
+           1e-3 * latencies[WAKE_COUNT - 1]);
+}
+
+//=== Batched submission ===//
+
+static TaskFn g_batch_fns[BATCH_MAX];
+static void *g_batch_datas[BATCH_MAX];
+
+static void
+batchCheck(TaskQueue *queue)
+{
+    static TaskFn fns[3 * TASK_BUFFER_SIZE / 2];
+    static void *datas[CF_ARRAY_SIZE(fns)];
+    static TaskId ids[CF_ARRAY_SIZE(fns)];
+    static AtomSize counters[CF_ARRAY_SIZE(fns)];
+
+    Size const count = CF_ARRAY_SIZE(fns);
+
+    for (Size i = 0; i < count; ++i)
+    {
+        fns[i] = countTask;
+        datas[i] = counters + i;
+        atomInit(counters + i, 0);
+    }
+
+    CF_ASSERT(taskEnqueueBatch(queue, fns, datas, 0) == 0, "Empty batch enqueued");
+
+    // NOTE (Matteo): The batch does not fit the buffer, so it is enqueued in pieces
+    for (Size queued = 0; queued < count;)
+    {
+        Size n = taskEnqueueBatchPriority(queue, fns + queued, datas + queued, count - queued,
+                                          TaskPriority_Normal, ids + queued);
+        CF_ASSERT(n <= TASK_BUFFER_SIZE, "Batch exceeds the buffer");
+
+        for (Size i = queued; i < queued + n; ++i)
+        {
+            CF_ASSERT(ids[i], "Invalid task ID");
+            CF_ASSERT(i == queued || ids[i] != ids[i - 1], "Duplicate task ID");
+        }
+
+        queued += n;
+        if (!n) cfYield();
+    }
+
+    for (Size i = 0; i < count; ++i)
+    {
+        while (!taskCompleted(queue, ids[i])) cfYield();
+        CF_ASSERT(atomRead(counters + i) == 1, "Task not executed exactly once");
+    }
+}
+
+/// Measure the submission throughput of trivial tasks, enqueued one by one or in batches of the
+/// given size; returns the average time per task in ns
+static double
+batchRun(TaskQueue *queue, Size batch, bool batched)
+{
+    AtomSize counter;
+    atomInit(&counter, 0);
+
+    for (Size i = 0; i < batch; ++i) g_batch_datas[i] = &counter;
+
+    Clock clock;
+    clockStart(&clock);
+
+    for (Size queued = 0; queued < BATCH_TASKS;)
+    {
+        Size n = cfMin(batch, BATCH_TASKS - queued);
+
+        if (batched)
+        {
+            n = taskEnqueueBatch(queue, g_batch_fns, g_batch_datas, n);
+        }
+        else
+        {
+            for (Size i = 0; i < n; ++i)
+            {
+                if (!taskEnqueue(queue, countTask, &counter))
+                {
+                    n = i;
+                    break;
+                }
+            }
+        }
+
+        queued += n;
+        if (!n) cfYield();
+    }
+
+    while (atomRead(&counter) < BATCH_TASKS) cfYield();
+
+    return 1e9 * timeGetSeconds(clockElapsed(&clock)) / BATCH_TASKS;
+}
+
+//=== Overflow ===//
+
+typedef struct OrderData
+{
+    AtomSize count;
+    Size order[OVERFLOW_ORDER];
+} OrderData;
+
+typedef struct OrderTask
+{
+    OrderData *data;
+    Size index;
+} OrderTask;
+
+static TASK_QUEUE_FN(orderTask)
+{
+    CF_UNUSED(canceled);
+
+    OrderTask *task = data;
+    task->data->order[atomFetchInc(&task->data->count)] = task->index;
+}
+
+static TaskQueue *
+overflowCreate(MemAllocator heap, TaskOverflow overflow, Size num_workers, Size *footprint)
+{
+    TaskQueueConfig config = {
+        .buffer_size = OVERFLOW_BUFFER_SIZE,
+        .num_workers = num_workers,
+        .overflow = overflow,
+        .spill_alloc = heap,
+    };
+
+    return taskTestCreateEx(heap, &config, footprint);
+}
+
+/// Spilled tasks follow the buffered ones in FIFO order, and can be boosted like them
+static void
+overflowSpillCheck(MemAllocator heap)
+{
+    static OrderData data;
+    static OrderTask tasks[OVERFLOW_ORDER];
+    static TaskFn fns[OVERFLOW_ORDER];
+    static void *datas[OVERFLOW_ORDER];
+    static TaskId ids[OVERFLOW_ORDER];
+
+    Size const boosted = OVERFLOW_ORDER / 2;
+    Size footprint;
+    TaskQueue *queue = overflowCreate(heap, TaskOverflow_Spill, 1, &footprint);
+
+    atomInit(&data.count, 0);
+
+    for (Size i = 0; i < OVERFLOW_ORDER; ++i)
+    {
+        tasks[i] = (OrderTask){.data = &data, .index = i};
+        fns[i] = orderTask;
+        datas[i] = tasks + i;
+    }
+
+    // NOTE (Matteo): The queue is not processing, so most tasks are spilled, part of them in batch
+    for (Size i = 0; i < OVERFLOW_ORDER / 4; ++i)
+    {
+        ids[i] = taskEnqueue(queue, orderTask, tasks + i);
+        CF_ASSERT(ids[i], "Enqueue failed");
+    }
+
+    Size batch = OVERFLOW_ORDER - OVERFLOW_ORDER / 4;
+    CF_ASSERT(taskEnqueueBatchPriority(queue, fns + OVERFLOW_ORDER / 4, datas + OVERFLOW_ORDER / 4,
+                                       batch, TaskPriority_Normal,
+                                       ids + OVERFLOW_ORDER / 4) == batch,
+              "Batch enqueue failed");
+
+    for (Size i = 0; i < OVERFLOW_ORDER; ++i)
+    {
+        CF_ASSERT(!taskCompleted(queue, ids[i]), "Queued task reported as completed");
+    }
+
+    ids[boosted] = taskSetPriority(queue, ids[boosted], TaskPriority_High);
+    CF_ASSERT(ids[boosted], "Spilled task not boosted");
+
+    taskStartProcessing(queue);
+
+    for (Size i = 0; i < OVERFLOW_ORDER; ++i)
+    {
+        while (!taskCompleted(queue, ids[i])) cfYield();
+    }
+
+    CF_ASSERT(atomRead(&data.count) == OVERFLOW_ORDER, "Tasks lost or duplicated");
+    atomAcquireFence();
+
+    CF_ASSERT(data.order[0] == boosted, "Boosted task not executed first");
+
+    for (Size i = 1, expected = 0; i < OVERFLOW_ORDER; ++i, ++expected)
+    {
+        if (expected == boosted) ++expected;
+        CF_ASSERT(data.order[i] == expected, "Spilled tasks executed out of order");
+    }
+
+    taskTestDestroy(heap, queue, footprint);
+}
+
+static void
+overflowInlineCheck(MemAllocator heap)
+{
+    static TaskFn fns[2 * OVERFLOW_BUFFER_SIZE];
+
+    AtomSize counter;
+    atomInit(&counter, 0);
+
+    Size footprint;
+    TaskQueue *queue = overflowCreate(heap, TaskOverflow_Inline, 2, &footprint);
+
+    for (Size i = 0; i < OVERFLOW_BUFFER_SIZE; ++i)
+    {
+        CF_ASSERT(taskEnqueue(queue, countTask, &counter), "Enqueue failed");
+    }
+
+    CF_ASSERT(atomRead(&counter) == 0, "Buffered task executed");
+
+    TaskId id = taskEnqueue(queue, countTask, &counter);
+    CF_ASSERT(id, "Enqueue failed");
+    CF_ASSERT(atomRead(&counter) == 1, "Overflowing task not executed inline");
+    CF_ASSERT(taskCompleted(queue, id), "Inline task not reported as completed");
+    CF_ASSERT(!taskCancel(queue, id), "Inline task canceled");
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(fns); ++i) fns[i] = countTask;
+
+    void *datas[CF_ARRAY_SIZE(fns)];
+    for (Size i = 0; i < CF_ARRAY_SIZE(fns); ++i) datas[i] = &counter;
+
+    CF_ASSERT(taskEnqueueBatch(queue, fns, datas, CF_ARRAY_SIZE(fns)) == CF_ARRAY_SIZE(fns),
+              "Batch enqueue failed");
+    CF_ASSERT(atomRead(&counter) == 1 + CF_ARRAY_SIZE(fns), "Batch not executed inline");
+
+    taskStartProcessing(queue);
+    while (atomRead(&counter) < 1 + OVERFLOW_BUFFER_SIZE + CF_ARRAY_SIZE(fns)) cfYield();
+
+    taskTestDestroy(heap, queue, footprint);
+}
+
+static void
+overflowBlockCheck(MemAllocator heap)
+{
+    AtomSize counter;
+    atomInit(&counter, 0);
+
+    Size footprint;
+    TaskQueue *queue = overflowCreate(heap, TaskOverflow_Block, 2, &footprint);
+
+    for (Size i = 0; i < OVERFLOW_BUFFER_SIZE; ++i)
+    {
+        CF_ASSERT(taskEnqueue(queue, countTask, &counter), "Enqueue failed");
+    }
+
+    // NOTE (Matteo): Nobody can make room if the queue is not processing
+    CF_ASSERT(!taskEnqueue(queue, countTask, &counter), "Blocking enqueue succeeded while stopped");
+
+    taskStartProcessing(queue);
+
+    for (Size i = 0; i < OVERFLOW_COUNT; ++i)
+    {
+        CF_ASSERT(taskEnqueue(queue, countTask, &counter), "Blocking enqueue failed");
+    }
+
+    while (atomRead(&counter) < OVERFLOW_BUFFER_SIZE + OVERFLOW_COUNT) cfYield();
+
+    taskTestDestroy(heap, queue, footprint);
+}
+
+/// Stress the overflow mode with tasks enqueued by both the main thread and the workers
+static double
+overflowRun(MemAllocator heap, TaskOverflow overflow, U64 fib_expected)
+{
+    AtomSize counter;
+    atomInit(&counter, 0);
+
+    Size footprint;
+    TaskQueue *queue = overflowCreate(heap, overflow, 4, &footprint);
+    taskStartProcessing(queue);
+
+    for (Size i = 0; i < OVERFLOW_COUNT; ++i)
+    {
+        CF_ASSERT(taskEnqueue(queue, countTask, &counter), "Enqueue failed");
+    }
+
+    double elapsed = fibRun(queue, fib_expected);
+
+    while (atomRead(&counter) < OVERFLOW_COUNT) cfYield();
+
+    taskTestDestroy(heap, queue, footprint);
+
+    return elapsed;
+}
+
+//=== Test ===//
+
+bool
+testTask(Platform *platform)
+{
+    MemAllocator heap = platform->heap;
+    Size footprint = 0;
+    TaskQueue *queue = NULL;
+
+    U64 const fib_expected = fibSerial(FIB_N);
+    U32 *items = memAllocArray(heap, U32, SORT_COUNT);
+    CF_ASSERT_NOT_NULL(items);
+
+    ForData for_data = {
+        .pixels = memAllocArray(heap, U32, FOR_PIXELS),
+        .sums = memAllocArray(heap, U64, 8 * (TASK_MAX_WORKERS + 1)),
+        .scale = 1.0f / FOR_POINTS,
+    };
+    CF_ASSERT(for_data.pixels && for_data.sums, "Allocation failed");
+
+    // Correctness, including the fallback to the shared buffer when the deques are full
+    Size const deque_sizes[] = {0, 4, TASK_DEQUE_SIZE};
+
+    for (Size i = 0; i < CF_ARRAY_SIZE(deque_sizes); ++i)
+    {
+        queue = taskTestCreate(heap, 4, deque_sizes[i], &footprint);
+        spawnRun(queue);
+        graphDiamond(queue);
+        pipeRunGraph(queue);
+        forCheck(queue, &for_data);
+        prioCheck(queue);
+        batchCheck(queue);
+        fibRun(queue, fib_expected);
+        sortRun(queue, items, SORT_COUNT);
+        taskTestDestroy(heap, queue, footprint);
+    }
+
+    overflowSpillCheck(heap);
+    overflowInlineCheck(heap);
+    overflowBlockCheck(heap);
+
+    // Overflow of a small buffer, compared with a buffer sized for the worst case
+    {
+        double spill = overflowRun(heap, TaskOverflow_Spill, fib_expected);
+        double inline_time = overflowRun(heap, TaskOverflow_Inline, fib_expected);
+        double block = overflowRun(heap, TaskOverflow_Block, fib_expected);
+
+        queue = taskTestCreate(heap, 4, 0, &footprint);
+        double large = fibRun(queue, fib_expected);
+        taskTestDestroy(heap, queue, footprint);
+
+        printf("fib with a %d slot buffer: spill %.2f ms, inline %.2f ms, block %.2f ms; "
+               "%d slot buffer %.2f ms\n",
+               OVERFLOW_BUFFER_SIZE, 1000 * spill, 1000 * inline_time, 1000 * block,
+               TASK_BUFFER_SIZE, 1000 * large);
+    }
+
+    // Scaling benchmark, compared with the shared buffer only
+    printf("workers   fib ring (ms)  fib steal (ms)  sort ring (ms) sort steal (ms)\n");
+
+    for (Size num_workers = 1; num_workers <= TASK_MAX_WORKERS; num_workers *= 2)
+    {
+        double times[4];
+
+        for (Size i = 0; i < 2; ++i)
+        {
+            queue = taskTestCreate(heap, num_workers, i ? TASK_DEQUE_SIZE : 0, &footprint);
+            times[i] = fibRun(queue, fib_expected);
+            times[2 + i] = sortRun(queue, items, SORT_COUNT);
+            taskTestDestroy(heap, queue, footprint);
+        }
+
+        printf("%7zu %15.2f %15.2f %15.2f %15.2f\n", num_workers, 1000 * times[0],
+               1000 * times[1], 1000 * times[2], 1000 * times[3]);
+    }
+
+    // Parallel for scaling, compared with a serial loop
+    printf("workers  swizzle serial (ms)  swizzle (ms)  escape serial (ms)   escape (ms)\n");
+
+    for (Size num_workers = 1; num_workers <= TASK_MAX_WORKERS; num_workers *= 2)
+    {
+        double swizzle_serial, escape_serial;
+
+        queue = taskTestCreate(heap, num_workers, TASK_DEQUE_SIZE, &footprint);
+        double swizzle = forRun(queue, &for_data, forSwizzle, FOR_PIXELS, 0, &swizzle_serial);
+        double escape = forRun(queue, &for_data, forEscape, FOR_POINTS, 0, &escape_serial);
+        taskTestDestroy(heap, queue, footprint);
+
+        printf("%7zu %20.2f %13.2f %19.2f %13.2f\n", num_workers, 1000 * swizzle_serial,
+               1000 * swizzle, 1000 * escape_serial, 1000 * escape);
+    }
+
+    // Time to display of the focused image while browsing, compared with a single FIFO
+    queue = taskTestCreate(heap, 1, 0, &footprint);
+    {
+        double fifo_max, prio_max;
+        double fifo = browseRun(queue, false, &fifo_max);
+        double prio = browseRun(queue, true, &prio_max);
+
+        printf("Time to display (avg/max): FIFO %.2f/%.2f ms, priorities %.2f/%.2f ms\n", fifo,
+               fifo_max, prio, prio_max);
+    }
+    taskTestDestroy(heap, queue, footprint);
+
+    // Submission throughput, compared with enqueuing one task at a time
+    for (Size i = 0; i < BATCH_MAX; ++i) g_batch_fns[i] = countTask;
+
+    queue = taskTestCreate(heap, 4, 0, &footprint);
+    printf("batch   single (ns/task)  batched (ns/task)\n");
+
+    for (Size batch = 1; batch <= BATCH_MAX; batch *= 4)
+    {
+        double single = batchRun(queue, batch, false);
+        double batched = batchRun(queue, batch, true);
+        printf("%5zu %18.2f %18.2f\n", batch, single, batched);
+    }
+
+    taskTestDestroy(heap, queue, footprint);
+
+    // Enqueue-to-start latency
+    queue = taskTestCreate(heap, 4, TASK_DEQUE_SIZE, &footprint);
+    printf("latency (us)      p50        p90        p99        max\n");
+    wakeRun(queue, 1, "single");
+    wakeRun(queue, WAKE_BURST, "burst");
+    taskTestDestroy(heap, queue, footprint);
+
+    // Pipeline latency, compared with polling once per frame
+    queue = taskTestCreate(heap, 4, TASK_DEQUE_SIZE, &footprint);
+
+    double polling_time = pipeRunPolling(queue);
+    double graph_time = pipeRunGraph(queue);
+
+    printf("%d pipelines of %d stages: polling %.2f ms, graph %.2f ms\n", PIPE_COUNT, PIPE_STAGES,
+           1000 * polling_time, 1000 * graph_time);
+
+    taskTestDestroy(heap, queue, footprint);
+
+    memFreeArray(heap, for_data.sums, 8 * (TASK_MAX_WORKERS + 1));
+    memFreeArray(heap, for_data.pixels, FOR_PIXELS);
+    memFreeArray(heap, items, SORT_COUNT);
+
+    return true;
+}
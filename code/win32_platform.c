@@ -10,6 +10,7 @@
 #include "foundation/paths.h"
 #include "foundation/strings.h"
 
+#include "foundation/atom.inl"
 #include "foundation/math.inl"
 #include "foundation/win32.inl"
 
@@ -33,6 +34,10 @@ static VMEM_RELEASE_FN(win32VmRelease);
 static VMEM_MIRROR_ALLOCATE_FN(win32MirrorAllocate);
 static VMEM_MIRROR_FREE_FN(win32MirrorFree);
 
+static VMEM_FILE_MAP_FN(win32FileMap);
+static VMEM_FILE_UNMAP_FN(win32FileUnmap);
+static VMEM_FILE_FLUSH_FN(win32FileFlush);
+
 //---- Heap allocation ----//
 
 static MEM_ALLOCATOR_FN(win32Alloc);
@@ -65,6 +70,9 @@ static Platform g_platform = {
             .decommit = win32VmDecommit,
             .mirrorAllocate = win32MirrorAllocate,
             .mirrorFree = win32MirrorFree,
+            .fileMap = win32FileMap,
+            .fileUnmap = win32FileUnmap,
+            .fileFlush = win32FileFlush,
         },
     .file =
         &(IoFileApi){
@@ -177,6 +185,10 @@ win32PlatformShutdown(void)
 
 VMEM_RESERVE_FN(win32VmReserve)
 {
+    // NOTE (Matteo): Huge pages are ignored, since MEM_LARGE_PAGES requires the
+    // SeLockMemoryPrivilege and must commit the pages together with the reservation
+    CF_UNUSED(flags);
+
     void *mem = VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
 
     if (mem)
@@ -189,6 +201,9 @@ VMEM_RESERVE_FN(win32VmReserve)
 
 VMEM_COMMIT_FN(win32VmCommit)
 {
+    // NOTE (Matteo): Prefaulting is ignored, pages are faulted in on first access
+    CF_UNUSED(flags);
+
     void *committed = VirtualAlloc(memory, size, MEM_COMMIT, PAGE_READWRITE);
 
     if (committed)
@@ -349,6 +364,137 @@ VMEM_MIRROR_FREE_FN(win32MirrorFree)
     buffer->os_handle = 0;
 }
 
+VMEM_FILE_MAP_FN(win32FileMap)
+{
+    VMemFileMap map = {0};
+
+    Char16 buffer[1024] = {0};
+    win32Utf8To16(path, buffer, CF_ARRAY_SIZE(buffer));
+
+    HANDLE file = CreateFileW(buffer, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                              OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        win32HandleLastError();
+        return map;
+    }
+
+    LARGE_INTEGER file_size = {0};
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        win32HandleLastError();
+        CloseHandle(file);
+        return map;
+    }
+
+    Size view_size = cfMax(size, (Size)file_size.QuadPart);
+
+    // NOTE (Matteo): Creating a mapping larger than the file grows the file to the mapping size;
+    // unlike Linux the file is not sparse, so disk space is allocated for the whole view
+    HANDLE mapping = NULL;
+    if (view_size)
+    {
+        mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE, (DWORD)((U64)view_size >> 32),
+                                     (DWORD)view_size, NULL);
+    }
+
+    if (mapping)
+    {
+        void *data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, view_size);
+        if (data)
+        {
+            map.data = data;
+            map.size = view_size;
+            map.file_size = (Size)file_size.QuadPart;
+            map.os_handle = file;
+        }
+        else
+        {
+            win32HandleLastError();
+        }
+
+        // NOTE (Matteo): The view keeps the mapping object alive
+        CloseHandle(mapping);
+    }
+    else
+    {
+        win32HandleLastError();
+    }
+
+    // NOTE (Matteo): The file handle is retained for flushing file metadata
+    if (!map.data) CloseHandle(file);
+
+    return map;
+}
+
+VMEM_FILE_UNMAP_FN(win32FileUnmap)
+{
+    if (map->data && !UnmapViewOfFile(map->data)) win32HandleLastError();
+    if (map->os_handle) CloseHandle(map->os_handle);
+
+    *map = (VMemFileMap){0};
+}
+
+VMEM_FILE_FLUSH_FN(win32FileFlush)
+{
+    CF_ASSERT((U8 *)memory >= (U8 *)map->data &&
+                  (U8 *)memory + size <= (U8 *)map->data + map->size,
+              "Range out of the file view");
+
+    // NOTE (Matteo): FlushViewOfFile only starts writing the dirty pages, FlushFileBuffers waits
+    // for the data and the metadata to hit the disk
+    if (!FlushViewOfFile(memory, size) || !FlushFileBuffers(map->os_handle))
+    {
+        win32HandleLastError();
+        return false;
+    }
+
+    return true;
+}
+
+// NOTE (Matteo): Blocks aligned beyond MEMORY_ALLOCATION_ALIGNMENT are over-allocated, and the
+// address of the underlying block is stored right before the aligned one. Since HeapReAlloc does
+// not preserve the alignment, the content is moved whenever the reallocated block ends up at a
+// different offset.
+static void *
+win32AllocAligned(HANDLE heap, void *memory, Size old_size, Size new_size, Size align)
+{
+    U8 *old_base = NULL;
+    Size old_offset = 0;
+
+    if (memory)
+    {
+        old_base = ((U8 **)memory)[-1];
+        old_offset = (Size)((U8 *)memory - old_base);
+    }
+
+    if (!new_size)
+    {
+        if (old_base) HeapFree(heap, 0, old_base);
+        return NULL;
+    }
+
+    // NOTE (Matteo): The heap alignment is at least the size of a pointer, so 'align' extra bytes
+    // leave room for the base address too
+    U8 *new_base = old_base ? HeapReAlloc(heap, 0, old_base, new_size + align)
+                            : HeapAlloc(heap, 0, new_size + align);
+    if (!new_base) return NULL;
+
+    U8 *new_mem = (U8 *)memAlignForward(new_base + sizeof(new_base), align);
+
+    if (memory && new_base + old_offset != new_mem)
+    {
+        memCopy(new_base + old_offset, new_mem, cfMin(old_size, new_size));
+    }
+
+    if (new_size > old_size) memClear(new_mem + old_size, new_size - old_size);
+
+    ((U8 **)new_mem)[-1] = new_base;
+
+    return new_mem;
+}
+
+// NOTE (Matteo): The heap can be used by multiple threads, so the statistics are updated atomically
 MEM_ALLOCATOR_FN(win32Alloc)
 {
     CF_UNUSED(state);
@@ -358,9 +504,12 @@ MEM_ALLOCATOR_FN(win32Alloc)
     void *new_mem = NULL;
 
     CF_ASSERT(cfIsPowerOf2(align), "Alignment is not a power of 2");
-    CF_ASSERT(align <= MEMORY_ALLOCATION_ALIGNMENT, "Unsupported alignment");
 
-    if (new_size)
+    if (align > MEMORY_ALLOCATION_ALIGNMENT)
+    {
+        new_mem = win32AllocAligned(heap, old_mem, old_size, new_size, align);
+    }
+    else if (new_size)
     {
         if (old_mem)
         {
@@ -376,17 +525,18 @@ MEM_ALLOCATOR_FN(win32Alloc)
         HeapFree(heap, 0, old_mem);
     }
 
-    if (old_mem)
+    // NOTE (Matteo): A failed reallocation leaves the old block untouched
+    if (old_mem && (new_mem || !new_size))
     {
         CF_ASSERT(old_size > 0, "Freeing valid pointer but given size is 0");
-        g_platform.heap_blocks--;
-        g_platform.heap_size -= old_size;
+        atomFetchDec((AtomSize *)&g_platform.heap_blocks);
+        atomFetchSub((AtomSize *)&g_platform.heap_size, old_size);
     }
 
     if (new_mem)
     {
-        g_platform.heap_blocks++;
-        g_platform.heap_size += new_size;
+        atomFetchInc((AtomSize *)&g_platform.heap_blocks);
+        atomFetchAdd((AtomSize *)&g_platform.heap_size, new_size);
     }
 
     return new_mem;